@@ -27,6 +27,16 @@ Dependencies:
 #define BS_BACKUPS_OPT       "--bsbc"        /* Bootsector backups count */
 #define B_BS_OPT             "--b-bsbc"      /* [DEBUG] Wrong bootsectos */
 #define JOURNALS_BACKUPS_OPT "--jc"
+#define ECC_OPT              "--ecc"         /* Metadata ECC codec: hamming or secded */
+#define CHECKSUM_OPT         "--checksum"    /* Checksum algorithm: murmur3 or crc32c */
+#define FAT_CHECKSUM_OPT     "--fat-checksum" /* Store a checksum per FAT sector */
+#define FREE_MAP_OPT         "--free-map"     /* Reserve an area for the free cluster map */
+
+#define ECC_HAMMING_15_11 0
+#define ECC_SECDED_39_32  1
+
+#define CHECKSUM_MURMUR3 0
+#define CHECKSUM_CRC32C  1
 
 typedef struct {
     char* save_path;
@@ -38,6 +48,10 @@ typedef struct {
     int   b_bsbc; // [DEBUG] Wrong boot sectors
     int   jc;     // journals count
     int   ec;     // errors count (error storage)
+    int   ecc;    // metadata ECC codec
+    int   crc;    // checksum algorithm
+    int   fat_sum; // FAT sector checksums
+    int   free_map; // free cluster map area
 } opt_t;
 
 int process_input(int argc, char* argv[], opt_t* opt);
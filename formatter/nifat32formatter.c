@@ -3,6 +3,7 @@
 static int      _write_bs(int, uint32_t, uint32_t);
 static int      _write_journals(int, uint32_t);
 static int      _write_errors(int, uint32_t);
+static int      _write_free_map(int, uint32_t, uint32_t);
 static int      _write_fats(int, fat_table_t, uint32_t, uint32_t);
 static int      _initialize_fat(fat_table_t, uint32_t, uint32_t);
 static int      _write_root_directory(int, uint32_t, uint32_t);
@@ -11,6 +12,7 @@ static int      _copy_files_to_fs(int, const char*, fat_table_t, uint32_t, uint3
 static int      _copy_file(int, FILE*, fat_table_t, uint32_t*, size_t*, uint32_t, uint32_t, int*);
 static void     _to_83_name(const char*, char*);
 static uint32_t _calculate_fat_size(uint32_t);
+static uint32_t _free_map_sectors(uint32_t);
 
 static opt_t opt = { 
     .spc    = SECTORS_PER_CLUSTER,
@@ -19,7 +21,11 @@ static opt_t opt = {
     .bsbc   = BS_BACKUPS,
     .b_bsbc = B_BS,
     .jc     = JOURNALS_BACKUPS,
-    .ec     = ERRORS_COUNT
+    .ec     = ERRORS_COUNT,
+    .ecc    = ECC_HAMMING_15_11,
+    .crc    = CHECKSUM_MURMUR3,
+    .fat_sum = 0,
+    .free_map = 0
 };
 
 int main(int argc, char* argv[]) {
@@ -58,6 +64,9 @@ int main(int argc, char* argv[]) {
         return EXIT_FAILURE;
     }
 
+    /* The FAT is set before the boot sector, because the free map area can be dropped here. */
+    memset(fat_table, FAT_ENTRY_FREE, total_clusters * sizeof(uint32_t));
+    _initialize_fat(fat_table, total_sectors, total_clusters);
     if (!_write_bs(fd, total_sectors, fat_size)) {
         fprintf(stderr, "Error writing boot sector\n");
         close(fd);
@@ -76,8 +85,12 @@ int main(int argc, char* argv[]) {
         return EXIT_FAILURE;
     }
 
-    memset(fat_table, FAT_ENTRY_FREE, total_clusters * sizeof(uint32_t));
-    _initialize_fat(fat_table, total_sectors, total_clusters);
+    if (!_write_free_map(fd, total_sectors, total_clusters)) {
+        fprintf(stderr, "Error writing free map area\n");
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
     if (!_write_root_directory(fd, data_start, fat_size)) {
         fprintf(stderr, "Error initializing root directory\n");
         free(fat_table);
@@ -161,6 +174,50 @@ static uint32_t _calculate_fat_size(uint32_t total_sectors) {
         return (void*)dst;
     }
 
+    static const unsigned long long _secded_parity_masks[6] = {
+        0x2AAAAAAAAAULL, 0x4CCCCCCCCCULL, 0x70F0F0F0F0ULL, 0x00FF00FF00ULL, 0x00FFFF0000ULL, 0x7F00000000ULL
+    };
+
+    static inline unsigned int _parity64(unsigned long long x) {
+        x ^= x >> 32;
+        x ^= x >> 16;
+        x ^= x >> 8;
+        x ^= x >> 4;
+        return (0x6996 >> (x & 0x0F)) & 1;
+    }
+
+    static unsigned long long _encode_secded_39_32(unsigned int d) {
+        unsigned long long c = ((unsigned long long)(d & 0x00000001) << 3) | ((unsigned long long)(d & 0x0000000E) << 4) |
+                               ((unsigned long long)(d & 0x000007F0) << 5) | ((unsigned long long)(d & 0x03FFF800) << 6) |
+                               ((unsigned long long)(d & 0xFC000000) << 7);
+        for (int j = 0; j < 6; j++) c |= (unsigned long long)_parity64(c & _secded_parity_masks[j]) << (1 << j);
+        return c | _parity64(c);
+    }
+
+    static void* _nft32_secded_pack(unsigned char* src, unsigned char* dst, int len) {
+        unsigned char* block = dst;
+        for (int i = 0; i < len; i += SECDED_DATA_BLOCK, block += SECDED_ENCODED_BLOCK) {
+            unsigned int d = 0;
+            for (int b = 0; b < SECDED_DATA_BLOCK && i + b < len; b++) d |= (unsigned int)src[i + b] << (b * 8);
+
+            unsigned long long c = _encode_secded_39_32(d);
+            for (int b = 0; b < SECDED_ENCODED_BLOCK; b++) block[b] = (unsigned char)(c >> (b * 8));
+        }
+
+        return (void*)dst;
+    }
+
+    /* Metadata (FAT, directories) codec selected by --ecc. Boot sector is always Hamming 15,11. */
+    static int _ecc_encoded_size(int len) {
+        if (opt.ecc == ECC_SECDED_39_32) return ((len + SECDED_DATA_BLOCK - 1) / SECDED_DATA_BLOCK) * SECDED_ENCODED_BLOCK;
+        return len * sizeof(encoded_t);
+    }
+
+    static void* _ecc_pack(unsigned char* src, unsigned char* dst, int len) {
+        if (opt.ecc == ECC_SECDED_39_32) return _nft32_secded_pack(src, dst, len);
+        return _nft32_pack_memory(src, (unsigned short*)dst, len);
+    }
+
     
     static inline unsigned int _rotl32(unsigned int x, char r) {
         return (x << r) | (x >> (32 - r));
@@ -212,6 +269,22 @@ static uint32_t _calculate_fat_size(uint32_t total_sectors) {
         return h1;
     }
 
+    static unsigned int _crc32c(const unsigned char* key, unsigned int len) {
+        unsigned int crc = 0xFFFFFFFF;
+        while (len--) {
+            crc ^= *key++;
+            for (int i = 0; i < 8; i++) crc = (crc >> 1) ^ (0x82F63B78 & -(crc & 1));
+        }
+
+        return ~crc;
+    }
+
+    /* Checksum fields use the algorithm selected by --checksum. Name hashes are always murmur3. */
+    static unsigned int _checksum(const unsigned char* key, unsigned int len) {
+        if (opt.crc == CHECKSUM_CRC32C) return _crc32c(key, len);
+        return _nft32_murmur3_x86_32(key, len, 0);
+    }
+
 #pragma endregion
 
 static int _write_bs(int fd, uint32_t total_sectors, uint32_t fat_size) {
@@ -239,14 +312,15 @@ static int _write_bs(int fd, uint32_t total_sectors, uint32_t fat_size) {
     ext.drive_number     = 0x80;
     ext.boot_signature   = 0x29;
     ext.volume_id        = 0x12345678;
+    ext.extended_flags   = opt.ecc | (opt.crc << 4) | (opt.fat_sum << 8) | (opt.free_map << 9);
     memcpy(ext.volume_label, "ROOT_LABEL ", 11);
     memcpy(ext.fat_type_label, "NIFAT32 ", 8);
     ext.checksum = 0;
-    ext.checksum = _nft32_murmur3_x86_32((uint8_t*)&ext, sizeof(ext), 0);
+    ext.checksum = _checksum((uint8_t*)&ext, sizeof(ext));
 
     memcpy(&bs.extended_section, &ext, sizeof(ext));
     bs.checksum = 0;
-    bs.checksum = _nft32_murmur3_x86_32((uint8_t*)&bs, sizeof(bs), 0);
+    bs.checksum = _checksum((uint8_t*)&bs, sizeof(bs));
     fprintf(stdout, "Bootstruct checksum: %u, ext. section: %u\n", bs.checksum, ext.checksum);
 
     int encoded_size = sizeof(encoded_t) * sizeof(nifat32_bootsector_t);
@@ -290,6 +364,65 @@ static int _write_errors(int fd, uint32_t ts) {
     return 1;
 }
 
+/* Sector count for the free cluster map. One sector for the header, then the encoded bitmap. */
+static uint32_t _free_map_sectors(uint32_t tc) {
+    return 1 + (_ecc_encoded_size(((tc + 31) / 32) * sizeof(uint32_t)) + BYTES_PER_SECTOR - 1) / BYTES_PER_SECTOR;
+}
+
+/* 
+The free map area is wiped, thus the driver builds the map from the FAT on the first mount
+and stores it on unmount.
+*/
+static int _write_free_map(int fd, uint32_t ts, uint32_t tc) {
+    if (!opt.free_map) return 1;
+    uint32_t sc = _free_map_sectors(tc);
+    uint32_t sector = GET_FREEMAPSECTOR(ts, sc);
+    uint8_t buffer[BYTES_PER_SECTOR] = { 0 };
+    for (uint32_t i = 0; i < sc; i++) {
+        if (pwrite(fd, buffer, sizeof(buffer), (off_t)(sector + i) * BYTES_PER_SECTOR) != sizeof(buffer)) return 0;
+    }
+
+    fprintf(stdout, "viped area for free map has been written at sa=%u -> %u!\n", sector, sector + sc);
+    return 1;
+}
+
+static int _sectors_overlap(uint32_t a, uint32_t a_count, uint32_t b, uint32_t b_count) {
+    return a < b + b_count && b < a + a_count;
+}
+
+/*
+Reserve data clusters under the free map area. The area should not cross other metadata,
+otherwise the volume is formatted without the free map.
+*/
+static int _reserve_free_map(uint32_t* fat_table, uint32_t ts, uint32_t tc) {
+    uint32_t fat_size = _calculate_fat_size(ts);
+    uint32_t sc = _free_map_sectors(tc);
+    uint32_t sa = GET_FREEMAPSECTOR(ts, sc);
+    uint32_t fat_sectors = (_ecc_encoded_size(fat_size * BYTES_PER_SECTOR) + BYTES_PER_SECTOR - 1) / BYTES_PER_SECTOR;
+    if (opt.fat_sum) fat_sectors += (_ecc_encoded_size(fat_size * sizeof(uint32_t)) + BYTES_PER_SECTOR - 1) / BYTES_PER_SECTOR;
+
+    int overlap = 0;
+    for (int i = 0; i < opt.bsbc; i++) overlap |= _sectors_overlap(sa, sc, GET_BOOTSECTOR(i, ts), 1);
+    for (int i = 0; i < opt.fc; i++)   overlap |= _sectors_overlap(sa, sc, RESERVED_SECTORS + GET_FATSECTOR(i, ts), fat_sectors);
+    for (int i = 0; i < opt.jc; i++)   overlap |= _sectors_overlap(sa, sc, GET_JOURNALSECTOR(i, ts), opt.spc);
+    for (int i = 0; i < opt.ec; i++)   overlap |= _sectors_overlap(sa, sc, GET_ERRORSSECTOR(i, ts), opt.spc);
+
+    uint32_t data_sector = RESERVED_SECTORS + opt.fc * fat_size;
+    uint32_t first = sa < data_sector ? ROOT_DIR_CLUSTER : (sa - data_sector) / opt.spc + ROOT_DIR_CLUSTER;
+    uint32_t last  = sa + sc <= data_sector ? first : (sa + sc - 1 - data_sector) / opt.spc + ROOT_DIR_CLUSTER + 1;
+    for (uint32_t c = first; c < last && c < tc; c++) overlap |= fat_table[c] != FAT_ENTRY_FREE;
+
+    if (overlap) {
+        fprintf(stderr, "Warning: free map area at sa=%u crosses other metadata. The volume has no free map!\n", sa);
+        opt.free_map = 0;
+        return 0;
+    }
+
+    for (uint32_t c = first; c < last && c < tc; c++) fat_table[c] = FAT_ENTRY_RESERVED | (0xF8 << 24);
+    printf("Reserved %u for free map\n", last - first);
+    return 1;
+}
+
 /* Generate first clusters, reserve clusters for bootstructs */
 static int _initialize_fat(uint32_t* fat_table, uint32_t ts, uint32_t tc) {
     fat_table[0] = FAT_ENTRY_RESERVED | (0xF8 << 24);
@@ -308,7 +441,8 @@ static int _initialize_fat(uint32_t* fat_table, uint32_t ts, uint32_t tc) {
 
     /* FATs */
     for (int i = 0; i < opt.fc; i++) {
-        long long total_reserved = tc * sizeof(uint32_t) * sizeof(encoded_t);
+        long long total_reserved = _ecc_encoded_size(tc * sizeof(uint32_t));
+        if (opt.fat_sum) total_reserved = _ecc_encoded_size(_calculate_fat_size(ts) * (BYTES_PER_SECTOR + sizeof(uint32_t)));
         uint32_t sa = RESERVED_SECTORS + GET_FATSECTOR(i, ts);
         cluster_for_backup = sa / opt.spc;
 
@@ -339,21 +473,52 @@ static int _initialize_fat(uint32_t* fat_table, uint32_t ts, uint32_t tc) {
         }
     }
 
+    /* Free map */
+    if (opt.free_map) _reserve_free_map(fat_table, ts, tc);
+    return 1;
+}
+
+/* 
+Checksums of FAT sectors go right after the encoded FAT, one encoded entry per sector.
+The checksum is taken from the entries without the high nibble, as the driver reads them.
+*/
+static int _pack_fat_sums(fat_table_t fat_table, uint32_t fat_size, uint32_t tc, unsigned char* dst) {
+    uint32_t entries = BYTES_PER_SECTOR / sizeof(uint32_t);
+    uint32_t* sums = (uint32_t*)calloc(fat_size, sizeof(uint32_t));
+    if (!sums) return 0;
+
+    for (uint32_t s = 0; s < fat_size && s * entries < tc; s++) {
+        uint32_t block[BYTES_PER_SECTOR / sizeof(uint32_t)];
+        uint32_t count = tc - s * entries < entries ? tc - s * entries : entries;
+        for (uint32_t e = 0; e < count; e++) block[e] = fat_table[s * entries + e] & 0x0FFFFFFF;
+        sums[s] = _checksum((unsigned char*)block, count * sizeof(uint32_t));
+    }
+
+    _ecc_pack((unsigned char*)sums, dst, fat_size * sizeof(uint32_t));
+    free(sums);
     return 1;
 }
 
 static int _write_fats(int fd, fat_table_t fat_table, uint32_t fat_size, uint32_t ts) {
-    uint32_t fat_bytes = fat_size * BYTES_PER_SECTOR * sizeof(encoded_t);
+    uint32_t table_bytes = _ecc_encoded_size(fat_size * BYTES_PER_SECTOR);
+    uint32_t fat_bytes = table_bytes + (opt.fat_sum ? _ecc_encoded_size(fat_size * sizeof(uint32_t)) : 0);
     unsigned char* encoded_fat = (unsigned char*)malloc(fat_bytes);
     if (!encoded_fat) return 0;
 
     memset(encoded_fat, 0, fat_bytes);
-    _nft32_pack_memory((unsigned char*)fat_table, (unsigned short*)encoded_fat, fat_size * BYTES_PER_SECTOR);
+    _ecc_pack((unsigned char*)fat_table, encoded_fat, fat_size * BYTES_PER_SECTOR);
+    if (opt.fat_sum) {
+        uint32_t tc = (ts - RESERVED_SECTORS - opt.fc * fat_size) / opt.spc;
+        if (!_pack_fat_sums(fat_table, fat_size, tc, encoded_fat + table_bytes)) {
+            free(encoded_fat);
+            return 0;
+        }
+    }
     
     for (int i = 0; i < opt.fc; i++) {
         uint32_t sa = RESERVED_SECTORS + GET_FATSECTOR(i, ts);
         if (pwrite(fd, encoded_fat, fat_bytes, sa * BYTES_PER_SECTOR) != fat_bytes) return 0;
-        printf("Encoded (Hamming) FAT written at sa=%u/%u\n", sa, ts);
+        printf("Encoded (%s) FAT written at sa=%u/%u\n", opt.ecc == ECC_SECDED_39_32 ? "SECDED" : "Hamming", sa, ts);
     }
 
     free(encoded_fat);
@@ -422,7 +587,7 @@ static int _copy_files_to_fs(
             root_dir[entry_count].attributes = 0x10;
             root_dir[entry_count].cluster    = start_cluster;
             root_dir[entry_count].file_size  = 0;
-            root_dir[entry_count].checksum   = _nft32_murmur3_x86_32((uint8_t*)&root_dir[entry_count], sizeof(root_dir[entry_count]), 0);
+            root_dir[entry_count].checksum   = _checksum((uint8_t*)&root_dir[entry_count], sizeof(root_dir[entry_count]));
             fprintf(stdout, "%s checksum: %u\n", entry->d_name, root_dir[entry_count].checksum);
             entry_count++;
         }
@@ -448,7 +613,7 @@ static int _copy_files_to_fs(
             root_dir[entry_count].cluster    = start_cluster;
             root_dir[entry_count].file_size  = file_size;
             root_dir[entry_count].checksum   = 0;
-            root_dir[entry_count].checksum   = _nft32_murmur3_x86_32((uint8_t*)&root_dir[entry_count], sizeof(root_dir[entry_count]), 0);
+            root_dir[entry_count].checksum   = _checksum((uint8_t*)&root_dir[entry_count], sizeof(root_dir[entry_count]));
             fprintf(stdout, "%s checksum: %u\n", entry->d_name, root_dir[entry_count].checksum);
             entry_count++;
         }
@@ -460,7 +625,7 @@ static int _copy_files_to_fs(
     root_dir[entry_count].cluster    = 0;
     root_dir[entry_count].file_size  = 0;
     root_dir[entry_count].checksum   = 0;
-    root_dir[entry_count].checksum   = _nft32_murmur3_x86_32((uint8_t*)&root_dir[entry_count], sizeof(root_dir[entry_count]), 0);
+    root_dir[entry_count].checksum   = _checksum((uint8_t*)&root_dir[entry_count], sizeof(root_dir[entry_count]));
     fprintf(stdout, "END checksum: %u\n", root_dir[entry_count].checksum);
     entry_count++;
 
@@ -471,8 +636,9 @@ static int _copy_files_to_fs(
         return 0;
     }
     
-    unsigned short encoded_root_dir[CLUSTER_SIZE] = { 0 };
-    _nft32_pack_memory((unsigned char*)root_dir, encoded_root_dir, CLUSTER_SIZE);
+    unsigned char encoded_root_dir[CLUSTER_SIZE] = { 0 };
+    int entries_per_cluster = CLUSTER_SIZE / _ecc_encoded_size(sizeof(directory_entry_t));
+    _ecc_pack((unsigned char*)root_dir, encoded_root_dir, entries_per_cluster * sizeof(directory_entry_t));
     if (write(fd, encoded_root_dir, CLUSTER_SIZE) != CLUSTER_SIZE) {
         free(root_dir);
         return 0;
@@ -497,7 +663,7 @@ static int _create_directory(
             entries[0].attributes = 0x10;
             entries[0].cluster    = i;
             entries[0].checksum   = 0;
-            entries[0].checksum   = _nft32_murmur3_x86_32((uint8_t*)&entries[0], sizeof(entries[0]), 0);
+            entries[0].checksum   = _checksum((uint8_t*)&entries[0], sizeof(entries[0]));
             fprintf(stdout, ". checksum: %u\n", entries[0].checksum);
 
             _to_83_name("..", (char*)entries[1].file_name);
@@ -505,7 +671,7 @@ static int _create_directory(
             entries[1].attributes = 0x10;
             entries[1].cluster    = 0;
             entries[1].checksum   = 0;
-            entries[1].checksum   = _nft32_murmur3_x86_32((uint8_t*)&entries[1], sizeof(entries[1]), 0);
+            entries[1].checksum   = _checksum((uint8_t*)&entries[1], sizeof(entries[1]));
             fprintf(stdout, ".. checksum: %u\n", entries[1].checksum);
 
             entries[2].file_name[0] = ENTRY_END;
@@ -513,21 +679,18 @@ static int _create_directory(
             entries[2].attributes = 0x10;
             entries[2].cluster    = 0;
             entries[2].checksum   = 0;
-            entries[2].checksum   = _nft32_murmur3_x86_32((uint8_t*)&entries[2], sizeof(entries[2]), 0);
+            entries[2].checksum   = _checksum((uint8_t*)&entries[2], sizeof(entries[2]));
             fprintf(stdout, "END checksum: %u\n", entries[1].checksum);
 
-            encoded_t* root_dirs = (encoded_t*)malloc(sizeof(entries) * sizeof(encoded_t));
+            int encoded_size = _ecc_encoded_size(sizeof(entries));
+            unsigned char* root_dirs = (unsigned char*)malloc(encoded_size);
             if (!root_dirs) {
                 return 0;
             }
 
-            _nft32_pack_memory((unsigned char*)entries, root_dirs, sizeof(entries));
+            _ecc_pack((unsigned char*)entries, root_dirs, sizeof(entries));
             off_t cluster_offset = data_start + (i - ROOT_DIR_CLUSTER) * CLUSTER_SIZE;
-            if (
-                pwrite(
-                    fd, root_dirs, sizeof(entries) * sizeof(encoded_t), cluster_offset
-                ) != sizeof(entries) * sizeof(encoded_t)
-            ) {
+            if (pwrite(fd, root_dirs, encoded_size, cluster_offset) != encoded_size) {
                 free(root_dirs);
                 return 0;
             }
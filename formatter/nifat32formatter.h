@@ -56,10 +56,12 @@ https://en.wikipedia.org/wiki/Golden_ratio
 #define FAT_MULTIPLIER     340573321U
 #define JOURNAL_MULTIPLIER 12983229U
 #define ERRORS_MULTIPLIER  10986542U
+#define FREEMAP_MULTIPLIER 2246822519U
 #define GET_BOOTSECTOR(n, ts)    (((((n) + 1) * BOOT_MULTIPLIER) >> 11) % (ts - 2))
 #define GET_FATSECTOR(n, ts)     (((((n) + 7) * FAT_MULTIPLIER) >> 13) % (ts - 32))
 #define GET_JOURNALSECTOR(n, ts) (((((n) + 35) * JOURNAL_MULTIPLIER) >> 3) % (ts - 2))
 #define GET_ERRORSSECTOR(n, ts)  (((((n) + 23) * ERRORS_MULTIPLIER) >> 9) % (ts - 2))
+#define GET_FREEMAPSECTOR(ts, sc) (((41 * FREEMAP_MULTIPLIER) >> 7) % (ts - (sc) - 2))
 
 #define BYTES_PER_SECTOR     512
 #define SECTORS_PER_CLUSTER  8
@@ -122,6 +124,9 @@ typedef struct {
 typedef unsigned char byte_t;
 typedef unsigned short encoded_t;
 typedef unsigned short decoded_t;
+
+#define SECDED_DATA_BLOCK    4
+#define SECDED_ENCODED_BLOCK 5
 typedef unsigned int* fat_table_t;
 
 #endif
@@ -58,6 +58,42 @@ int process_input(int argc, char* argv[], opt_t* opt) {
                 return 0;
             }
         }
+        else if (!strcmp(argv[i], ECC_OPT)) {
+            if (i + 1 < argc) {
+                char* codec = argv[++i];
+                if (!strcmp(codec, "hamming") || !strcmp(codec, "0")) opt->ecc = ECC_HAMMING_15_11;
+                else if (!strcmp(codec, "secded") || !strcmp(codec, "1")) opt->ecc = ECC_SECDED_39_32;
+                else {
+                    fprintf(stderr, "Error: Unknown ECC codec %s\n", codec);
+                    return 0;
+                }
+            }
+            else {
+                fprintf(stderr, "Error: ECC codec required after %s\n", ECC_OPT);
+                return 0;
+            }
+        }
+        else if (!strcmp(argv[i], CHECKSUM_OPT)) {
+            if (i + 1 < argc) {
+                char* algorithm = argv[++i];
+                if (!strcmp(algorithm, "murmur3") || !strcmp(algorithm, "0")) opt->crc = CHECKSUM_MURMUR3;
+                else if (!strcmp(algorithm, "crc32c") || !strcmp(algorithm, "1")) opt->crc = CHECKSUM_CRC32C;
+                else {
+                    fprintf(stderr, "Error: Unknown checksum algorithm %s\n", algorithm);
+                    return 0;
+                }
+            }
+            else {
+                fprintf(stderr, "Error: Checksum algorithm required after %s\n", CHECKSUM_OPT);
+                return 0;
+            }
+        }
+        else if (!strcmp(argv[i], FAT_CHECKSUM_OPT)) {
+            opt->fat_sum = 1;
+        }
+        else if (!strcmp(argv[i], FREE_MAP_OPT)) {
+            opt->free_map = 1;
+        }
     }
 
     return 1;
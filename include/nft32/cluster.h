@@ -33,6 +33,17 @@ extern "C" {
 /* Default offset for new clusters */
 #define CLUSTER_OFFSET 128
 
+/*
+The cluster space is split to allocation groups with own lock and search cursor. A chain
+grows in the group of its end, a new chain takes the next group. A full or busy group spills
+to the next one. Groups are aligned to whole FAT blocks and bitmap words.
+*/
+#ifndef ALLOC_GROUPS
+#define ALLOC_GROUPS 8
+#endif
+
+#define ALLOC_GROUP_ALIGN 1024
+
 typedef unsigned char        stack_buffer_t;
 typedef unsigned char*       buffer_t;
 typedef const unsigned char* const_buffer_t;
@@ -48,7 +59,17 @@ Return count of cluster for provided data.
 int get_cluster_count(unsigned int size, fat_data_t* fi);
 
 /*
-Allocate cluster from free-clusters on disk and DON'T mark cluster as "END_CLUSTER32"
+Split the cluster space to allocation groups. Should be called before any allocation.
+Params:
+- `fi` - FS data.
+
+Return 1 if succeeds.
+*/
+int alloc_groups_init(fat_data_t* fi);
+
+/*
+Allocate cluster from free-clusters on disk and mark cluster as "END_CLUSTER32".
+The cluster is marked before the group is unlocked, thus it can't be allocated twice.
 [Thread-safe]
 
 Params:
@@ -58,6 +79,23 @@ Return cluster address or BAD_CLUSTER if error.
 */
 cluster_addr_t alloc_cluster(fat_data_t* fi);
 
+/*
+Allocate a run of free clusters that follow each other on disk and link them to a chain
+with the <END> at the last cluster. The FAT is updated by blocks. If there is no free run
+of the count, the run is halved until it is found. The run doesn't cross allocation groups.
+[Thread-safe]
+
+Params:
+- `count` - Wanted count of clusters.
+- `hint` - Cluster where the search starts, e.g. the next cluster after the chain end.
+           If it isn't a valid cluster, the search starts at the cursor of the next group.
+- `allocated` - Count of allocated clusters.
+- `fi` - FS data.
+
+Return the first cluster of the run or BAD_CLUSTER if error.
+*/
+cluster_addr_t alloc_extent(unsigned int count, cluster_addr_t hint, unsigned int* allocated, fat_data_t* fi);
+
 /*
 Mark cluster as <FREE>.
 Params:
@@ -95,6 +133,22 @@ int readoff_cluster(
     cluster_addr_t ca, cluster_offset_t offset, buffer_t __restrict buffer, int buff_size, fat_data_t* __restrict fi
 );
 
+/*
+Read data from a run of clusters that follow each other on disk, by one disk transfer.
+Params:
+- `ca` - First cluster address of the run.
+- `count` - Clusters count in the run.
+- `offset` - Offset in the run (Should be lower than count * spc * sector_size).
+- `buffer` - Pointer where function will store data.
+- `buff_size` - buffer size.
+- `fi` - FS data.
+
+Return count of readden bytes.
+*/
+int readoff_clusters(
+    cluster_addr_t ca, unsigned int count, cluster_offset_t offset, buffer_t __restrict buffer, int buff_size, fat_data_t* __restrict fi
+);
+
 /*
 Read data from cluster.
 Params:
@@ -122,6 +176,22 @@ int writeoff_cluster(
     cluster_addr_t ca, cluster_offset_t offset, const_buffer_t __restrict data, int data_size, fat_data_t* __restrict fi
 );
 
+/*
+Write data to a run of clusters that follow each other on disk, by one disk transfer.
+Params:
+- `ca` - First cluster address of the run.
+- `count` - Clusters count in the run.
+- `offset` - Offset in the run (Should be lower than count * spc * sector_size).
+- `buffer` - Pointer where function will take data for write.
+- `buff_size` - buffer size.
+- `fi` - FS data.
+
+Return count of written bytes.
+*/
+int writeoff_clusters(
+    cluster_addr_t ca, unsigned int count, cluster_offset_t offset, const_buffer_t __restrict data, int data_size, fat_data_t* __restrict fi
+);
+
 /*
 Write data to cluster.
 Params:
@@ -148,6 +218,69 @@ Return count of readden and written bytes.
 */
 int copy_cluster(cluster_addr_t src, cluster_addr_t dst, buffer_t __restrict buffer, int buff_size, fat_data_t* __restrict fi);
 
+/*
+Runs of clusters, which go to the disk as a batch of asynchronous requests. A full batch is 
+submitted and waited, thus up to DISK_BATCH_MAX transfers are in flight at once.
+*/
+typedef struct {
+    disk_request_t reqs[DISK_BATCH_MAX];
+    int            count;
+    int            result;
+} cluster_batch_t;
+
+/*
+Prepare an empty batch.
+Params:
+- `b` - Batch.
+*/
+void cluster_batch_init(cluster_batch_t* b);
+
+/*
+Add a read of a run of clusters to the batch. The buffer is filled after cluster_batch_wait.
+Params:
+- `b` - Batch.
+- `ca` - First cluster address of the run.
+- `count` - Clusters count in the run.
+- `offset` - Offset in the run (Should be lower than count * spc * sector_size).
+- `buffer` - Pointer where function will store data.
+- `buff_size` - buffer size.
+- `fi` - FS data.
+
+Return 1 if the batch has no errors for now.
+Return 0 if a request of the batch is failed.
+*/
+int cluster_batch_read(
+    cluster_batch_t* b, cluster_addr_t ca, unsigned int count, cluster_offset_t offset, buffer_t buffer, int buff_size, fat_data_t* fi
+);
+
+/*
+Add a write of a run of clusters to the batch. The data should stay unchanged until cluster_batch_wait.
+Params:
+- `b` - Batch.
+- `ca` - First cluster address of the run.
+- `count` - Clusters count in the run.
+- `offset` - Offset in the run (Should be lower than count * spc * sector_size).
+- `data` - Pointer where function will take data for write.
+- `data_size` - Data size.
+- `fi` - FS data.
+
+Return 1 if the batch has no errors for now.
+Return 0 if a request of the batch is failed.
+*/
+int cluster_batch_write(
+    cluster_batch_t* b, cluster_addr_t ca, unsigned int count, cluster_offset_t offset, const_buffer_t data, int data_size, fat_data_t* fi
+);
+
+/*
+Submit rest requests of the batch and wait for all of them. The batch is empty after the call.
+Params:
+- `b` - Batch.
+
+Return 1 if every request is succeeded.
+Return 0 if io error.
+*/
+int cluster_batch_wait(cluster_batch_t* b);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,96 @@
+/*
+License:
+    MIT License. See LICENSE file in project root.
+    Copyright (c) 2025 Nikolay
+
+Description:
+    Per-region counters of the bits corrected by the Hamming decoder. Shows which
+    metadata regions actually degraded on the media.
+
+Dependencies:
+    - std/str.h - Memory helpers.
+    - std/hamming.h - Counting decoders.
+*/
+
+#ifndef CORRECTIONS_H_
+#define CORRECTIONS_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <std/str.h>
+#include <std/hamming.h>
+
+#define CORRECTIONS_BOOT      0
+#define CORRECTIONS_FAT       1
+#define CORRECTIONS_JOURNAL   2
+#define CORRECTIONS_ERRORS    3
+#define CORRECTIONS_DIRECTORY 4
+#define CORRECTIONS_FREEMAP   5
+
+#ifndef CORRECTIONS_MAX_FAT
+    #define CORRECTIONS_MAX_FAT 8 // FAT copies above this number share the last counter
+#endif
+
+typedef struct {
+    unsigned int boot;
+    unsigned int fat[CORRECTIONS_MAX_FAT];
+    unsigned int journal;
+    unsigned int errors;
+    unsigned int directory;
+    unsigned int freemap;
+    unsigned int last_fat_ca;       // last FAT entry with a corrected codeword
+    unsigned int last_directory_ca; // last directory cluster with a corrected codeword
+} corrections_t;
+
+/*
+Decode data and count corrected codewords in the region.
+Note: The boot sector and the error store are read before the volume ECC codec is known,
+      so they are always decoded with Hamming 15,11. Other regions use the volume codec.
+Params:
+- region - CORRECTIONS_* region.
+- index - FAT copy index for CORRECTIONS_FAT.
+- ca - Cluster address of the data (FAT entry or directory cluster). Not used for other regions.
+- src - Source encoded data.
+- dst - Destination for decoded data.
+- l - Element count.
+
+Return the count of corrected codewords.
+*/
+int corrections_unpack(int region, int index, unsigned int ca, const byte_t* src, byte_t* dst, int l);
+
+/*
+Decode several consecutive elements (e.g. FAT entries) with one codec call.
+The last corrected address is ca plus the index of the first corrected element.
+Params:
+- region - CORRECTIONS_FAT or CORRECTIONS_DIRECTORY.
+- index - FAT copy index for CORRECTIONS_FAT.
+- ca - Address of the first element.
+- src - Source encoded data.
+- dst - Destination for decoded data.
+- count - Elements count.
+- size - Decoded element size.
+
+Return the count of corrected codewords.
+*/
+int corrections_unpack_entries(int region, int index, unsigned int ca, const byte_t* src, byte_t* dst, int count, int size);
+
+/*
+Copy current counters.
+Params:
+- c - Output data destination.
+
+Return 1.
+*/
+int corrections_get(corrections_t* c);
+
+/*
+Reset all counters to zero.
+Return 1.
+*/
+int corrections_reset();
+
+#ifdef __cplusplus
+}
+#endif
+#endif
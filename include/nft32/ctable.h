@@ -11,6 +11,7 @@ Dependencies:
     - std/null.h - NULL definition.
     - std/threading.h - Table locks.
     - nft32/fat.h - Cluster types.
+    - nft32/cluster.h - Read-ahead cluster reads.
     - nft32/entry.h - Directory entry structures.
     - nft32/ecache.h - Entry cache structures.
     - nft32/fatinfo.h - FAT filesystem metadata.
@@ -27,6 +28,7 @@ extern "C" {
 #include <std/threading.h>
 #include <nft32/fat.h>
 #include <nft32/entry.h>
+#include <nft32/cluster.h>
 #include <nft32/ecache.h>
 #include <nft32/fatinfo.h>
 
@@ -34,6 +36,20 @@ extern "C" {
     #define CONTENT_TABLE_SIZE 50
 #endif
 
+/* Max read-ahead window in clusters. 0 disables read-ahead. */
+#ifndef READ_AHEAD_MAX
+    #define READ_AHEAD_MAX 16
+#endif
+
+#ifdef NO_HEAP
+    #define NIFAT32_NO_EXTENTS
+    #define NIFAT32_NO_READAHEAD
+#endif
+
+#if READ_AHEAD_MAX <= 0
+    #define NIFAT32_NO_READAHEAD
+#endif
+
 /* Content Index - ci */
 typedef int ci_t;
 
@@ -57,6 +73,30 @@ typedef struct {
     ecache_t* root;
 } content_index_t;
 
+/* Run of physically consecutive clusters in a chain. The run lasts until the next run. */
+typedef struct {
+    cluster_addr_t ca;    /* First cluster of the run         */
+    unsigned int   index; /* Chain index of the first cluster */
+} extent_t;
+
+typedef struct {
+    extent_t*    runs;     /* NULL if the map isn't built */
+    unsigned int count;    /* Runs count                  */
+    unsigned int capacity; /* Allocated runs              */
+    unsigned int length;   /* Mapped clusters             */
+    int          complete; /* The whole chain is mapped   */
+} extent_map_t;
+
+/* Read-ahead state. The window grows twice on every sequential read, that isn't buffered. */
+typedef struct {
+    buffer_t         buffer;   /* Buffered clusters, NULL if isn't allocated */
+    unsigned int     capacity; /* Allocated clusters                         */
+    unsigned int     first;    /* Chain index of the first buffered cluster  */
+    unsigned int     count;    /* Buffered clusters                          */
+    unsigned int     window;   /* Clusters of the next read-ahead            */
+    cluster_offset_t next;     /* Offset of the next sequential read         */
+} readahead_t;
+
 typedef struct {
     union {
         directory_t   directory;
@@ -64,9 +104,12 @@ typedef struct {
     };
     
     content_index_t   index;          /* If this is a directory - Index data  */
+    extent_map_t      extents;        /* Data chain map, built on demand      */
+    readahead_t       readahead;      /* Sequential read state                */
     cluster_addr_t    parent_cluster; /* Claster where is the entry is placed */
     cluster_addr_t    data_cluster;   /* Head data claster of the entry       */
     directory_entry_t meta;           /* The entry                            */
+    checksum_state_t   meta_prefix;    /* Checksum state of the entry prefix   */
     content_type_t    content_type;
     unsigned char     mode;           /* Open mode                            */
 } content_t;
@@ -140,6 +183,7 @@ cluster_addr_t get_content_data_ca(const ci_t ci);
 
 /*
 Set the data head field for an entry by the provided content index.
+Note: Drops the extent map of the content.
 Params:
     - `ci` - Content index.
     - `ca` - Cluster address.
@@ -148,6 +192,116 @@ Returns 1 if succeeds, otherwise will return 0.
 */
 int set_content_data_ca(const ci_t ci, cluster_addr_t ca);
 
+/*
+Get the cluster of the content's data chain by its index in the chain.
+Note: The extent map of the chain is built on demand. A walk maps the chain up to the
+      index once, then the cluster is found by a binary search over the runs.
+Note 2: Without the map (NIFAT32_NO_EXTENTS or no memory) the chain is walked.
+Params:
+    - `ci` - Content index.
+    - `index` - Cluster index in the chain.
+    - `fi` - FAT information.
+
+Returns the cluster, 'FAT_CLUSTER_END' if the chain is shorter or 'FAT_CLUSTER_BAD' if something went wrong.
+*/
+cluster_addr_t get_content_cluster(const ci_t ci, unsigned int index, fat_data_t* fi);
+
+/*
+Get the next cluster during a sequential chain walk. Uses the extent map if it is built,
+otherwise reads the FAT.
+Params:
+    - `ci` - Content index.
+    - `index` - Chain index of the next cluster.
+    - `ca` - Current cluster (index - 1).
+    - `fi` - FAT information.
+
+Returns the cluster, 'FAT_CLUSTER_END' or 'FAT_CLUSTER_BAD' if something went wrong.
+*/
+cluster_addr_t get_content_next_cluster(const ci_t ci, unsigned int index, cluster_addr_t ca, fat_data_t* fi);
+
+/*
+Get the count of clusters from the chain index that follow each other on disk, thus
+can be read or written by one disk transfer. Uses the extent map if it is built,
+otherwise the run is one cluster.
+Params:
+    - `ci` - Content index.
+    - `index` - Chain index of the run start.
+    - `max` - Max count of clusters in the run.
+    - `fi` - FAT information.
+
+Returns the run length or 0 if the chain is shorter than the index.
+*/
+unsigned int get_content_run(const ci_t ci, unsigned int index, unsigned int max, fat_data_t* fi);
+
+/*
+Get the count of clusters in the content's data chain.
+Params:
+    - `ci` - Content index.
+    - `fi` - FAT information.
+
+Returns the chain length.
+*/
+unsigned int get_content_length(const ci_t ci, fat_data_t* fi);
+
+/*
+Update the extent map after a cluster was linked to the end of the chain.
+Note: Maps of other contents with the same chain are dropped.
+Params:
+    - `ci` - Content index.
+    - `ca` - Appended cluster.
+
+Returns 1 if succeeds, otherwise will return 0.
+*/
+int content_extents_append(const ci_t ci, cluster_addr_t ca);
+
+/*
+Update the extent map after the chain was cut to the provided part.
+Note: Maps of other contents with the same chain are dropped.
+Params:
+    - `ci` - Content index.
+    - `first` - Chain index of the new head.
+    - `count` - Clusters left in the chain.
+
+Returns 1 if succeeds, otherwise will return 0.
+*/
+int content_extents_trim(const ci_t ci, unsigned int first, unsigned int count);
+
+/*
+Drop the extent map. It will be built again on demand.
+Params:
+    - `ci` - Content index.
+
+Returns 1 if succeeds, otherwise will return 0.
+*/
+int content_extents_drop(const ci_t ci);
+
+/*
+Read the content's data through the read-ahead buffer. A read, that starts where the previous
+one ended, is sequential. If it isn't buffered, the window grows twice (up to READ_AHEAD_MAX
+clusters) and the window of clusters from the read's cluster is read by one batch. The extent
+map walk reads FAT entries of these clusters at the same time. Other reads reset the window.
+Note: Without read-ahead (NIFAT32_NO_READAHEAD) always returns 0.
+Params:
+    - `ci` - Content index.
+    - `offset` - Data offset.
+    - `buffer` - Output buffer.
+    - `size` - Read size.
+    - `fi` - FAT information.
+
+Returns the read size, or 0 if the read isn't buffered and should go to the disk.
+*/
+int read_content_ahead(const ci_t ci, cluster_offset_t offset, buffer_t buffer, int size, fat_data_t* fi);
+
+/*
+Drop buffered data of the content and other contents with the same data chain.
+Should be invoked after the chain data was changed.
+Params:
+    - `ci` - Content index.
+
+Returns 1 if succeeds, otherwise will return 0.
+*/
+int content_readahead_drop(const ci_t ci);
+
 /*
 Get the data size field from an entry by the provided content index.
 Params:
@@ -175,6 +329,29 @@ Returns the name or NULL if something went wrong.
 */
 const char* get_content_name(const ci_t ci);
 
+/*
+Get the content's name with its hash. The hash is taken from the entry, the name isn't hashed again.
+Params:
+    - `ci` - Content index.
+    - `hn` - Output hashed name.
+
+Returns 1 if succeeds, otherwise will return 0.
+*/
+int get_content_hashed_name(const ci_t ci, hashed_name_t* hn);
+
+/*
+Update data cluster and size of the content's entry. The entry checksum is finished from
+the cached prefix state, thus only dca and file_size are hashed.
+Params:
+    - `ci` - Content index.
+    - `dca` - New data cluster.
+    - `file_size` - New size.
+    - `meta` - Output updated entry. Can be NULL.
+
+Returns 1 if succeeds, otherwise will return 0.
+*/
+int update_content_meta(const ci_t ci, cluster_addr_t dca, unsigned int file_size, directory_entry_t* meta);
+
 /*
 Get the mode field from an entry by the provided content index.
 Params:
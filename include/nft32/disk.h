@@ -4,9 +4,11 @@ License:
     Copyright (c) 2025 Nikolay
 
 Description:
-    Disk and block-device sector I/O interface.
+    Disk and block-device sector I/O interface with an optional LRU sector cache.
 
 Dependencies:
+    - std/mm.h - Sector cache allocation.
+    - std/str.h - Memory copy helpers.
     - std/null.h - NULL definition.
     - std/logging.h - Logging helpers.
     - std/threading.h - I/O locks.
@@ -18,6 +20,8 @@ Dependencies:
 extern "C" {
 #endif
 
+#include <std/mm.h>
+#include <std/str.h>
 #include <std/null.h>
 #include <std/logging.h>
 #include <std/threading.h>
@@ -29,40 +33,194 @@ typedef unsigned int sector_addr_t;
 #define READ_LOCK  1
 typedef struct {
     sector_addr_t start;
-    int           count;
+    int           count; // -1 - free slot
     int           ro;
 } io_area_t;
 
-#ifndef IO_THREADS_MAX
-    #define IO_THREADS_MAX 25
+/*
+Locked ranges are kept in shards. The sector space is split to regions of IO_LOCK_REGION_SECTORS
+sectors, and every region belongs to the shard `region % IO_LOCK_SHARDS`. A range is placed to every
+shard of its regions, thus overlapped ranges always meet in a shard, and ranges of different regions
+don't wait for a common lock.
+*/
+#ifndef IO_LOCK_SHARDS
+    #define IO_LOCK_SHARDS 64
+#endif
+
+#ifndef IO_SHARD_AREAS
+    #define IO_SHARD_AREAS 8
 #endif
+
+#ifndef IO_LOCK_REGION_SECTORS
+    #define IO_LOCK_REGION_SECTORS 32
+#endif
+
 typedef struct {
-    io_area_t areas[IO_THREADS_MAX];
+    io_area_t areas[IO_SHARD_AREAS];
+    int       used;
     lock_t    lock;
-} io_thread_t;
+} io_shard_t;
+
+#ifdef NO_HEAP
+    #define NO_SECTOR_CACHE
+#endif
+
+/* Runs longer than this count of sectors bypass the sector cache, thus a scan doesn't flush it. */
+#ifndef SECTOR_CACHE_RUN_MAX
+    #define SECTOR_CACHE_RUN_MAX 8
+#endif
+
+#define SECTOR_CACHE_WRITE_THROUGH 0 // Writes go to the disk, the cache keeps a copy
+#define SECTOR_CACHE_WRITE_BACK    1 // Writes stay in the cache until an eviction or DSK_flush
+
+typedef struct {
+    sector_addr_t sa;
+    int           prev;  // LRU list, the head is the most recent sector
+    int           next;
+    int           hnext; // Hash chain
+    unsigned char valid;
+    unsigned char dirty;
+} sector_slot_t;
+
+typedef struct {
+    unsigned int hits;       // cached sectors of reads and writes
+    unsigned int misses;     // sectors read from the disk for the cache
+    unsigned int evictions;  // sectors dropped for other sectors
+    unsigned int writebacks; // dirty sectors written to the disk
+    unsigned int dirty;      // dirty sectors in the cache now
+    unsigned int sectors;    // cache capacity in sectors
+} sector_cache_stat_t;
 
+typedef struct {
+    sector_slot_t*      slots;
+    int*                buckets;
+    unsigned char*      data;
+    unsigned char*      scratch; // one run of SECTOR_CACHE_RUN_MAX sectors
+    int                 count;
+    int                 mask;
+    int                 head;
+    int                 tail;
+    int                 mode;
+    sector_cache_stat_t stat;
+    lock_t              lock;
+} sector_cache_t;
+
+/*
+One part of a vectored IO. The data goes from the byte `offset` of the sector `sa`,
+thus the offset can be larger than a sector. Write functions don't change the buffer.
+*/
+typedef struct {
+    sector_addr_t   sa;
+    sector_offset_t offset;
+    unsigned char*  buffer;
+    int             size;
+} disk_iovec_t;
+
+#define DISK_REQUEST_PENDING -1
+
+/* Count of requests, which the file system submits at once. */
+#ifndef DISK_BATCH_MAX
+    #define DISK_BATCH_MAX 16
+#endif
+
+/*
+One asynchronous request. The platform completes it by DSK_complete, which invokes `done` (optional)
+and sets the status. The range stays locked until the completion.
+*/
+typedef struct disk_request {
+    disk_iovec_t iov;
+    int          write;
+    volatile int status; // DISK_REQUEST_PENDING, 1 - success, 0 - io error
+    void       (*done)(struct disk_request*, int); // gets the request and the result
+    void*        ctx;
+} disk_request_t;
+
+/*
+Platform IO functions. `read_sector` and `write_sector` get data of one sector.
+Other functions are optional (NULL if not provided):
+- `read_sectors` / `write_sectors` get data of sequential sectors by one call.
+- `readv` / `writev` get a list of such ranges by one call.
+- `wait` is invoked by a thread, which waits for a range locked by other threads (e.g. a scheduler yield).
+- `submit` queues requests and returns the count of queued ones. The platform completes every
+  queued request by DSK_complete later, from `poll` or from its own thread.
+- `poll` completes finished requests and returns their count. With a non-zero argument it waits
+  for at least one, if there are queued requests.
+Without them the range is split to sectors, the list is split to ranges, waiters spin, and 
+requests are done at the submit.
+*/
 typedef struct {
     int (*read_sector)(sector_addr_t, sector_offset_t, unsigned char*, int);
     int (*write_sector)(sector_addr_t, sector_offset_t, const unsigned char*, int);
     int sector_size;
+    int (*read_sectors)(sector_addr_t, sector_offset_t, unsigned char*, int);
+    int (*write_sectors)(sector_addr_t, sector_offset_t, const unsigned char*, int);
+    int (*readv)(const disk_iovec_t*, int);
+    int (*writev)(const disk_iovec_t*, int);
+    void (*wait)();
+    int (*submit)(disk_request_t*, int);
+    int (*poll)(int);
 } disk_io_t;
 
 /*
 Setup disk ubstraction layer.
 
 Params: 
-- read - IO read function on specific platform.
-- write - IO write function on specific platform.
-- sector_size - Platform sector size.
+- io - IO functions on specific platform. `read_sector`, `write_sector` and 
+       `sector_size` are required.
+
+Return 1 if setup success.
+Return 0 if something goes wrong.
+*/
+int DSK_setup(const disk_io_t* io);
+
+/*
+Setup the sector cache. Raw (encoded) sectors of reads and writes up to SECTOR_CACHE_RUN_MAX
+sectors are kept in RAM and evicted by the LRU order. Longer runs go to the disk directly, 
+and cached copies of their sectors are updated.
+Note: The cache needs at least 2 * SECTOR_CACHE_RUN_MAX sectors. With a smaller budget there is no cache.
+Note 2: The WRITE_BACK mode changes the order of writes until DSK_flush.
+
+Params:
+- size - RAM budget in bytes. 0 - no cache.
+- mode - SECTOR_CACHE_WRITE_THROUGH or SECTOR_CACHE_WRITE_BACK.
 
 Return 1 if setup success.
 Return 0 if something goes wrong.
 */
-int DSK_setup(
-    int (*read)(sector_addr_t, sector_offset_t, unsigned char*, int), 
-    int (*write)(sector_addr_t, sector_offset_t, const unsigned char*, int), 
-    int sector_size
-);
+int DSK_cache_init(unsigned int size, int mode);
+
+/*
+Write dirty sectors of the cache to the disk. Writes before this call reach the disk
+before writes after it.
+[Thread-safe]
+
+Return 1 if every dirty sector is written.
+Return 0 if something goes wrong.
+*/
+int DSK_flush();
+
+/*
+Load counters of the sector cache.
+Params:
+- st - Output data destination.
+
+Return 1 if there is a cache.
+Return 0 if there is no cache.
+*/
+int DSK_cache_stat(sector_cache_stat_t* st);
+
+/*
+Reset hit, miss, eviction and write-back counters.
+Return 1.
+*/
+int DSK_cache_stat_reset();
+
+/*
+Flush and free the sector cache.
+Return 1 if dirty sectors are written.
+Return 0 if something goes wrong.
+*/
+int DSK_cache_unload();
 
 /*
 Read one sector from disk with io functions.
@@ -101,6 +259,40 @@ Return 0 if io error.
 */
 int DSK_readoff_sectors(sector_addr_t sa, sector_offset_t offset, unsigned char* buffer, int buff_size, int sc);
 
+/*
+Read a run of sequential sectors with offset by one io call. The platform `read_sectors`
+gets the whole range at once, without it the range is read by sectors.
+Note: Will claim area for read lock.
+[Thread-safe]
+
+Params:
+- sa - Start sector address, e.g. sector index.
+- offset - Offset in the run.
+- buffer - Pointer to buffer where function will safe data from disk.
+- buff_size - Buffer size.
+              Note: Data will shrink to the run end without error.
+- sc - Sectors count.
+
+Return 1 if io read success.
+Return 0 if io error.
+*/
+int DSK_readoff_run(sector_addr_t sa, sector_offset_t offset, unsigned char* buffer, int buff_size, int sc);
+
+/*
+Read a list of ranges by one io call. Without the platform `readv` ranges are read
+one by one.
+Note: Will claim areas for read lock.
+[Thread-safe]
+
+Params:
+- iov - Ranges.
+- count - Ranges count.
+
+Return 1 if io read success.
+Return 0 if io error.
+*/
+int DSK_readv(const disk_iovec_t* iov, int count);
+
 /*
 Write data from data buffer to sector on disk via disk io functions.
 Note: Will claim area for write lock.
@@ -134,6 +326,83 @@ Return 0 if io error.
 */
 int DSK_writeoff_sectors(sector_addr_t sa, sector_offset_t offset, const unsigned char* data, int data_size, int sc);
 
+/*
+Write data from data buffer to a run of sequential sectors by one io call. The platform
+`write_sectors` gets the whole range at once, without it the range is written by sectors.
+Note: Will claim area for write lock.
+[Thread-safe]
+
+Params:
+- sa - Start sector address, e.g. sector index.
+- offset - Offset in the run.
+- data - Pointer to buffer where placed data for write operation.
+- data_size - Data size for write.
+              Note: Data will shrink to the run end without error.
+- sc - Sectors count.
+
+Return 1 if io write success.
+Return 0 if io error.
+*/
+int DSK_writeoff_run(sector_addr_t sa, sector_offset_t offset, const unsigned char* data, int data_size, int sc);
+
+/*
+Write a list of ranges by one io call. Without the platform `writev` ranges are written
+one by one. A failed range doesn't stop writes of next ranges.
+Note: Will claim areas for write lock.
+[Thread-safe]
+
+Params:
+- iov - Ranges.
+- count - Ranges count.
+
+Return 1 if io write success for every range.
+Return 0 if io error.
+*/
+int DSK_writev(const disk_iovec_t* iov, int count);
+
+/*
+Submit requests. Ranges of requests are locked until the completion. Requests go to the platform 
+`submit` by one call. Without it, with the sector cache, or if a range is locked by other IO, 
+requests are done one by one before the return.
+Note: A thread shouldn't submit a range, which overlaps its own requests in flight.
+[Thread-safe]
+
+Params:
+- reqs - Requests. They should stay in memory until the completion.
+- count - Requests count.
+
+Return 1.
+*/
+int DSK_submit(disk_request_t* reqs, int count);
+
+/*
+Complete finished requests by the platform `poll`.
+Params:
+- wait - Wait for at least one request.
+
+Return count of completed requests.
+*/
+int DSK_poll(int wait);
+
+/*
+Wait for completion of requests.
+Params:
+- reqs - Requests.
+- count - Requests count.
+
+Return 1 if every request is succeeded.
+Return 0 if io error.
+*/
+int DSK_wait(disk_request_t* reqs, int count);
+
+/*
+Complete the request. Invoked by the platform for every queued request.
+Params:
+- req - Request.
+- result - 1 if io success, 0 if io error.
+*/
+void DSK_complete(disk_request_t* req, int result);
+
 /*
 Copy sector to destination sector.
 Note: copy buffer should be greater or equals to sector size.
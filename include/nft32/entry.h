@@ -11,12 +11,13 @@ Dependencies:
     - std/logging.h - Logging helpers.
     - std/hamming.h - Encoded data helpers.
     - std/fatname.h - FAT 8.3 name conversion.
-    - std/checksum.h - Entry checksum type.
+    - std/checksum.h - Entry checksum and streaming hasher.
     - nft32/ecache.h - Entry cache structures.
     - nft32/errors.h - Error registration.
     - nft32/fatinfo.h - FAT filesystem metadata.
     - nft32/cluster.h - Cluster I/O utilities.
     - nft32/journal.h - Journal operations.
+    - nft32/corrections.h - Corrected bits counters.
 */
 
 #ifndef ENTRY_H_
@@ -35,6 +36,7 @@ extern "C" {
 #include <nft32/fatinfo.h>
 #include <nft32/cluster.h>
 #include <nft32/journal.h>
+#include <nft32/corrections.h>
 
 #define FILE_LAST_LONG_ENTRY 0x40
 #define ENTRY_FREE           0xE5
@@ -49,9 +51,17 @@ extern "C" {
 #define FILE_DIRECTORY 0x10
 #define FILE_ARCHIVE   0x20
 
+/* Per-slot validity bitmap of a directory cluster. Filled by the fused decode pass. */
+typedef unsigned int entry_bitmap_t;
+#define ENTRY_BITMAP_BITS       (sizeof(entry_bitmap_t) * 8)
+#define ENTRY_BITMAP_SIZE(n)    (((n) + ENTRY_BITMAP_BITS - 1) / ENTRY_BITMAP_BITS)
+#define ENTRY_BITMAP_SET(b, i)  ((b)[(i) / ENTRY_BITMAP_BITS] |= (1U << ((i) % ENTRY_BITMAP_BITS)))
+#define ENTRY_BITMAP_GET(b, i)  (((b)[(i) / ENTRY_BITMAP_BITS] >> ((i) % ENTRY_BITMAP_BITS)) & 1)
+
 typedef struct {
     cluster_addr_t ca;
     int            offset;
+    int            valid; // entry checksum is correct
 } entry_info_t;
 
 /* from http://wiki.osdev.org/FAT */
@@ -66,10 +76,46 @@ typedef struct directory_entry {
     checksum_t     checksum;
 } __attribute__((packed)) directory_entry_t;
 
+/* Entry fields before dca are hashed as a prefix. dca, file_size and checksum are the suffix. */
+#define ENTRY_CHECKSUM_PREFIX __builtin_offsetof(directory_entry_t, dca)
+
+/* Count of encoded entries in one directory cluster. Depends on the volume ECC codec. */
+#define ENTRIES_PER_CLUSTER(fi) ((fi)->cluster_size / nft32_ecc_encoded_size(sizeof(directory_entry_t)))
+
+/*
+Calculate entry checksum. The checksum field is hashed as zero, the entry isn't modified.
+Params:
+- entry - Entry.
+
+Return entry checksum.
+*/
+checksum_t entry_checksum(const directory_entry_t* entry);
+
+/*
+Save hasher state after the entry prefix (name, name hash, attributes, rca).
+Params:
+- entry - Entry.
+- prefix - Place where state will be saved.
+
+Return 1.
+*/
+int entry_checksum_prefix(const directory_entry_t* entry, checksum_state_t* prefix);
+
+/*
+Finish entry checksum from the saved prefix state. Use it when only dca or file_size
+were changed, the prefix isn't hashed again.
+Params:
+- prefix - State from entry_checksum_prefix.
+- entry - Entry with the same prefix.
+
+Return entry checksum.
+*/
+checksum_t entry_checksum_update(const checksum_state_t* prefix, const directory_entry_t* entry);
+
 /*
 Create new empty entry.
 Params:
-- fullname - 8.3 name for entry.
+- name - Hashed 8.3 name for entry.
 - is_dir - Is this entry for directory.
 - dca - Data cluster address. 
         Note: This cluster should be marked as <FREE>.
@@ -80,7 +126,7 @@ Return 1 if entry data generation complete.
 Return 0 if something goes wrong.
 */
 int create_entry(
-    const char* fullname, char is_dir, cluster_addr_t dca, 
+    const hashed_name_t* name, char is_dir, cluster_addr_t dca, 
     unsigned int file_size, directory_entry_t* entry
 );
 
@@ -92,6 +138,9 @@ Params:
 - ctx - Context for function.
 - fi - FS data.
 
+Note: Entries are validated during the cluster decoding. The handler gets the result
+      in info->valid and doesn't need to recompute the entry checksum.
+
 Return 1 if iterate success.
 Return 0 if something goes wrong.
 */
@@ -116,7 +165,7 @@ int entry_index(cluster_addr_t ca, ecache_t** __restrict cache, fat_data_t* __re
 /*
 Search entry in cluster by name. 
 Params:
-- name - Entry name.
+- name - Hashed entry name.
 - ca - Cluster address where we should search.
 - cache - Cache of entry. Can be NO_ECACHE or NULL.
 - meta - Storage for entry data.
@@ -127,7 +176,7 @@ Return -1 if something goes wrong.
 Return -4 if wntry wasn't found.
 */
 int entry_search(
-    const char* name, cluster_addr_t ca, ecache_t* __restrict cache,
+    const hashed_name_t* name, cluster_addr_t ca, ecache_t* __restrict cache,
     directory_entry_t* meta, fat_data_t* __restrict fi
 );
 
@@ -148,29 +197,29 @@ int entry_add(cluster_addr_t ca, ecache_t* __restrict cache, directory_entry_t*
 Edit an entry in a cluster.
 Params:
 - `ca` - Cluster where the entry is placed.
-- `name` - Name of the entry for edit.
-- `meta` - New meta for the entry.
+- `name` - Hashed name of the entry for edit.
+- `meta` - New meta for the entry. Checksum should be already calculated.
 - `fi` - FS data.
 
 Returns 1 if edit was succeed.
 Returns 0 if something went wrong.
 */
 int entry_edit(
-    cluster_addr_t ca, ecache_t* __restrict cache, const char* name, 
+    cluster_addr_t ca, ecache_t* __restrict cache, const hashed_name_t* name, 
     const directory_entry_t* meta, fat_data_t* __restrict fi
 );
 
 /*
 Entry remove just mark entry as free without erasing data.
 - ca - Clyster where entry is placed.
-- name - Name entry for edit.
+- name - Hashed name of the entry for remove.
 - cache - Ecache for directory.
 - fi - FS data.
 
 Return 1 if delete success.
 Return 0 if something goes wrong.
 */
-int entry_remove(cluster_addr_t ca, const char* name, ecache_t* __restrict cache, fat_data_t* __restrict fi);
+int entry_remove(cluster_addr_t ca, const hashed_name_t* name, ecache_t* __restrict cache, fat_data_t* __restrict fi);
 
 #ifdef __cplusplus
 }
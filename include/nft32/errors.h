@@ -11,6 +11,7 @@ Dependencies:
     - std/errcodes.h - Error code enumeration.
     - nft32/disk.h - Sector I/O primitives.
     - nft32/fatinfo.h - FAT filesystem metadata.
+    - nft32/corrections.h - Corrected bits counters.
 */
 
 #ifndef ERRORS_H_
@@ -23,6 +24,7 @@ extern "C" {
 #include <std/errcodes.h>
 #include <nft32/disk.h>
 #include <nft32/fatinfo.h>
+#include <nft32/corrections.h>
 
 #define PACK_INFO_ENTRY(f, c) (((unsigned int)(f) << 16) | ((unsigned int)(c) & 0xFFFF))
 #define GET_FIRST_ERROR(e)    ((unsigned short)((e) >> 16))
@@ -11,10 +11,13 @@ Dependencies:
     - std/null.h - NULL definition.
     - std/hamming.h - Encoded FAT value helpers.
     - std/logging.h - Logging helpers.
+    - std/checksum.h - FAT block checksums.
     - std/threading.h - FAT locks.
     - nft32/disk.h - Sector I/O primitives.
     - nft32/fatmap.h - Free cluster bitmap.
+    - nft32/fatpage.h - Paged FAT cache.
     - nft32/errors.h - Error registration.
+    - nft32/corrections.h - Corrected bits counters.
     - nft32/fatinfo.h - FAT filesystem metadata.
 */
 
@@ -28,10 +31,13 @@ extern "C" {
 #include <std/null.h>
 #include <std/hamming.h>
 #include <std/logging.h>
+#include <std/checksum.h>
 #include <std/threading.h>
 #include <nft32/disk.h>
 #include <nft32/fatmap.h>
+#include <nft32/fatpage.h>
 #include <nft32/errors.h>
+#include <nft32/corrections.h>
 #include <nft32/fatinfo.h>
 
 #define FAT_CLUSTER_FREE     0x00000000
@@ -47,20 +53,84 @@ typedef unsigned int cluster_addr_t;
 typedef unsigned int cluster_status_t;
 typedef unsigned int cluster_val_t;
 
+/* FAT cache is filled by blocks. One block is the entries of one decoded FAT sector. */
+#define FAT_BLOCK_ENTRIES(fi) ((fi)->bytes_per_sector / sizeof(cluster_val_t))
+
+/* 
+With fat_checksums every FAT copy stores the checksum of each block after the encoded table.
+The checksum of block b is encoded as the entry with this index.
+*/
+#define FAT_SUM_SLOT(b, fi) ((fi)->fat_size * FAT_BLOCK_ENTRIES(fi) + (b))
+
 /*
 Initialize cache for FAT.
-Note: Will allocate total_cluster * sizeof(uint32_t). 
+Note: Will allocate total_cluster * sizeof(uint32_t) and a bit per FAT block.
+Note 2: The cache is filled by blocks. A miss in read_fat loads the whole block,
+        thus neighbouring reads during chain walks don't touch the disk. 
+Note 3: If the table doesn't fit to the budget, the cache is paged. It holds as many
+        blocks as fit to the budget and evicts them by the CLOCK algorithm.
 Params:
+- budget - RAM budget in bytes. 0 means the whole table.
 - fi - Pointer to FS info.
 
 Return 1 if init success.
 Return 0 if something goes wrong.
 */
-int fat_cache_init(fat_data_t* fi);
+int fat_cache_init(unsigned int budget, fat_data_t* fi);
+
+/* Write-back mode flushes the cache when more FAT blocks than this are dirty. */
+#ifndef FAT_DIRTY_LIMIT
+#define FAT_DIRTY_LIMIT 64
+#endif
+
+/*
+Enable the write-back mode of the FAT cache. write_fat will only update the cache and
+mark the FAT block as dirty. Dirty blocks are written to every FAT copy by fat_cache_flush.
+Note: Requires fat_cache_init. Will allocate a bit per FAT block.
+Note 2: A FAT block is flushed by itself when FAT_DIRTY_LIMIT blocks are dirty.
+Params:
+- fi - Pointer to FS info.
+
+Return 1 if write-back is enabled.
+Return 0 if something goes wrong.
+*/
+int fat_cache_writeback(fat_data_t* fi);
 
 /*
-FAT cache hard load. Will load entier FAT table to RAM via fat_read.
-WARN: This operation really slow. Invoke it before start and only ones.
+Write all dirty FAT blocks to every FAT copy. One disk write per FAT copy per block.
+Note: Does nothing if write-back mode is off.
+Params:
+- fi - Pointer to FS info.
+
+Return 1 if flush success.
+Return 0 if something goes wrong. Failed blocks stay dirty.
+*/
+int fat_cache_flush(fat_data_t* fi);
+
+/* FAT blocks read by one disk call per FAT copy during the hard load. */
+#ifndef FAT_HLOAD_CHUNK
+#define FAT_HLOAD_CHUNK 16
+#endif
+
+/*
+FAT cache hard load of one part of the table. The part is streamed from every FAT copy 
+by FAT_HLOAD_CHUNK blocks, decoded, voted, and stored to the cache and the fat map.
+Note: Parts don't share blocks, thus they can be loaded by different threads.
+Note 2: Already loaded blocks are skipped.
+Note 3: Does nothing for the paged cache.
+Params:
+- part - Part index.
+- parts - Parts count.
+- fi - FS info.
+
+Return 1 if hard load success.
+Return 0 if something goes wrong.
+*/
+int fat_cache_hload_part(int part, int parts, fat_data_t* fi);
+
+/*
+FAT cache hard load. Will load entier FAT table to RAM.
+Note: Same as fat_cache_hload_part with one part.
 Params:
 - fi - FS info.
 
@@ -69,8 +139,20 @@ Return 0 if something goes wrong.
 */
 int fat_cache_hload(fat_data_t* fi);
 
+/*
+Read the whole FAT to fill the free cluster map. With the whole table cache it is the same
+as fat_cache_hload. Otherwise blocks are read by FAT_HLOAD_CHUNK and dropped.
+Params:
+- fi - FS info.
+
+Return 1 if every FAT block was read.
+Return 0 if something goes wrong.
+*/
+int fat_scan(fat_data_t* fi);
+
 /*
 Unload allocated fat cache table.
+Note: Dirty blocks are dropped. Invoke fat_cache_flush before.
 Return 1 if operation success.
 Return 0 if cache was NULL.
 */
@@ -80,6 +162,8 @@ int fat_cache_unload();
 Read 4 bytes from FAT for target cluster.
 Note: Will read data from all copies. Return most freq. data.
 Note 2: Fix bit-errors if major voting works correct.
+Note 3: With fat_checksums the block of the entry is read from the first copy. Other copies 
+        are read and voted only if the block checksum doesn't match.
 Params:
 - ca - Target claster address.
 - fi - FS info.
@@ -91,7 +175,8 @@ cluster_val_t read_fat(cluster_addr_t ca, fat_data_t* fi);
 
 /*
 Write 4 bytes to FAT for target cluster.
-Note: Will sync all FAT copies.
+Note: Will sync all FAT copies. In the write-back mode only the cache is updated.
+Note 2: With fat_checksums the whole block of the entry is written with its checksum.
 Params:
 - ca - Target claster address.
 - fi - FS info.
@@ -101,6 +186,21 @@ Return 0 if something goes wrong.
 */
 int write_fat(cluster_addr_t ca, cluster_status_t value, fat_data_t* fi);
 
+/*
+Link a run of clusters to a chain: every entry points to the next cluster, the last
+entry gets the last value. Entries are written by FAT blocks, one disk call per block
+and FAT copy, instead of one write_fat per entry.
+Params:
+- ca - First cluster of the run.
+- count - Clusters count in the run.
+- last - Value of the last entry (e.g. FAT_CLUSTER_END).
+- fi - FS info.
+
+Return 1 if write success.
+Return 0 if something goes wrong.
+*/
+int write_fat_chain(cluster_addr_t ca, unsigned int count, cluster_status_t last, fat_data_t* fi);
+
 /*
 Check if cluster is free.
 Return 1 if it is free.
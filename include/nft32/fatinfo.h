@@ -30,6 +30,8 @@ typedef struct {
     unsigned int  sectors_padd;
     unsigned char journals_count;
     unsigned char errors_count;
+    unsigned char fat_checksums; // FAT copies store a checksum per FAT sector
+    unsigned char free_map;      // the volume has an area for the free cluster map
 } fat_data_t;
 
 #ifdef __cplusplus
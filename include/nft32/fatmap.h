@@ -12,7 +12,10 @@ Dependencies:
     - std/null.h - NULL definition.
     - std/logging.h - Logging helpers.
     - std/threading.h - Bitmap locks.
+    - std/checksum.h - Free map checksums.
+    - nft32/disk.h - Sector I/O primitives.
     - nft32/errors.h - Error registration.
+    - nft32/corrections.h - Corrected bits counters.
     - nft32/fatinfo.h - FAT filesystem metadata.
 */
 
@@ -27,19 +30,224 @@ extern "C" {
 #include <std/null.h>
 #include <std/logging.h>
 #include <std/threading.h>
+#include <std/checksum.h>
+#include <nft32/disk.h>
 #include <nft32/errors.h>
+#include <nft32/corrections.h>
 #include <nft32/fatinfo.h>
 
 #define BITMAP_NFREE             0x00000000
-#define BITMAP_IS_FREE(val, pos) (!(((val) >> (pos)) & 1))
+#define BITMAP_IS_FREE(val, pos) (((val) >> (pos)) & 1)
 typedef unsigned int bitmap_val_t;
 
 #define BITS_PER_WORD (sizeof(bitmap_val_t) * 8)
 
+/*
+Summary levels over the cluster bitmap. Every level has one bit per word of the level
+below, which is set if the word has a free cluster. Eight levels cover 2^40 clusters.
+Words are changed by atomic operations, thus the map doesn't need a lock. A summary bit
+may be set for an empty word for a moment, the search skips and clears such bits.
+*/
+#define FATMAP_LEVELS 8
+
+/*
+On-disk free map. The first sector holds the encoded header, the encoded bitmap (the first 
+level only) goes from the next sector. The header is clean only while the bitmap matches
+the FAT. It is marked dirty on the first change after the load or the store.
+*/
+#define FREEMAP_MULTIPLIER 2246822519U
+#define GET_FREEMAPSECTOR(ts, sc) (((41 * FREEMAP_MULTIPLIER) >> 7) % (ts - (sc) - 2))
+#define FREEMAP_BYTES(fi)   ((((fi)->total_clusters + BITS_PER_WORD - 1) / BITS_PER_WORD) * sizeof(bitmap_val_t))
+#define FREEMAP_SECTORS(fi) (1 + (nft32_ecc_encoded_size(FREEMAP_BYTES(fi)) + (fi)->bytes_per_sector - 1) / (fi)->bytes_per_sector)
+
+#define FREEMAP_MAGIC 0x50414D46 // FMAP
+#define FREEMAP_DIRTY 0x00
+#define FREEMAP_CLEAN 0x01
+
+/*
+Free space summary of the map. The bucket b of the histogram counts free runs of
+[2^b, 2^(b+1)) clusters, the last bucket counts longer runs too.
+*/
+#define FATMAP_HISTOGRAM 16
+typedef struct {
+    unsigned int free;     // free clusters
+    unsigned int extents;  // runs of free clusters
+    unsigned int largest;  // clusters in the longest free run
+    unsigned int histogram[FATMAP_HISTOGRAM];
+} fatmap_stat_t;
+
+typedef struct {
+    unsigned int  magic;
+    unsigned char state;
+    unsigned int  clusters;
+    unsigned int  free;
+    checksum_t    bitmap_checksum;
+    checksum_t    checksum;
+} __attribute__((packed)) fatmap_header_t;
+
+/*
+Init the free cluster map. A cluster is free in the map only if its FAT entry was seen
+as free, thus the map is filled by FAT reads and writes.
+Params:
+    - `fi` - FAT information.
+
+Returns 1 if succeeds, otherwise will return 0.
+*/
 int fatmap_init(fat_data_t* fi);
+
+/*
+Mark the cluster as free. The stored map area is marked dirty before the first change.
+[Thread-safe]
+
+Params:
+    - `ca` - Cluster address.
+
+Returns 1 if succeeds or the cluster isn't in the map. Returns 0 if the area can't be marked
+dirty, thus the FAT shouldn't be changed.
+*/
 int fatmap_set(unsigned int ca);
+
+/*
+Mark the cluster as used. The stored map area is marked dirty before the first change.
+[Thread-safe]
+
+Params:
+    - `ca` - Cluster address.
+
+Returns 1 if succeeds or the cluster isn't in the map. Returns 0 if the area can't be marked
+dirty, thus the FAT shouldn't be changed.
+*/
 int fatmap_unset(unsigned int ca);
+
+/*
+Mark the stored map area dirty before a FAT change. The FAT is written first, then the map
+bits are changed by fatmap_set and fatmap_unset.
+[Thread-safe]
+
+Returns 1 if the area is dirty or there is no stored map. Returns 0 if the area can't be marked
+dirty, thus the FAT shouldn't be changed.
+*/
+int fatmap_prepare();
+
+/*
+Find the first run of free clusters from the offset. The search skips full words by
+the summary levels, thus it doesn't depend on the count of used clusters.
+Params:
+    - `offset` - First cluster for the search.
+    - `size` - Count of free clusters in a row.
+    - `fi` - FAT information.
+
+Returns the first cluster of the run, or 0 if there is no such run in the map.
+*/
 unsigned int fatmap_find_free(unsigned int offset, int size, fat_data_t* fi);
+
+/*
+Find the first run of free clusters from the offset, which ends before the end cluster.
+Params:
+    - `offset` - First cluster for the search.
+    - `end` - Cluster after the last cluster of the search.
+    - `size` - Count of free clusters in a row.
+    - `fi` - FAT information.
+
+Returns the first cluster of the run, or 0 if there is no such run in the map.
+*/
+unsigned int fatmap_find_free_range(unsigned int offset, unsigned int end, int size, fat_data_t* fi);
+
+/*
+Find the first free cluster from the offset and mark it as used by one atomic operation.
+Two threads never claim the same cluster. The claimed cluster should be written to the FAT
+as used, or released with fatmap_set.
+[Thread-safe]
+
+Params:
+    - `offset` - First cluster for the search.
+    - `end` - Cluster after the last cluster of the search.
+    - `fi` - FAT information.
+
+Returns the claimed cluster, or 0 if there is no free cluster in the map or the stored map
+area can't be marked dirty.
+*/
+unsigned int fatmap_claim_free(unsigned int offset, unsigned int end, fat_data_t* fi);
+
+/*
+Mark the run of free clusters as used. Either the whole run is claimed, or nothing.
+[Thread-safe]
+
+Params:
+    - `ca` - First cluster of the run.
+    - `count` - Count of clusters in the run.
+
+Returns 1 if the run is claimed, otherwise (a used cluster in the run, or the stored map area
+can't be marked dirty) will return 0.
+*/
+int fatmap_claim(unsigned int ca, unsigned int count);
+
+/*
+Load the map from the free map area of the volume. Only a clean area with the right checksums
+is loaded. Otherwise the area is marked dirty, and the map should be filled from the FAT and 
+stored with fatmap_store. If the FAT can't be read, the map should be unloaded.
+Params:
+    - `fi` - FAT information.
+
+Returns 1 if the map is loaded, otherwise will return 0.
+*/
+int fatmap_load(fat_data_t* fi);
+
+/*
+Store the map to the free map area and mark the area clean. Does nothing if the area is clean
+already, or the volume has no free map area.
+Note: Call it after FAT changes are on the disk (after the FAT cache flush).
+Params:
+    - `fi` - FAT information.
+
+Returns 1 if succeeds, otherwise will return 0.
+*/
+int fatmap_store(fat_data_t* fi);
+
+/*
+Mark the free map area of the volume dirty, if the map isn't loaded from it. A mount without
+the loaded map changes the FAT without the map, thus the next MAP_CACHE mount should rebuild
+the stored map. Does nothing if the volume has no free map area.
+Note: Call it on the mount before any FAT change.
+Params:
+    - `fi` - FAT information.
+
+Returns 1 if succeeds, otherwise will return 0.
+*/
+int fatmap_invalidate(fat_data_t* fi);
+
+/*
+Mark the map as complete, i.e. every FAT entry was seen by the map. It is done after the 
+hard load, the load of the free map area, or the full FAT scan.
+Returns 1 if succeeds, or 0 if there is no map.
+*/
+int fatmap_complete();
+
+/*
+Get the free space summary. The free count is kept by every change of the map, 
+thus it is taken without a search. Runs are found by the summary levels.
+Doesn't read the disk.
+[Thread-safe]
+
+Params:
+    - `st` - Output summary.
+
+Returns 1 if succeeds, 0 if the map isn't complete, or -1 if there is no map.
+*/
+int fatmap_stat(fatmap_stat_t* st);
+
+/*
+Add the free run to the summary.
+Params:
+    - `st` - Summary.
+    - `length` - Clusters in the run.
+*/
+void fatmap_stat_add_run(fatmap_stat_t* st, unsigned int length);
+
+/*
+Free the map.
+Returns 1 if succeeds, otherwise will return 0.
+*/
 int fatmap_unload();
 
 #ifdef __cplusplus
@@ -0,0 +1,98 @@
+/*
+License:
+    MIT License. See LICENSE file in project root.
+    Copyright (c) 2025 Nikolay
+
+Description:
+    Fixed set of FAT cache pages with CLOCK eviction. A page holds the decoded
+    entries of one FAT block. Used by the FAT cache when the whole table doesn't
+    fit to the memory budget.
+
+Dependencies:
+    - std/mm.h - Filesystem memory manager.
+    - std/str.h - Memory helpers.
+    - std/null.h - NULL definition.
+    - std/logging.h - Logging helpers.
+    - nft32/errors.h - Error registration.
+    - nft32/fatinfo.h - FAT filesystem metadata.
+*/
+
+#ifndef FATPAGE_H_
+#define FATPAGE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <std/mm.h>
+#include <std/str.h>
+#include <std/null.h>
+#include <std/logging.h>
+#include <nft32/errors.h>
+#include <nft32/fatinfo.h>
+
+#define FATPAGE_EMPTY 0xFFFFFFFF
+
+typedef struct {
+    unsigned int  block; /* FAT block in the page or FATPAGE_EMPTY */
+    int           next;  /* Next page in the hash bucket or -1     */
+    unsigned char ref;   /* CLOCK reference bit                    */
+} fat_page_t;
+
+/* RAM for one page with the given entries count, including the lookup structures. */
+#define FATPAGE_COST(entries) ((entries) * sizeof(unsigned int) + sizeof(fat_page_t) + sizeof(int))
+
+/*
+Allocate pages.
+Params:
+- `pages` - Pages count.
+- `entries` - Entries in a page.
+- `fi` - FS info.
+
+Return 1 if init success.
+Return 0 if something goes wrong.
+*/
+int fatpage_init(unsigned int pages, unsigned int entries, fat_data_t* fi);
+
+/*
+Get the page of the block.
+Note: Sets the reference bit of the page.
+Params:
+- `block` - FAT block.
+
+Return pointer to the page entries.
+Return NULL if the block isn't present.
+*/
+unsigned int* fatpage_get(unsigned int block);
+
+/*
+Select a page for a new block by the CLOCK algorithm. Free pages are selected first.
+Note: The page keeps the old block until fatpage_bind. The caller should save the old
+      block content if it is dirty.
+Params:
+- `block` - Output of the block in the selected page. FATPAGE_EMPTY if the page is free.
+
+Return pointer to the page entries.
+*/
+unsigned int* fatpage_victim(unsigned int* block);
+
+/*
+Bind the page to the block.
+Params:
+- `page` - Page entries from fatpage_victim.
+- `block` - New FAT block. FATPAGE_EMPTY makes the page free.
+
+Return 1 if bind success.
+Return 0 if page is unknown.
+*/
+int fatpage_bind(unsigned int* page, unsigned int block);
+
+/*
+Free pages.
+Return 1.
+*/
+int fatpage_unload();
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -14,6 +14,7 @@ Dependencies:
     - nft32/fat.h - Cluster types.
     - nft32/disk.h - Sector I/O primitives.
     - nft32/errors.h - Error registration.
+    - nft32/corrections.h - Corrected bits counters.
     - nft32/cluster.h - Cluster I/O utilities.
     - nft32/fatinfo.h - FAT filesystem metadata.
 */
@@ -31,6 +32,7 @@ extern "C" {
 #include <nft32/fat.h>
 #include <nft32/disk.h>
 #include <nft32/errors.h>
+#include <nft32/corrections.h>
 #include <nft32/cluster.h>
 #include <nft32/fatinfo.h>
 
@@ -68,6 +70,9 @@ typedef struct {
     checksum_t       checksum;
 } __attribute__((packed)) journal_entry_t;
 
+/* Count of encoded journal entries in one journal cluster. Depends on the volume ECC codec. */
+#define JOURNAL_ENTRIES(fi) ((fi)->cluster_size / nft32_ecc_encoded_size(sizeof(journal_entry_t)))
+
 /*
 Restore all saved actions from journal. Will restore cluster_size / sizeof(journal_entry_t) actions.
 Params:
@@ -4,10 +4,15 @@ License:
     Copyright (c) 2025 Nikolay
 
 Description:
-    Checksum type and Murmur3 x86 32-bit checksum function.
+    Checksum type and Murmur3 x86 32-bit checksum function. The streaming API (init/update/final)
+    gives the same result as the one-shot function and lets callers hash data by parts or
+    save the state after a common prefix.
+    Volume checksums (entries, boot sector, journal) go through nft32_checksum_*. The algorithm
+    is selected per volume: murmur3 (old images) or CRC32C (hardware accelerated, see std/crc32c.h).
+    Name hashes always use murmur3.
 
 Dependencies:
-    - None.
+    - std/crc32c.h - CRC32C kernels.
 */
 
 #ifndef CHECKSUM_H_
@@ -16,9 +21,90 @@ Dependencies:
 extern "C" {
 #endif
 
+#include <std/crc32c.h>
+
 typedef unsigned int checksum_t;
 checksum_t nft32_murmur3_x86_32(const unsigned char* key, unsigned int len, unsigned int seed);
 
+typedef struct {
+    unsigned int  h1;       // running hash
+    unsigned int  len;      // total hashed length
+    unsigned int  tail;     // pending bytes of an incomplete block
+    unsigned char tail_len; // count of pending bytes
+} murmur3_state_t;
+
+/*
+Init the streaming hasher.
+Params:
+- state - Hasher state.
+- seed - Hash seed.
+
+Return 1.
+*/
+int nft32_murmur3_init(murmur3_state_t* state, unsigned int seed);
+
+/*
+Hash the next part of data. Parts can have any length.
+Params:
+- state - Hasher state.
+- key - Data part.
+- len - Data part length.
+
+Return 1.
+*/
+int nft32_murmur3_update(murmur3_state_t* state, const unsigned char* key, unsigned int len);
+
+/*
+Finish hashing. The state isn't modified, thus a saved prefix state can be finished
+several times with different suffixes (copy the state before update).
+Params:
+- state - Hasher state.
+
+Return hash of all data passed to nft32_murmur3_update.
+*/
+checksum_t nft32_murmur3_final(const murmur3_state_t* state);
+
+#define CHECKSUM_MURMUR3 0
+#define CHECKSUM_CRC32C  1
+
+typedef struct {
+    murmur3_state_t murmur3; // CHECKSUM_MURMUR3 state
+    unsigned int    crc;     // CHECKSUM_CRC32C state
+} checksum_state_t;
+
+/*
+Select the volume checksum algorithm.
+Params:
+- algorithm - CHECKSUM_* value.
+
+Return 1 if the algorithm was selected.
+Return 0 if the algorithm is unknown. In this case the current algorithm isn't changed.
+*/
+int nft32_checksum_setup(int algorithm);
+
+/*
+Return the current CHECKSUM_* value.
+*/
+int nft32_checksum_algorithm();
+
+/*
+Calculate the volume checksum of data.
+Params:
+- key - Data.
+- len - Data length.
+
+Return checksum.
+*/
+checksum_t nft32_checksum(const unsigned char* key, unsigned int len);
+
+/*
+Streaming version of nft32_checksum. Works the same way as nft32_murmur3_init/update/final.
+The state should be finished with the same algorithm that was used for init.
+*/
+int nft32_checksum_init(checksum_state_t* state);
+int nft32_checksum_update(checksum_state_t* state, const unsigned char* key, unsigned int len);
+checksum_t nft32_checksum_final(const checksum_state_t* state);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,67 @@
+/*
+License:
+    MIT License. See LICENSE file in project root.
+    Copyright (c) 2025 Nikolay
+
+Description:
+    CRC32C (Castagnoli) with hardware kernels. SSE4.2 on x86 is selected at runtime,
+    the ARMv8 CRC extension is used when the compiler targets it. The table-driven
+    software kernel is the fallback.
+
+Dependencies:
+    - None.
+*/
+
+#ifndef CRC32C_H_
+#define CRC32C_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(NIFAT32_NO_SIMD)
+    #define NIFAT32_CRC32C_SSE42
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32) && !defined(NIFAT32_NO_SIMD)
+    #define NIFAT32_CRC32C_ARMV8
+#endif
+
+#define CRC32C_KERNEL_AUTO  0
+#define CRC32C_KERNEL_SW    1
+#define CRC32C_KERNEL_SSE42 2
+#define CRC32C_KERNEL_ARMV8 3
+
+#define CRC32C_INIT 0xFFFFFFFFU
+
+/*
+Select the CRC32C kernel.
+Note: With CRC32C_KERNEL_AUTO will pick the hardware kernel if the CPU supports it.
+Params:
+- kernel - CRC32C_KERNEL_* value.
+
+Return 1 if the kernel was selected.
+Return 0 if the kernel isn't supported. In this case the current kernel isn't changed.
+*/
+int nft32_crc32c_setup(int kernel);
+
+/*
+Return the current CRC32C_KERNEL_* value.
+*/
+int nft32_crc32c_kernel();
+
+/*
+Update the running CRC32C value. Start from CRC32C_INIT and invert the result
+(~crc) after the last update.
+Params:
+- crc - Running CRC value.
+- key - Data.
+- len - Data length.
+
+Return the new running CRC value.
+*/
+unsigned int nft32_crc32c_update(unsigned int crc, const unsigned char* key, unsigned int len);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -4,10 +4,11 @@ License:
     Copyright (c) 2025 Nikolay
 
 Description:
-    FAT 8.3 name and path conversion helpers.
+    FAT 8.3 name and path conversion helpers. Hashed 8.3 name type.
 
 Dependencies:
     - std/str.h - String helpers.
+    - std/checksum.h - Name hash.
 */
 
 #ifndef FATNAME_H_
@@ -17,8 +18,16 @@ extern "C" {
 #endif
 
 #include <std/str.h>
+#include <std/checksum.h>
 
 #define PATH_SPLITTER '/'
+#define FATNAME_SIZE  11
+
+/* 8.3 name with its hash. The name is hashed once per operation and passed down as is. */
+typedef struct {
+    const char* name; // 8.3 name, FATNAME_SIZE bytes
+    checksum_t  hash;
+} hashed_name_t;
 
 /*
 Convert fatname 8.3 to default name and ext.
@@ -87,6 +96,16 @@ Return 1.
 */
 int unpack_83_name(const char* name83, char* name, char* ext);
 
+/*
+Hash 8.3 name.
+Params:
+- name83 - 8.3 name. Should live as long as the hashed name.
+- hn - Hashed name.
+
+Return 1.
+*/
+int nft32_hash_fatname(const char* name83, hashed_name_t* hn);
+
 #ifdef __cplusplus
 }
 #endif
@@ -5,6 +5,13 @@ License:
 
 Description:
     Hamming 15,11 encode/decode helpers and bit macros.
+    Encoding and decoding are table-driven. By default there is a 256-entry encode table
+    and a syndrome table per codeword byte. Build with 'NIFAT32_HAMMING_NIBBLE' to use
+    16-entry nibble tables instead (less than 200 bytes of tables for flash-constrained MCUs).
+    Bulk pack/unpack goes through a kernel dispatch table. On x86 SSE2, AVX2 and BMI2 kernels
+    can be selected with nft32_hamming_setup(). The scalar codec is the fallback.
+    Metadata goes through the ECC codec interface (nft32_ecc_*). The codec is selected
+    per volume: Hamming 15,11 (2x size) or SECDED 39,32 (1.25x size, see std/secded.h).
 
 Dependencies:
     - None.
@@ -24,6 +31,42 @@ typedef unsigned char  byte_t;
 typedef unsigned short encoded_t;
 typedef unsigned short decoded_t;
 
+#define HAMMING_KERNEL_AUTO   0
+#define HAMMING_KERNEL_SCALAR 1
+#define HAMMING_KERNEL_SSE2   2
+#define HAMMING_KERNEL_AVX2   3
+#define HAMMING_KERNEL_BMI2   4
+
+typedef struct {
+    int   kernel;
+    int   (*unpack)(const encoded_t*, byte_t*, int, int*);
+    void* (*pack)(const byte_t*, encoded_t*, int);
+} hamming_kernel_t;
+
+/*
+Select the pack/unpack kernel. Should be invoked once before any other work (NIFAT32_init does it).
+Note: With HAMMING_KERNEL_AUTO will pick the fastest kernel that the CPU supports.
+Params:
+- kernel - HAMMING_KERNEL_* value.
+
+Return 1 if the kernel was selected.
+Return 0 if the kernel isn't supported. In this case the current kernel isn't changed.
+*/
+int nft32_hamming_setup(int kernel);
+
+/*
+Return the current HAMMING_KERNEL_* value.
+*/
+int nft32_hamming_kernel();
+
+/*
+Scalar (table-driven) versions of nft32_unpack_memory_count and nft32_pack_memory.
+Used as a fallback by the bulk kernels.
+Note: Unpack kernels set first only if there is at least one corrected codeword.
+*/
+int nft32_unpack_memory_scalar(const encoded_t* src, byte_t* dst, int l, int* first);
+void* nft32_pack_memory_scalar(const byte_t* src, encoded_t* dst, int l);
+
 /*
 Unpack memory function should decode src pointed data from hamming 15,11 (With error correction).
 P.S. Before usage, allocate dst memory with size, same as count of elements in src.
@@ -37,6 +80,18 @@ Return pointer to dst.
 */
 void* nft32_unpack_memory(const encoded_t* src, byte_t* dst, int l);
 
+/*
+Same as nft32_unpack_memory, but also reports the codewords with a corrected bit.
+Params:
+- src - Source encoded data.
+- dst - Destination for decoded data.
+- l - Element count.
+- first - Index of the first corrected codeword or -1. Can be NULL.
+
+Return the count of corrected codewords.
+*/
+int nft32_unpack_memory_count(const encoded_t* src, byte_t* dst, int l, int* first);
+
 /*
 Pack memory function should encode src pointed data to hamming 15,11.
 P.S. Before usage, allocate dst memory with size, same as count of elements in src.
@@ -50,6 +105,74 @@ Return pointer to dst.
 */
 void* nft32_pack_memory(const byte_t* src, decoded_t* dst, int l);
 
+#define ECC_HAMMING_15_11 0
+#define ECC_SECDED_39_32  1
+
+/* Upper bound of the encoded size for every codec. Use it for stack buffers. */
+#define ECC_MAX_ENCODED_SIZE(l) ((l) * sizeof(encoded_t))
+
+typedef struct {
+    int   codec;
+    int   data_block;    // decoded bytes in one block
+    int   encoded_block; // encoded bytes in one block
+    int   (*unpack)(const byte_t*, byte_t*, int, int*);
+    void* (*pack)(const byte_t*, byte_t*, int);
+} ecc_codec_t;
+
+/*
+Select the metadata ECC codec. NIFAT32_init does it with the codec from the boot sector.
+Note: The boot sector itself is always encoded with Hamming 15,11.
+Params:
+- codec - ECC_* value.
+
+Return 1 if the codec was selected.
+Return 0 if the codec is unknown. In this case the current codec isn't changed.
+*/
+int nft32_ecc_setup(int codec);
+
+/*
+Return the current ECC_* value.
+*/
+int nft32_ecc_codec();
+
+/*
+Get the encoded size of data with the current codec.
+Params:
+- l - Decoded data size in bytes.
+
+Return the encoded size in bytes. The last block is padded.
+*/
+int nft32_ecc_encoded_size(int l);
+
+/*
+Return the data block size of the current codec in bytes. The first index from
+nft32_ecc_unpack multiplied by this value is the byte offset of the block.
+*/
+int nft32_ecc_data_block();
+
+/*
+Decode metadata with the current codec (With error correction).
+Params:
+- src - Source encoded data. Should be nft32_ecc_encoded_size(l) bytes.
+- dst - Destination for decoded data.
+- l - Decoded data size in bytes.
+- first - Index of the first codeword (block) with an error or -1. Can be NULL.
+
+Return the count of codewords with an error.
+*/
+int nft32_ecc_unpack(const byte_t* src, byte_t* dst, int l, int* first);
+
+/*
+Encode metadata with the current codec.
+Params:
+- src - Source data.
+- dst - Destination for encoded data. Should fit nft32_ecc_encoded_size(l) bytes.
+- l - Source data size in bytes.
+
+Return pointer to dst.
+*/
+void* nft32_ecc_pack(const byte_t* src, byte_t* dst, int l);
+
 #ifdef __cplusplus
 }
 #endif
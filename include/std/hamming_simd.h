@@ -0,0 +1,48 @@
+/*
+License:
+    MIT License. See LICENSE file in project root.
+    Copyright (c) 2025 Nikolay
+
+Description:
+    x86 bulk Hamming 15,11 kernels (SSE2, AVX2, BMI2). The kernels are selected at runtime
+    by nft32_hamming_setup() and fall back to the scalar table codec on blocks with errors.
+
+Dependencies:
+    - std/hamming.h - Encoded data types and scalar codec.
+*/
+
+#ifndef HAMMING_SIMD_H_
+#define HAMMING_SIMD_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <std/hamming.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(NIFAT32_NO_SIMD)
+    #define NIFAT32_HAMMING_SIMD
+#endif
+
+#ifdef NIFAT32_HAMMING_SIMD
+/*
+Check CPU (and OS) support for the kernel.
+Params:
+- kernel - HAMMING_KERNEL_SSE2, HAMMING_KERNEL_AVX2 or HAMMING_KERNEL_BMI2.
+
+Return 1 if the kernel can be used on this CPU.
+Return 0 if it can't.
+*/
+int nft32_hamming_simd_supported(int kernel);
+
+int nft32_unpack_memory_sse2(const encoded_t* src, byte_t* dst, int l, int* first);
+void* nft32_pack_memory_sse2(const byte_t* src, encoded_t* dst, int l);
+int nft32_unpack_memory_avx2(const encoded_t* src, byte_t* dst, int l, int* first);
+void* nft32_pack_memory_avx2(const byte_t* src, encoded_t* dst, int l);
+int nft32_unpack_memory_bmi2(const encoded_t* src, byte_t* dst, int l, int* first);
+void* nft32_pack_memory_bmi2(const byte_t* src, encoded_t* dst, int l);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,52 @@
+/*
+License:
+    MIT License. See LICENSE file in project root.
+    Copyright (c) 2025 Nikolay
+
+Description:
+    SECDED Hamming 39,32 codec. Every 32-bit word is stored as a 5-byte block (39 code bits
+    and one zero bit), so metadata takes 1.25x instead of 2x of the Hamming 15,11 codec.
+    A single flipped bit in a block is corrected, two flipped bits are detected.
+
+Dependencies:
+    - std/hamming.h - Encoded data types.
+*/
+
+#ifndef SECDED_H_
+#define SECDED_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <std/hamming.h>
+
+#define SECDED_DATA_BLOCK    4
+#define SECDED_ENCODED_BLOCK 5
+
+/*
+Decode data from SECDED 39,32 blocks (With error correction).
+Params:
+- src - Source encoded data. Should contain (l + 3) / 4 blocks.
+- dst - Destination for decoded data.
+- l - Decoded data size in bytes.
+- first - Index of the first block with an error. Set only if there is at least one.
+
+Return the count of blocks with an error (corrected or detected).
+*/
+int nft32_secded_unpack(const byte_t* src, byte_t* dst, int l, int* first);
+
+/*
+Encode data to SECDED 39,32 blocks. The last block is padded with zeros.
+Params:
+- src - Source data.
+- dst - Destination for encoded data. Should fit (l + 3) / 4 blocks.
+- l - Source data size in bytes.
+
+Return pointer to dst.
+*/
+void* nft32_secded_pack(const byte_t* src, byte_t* dst, int l);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -9,6 +9,64 @@ int NIFAT32_get_fs_data(fat_data_t* d) {
     return 1;
 }
 
+int NIFAT32_get_corrections(corrections_t* c, int reset) {
+    corrections_get(c);
+    if (reset) corrections_reset();
+    return 1;
+}
+
+int NIFAT32_statfs(nifat32_statfs_t* st) {
+    print_log("NIFAT32_statfs()");
+    fatmap_stat_t map;
+    int stat = fatmap_stat(&map);
+    if (!stat) {
+        /* Every FAT entry is seen by the scan, thus the map is complete after it. */
+        if (!fat_scan(&_fs_data)) {
+            print_error("fat_scan() error!");
+            return 0;
+        }
+
+        fatmap_complete();
+        stat = fatmap_stat(&map);
+    }
+
+    if (stat < 0) {
+        cluster_addr_t run = 0;
+        for (cluster_addr_t ca = _fs_data.ext_root_cluster; ca < _fs_data.total_clusters; ca++) {
+            if (is_cluster_free(read_fat(ca, &_fs_data))) {
+                map.free++;
+                run++;
+            }
+            else {
+                fatmap_stat_add_run(&map, run);
+                run = 0;
+            }
+        }
+
+        fatmap_stat_add_run(&map, run);
+    }
+    else if (stat == 0) {
+        print_error("fatmap_stat() error!");
+        return 0;
+    }
+
+    st->cluster_size        = _fs_data.cluster_size;
+    st->total_clusters      = _fs_data.total_clusters - _fs_data.ext_root_cluster;
+    st->free_clusters       = map.free;
+    st->used_clusters       = st->total_clusters - map.free;
+    st->free_extents        = map.extents;
+    st->largest_free_extent = map.largest;
+    st->fragmentation       = map.free ? (unsigned int)(100ULL * (map.free - map.largest) / map.free) : 0;
+    nft32_str_memcpy(st->extents_histogram, map.histogram, sizeof(map.histogram));
+    return 1;
+}
+
+int NIFAT32_get_sector_cache_stat(sector_cache_stat_t* st, int reset) {
+    int result = DSK_cache_stat(st);
+    if (reset) DSK_cache_stat_reset();
+    return result;
+}
+
 int NIFAT32_init(nifat32_params_t* params) {
     LOG_setup(params->logg_io.fd_fprintf, params->logg_io.fd_vfprintf);
     print_log("NIFAT32 init. Reading %i bootsector at sa=%i", params->bs_num, GET_BOOTSECTOR(params->bs_num, params->ts));
@@ -19,12 +77,21 @@ int NIFAT32_init(nifat32_params_t* params) {
 
     nft32_setup_mm_manager(params->mm_manager.init, params->mm_manager.malloc, params->mm_manager.free);
     nft32_mm_init();
+    nft32_hamming_setup(HAMMING_KERNEL_AUTO);
+    print_log("Hamming kernel: %i", nft32_hamming_kernel());
+    nft32_crc32c_setup(CRC32C_KERNEL_AUTO);
+    print_log("CRC32C kernel: %i", nft32_crc32c_kernel());
 
-    if (!DSK_setup(params->disk_io.read_sector, params->disk_io.write_sector, params->disk_io.sector_size)) {
+    if (!DSK_setup(&params->disk_io)) {
         print_error("DSK_setup() error!");
         return 0;
     }
 
+    if (!DSK_cache_init(params->sector_cache_size, params->sector_cache_mode)) {
+        print_error("DSK_cache_init() error!");
+        return 0;
+    }
+
     _fs_data.errors_count = params->ec;
     if (_fs_data.errors_count && !errors_setup(&_fs_data)) {
         print_error("errors_register_error() error!");
@@ -40,15 +107,24 @@ int NIFAT32_init(nifat32_params_t* params) {
     }
 
     nifat32_bootsector_t bootstruct;
-    nft32_unpack_memory((encoded_t*)&encoded_bs, (byte_t*)&bootstruct, sizeof(nifat32_bootsector_t));
+    corrections_unpack(CORRECTIONS_BOOT, params->bs_num, 0, (const byte_t*)&encoded_bs, (byte_t*)&bootstruct, sizeof(nifat32_bootsector_t));
+
+    /* The checksum algorithm flags are verified by the checksum itself. A wrong algorithm
+       gives a checksum mismatch and the next boot sector is used. */
+    if (!nft32_checksum_setup(GET_BS_CHECKSUM(bootstruct.extended_section.extended_flags))) {
+        print_error("Unknown checksum algorithm=%i in boot sector!", GET_BS_CHECKSUM(bootstruct.extended_section.extended_flags));
+        params->bs_num++;
+        errors_register_error(CHECKSUM_CHECK_ERROR, &_fs_data);
+        return NIFAT32_init(params);
+    }
 
     checksum_t bcheck = bootstruct.checksum;
     bootstruct.checksum = 0;
     checksum_t exbcheck = bootstruct.extended_section.checksum;
     bootstruct.extended_section.checksum = 0;
 
-    bootstruct.extended_section.checksum = nft32_murmur3_x86_32((buffer_t)&bootstruct.extended_section, sizeof(nifat32_ext32_bootsector_t), 0);
-    bootstruct.checksum = nft32_murmur3_x86_32((buffer_t)&bootstruct, sizeof(nifat32_bootsector_t), 0);
+    bootstruct.extended_section.checksum = nft32_checksum((buffer_t)&bootstruct.extended_section, sizeof(nifat32_ext32_bootsector_t));
+    bootstruct.checksum = nft32_checksum((buffer_t)&bootstruct, sizeof(nifat32_bootsector_t));
     if (bootstruct.checksum != bcheck || bootstruct.extended_section.checksum != exbcheck) {
         print_error(
             "Checksum check error! [bootstruct=%u != %u] or [ext_bootstruct=%u != %u]. Moving to reserved sector!", 
@@ -64,10 +140,17 @@ int NIFAT32_init(nifat32_params_t* params) {
         bootstruct.extended_section.checksum = exbcheck;
     }
 
+    if (!nft32_ecc_setup(GET_BS_ECC(bootstruct.extended_section.extended_flags))) {
+        print_error("Unknown ECC codec=%i in boot sector!", GET_BS_ECC(bootstruct.extended_section.extended_flags));
+        return 0;
+    }
+
     _fs_data.journals_count = params->jc;
     _fs_data.fat_count      = bootstruct.table_count;
     _fs_data.total_sectors  = bootstruct.total_sectors_32;
     _fs_data.fat_size       = bootstruct.extended_section.table_size_32;
+    _fs_data.fat_checksums  = GET_BS_FAT_CHECKSUM(bootstruct.extended_section.extended_flags);
+    _fs_data.free_map       = GET_BS_FREE_MAP(bootstruct.extended_section.extended_flags);
 
     print_info("| NIFAT32 image load! Base information:");
     print_info("| Sectors per cluster: %i", bootstruct.sectors_per_cluster);
@@ -103,6 +186,10 @@ int NIFAT32_init(nifat32_params_t* params) {
     print_info("| First data sector:       %u", _fs_data.first_data_sector);
     print_info("| Root cluster (FAT32):    %u", _fs_data.ext_root_cluster);
     print_info("| Cluster size (in bytes): %u", _fs_data.cluster_size);
+    print_info("| Metadata ECC codec:      %i", nft32_ecc_codec());
+    print_info("| Checksum algorithm:      %i", nft32_checksum_algorithm());
+    print_info("| FAT sector checksums:    %i", _fs_data.fat_checksums);
+    print_info("| Free map area:           %i", _fs_data.free_map);
 
     if (params->bs_num > 0) {
         print_warn("%i of boot sector records are incorrect. Attempt to fix...", params->bs_num);
@@ -114,24 +201,63 @@ int NIFAT32_init(nifat32_params_t* params) {
         }
     }
 
+    /* A mount without the map marks the stored map dirty before the first FAT access. */
+    int map_cache = (params->fat_cache & CACHE) && (params->fat_cache & MAP_CACHE);
+    if (!map_cache && !fatmap_invalidate(&_fs_data)) {
+        print_error("Can't mark the free map area dirty!");
+        return 0;
+    }
+
     if (params->fat_cache & CACHE) {
-        if (!fat_cache_init(&_fs_data)) {
+        if (!fat_cache_init(params->fat_cache_size, &_fs_data)) {
             print_warn("FAT cache init error!");
         }
 
+        /* The map is filled by every FAT read, thus it is set before the hard load. 
+           A dirty free map area is rebuilt by the whole FAT read. */
+        if (params->fat_cache & MAP_CACHE) {
+            if (!fatmap_init(&_fs_data)) {
+                print_warn("FAT map cache init error!");
+            }
+            else if (_fs_data.free_map && !fatmap_load(&_fs_data)) {
+                print_warn("Free map isn't clean. Rebuilding from the FAT...");
+                if (!fat_scan(&_fs_data)) {
+                    print_warn("FAT read error! The free map is dropped.");
+                    fatmap_unload();
+                }
+                else {
+                    fatmap_complete();
+                    if (!fatmap_store(&_fs_data)) print_warn("Free map store error!");
+                }
+            }
+            else if (_fs_data.free_map) {
+                fatmap_complete();
+            }
+        }
+
         if (params->fat_cache & HARD_CACHE) {
             if (!fat_cache_hload(&_fs_data)) {
                 print_warn("FAT hard cache init error!");
             }
         }
 
-        if (params->fat_cache & MAP_CACHE) {
-            if (!fatmap_init(&_fs_data)) {
-                print_warn("FAT map cache init error!");
+        if (params->fat_cache & WRITE_BACK_CACHE) {
+            if (!fat_cache_writeback(&_fs_data)) {
+                print_warn("FAT write-back cache init error!");
             }
         }
     }
 
+    /* The map isn't loaded or its load failed, thus FAT changes don't reach the stored map. */
+    if (map_cache && !fatmap_invalidate(&_fs_data)) {
+        print_error("Can't mark the free map area dirty!");
+        return 0;
+    }
+
+    if (!alloc_groups_init(&_fs_data)) {
+        print_warn("Allocation groups init error!");
+    }
+
     if (!ctable_init()) {
         print_warn("Ctable init error!");
     }
@@ -143,6 +269,11 @@ int NIFAT32_init(nifat32_params_t* params) {
     return 1;
 }
 
+int NIFAT32_hload_fat(int part, int parts) {
+    print_log("NIFAT32_hload_fat(part=%i, parts=%i)", part, parts);
+    return fat_cache_hload_part(part, parts, &_fs_data);
+}
+
 int NIFAT32_repair_bootsectors() {
     nifat32_bootsector_t bs = { .bootjmp = { 0xEB, 0x5B, 0x9 }, .media_type = 0xF8, .sectors_per_track = 63, .head_side_count = 255 };
     nft32_str_memcpy(bs.oem_name, "recover ", 8);
@@ -155,11 +286,14 @@ int NIFAT32_repair_bootsectors() {
     nifat32_ext32_bootsector_t ext = { .boot_signature = 0x5A, .drive_number = 0x8, .volume_id = 0x1234 };
     ext.table_size_32 = _fs_data.fat_size;
     ext.root_cluster  = _fs_data.ext_root_cluster;
+    ext.extended_flags = (nft32_ecc_codec() & BS_ECC_MASK) | ((nft32_checksum_algorithm() << BS_CHECKSUM_SHIFT) & BS_CHECKSUM_MASK);
+    if (_fs_data.fat_checksums) ext.extended_flags |= BS_FAT_CHECKSUM;
+    if (_fs_data.free_map) ext.extended_flags |= BS_FREE_MAP;
     nft32_str_memcpy(ext.volume_label, "ROOT_LABEL ", 11);
     nft32_str_memcpy(ext.fat_type_label, "NIFAT32 ", 8);
-    ext.checksum = nft32_murmur3_x86_32((buffer_t)&ext, sizeof(ext), 0);
+    ext.checksum = nft32_checksum((buffer_t)&ext, sizeof(ext));
     nft32_str_memcpy(&bs.extended_section, &ext, sizeof(ext));
-    bs.checksum = nft32_murmur3_x86_32((buffer_t)&bs, sizeof(bs), 0);
+    bs.checksum = nft32_checksum((buffer_t)&bs, sizeof(bs));
 
     const_buffer_t encoded_bs[sizeof(nifat32_bootsector_t)];
     nft32_pack_memory((const byte_t*)&bs, (decoded_t*)encoded_bs, sizeof(bs));
@@ -202,13 +336,16 @@ static cluster_addr_t _get_cluster_by_path(
             nft32_str_memcpy(name_buffer, path + start, iterator - start);
             nft32_name_to_fatname(name_buffer, fatname_buffer);
 
+            hashed_name_t name;
+            nft32_hash_fatname(fatname_buffer, &name);
+
             ecache_t* entry_index = get_content_ecache(curr_ci);
-            if (!entry_search(fatname_buffer, active_cluster, entry_index, &current_entry, &_fs_data)) {
+            if (!entry_search(&name, active_cluster, entry_index, &current_entry, &_fs_data)) {
                 if (IS_CREATE_MODE(mode)) {
                     cluster_addr_t nca = alloc_cluster(&_fs_data);
-                    if (set_cluster_end(nca, &_fs_data)) {
+                    if (!is_cluster_bad(nca)) {
                         create_entry(
-                            fatname_buffer, path[iterator] || GET_MODE_TARGET(mode) != FILE_TARGET, 
+                            &name, path[iterator] || GET_MODE_TARGET(mode) != FILE_TARGET, 
                             nca, _fs_data.cluster_size, &current_entry
                         );
 
@@ -219,8 +356,8 @@ static cluster_addr_t _get_cluster_by_path(
                         }
                     }
                     else {
-                        print_error("set_cluster_end() error!");
-                        errors_register_error(SET_CLUSTER_END_ERROR, &_fs_data);
+                        print_error("alloc_cluster() error!");
+                        errors_register_error(CLUSTER_ALLOCATION_ERROR, &_fs_data);
                         return FAT_CLUSTER_BAD;
                     }
                 }
@@ -298,93 +435,83 @@ int NIFAT32_read_content2buffer(const ci_t ci, cluster_offset_t offset, buffer_t
         return 0;
     }
 
-    int total_readden = 0;
-    cluster_addr_t ca = get_content_data_ca(ci);
-    do {
-        if (offset > _fs_data.cluster_size) offset -= _fs_data.cluster_size;
-        else {
-            int readeble = (buff_size > (int)(_fs_data.cluster_size - offset)) ? (int)(_fs_data.cluster_size - offset) : buff_size;
-            if (!readoff_cluster(ca, offset, buffer + total_readden, readeble, &_fs_data)) {
-                print_error("readoff_cluster() error. Aborting...");
-                errors_register_error(READOFF_CLUSTER_ERROR, &_fs_data);
-                return 0;
-            }
-
-            offset = 0;
-            buff_size -= readeble;
-            total_readden += readeble;
-        }
+    /* Small sequential reads are served from the read-ahead window of the content. */
+    int readahead = read_content_ahead(ci, offset, buffer, buff_size, &_fs_data);
+    if (readahead > 0) return readahead;
 
-        ca = read_fat(ca, &_fs_data);
-    } while (!is_cluster_end(ca) && !is_cluster_bad(ca) && buff_size > 0);
+    /* The first cluster is taken from the extent map of the chain, not by a chain walk.
+       Clusters that follow each other on disk are read by one transfer, and transfers
+       go in flight by batches. */
+    cluster_batch_t batch;
+    cluster_batch_init(&batch);
+    int total_readden = 0;
+    unsigned int index = offset / _fs_data.cluster_size;
+    offset %= _fs_data.cluster_size;
+    cluster_addr_t ca = get_content_cluster(ci, index, &_fs_data);
+    while (!is_cluster_end(ca) && !is_cluster_bad(ca) && buff_size > 0) {
+        unsigned int needed = (offset + buff_size + _fs_data.cluster_size - 1) / _fs_data.cluster_size;
+        unsigned int run = get_content_run(ci, index, needed, &_fs_data);
+        if (!run) break;
+
+        int run_size = (int)(run * _fs_data.cluster_size - offset);
+        int readeble = (buff_size > run_size) ? run_size : buff_size;
+        if (!cluster_batch_read(&batch, ca, run, offset, buffer + total_readden, readeble, &_fs_data)) break;
+
+        offset = 0;
+        buff_size -= readeble;
+        total_readden += readeble;
+        index += run;
+        ca = get_content_next_cluster(ci, index, ca + run - 1, &_fs_data);
+    }
+
+    if (!cluster_batch_wait(&batch)) {
+        print_error("cluster_batch_read() error. Aborting...");
+        errors_register_error(READOFF_CLUSTER_ERROR, &_fs_data);
+        return 0;
+    }
 
     return total_readden;
 }
 
 #ifndef NIFAT32_RO
 /*
-Add a new cluster to an existed chain.
+Add new clusters to an existed chain. Clusters are allocated by contiguous extents, 
+the first one starts the search right after the chain end.
 Params:
-    - `hca` - Existed chain head cluster.
+    - `lca` - Last cluster of the chain.
+    - `count` - Count of new clusters.
+    - `ci` - Content with this chain. Its extent map gets new clusters. Can be NO_RCI.
 
-Returns BAD_CLUSTER if something goes wrong or a new allocated cluster.
+Returns count of added clusters.
 */
-static cluster_addr_t _add_cluster_to_chain(cluster_addr_t hca) {
-    print_debug("_add_cluster_to_chain(hca=%i)", hca);
-    cluster_addr_t allocated_cluster = alloc_cluster(&_fs_data);
-    if (!is_cluster_bad(allocated_cluster)) {
-        if (!set_cluster_end(allocated_cluster, &_fs_data)) {
-            print_error("Can't set cluster to <END> state!");
-            errors_register_error(SET_CLUSTER_END_ERROR, &_fs_data);
-            dealloc_cluster(allocated_cluster, &_fs_data);
-            return FAT_CLUSTER_BAD;
+static unsigned int _add_clusters_to_chain(cluster_addr_t lca, unsigned int count, const ci_t ci) {
+    print_debug("_add_clusters_to_chain(lca=%u, count=%u, ci=%i)", lca, count, ci);
+    unsigned int added = 0;
+    while (added < count) {
+        unsigned int allocated = 0;
+        cluster_addr_t ca = alloc_extent(count - added, lca + 1, &allocated, &_fs_data);
+        if (is_cluster_bad(ca)) {
+            print_error("Can't allocate clusters for the chain!");
+            errors_register_error(CLUSTER_ALLOCATION_ERROR, &_fs_data);
+            break;
         }
 
-        if (!write_fat(hca, allocated_cluster, &_fs_data)) {
-            print_error("Allocated cluster can't be added to content!");
+        if (!write_fat(lca, ca, &_fs_data)) {
+            print_error("Allocated clusters can't be added to the chain!");
             errors_register_error(WRITE_FAT_ERROR, &_fs_data);
-            dealloc_cluster(allocated_cluster, &_fs_data);
-            return FAT_CLUSTER_BAD;
+            dealloc_chain(ca, &_fs_data);
+            break;
         }
 
-        return allocated_cluster;
-    }
-    else {
-        print_error("Allocated cluster [addr=%i] is <BAD>!", allocated_cluster);
-        errors_register_error(ALLOCATED_CLUSTER_BAD_ERROR, &_fs_data);
-        return FAT_CLUSTER_BAD;
-    }
-
-    return FAT_CLUSTER_BAD;
-}
-
-/*
-Add an allocated cluster to the provided content index.
-Params:
-- `ci` - Content that needs new cluster.
-- `lca` - Last cluster of content. Can be FAT_CLUSTER_BAD if we don't now yet last cluster.
-
-Return cluster_addr_t to new cluster. Also new cluster marked as FAT_CLUSTER_END.
-Return FAT_CLUSTER_BAD if comething goes wrong.
-*/
-static cluster_addr_t _add_cluster_to_content(const ci_t ci, cluster_addr_t lca) {
-    print_debug("_add_cluster_to_content(ci=%i, lca=%i)", ci, lca);
-    if (lca == FAT_CLUSTER_BAD) {
-        int max_iterations = _fs_data.total_clusters;
-        cluster_addr_t cluster = get_content_data_ca(ci);
-        while (!is_cluster_end(cluster) && !is_cluster_bad(cluster) && max_iterations-- > 0) {
-            lca = cluster;
-            cluster = read_fat(cluster, &_fs_data);
+        if (ci != NO_RCI) {
+            for (unsigned int i = 0; i < allocated; i++) content_extents_append(ci, ca + i);
         }
 
-        if (max_iterations <= 0) {
-            print_error("Can't allocate cluster!");
-            errors_register_error(CLUSTER_ALLOCATION_ERROR, &_fs_data);
-            return FAT_CLUSTER_BAD;
-        }
+        lca = ca + allocated - 1;
+        added += allocated;
     }
 
-    return _add_cluster_to_chain(lca);
+    return added;
 }
 #endif
 
@@ -397,46 +524,51 @@ int NIFAT32_write_buffer2content(const ci_t ci, cluster_offset_t offset, const_b
         return 0;
     }
 
-    int total_written = 0;
-    unsigned int total_size = 0;
-    cluster_addr_t ca  = get_content_data_ca(ci);
-    cluster_addr_t lca = ca;
-    do {
-        if (offset > _fs_data.cluster_size) {
-            total_size += _fs_data.cluster_size;
-            offset -= _fs_data.cluster_size;
-        }
-        else {
-            int writable = (data_size > (int)(_fs_data.cluster_size - offset)) ? (int)(_fs_data.cluster_size - offset) : data_size;
-            if (!writeoff_cluster(ca, offset, data + total_written, writable, &_fs_data)) {
-                print_error("readoff_cluster() error. Aborting...");
-                errors_register_error(READOFF_CLUSTER_ERROR, &_fs_data);
-                return 0;
-            }
+    if (data_size <= 0) return 0;
 
-            offset = 0;
-            data_size -= writable;
-            total_written += writable;
+    /* The chain is extended from its last cluster before the write, thus new clusters are written
+       by runs too. Clusters before the offset are left unwritten. */
+    unsigned int index  = offset / _fs_data.cluster_size;
+    unsigned int needed = index + (offset % _fs_data.cluster_size + data_size + _fs_data.cluster_size - 1) / _fs_data.cluster_size;
+    if (is_cluster_end(get_content_cluster(ci, needed - 1, &_fs_data))) {
+        unsigned int length = get_content_length(ci, &_fs_data);
+        cluster_addr_t lca = length ? get_content_cluster(ci, length - 1, &_fs_data) : FAT_CLUSTER_BAD;
+        if (is_cluster_bad(lca)) {
+            print_error("Can't allocate cluster!");
+            errors_register_error(CLUSTER_ALLOCATION_ERROR, &_fs_data);
+            return 0;
         }
 
-        lca = ca;
-        ca  = read_fat(ca, &_fs_data);
-    } while (!is_cluster_end(ca) && !is_cluster_bad(ca) && data_size > 0);
-
-    ca = lca;
-    while (data_size > 0 && !is_cluster_bad(ca = _add_cluster_to_content(ci, ca))) {
-        if (offset > _fs_data.cluster_size) {
-            total_size += _fs_data.cluster_size;
-            offset -= _fs_data.cluster_size;
-        }
-        else {
-            int writable = (data_size > (int)(_fs_data.cluster_size - offset)) ? (int)(_fs_data.cluster_size - offset) : data_size;
-            writeoff_cluster(ca, offset, data + total_written, writable, &_fs_data);
+        _add_clusters_to_chain(lca, needed - length, ci);
+    }
 
-            offset = 0;
-            data_size -= writable;
-            total_written += writable;
-        }
+    cluster_batch_t batch;
+    cluster_batch_init(&batch);
+    int total_written = 0;
+    offset %= _fs_data.cluster_size;
+    cluster_addr_t ca = get_content_cluster(ci, index, &_fs_data);
+    while (!is_cluster_end(ca) && !is_cluster_bad(ca) && data_size > 0) {
+        unsigned int run = get_content_run(ci, index, needed - index, &_fs_data);
+        if (!run) break;
+
+        int run_size = (int)(run * _fs_data.cluster_size - offset);
+        int writable = (data_size > run_size) ? run_size : data_size;
+        if (!cluster_batch_write(&batch, ca, run, offset, data + total_written, writable, &_fs_data)) break;
+
+        offset = 0;
+        data_size -= writable;
+        total_written += writable;
+        index += run;
+        ca = get_content_next_cluster(ci, index, ca + run - 1, &_fs_data);
+    }
+
+    /* Read-ahead windows of this chain have old data. They are dropped after the write is done. */
+    int synced = cluster_batch_wait(&batch);
+    content_readahead_drop(ci);
+    if (!synced) {
+        print_error("cluster_batch_write() error. Aborting...");
+        errors_register_error(READOFF_CLUSTER_ERROR, &_fs_data);
+        return 0;
     }
 
     // directory_entry_t entry; TODO: calculate total size and update
@@ -452,12 +584,18 @@ int NIFAT32_write_buffer2content(const ci_t ci, cluster_offset_t offset, const_b
 int NIFAT32_change_meta(const ci_t ci, const cinfo_t* info) {
 #ifndef NIFAT32_RO
     print_log("NIFAT32_change_meta(ci=%i, info=%.11s/%.8s/%.3s)", ci, info->full_name, info->name, info->extention);
+    hashed_name_t name, new_name;
+    get_content_hashed_name(ci, &name);
+    nft32_hash_fatname(info->full_name, &new_name);
+
     directory_entry_t meta;
     create_entry(
-        info->full_name, info->type == STAT_DIR, get_content_data_ca(ci), info->size, &meta
+        &new_name, info->type == STAT_DIR, get_content_data_ca(ci), info->size, &meta
     );
 
-    if (!entry_edit(get_content_root_ca(ci), get_content_ecache(ci), get_content_name(ci), &meta, &_fs_data)) {
+    meta.rca = get_content_root_ca(ci);
+    meta.checksum = entry_checksum(&meta);
+    if (!entry_edit(get_content_root_ca(ci), get_content_ecache(ci), &name, &meta, &_fs_data)) {
         print_error("entry_edit() encountered an error. Aborting...");
         errors_register_error(ENTRY_EDIT_ERROR, &_fs_data);
         return 0;
@@ -480,6 +618,7 @@ int NIFAT32_truncate_content(const ci_t ci, cluster_offset_t offset, int size) {
     }
 
     unsigned int end_size = size;
+    unsigned int skipped = 0, kept = 0;
     cluster_addr_t ca = get_content_data_ca(ci);
     cluster_addr_t start_ca = FAT_CLUSTER_BAD, end_ca = FAT_CLUSTER_BAD;
     do {
@@ -488,8 +627,10 @@ int NIFAT32_truncate_content(const ci_t ci, cluster_offset_t offset, int size) {
             if (offset > _fs_data.cluster_size) {
                 offset -= _fs_data.cluster_size;
                 dealloc_cluster(ca, &_fs_data);
+                skipped++;
             }
             else {
+                kept++;
                 if (start_ca == FAT_CLUSTER_BAD) start_ca = ca;
                 if ((size -= _fs_data.cluster_size) < 0 && end_ca == FAT_CLUSTER_BAD) {
                     set_cluster_end(ca, &_fs_data);
@@ -501,9 +642,15 @@ int NIFAT32_truncate_content(const ci_t ci, cluster_offset_t offset, int size) {
         ca = read_fat(ca, &_fs_data);
     } while (!is_cluster_end(ca) && !is_cluster_bad(ca));
 
+    content_extents_trim(ci, skipped, kept);
+    content_readahead_drop(ci);
+
+    /* Only dca and size are changed, the checksum is finished from the cached entry prefix. */
+    hashed_name_t name;
     directory_entry_t entry;
-    create_entry(get_content_name(ci), 0, start_ca, end_size, &entry);
-    entry_edit(get_content_root_ca(ci), NO_ECACHE, get_content_name(ci), &entry, &_fs_data);
+    get_content_hashed_name(ci, &name);
+    update_content_meta(ci, start_ca, end_size, &entry);
+    entry_edit(get_content_root_ca(ci), NO_ECACHE, &name, &entry, &_fs_data);
     return 1;
 #endif
     UNUSED(ci, offset, size);
@@ -516,36 +663,34 @@ int NIFAT32_put_content(const ci_t ci, cinfo_t* info, int reserve) {
     print_log("NIFAT32_put_content(ci=%i, info=%s, reserve=%i)", ci, info->full_name, reserve);
     cluster_addr_t target = get_content_data_ca(ci);
     ecache_t* entry_cache = get_content_ecache(target);
-    if (entry_search((char*)info->full_name, target, entry_cache, NULL, &_fs_data)) {
+    hashed_name_t name;
+    nft32_hash_fatname(info->full_name, &name);
+    if (entry_search(&name, target, entry_cache, NULL, &_fs_data)) {
         print_error("entry_search() encountered an error. Aborting...");
         errors_register_error(ENTRY_SEARCH_ERROR, &_fs_data);
         return 0;
     }
 
+    /* The reserved chain is allocated by extents before the entry. */
     directory_entry_t entry;
-    cluster_addr_t entry_ca = alloc_cluster(&_fs_data);
-    if (!set_cluster_end(entry_ca, &_fs_data)) {
-        print_error("set_cluster_end() error!");
-        errors_register_error(SET_CLUSTER_END_ERROR, &_fs_data);
+    unsigned int chain = reserve > NO_RESERVE ? reserve : NO_RESERVE, allocated = 0;
+    cluster_addr_t entry_ca = alloc_extent(chain, FAT_CLUSTER_BAD, &allocated, &_fs_data);
+    if (is_cluster_bad(entry_ca)) {
+        print_error("alloc_extent() error!");
+        errors_register_error(CLUSTER_ALLOCATION_ERROR, &_fs_data);
         return 0;
     }
 
-    create_entry(info->full_name, info->type == STAT_DIR, entry_ca, reserve * _fs_data.cluster_size, &entry);
+    if (allocated < chain) _add_clusters_to_chain(entry_ca + allocated - 1, chain - allocated, NO_RCI);
+    create_entry(&name, info->type == STAT_DIR, entry_ca, reserve * _fs_data.cluster_size, &entry);
     int is_add = entry_add(target, entry_cache, &entry, &_fs_data);
     if (is_add < 0) {
         print_error("entry_add() during final entry save encountered an error=%i!", is_add);
         errors_register_error(ENTRY_ADD_ERROR, &_fs_data);
-        dealloc_cluster(entry.dca, &_fs_data);
+        dealloc_chain(entry.dca, &_fs_data);
         return 0;
     }
 
-    if (reserve > NO_RESERVE) {
-        cluster_addr_t lca = entry.dca;
-        for (; reserve-- > NO_RESERVE; ) {
-            lca = _add_cluster_to_chain(lca);
-        }
-    }
-
     return 1;
 #endif
     UNUSED(ci, info, reserve);
@@ -554,31 +699,87 @@ int NIFAT32_put_content(const ci_t ci, cinfo_t* info, int reserve) {
 }
 
 #ifndef NIFAT32_RO
-static int _deepcopy_handler(entry_info_t* __restrict info __attribute__((unused)), directory_entry_t* __restrict entry, void* ctx) {
-    cluster_addr_t old_ca = entry->dca;
-    cluster_addr_t nca = alloc_cluster(&_fs_data);
-    cluster_addr_t hca = nca;
-    if (set_cluster_end(nca, &_fs_data)) {
-        do {
-            if (!copy_cluster(old_ca, nca, ctx, _fs_data.bytes_per_sector, &_fs_data)) {
-                print_error("copy_cluster() error during the deep copy operation!");
+/*
+Copy data of the source chain to the destination chain. The destination chain is extended
+by extents for the whole source length before the copy. With a heap up to DISK_BATCH_MAX source
+clusters are read at once, then written at once, otherwise clusters are copied by sectors.
+Params:
+    - `src_ca` - Source chain head cluster.
+    - `hca` - Destination chain head cluster.
+    - `buffer` - Copy buffer with the sector size.
+
+Returns 1 if succeeds, otherwise will return 0. The destination chain is released on error.
+*/
+static int _copy_chain(cluster_addr_t src_ca, cluster_addr_t hca, buffer_t buffer) {
+    unsigned int length = 0;
+    for (cluster_addr_t ca = src_ca; !is_cluster_end(ca) && !is_cluster_bad(ca) && length < _fs_data.total_clusters; ca = read_fat(ca, &_fs_data)) {
+        length++;
+    }
+
+    int result = length < 2 || _add_clusters_to_chain(hca, length - 1, NO_RCI) == length - 1;
+    buffer_t clusters = NULL;
+#ifndef NO_HEAP
+    if (result && length > 1) clusters = (buffer_t)nft32_malloc_s(DISK_BATCH_MAX * _fs_data.cluster_size);
+#endif
+
+    cluster_addr_t dst_ca = hca;
+    while (result && length > 0) {
+        if (!clusters) {
+            if (!copy_cluster(src_ca, dst_ca, buffer, _fs_data.bytes_per_sector, &_fs_data)) {
+                print_error("copy_cluster() error. Can't copy a cluster from the source!");
                 errors_register_error(COPY_CLUSTER_ERROR, &_fs_data);
-                if (!dealloc_chain(hca, &_fs_data)) {
-                    print_error("Can't deallocate the destination's chain as a part of abort operation in deep copy!!");
-                    errors_register_error(CLUSTER_CHAIN_DELETION_ERROR, &_fs_data);
-                }
-                
-                return 0;
+                result = 0;
             }
 
-            old_ca = read_fat(old_ca, &_fs_data);
-            if (!is_cluster_end(old_ca)) nca = _add_cluster_to_chain(nca);
-        } while (!is_cluster_end(old_ca) && !is_cluster_bad(old_ca) && !is_cluster_bad(nca));
+            src_ca = read_fat(src_ca, &_fs_data);
+            dst_ca = read_fat(dst_ca, &_fs_data);
+            length--;
+            continue;
+        }
+
+        int count = 0;
+        cluster_batch_t batch;
+        cluster_addr_t dst[DISK_BATCH_MAX];
+        cluster_batch_init(&batch);
+        for (; count < DISK_BATCH_MAX && length > 0; count++, length--) {
+            cluster_batch_read(&batch, src_ca, 1, 0, clusters + count * _fs_data.cluster_size, _fs_data.cluster_size, &_fs_data);
+            dst[count] = dst_ca;
+            src_ca = read_fat(src_ca, &_fs_data);
+            dst_ca = read_fat(dst_ca, &_fs_data);
+        }
+
+        result = cluster_batch_wait(&batch);
+        for (int i = 0; result && i < count; i++) {
+            cluster_batch_write(&batch, dst[i], 1, 0, clusters + i * _fs_data.cluster_size, _fs_data.cluster_size, &_fs_data);
+        }
+
+        if (!result || !cluster_batch_wait(&batch)) {
+            print_error("cluster_batch_wait() error. Can't copy clusters from the source!");
+            errors_register_error(COPY_CLUSTER_ERROR, &_fs_data);
+            result = 0;
+        }
     }
-    
+
+    if (clusters) nft32_free_s(clusters);
+
+    if (!result && !dealloc_chain(hca, &_fs_data)) {
+        print_error("Can't deallocate the destination's chain after the copy error!");
+        errors_register_error(CLUSTER_CHAIN_DELETION_ERROR, &_fs_data);
+    }
+
+    return result;
+}
+
+static int _deepcopy_handler(entry_info_t* __restrict info __attribute__((unused)), directory_entry_t* __restrict entry, void* ctx) {
+    unsigned int allocated = 0;
+    cluster_addr_t hca = alloc_extent(1, FAT_CLUSTER_BAD, &allocated, &_fs_data);
+    if (is_cluster_bad(hca) || !_copy_chain(entry->dca, hca, (buffer_t)ctx)) {
+        print_error("Chain copy error during the deep copy operation!");
+        return 0;
+    }
+
     entry->dca = hca;
-    entry->checksum = 0;
-    entry->checksum = nft32_murmur3_x86_32((const_buffer_t)entry, sizeof(directory_entry_t), 0);
+    entry->checksum = entry_checksum(entry);
     if ((entry->attributes & FILE_DIRECTORY) == FILE_DIRECTORY) entry_iterate(hca, _deepcopy_handler, ctx, &_fs_data);
     return 0;
 }
@@ -589,27 +790,12 @@ int NIFAT32_copy_content(const ci_t src, const ci_t dst, char deep) {
     print_log("NIFAT32_copy_content(src=%i, dst=%i, deep=%i)", src, dst, deep);
     switch (deep) {
         case DEEP_COPY: {
-            cluster_addr_t dst_ca = get_content_data_ca(dst);
-            cluster_addr_t src_ca = get_content_data_ca(src);
-
             stack_buffer_t copy_buffer[_fs_data.bytes_per_sector];
-            cluster_addr_t hca_dst = dst_ca;
-            do {
-                if (!copy_cluster(src_ca, dst_ca, (buffer_t)&copy_buffer, _fs_data.bytes_per_sector, &_fs_data)) {
-                    print_error("copy_cluster() error. Can't copy a cluster from the destination!");
-                    errors_register_error(COPY_CLUSTER_ERROR, &_fs_data);
-                    if (!dealloc_chain(hca_dst, &_fs_data)) {
-                        print_error("Can't deallocate the destination's chain after the copy error!");
-                        errors_register_error(CLUSTER_CHAIN_DELETION_ERROR, &_fs_data);
-                    }
-
-                    return 0;
-                }
-
-                src_ca = read_fat(src_ca, &_fs_data);
-                if (!is_cluster_end(src_ca)) dst_ca = _add_cluster_to_chain(dst_ca);
-            } while (!is_cluster_end(src_ca) && !is_cluster_bad(src_ca) && !is_cluster_bad(dst_ca));
+            cluster_addr_t hca_dst = get_content_data_ca(dst);
+            if (!_copy_chain(get_content_data_ca(src), hca_dst, (buffer_t)&copy_buffer)) return 0;
 
+            content_extents_drop(dst);
+            content_readahead_drop(dst);
             if (get_content_type(src) == CONTENT_TYPE_DIRECTORY) {
                 entry_iterate(hca_dst, _deepcopy_handler, (void*)&copy_buffer, &_fs_data);
             }
@@ -617,14 +803,18 @@ int NIFAT32_copy_content(const ci_t src, const ci_t dst, char deep) {
             break;
         }
         case SHALLOW_COPY: {
+            hashed_name_t src_name, dst_name;
+            get_content_hashed_name(src, &src_name);
+            get_content_hashed_name(dst, &dst_name);
+
             directory_entry_t source, destination;
-            if (!entry_search(get_content_name(src), get_content_root_ca(src), NO_ECACHE, &source, &_fs_data)) {
+            if (!entry_search(&src_name, get_content_root_ca(src), NO_ECACHE, &source, &_fs_data)) {
                 print_error("Source content %i wasn't found! I don't know what I need to copy!", src);
                 errors_register_error(ENTRY_SEARCH_ERROR, &_fs_data);
                 return 0;
             }
 
-            if (!entry_search(get_content_name(dst), get_content_root_ca(dst), NO_ECACHE, &destination, &_fs_data)) {
+            if (!entry_search(&dst_name, get_content_root_ca(dst), NO_ECACHE, &destination, &_fs_data)) {
                 print_error("Destination content %i wasn't found! I don't know where I need to store a link!", dst);
                 errors_register_error(ENTRY_SEARCH_ERROR, &_fs_data);
                 return 0;
@@ -637,10 +827,8 @@ int NIFAT32_copy_content(const ci_t src, const ci_t dst, char deep) {
             }
 
             source.rca = get_content_root_ca(dst);
-            source.checksum = 0;
-            source.checksum = nft32_murmur3_x86_32((const_buffer_t)&source, sizeof(directory_entry_t), 0);
-
-            if (!entry_edit(source.rca, NO_ECACHE, get_content_name(dst), &source, &_fs_data)) {
+            source.checksum = entry_checksum(&source);
+            if (!entry_edit(source.rca, NO_ECACHE, &dst_name, &source, &_fs_data)) {
                 print_error("Content %i wasn't found and can't be edited!", dst);
                 errors_register_error(ENTRY_EDIT_ERROR, &_fs_data);
                 return 0;
@@ -666,7 +854,9 @@ int NIFAT32_copy_content(const ci_t src, const ci_t dst, char deep) {
 int NIFAT32_delete_content(ci_t ci) {
 #ifndef NIFAT32_RO
     print_log("NIFAT32_delete_content(ci=%i)", ci);
-    if (!entry_remove(get_content_root_ca(ci), get_content_name(ci), get_content_ecache(ci), &_fs_data)) {
+    hashed_name_t name;
+    get_content_hashed_name(ci, &name);
+    if (!entry_remove(get_content_root_ca(ci), &name, get_content_ecache(ci), &_fs_data)) {
         print_error("entry_remove() encountered an error. Aborting...");
         errors_register_error(ENTRY_REMOVE_ERROR, &_fs_data);
         return 0;
@@ -718,8 +908,27 @@ error_code_t NIFAT32_get_last_error() {
     return errors_last_error(&_fs_data);
 }
 
+int NIFAT32_sync() {
+    print_log("NIFAT32_sync()");
+    if (!fat_cache_flush(&_fs_data)) return 0;
+    if (!fatmap_store(&_fs_data)) return 0;
+    return DSK_flush();
+}
+
 int NIFAT32_unload() {
+    if (!fat_cache_flush(&_fs_data)) {
+        print_warn("FAT cache flush error!");
+    }
+    else if (!fatmap_store(&_fs_data)) {
+        print_warn("Free map store error!");
+    }
+
     fat_cache_unload();
+    fatmap_unload();
     ctable_destroy();
+    if (!DSK_cache_unload()) {
+        print_warn("Sector cache flush error!");
+    }
+
     return 1;
 }
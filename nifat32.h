@@ -24,6 +24,7 @@ Dependencies:
     - nft32/errors.h - Error registration.
     - nft32/cluster.h - Cluster I/O utilities.
     - nft32/fatinfo.h - FAT filesystem metadata.
+    - nft32/corrections.h - Corrected bits counters.
 */
 
 #ifndef NIFAT32_H_
@@ -49,6 +50,7 @@ extern "C" {
 #include <nft32/errors.h>
 #include <nft32/cluster.h>
 #include <nft32/fatinfo.h>
+#include <nft32/corrections.h>
 
 /* Bpb taken from http://wiki.osdev.org/FAT */
 typedef struct fat_extBS_32 {
@@ -64,6 +66,23 @@ typedef struct fat_extBS_32 {
     checksum_t     checksum;
 } __attribute__((packed)) nifat32_ext32_bootsector_t;
 
+/* Low nibble of extended_flags holds the metadata ECC codec (ECC_HAMMING_15_11 on old images). */
+#define BS_ECC_MASK        0x000F
+#define GET_BS_ECC(flags)  ((flags) & BS_ECC_MASK)
+
+/* Next nibble holds the checksum algorithm (CHECKSUM_MURMUR3 on old images). */
+#define BS_CHECKSUM_MASK       0x00F0
+#define BS_CHECKSUM_SHIFT      4
+#define GET_BS_CHECKSUM(flags) (((flags) & BS_CHECKSUM_MASK) >> BS_CHECKSUM_SHIFT)
+
+/* Bit 8 marks FAT copies with a checksum per FAT sector (not set on old images). */
+#define BS_FAT_CHECKSUM            0x0100
+#define GET_BS_FAT_CHECKSUM(flags) (((flags) & BS_FAT_CHECKSUM) != 0)
+
+/* Bit 9 marks a reserved area with the free cluster map (not set on old images). */
+#define BS_FREE_MAP            0x0200
+#define GET_BS_FREE_MAP(flags) (((flags) & BS_FREE_MAP) != 0)
+
 typedef struct fat_BS {
     unsigned char              bootjmp[3];
     unsigned char              oem_name[8];
@@ -87,18 +106,33 @@ typedef struct fat_BS {
 #define CACHE      0b00000001
 #define HARD_CACHE 0b00000010
 #define MAP_CACHE  0b00000100
+#define WRITE_BACK_CACHE 0b00001000 // Requires CACHE. FAT changes are written on NIFAT32_sync
 typedef struct {
-    char          fat_cache : 3;
+    unsigned char fat_cache : 4;
     unsigned char bs_num;   // bootsectors number
     unsigned char bs_count; // bootsector count
     unsigned int  ts;       // total sectors
     unsigned char jc;       // journals count
     unsigned char ec;       // error clusters count
+    unsigned int  fat_cache_size; // FAT cache RAM budget in bytes (0 - whole table)
+    unsigned int  sector_cache_size; // Sector cache RAM budget in bytes (0 - no sector cache)
+    unsigned char sector_cache_mode; // SECTOR_CACHE_WRITE_THROUGH or SECTOR_CACHE_WRITE_BACK
     disk_io_t     disk_io;
     log_io_t      logg_io;
     mm_manager_t  mm_manager;
 } nifat32_params_t;
 
+typedef struct {
+    unsigned int cluster_size;   // bytes in a cluster
+    unsigned int total_clusters; // data clusters of the volume
+    unsigned int free_clusters;
+    unsigned int used_clusters;  // data and metadata clusters
+    unsigned int free_extents;   // runs of free clusters
+    unsigned int largest_free_extent;
+    unsigned int fragmentation;  // percent of free clusters out of the largest free run
+    unsigned int extents_histogram[FATMAP_HISTOGRAM]; // bucket b counts free runs of [2^b, 2^(b+1)) clusters
+} nifat32_statfs_t;
+
 #define BOOT_MULTIPLIER 2654435761U // Knuth's multiplier (2^32 / φ)
 #define GET_BOOTSECTOR(n, ts) (((((n) + 1) * BOOT_MULTIPLIER) >> 11) % (ts - 2))
 
@@ -117,6 +151,41 @@ Returns 1 if succeeds.
 */
 int NIFAT32_get_fs_data(fat_data_t* d);
 
+/*
+Load counters of the bits corrected by the Hamming decoder per metadata region
+(boot sector, every FAT copy, journal, error store, directory clusters).
+Params:
+    - `c` - Output data destination.
+    - `reset` - Reset counters after the read.
+
+Returns 1 if succeeds.
+*/
+int NIFAT32_get_corrections(corrections_t* c, int reset);
+
+/*
+Get free space of the volume. With MAP_CACHE the first call completes the map by a FAT scan,
+if the map wasn't filled at the mount (by HARD_CACHE or the free map area). Then calls 
+don't read the disk. Without the map every call reads the whole FAT.
+[Thread-safe]
+
+Params:
+    - `st` - Output data destination.
+
+Returns 1 if succeeds.
+*/
+int NIFAT32_statfs(nifat32_statfs_t* st);
+
+/*
+Load counters of the sector cache (hits, misses, evictions, write-backs).
+Params:
+    - `st` - Output data destination.
+    - `reset` - Reset counters after the read.
+
+Returns 1 if there is a sector cache.
+Returns 0 if the instance is mounted without the sector cache.
+*/
+int NIFAT32_get_sector_cache_stat(sector_cache_stat_t* st, int reset);
+
 /*
 Init function. 
 Note: This function also init memory manager.
@@ -130,6 +199,19 @@ Return 0 if init was interrupted by error.
 */
 int NIFAT32_init(nifat32_params_t* params);
 
+/*
+Load a part of the FAT to the cache. Use it instead of the HARD_CACHE flag to split 
+the hard load between platform threads: mount with CACHE, then invoke 
+NIFAT32_hload_fat(i, n) from n threads.
+Params:
+- `part` - Part index.
+- `parts` - Parts count.
+
+Return 1 if load success.
+Return 0 if something went wrong.
+*/
+int NIFAT32_hload_fat(int part, int parts);
+
 /*
 Restore bootsectors on mount image.
 Note: Will create a new bootsector from current info from RAM. 
@@ -138,8 +220,22 @@ Return 1.
 */
 int NIFAT32_repair_bootsectors();
 
+/*
+Write all cached changes to the image.
+Note: With the WRITE_BACK_CACHE mode FAT changes stay in RAM until this call, 
+      until the FAT_DIRTY_LIMIT is reached, or until an entry is added/edited/removed. 
+      Invoke it from a platform timer to bound the amount of lost changes.
+Note 2: The free map area is stored clean as well, thus the next mount loads it without a FAT scan.
+Note 3: Dirty sectors of the SECTOR_CACHE_WRITE_BACK sector cache are written at the end. Writes 
+        before this call reach the image before writes after it.
+Return 1 if sync success.
+Return 0 if something went wrong.
+*/
+int NIFAT32_sync();
+
 /*
 Unload sequence. Perform all cleanup tasks.
+Note: Will sync cached changes before the cleanup.
 Return 1.
 */
 int NIFAT32_unload();
@@ -4,48 +4,183 @@ int get_cluster_count(unsigned int size, fat_data_t* fi) {
     return size / (fi->sectors_per_cluster * fi->bytes_per_sector);
 }
 
-lock_t _allocater_lock = NULL_LOCK;
-static cluster_addr_t last_allocated_cluster = CLUSTER_OFFSET;
-cluster_addr_t alloc_cluster(fat_data_t* fi) {
 #ifndef NIFAT32_RO
-    if (!THR_require_write(&_allocater_lock, get_thread_num())) {
-        print_error("Can't write-lock alloc_cluster function!");
-        errors_register_error(WRITELOCK_CLUSTER_ERROR, fi);
-        return FAT_CLUSTER_BAD;
+typedef struct {
+    lock_t         lock;
+    cluster_addr_t first;  // first cluster of the group
+    cluster_addr_t end;    // cluster after the last cluster of the group
+    cluster_addr_t cursor; // the next search starts here
+} alloc_group_t;
+
+static alloc_group_t _groups[ALLOC_GROUPS];
+static unsigned int  _groups_count = 0;
+static unsigned int  _group_size   = 0;
+static volatile unsigned int _next_group = 0;
+#endif
+
+int alloc_groups_init(fat_data_t* fi) {
+#ifndef NIFAT32_RO
+    unsigned int aligned = (fi->total_clusters + ALLOC_GROUP_ALIGN - 1) / ALLOC_GROUP_ALIGN;
+    unsigned int count = aligned < ALLOC_GROUPS ? aligned : ALLOC_GROUPS;
+    if (!count) count = 1;
+
+    _group_size   = ((aligned + count - 1) / count) * ALLOC_GROUP_ALIGN;
+    _groups_count = (fi->total_clusters + _group_size - 1) / _group_size;
+    for (unsigned int g = 0; g < _groups_count; g++) {
+        _groups[g].lock   = NULL_LOCK;
+        _groups[g].first  = g ? g * _group_size : fi->ext_root_cluster;
+        _groups[g].end    = (g + 1) * _group_size < fi->total_clusters ? (g + 1) * _group_size : fi->total_clusters;
+        _groups[g].cursor = !g && CLUSTER_OFFSET < _groups[g].end ? CLUSTER_OFFSET : _groups[g].first;
     }
 
-    cluster_addr_t cluster = fatmap_find_free(last_allocated_cluster, 1, fi);
-    if (!cluster) cluster = last_allocated_cluster;
-    else {
-        last_allocated_cluster = cluster + 1;
-        THR_release_write(&_allocater_lock, get_thread_num());
+    _next_group = 0;
+    print_log("Allocation groups: %u by %u clusters", _groups_count, _group_size);
+    return 1;
+#endif
+    UNUSED(fi);
+    return 1;
+}
+
+#ifndef NIFAT32_RO
+/*
+Find a free cluster in the group. The map search wraps to the group start, and the found 
+cluster is claimed in the map. Thus it isn't found again until the caller marks it in the FAT.
+The FAT scan is used only for clusters that the map hasn't seen yet. The caller should hold 
+the group lock.
+Returns the cluster or FAT_CLUSTER_BAD.
+*/
+static cluster_addr_t _find_free_cluster(alloc_group_t* group, fat_data_t* fi) {
+    cluster_addr_t cluster = fatmap_claim_free(group->cursor, group->end, fi);
+    if (!cluster) cluster = fatmap_claim_free(group->first, group->end, fi);
+    if (cluster) {
+        group->cursor = cluster + 1;
         return cluster;
     }
 
-    int nfree_skip_step = 0;
-    cluster_status_t cluster_status = FAT_CLUSTER_FREE;
-    while (cluster < fi->total_clusters) {
-        cluster_status = read_fat(cluster, fi);
-        if (is_cluster_free(cluster_status)) {
-            last_allocated_cluster = cluster + 1;
-            THR_release_write(&_allocater_lock, get_thread_num());
-            return cluster;
+    cluster_addr_t from[2] = { group->cursor, group->first };
+    cluster_addr_t to[2]   = { group->end, group->cursor };
+    for (int pass = 0; pass < 2; pass++) {
+        int nfree_skip_step = 0;
+        for (cluster = from[pass]; cluster < to[pass]; cluster++) {
+            cluster_status_t cluster_status = read_fat(cluster, fi);
+            if (is_cluster_free(cluster_status)) {
+                group->cursor = cluster + 1;
+                return cluster;
+            }
+            else if (is_cluster_bad(cluster_status) || is_cluster_reserved(cluster_status)) {
+                cluster += nfree_skip_step++;
+            }
         }
-        else if (is_cluster_bad(cluster_status) || is_cluster_reserved(cluster_status)) {
-            cluster += nfree_skip_step++;
+    }
+
+    return FAT_CLUSTER_BAD;
+}
+
+/*
+Allocate a run in the group. The caller should hold the group lock.
+Returns the first cluster of the run or FAT_CLUSTER_BAD.
+*/
+static cluster_addr_t _alloc_group_extent(
+    alloc_group_t* group, unsigned int count, cluster_addr_t hint, unsigned int* allocated, fat_data_t* fi
+) {
+    /* The run size is halved until the map has such a run. Thus a large request gets the largest power-of-two part of it. */
+    cluster_addr_t start = hint >= group->first && hint < group->end ? hint : group->cursor;
+    unsigned int size = count;
+    cluster_addr_t ca = 0;
+    while (size) {
+        if (
+            !(ca = fatmap_find_free_range(start, group->end, size, fi)) && 
+            !(ca = fatmap_find_free_range(group->first, group->end, size, fi))
+        ) {
+            size /= 2;
+            continue;
+        }
+
+        /* The found run is claimed before the FAT write, a failed claim means the run has changed. */
+        if (fatmap_claim(ca, size)) break;
+        ca = 0;
+    }
+
+    /* Without the map the run grows from a free cluster while next clusters are free. */
+    if (!ca) {
+        group->cursor = start;
+        if (is_cluster_bad(ca = _find_free_cluster(group, fi))) return FAT_CLUSTER_BAD;
+        size = 1;
+        while (size < count && ca + size < group->end && is_cluster_free(read_fat(ca + size, fi))) size++;
+    }
+
+    if (!write_fat_chain(ca, size, FAT_CLUSTER_END, fi)) {
+        print_error("Can't link the extent ca=%u size=%u!", ca, size);
+        errors_register_error(SET_CLUSTER_END_ERROR, fi);
+        return FAT_CLUSTER_BAD;
+    }
+
+    group->cursor = ca + size;
+    *allocated = size;
+    return ca;
+}
+#endif
+
+cluster_addr_t alloc_cluster(fat_data_t* fi) {
+#ifndef NIFAT32_RO
+    if (!_groups_count) return FAT_CLUSTER_BAD;
+    int locked = 0;
+    unsigned int first = __sync_fetch_and_add(&_next_group, 1) % _groups_count;
+    for (unsigned int g = 0; g < _groups_count; g++) {
+        alloc_group_t* group = &_groups[(first + g) % _groups_count];
+        if (!THR_require_write(&group->lock, get_thread_num())) continue;
+        cluster_addr_t cluster = _find_free_cluster(group, fi);
+        if (!is_cluster_bad(cluster) && !set_cluster_end(cluster, fi)) {
+            print_error("Can't set the allocated cluster ca=%u as <END>!", cluster);
+            errors_register_error(SET_CLUSTER_END_ERROR, fi);
+            cluster = FAT_CLUSTER_BAD;
         }
 
-        cluster++;
+        THR_release_write(&group->lock, get_thread_num());
+        if (!is_cluster_bad(cluster)) return cluster;
+        locked++;
+    }
+
+    if (!locked) {
+        print_error("Can't write-lock alloc_cluster function!");
+        errors_register_error(WRITELOCK_CLUSTER_ERROR, fi);
     }
 
-    last_allocated_cluster = fi->ext_root_cluster;
-    THR_release_write(&_allocater_lock, get_thread_num());
     return FAT_CLUSTER_BAD;
 #endif
     UNUSED(fi);
     return FAT_CLUSTER_BAD;
 }
 
+cluster_addr_t alloc_extent(unsigned int count, cluster_addr_t hint, unsigned int* allocated, fat_data_t* fi) {
+#ifndef NIFAT32_RO
+    *allocated = 0;
+    if (!count || !_groups_count) return FAT_CLUSTER_BAD;
+
+    /* A chain grows in the group of its end, a new chain takes the next group. */
+    int locked = 0;
+    int hinted = hint >= fi->ext_root_cluster && hint < fi->total_clusters;
+    unsigned int first = hinted ? hint / _group_size : __sync_fetch_and_add(&_next_group, 1) % _groups_count;
+    for (unsigned int g = 0; g < _groups_count; g++) {
+        alloc_group_t* group = &_groups[(first + g) % _groups_count];
+        if (!THR_require_write(&group->lock, get_thread_num())) continue;
+        cluster_addr_t ca = _alloc_group_extent(group, count, hint, allocated, fi);
+        THR_release_write(&group->lock, get_thread_num());
+        if (!is_cluster_bad(ca)) return ca;
+        locked++;
+    }
+
+    if (!locked) {
+        print_error("Can't write-lock alloc_extent function!");
+        errors_register_error(WRITELOCK_CLUSTER_ERROR, fi);
+    }
+
+    return FAT_CLUSTER_BAD;
+#endif
+    UNUSED(count, hint, allocated, fi);
+    return FAT_CLUSTER_BAD;
+}
+
 int dealloc_cluster(const cluster_addr_t ca, fat_data_t* fi) {
 #ifndef NIFAT32_RO
     cluster_status_t cluster_status = read_fat(ca, fi);
@@ -85,6 +220,14 @@ int readoff_cluster(
     return DSK_readoff_sectors(start_sect, offset, buffer, buff_size, fi->sectors_per_cluster);
 }
 
+int readoff_clusters(
+    cluster_addr_t ca, unsigned int count, cluster_offset_t offset, buffer_t __restrict buffer, int buff_size, fat_data_t* __restrict fi
+) {
+    print_debug("readoff_clusters(ca=%u, count=%u, offset=%u, size=%i)", ca, count, offset, buff_size);
+    sector_addr_t start_sect = (ca - fi->ext_root_cluster) * (unsigned short)fi->sectors_per_cluster + fi->first_data_sector;
+    return DSK_readoff_run(start_sect, offset, buffer, buff_size, count * fi->sectors_per_cluster);
+}
+
 int read_cluster(cluster_addr_t ca, buffer_t __restrict buffer, int buff_size, fat_data_t* __restrict fi) {
     return readoff_cluster(ca, 0, buffer, buff_size, fi);
 }
@@ -101,6 +244,19 @@ int writeoff_cluster(
     return 1;
 }
 
+int writeoff_clusters(
+    cluster_addr_t ca, unsigned int count, cluster_offset_t offset, const_buffer_t __restrict data, int data_size, fat_data_t* __restrict fi
+) {
+#ifndef NIFAT32_RO
+    print_debug("writeoff_clusters(ca=%u, count=%u, offset=%u, size=%i)", ca, count, offset, data_size);
+    sector_addr_t start_sect = (ca - fi->ext_root_cluster) * (unsigned short)fi->sectors_per_cluster + fi->first_data_sector;
+    return DSK_writeoff_run(start_sect, offset, data, data_size, count * fi->sectors_per_cluster);
+#endif
+    UNUSED(ca, count, offset);
+    UNUSED(data, data_size, fi);
+    return 1;
+}
+
 int write_cluster(cluster_addr_t ca, const_buffer_t __restrict data, int data_size, fat_data_t* __restrict fi) {
 #ifndef NIFAT32_RO
     return writeoff_cluster(ca, 0, data, data_size, fi);
@@ -119,3 +275,53 @@ int copy_cluster(cluster_addr_t src, cluster_addr_t dst, buffer_t __restrict buf
     UNUSED(src, dst, buffer, buff_size, fi);
     return 1;
 }
+
+void cluster_batch_init(cluster_batch_t* b) {
+    b->count  = 0;
+    b->result = 1;
+}
+
+int cluster_batch_wait(cluster_batch_t* b) {
+    if (b->count) {
+        DSK_submit(b->reqs, b->count);
+        b->result = DSK_wait(b->reqs, b->count) && b->result;
+        b->count  = 0;
+    }
+
+    return b->result;
+}
+
+static int _batch_add(
+    cluster_batch_t* b, cluster_addr_t ca, unsigned int count, cluster_offset_t offset, buffer_t buffer, int size, int write, fat_data_t* fi
+) {
+    if (b->count == DISK_BATCH_MAX && !cluster_batch_wait(b)) return 0;
+    disk_request_t* req = &b->reqs[b->count++];
+    int run_size = (int)(count * fi->cluster_size - offset);
+    req->iov.sa     = (ca - fi->ext_root_cluster) * (unsigned short)fi->sectors_per_cluster + fi->first_data_sector;
+    req->iov.offset = offset;
+    req->iov.buffer = buffer;
+    req->iov.size   = size > run_size ? run_size : size;
+    req->write      = write;
+    req->done       = NULL;
+    req->ctx        = NULL;
+    return b->result;
+}
+
+int cluster_batch_read(
+    cluster_batch_t* b, cluster_addr_t ca, unsigned int count, cluster_offset_t offset, buffer_t buffer, int buff_size, fat_data_t* fi
+) {
+    print_debug("cluster_batch_read(ca=%u, count=%u, offset=%u, size=%i)", ca, count, offset, buff_size);
+    return _batch_add(b, ca, count, offset, buffer, buff_size, 0, fi);
+}
+
+int cluster_batch_write(
+    cluster_batch_t* b, cluster_addr_t ca, unsigned int count, cluster_offset_t offset, const_buffer_t data, int data_size, fat_data_t* fi
+) {
+#ifndef NIFAT32_RO
+    print_debug("cluster_batch_write(ca=%u, count=%u, offset=%u, size=%i)", ca, count, offset, data_size);
+    return _batch_add(b, ca, count, offset, (buffer_t)data, data_size, 1, fi);
+#endif
+    UNUSED(b, ca, count, offset);
+    UNUSED(data, data_size, fi);
+    return 1;
+}
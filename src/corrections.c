@@ -0,0 +1,48 @@
+#include <nft32/corrections.h>
+
+static corrections_t _corrections = { 0 };
+
+static int _count_corrections(int region, int index, unsigned int ca, int corrected) {
+    switch (region) {
+        case CORRECTIONS_BOOT:    __sync_fetch_and_add(&_corrections.boot, corrected);    break;
+        case CORRECTIONS_JOURNAL: __sync_fetch_and_add(&_corrections.journal, corrected); break;
+        case CORRECTIONS_ERRORS:  __sync_fetch_and_add(&_corrections.errors, corrected);  break;
+        case CORRECTIONS_FREEMAP: __sync_fetch_and_add(&_corrections.freemap, corrected); break;
+        case CORRECTIONS_FAT:
+            if (index >= CORRECTIONS_MAX_FAT) index = CORRECTIONS_MAX_FAT - 1;
+            __sync_fetch_and_add(&_corrections.fat[index], corrected);
+            _corrections.last_fat_ca = ca;
+        break;
+        case CORRECTIONS_DIRECTORY:
+            __sync_fetch_and_add(&_corrections.directory, corrected);
+            _corrections.last_directory_ca = ca;
+        break;
+        default: break;
+    }
+
+    return corrected;
+}
+
+int corrections_unpack(int region, int index, unsigned int ca, const byte_t* src, byte_t* dst, int l) {
+    int corrected = region == CORRECTIONS_BOOT || region == CORRECTIONS_ERRORS ? 
+        nft32_unpack_memory_count((const encoded_t*)src, dst, l, NULL) : nft32_ecc_unpack(src, dst, l, NULL);
+    if (!corrected) return 0;
+    return _count_corrections(region, index, ca, corrected);
+}
+
+int corrections_unpack_entries(int region, int index, unsigned int ca, const byte_t* src, byte_t* dst, int count, int size) {
+    int first = -1;
+    int corrected = nft32_ecc_unpack(src, dst, count * size, &first);
+    if (!corrected) return 0;
+    return _count_corrections(region, index, ca + (first * nft32_ecc_data_block()) / size, corrected);
+}
+
+int corrections_get(corrections_t* c) {
+    nft32_str_memcpy(c, &_corrections, sizeof(corrections_t));
+    return 1;
+}
+
+int corrections_reset() {
+    nft32_str_memset(&_corrections, 0, sizeof(corrections_t));
+    return 1;
+}
@@ -6,6 +6,8 @@ int ctable_init() {
     for (ci_t i = 0; i < CONTENT_TABLE_SIZE; i++) {
         _content_table[i].content_type = CONTENT_TYPE_EMPTY;
         _content_table[i].index.root   = NO_ECACHE;
+        nft32_str_memset(&_content_table[i].extents, 0, sizeof(extent_map_t));
+        nft32_str_memset(&_content_table[i].readahead, 0, sizeof(readahead_t));
     }
     
     return 1;
@@ -17,6 +19,8 @@ static int _init_content(ci_t ci) {
     _content_table[ci].content_type   = CONTENT_TYPE_UNKNOWN;
     _content_table[ci].parent_cluster = FAT_CLUSTER_BAD;
     _content_table[ci].index.root     = NO_ECACHE;
+    nft32_str_memset(&_content_table[ci].extents, 0, sizeof(extent_map_t));
+    nft32_str_memset(&_content_table[ci].readahead, 0, sizeof(readahead_t));
     return 1;
 }
 
@@ -53,6 +57,7 @@ int setup_content(
 
     if (meta) {
         nft32_str_memcpy(&_content_table[ci].meta, meta, sizeof(directory_entry_t));
+        entry_checksum_prefix(meta, &_content_table[ci].meta_prefix);
         _content_table[ci].parent_cluster = meta->rca;
         _content_table[ci].data_cluster   = meta->dca;
     }
@@ -68,10 +73,317 @@ cluster_addr_t get_content_data_ca(const ci_t ci) {
 
 int set_content_data_ca(const ci_t ci, cluster_addr_t ca) {
     if (ci > CONTENT_TABLE_SIZE || ci < 0) return FAT_CLUSTER_BAD;
+    content_extents_drop(ci);
+    content_readahead_drop(ci);
     _content_table[ci].data_cluster = ca;
     return 1;
 }
 
+int content_extents_drop(const ci_t ci) {
+    if (ci > CONTENT_TABLE_SIZE || ci < 0) return 0;
+    extent_map_t* map = &_content_table[ci].extents;
+#ifndef NIFAT32_NO_EXTENTS
+    if (map->runs) nft32_free_s(map->runs);
+#endif
+    map->runs     = NULL;
+    map->count    = 0;
+    map->capacity = 0;
+    map->length   = 0;
+    map->complete = 0;
+    return 1;
+}
+
+#ifndef NIFAT32_NO_EXTENTS
+/*
+Grow the runs array twice.
+Returns 1 if succeeds, otherwise will return 0.
+*/
+static int _grow_extents(extent_map_t* map) {
+    unsigned int capacity = map->capacity ? map->capacity * 2 : 4;
+    extent_t* runs = (extent_t*)nft32_malloc_s(capacity * sizeof(extent_t));
+    if (!runs) return 0;
+    if (map->runs) {
+        nft32_str_memcpy(runs, map->runs, map->count * sizeof(extent_t));
+        nft32_free_s(map->runs);
+    }
+
+    map->runs     = runs;
+    map->capacity = capacity;
+    return 1;
+}
+
+/*
+Add a run to the end of the map.
+Returns 1 if succeeds, otherwise will return 0.
+*/
+static int _push_extent(extent_map_t* map, cluster_addr_t ca, unsigned int index) {
+    if (map->count == map->capacity && !_grow_extents(map)) return 0;
+    map->runs[map->count].ca    = ca;
+    map->runs[map->count].index = index;
+    map->count++;
+    return 1;
+}
+
+/*
+Extend the last run by the cluster or start a new one.
+*/
+static int _extend_extents(extent_map_t* map, cluster_addr_t ca) {
+    if (map->count) {
+        extent_t* last = &map->runs[map->count - 1];
+        if (last->ca + (map->length - last->index) == ca) {
+            map->length++;
+            return 1;
+        }
+    }
+
+    if (!_push_extent(map, ca, map->length)) return 0;
+    map->length++;
+    return 1;
+}
+
+/*
+Extend the map by a chain walk until it covers the index or the chain ends. The walk
+continues from the last mapped cluster, thus every FAT entry of the chain is read once.
+Returns 1 if the map can be used, otherwise will return 0.
+*/
+static int _walk_extents(const ci_t ci, unsigned int index, fat_data_t* fi) {
+    extent_map_t* map = &_content_table[ci].extents;
+    if (!map->runs && !_grow_extents(map)) return 0;
+    if (map->complete || index < map->length) return 1;
+
+    cluster_addr_t ca = _content_table[ci].data_cluster;
+    if (map->count) {
+        extent_t* last = &map->runs[map->count - 1];
+        ca = read_fat(last->ca + (map->length - 1 - last->index), fi);
+    }
+
+    while (1) {
+        if (is_cluster_end(ca) || is_cluster_bad(ca) || map->length >= fi->total_clusters) {
+            map->complete = 1;
+            return 1;
+        }
+
+        if (!_extend_extents(map, ca)) {
+            print_warn("Not enough memory for the extent map of ci=%i. Walking the chain...", ci);
+            content_extents_drop(ci);
+            return 0;
+        }
+
+        if (map->length > index) return 1;
+        ca = read_fat(ca, fi);
+    }
+}
+
+/*
+Find the run of the chain index by a binary search over the runs.
+*/
+static unsigned int _find_extent(extent_map_t* map, unsigned int index) {
+    unsigned int low = 0, high = map->count - 1;
+    while (low < high) {
+        unsigned int mid = (low + high + 1) / 2;
+        if (map->runs[mid].index <= index) low = mid;
+        else high = mid - 1;
+    }
+
+    return low;
+}
+
+/*
+Find the cluster of the chain index.
+*/
+static cluster_addr_t _lookup_extent(extent_map_t* map, unsigned int index) {
+    if (index >= map->length) return FAT_CLUSTER_END;
+    unsigned int run = _find_extent(map, index);
+    return map->runs[run].ca + (index - map->runs[run].index);
+}
+
+/*
+Drop maps of other contents with the same data chain. They became outdated after the chain change.
+*/
+static void _drop_shared_extents(const ci_t ci) {
+    for (ci_t i = 0; i < CONTENT_TABLE_SIZE; i++) {
+        if (i == ci || !_content_table[i].extents.runs) continue;
+        if (_content_table[i].data_cluster == _content_table[ci].data_cluster) content_extents_drop(i);
+    }
+}
+#endif
+
+cluster_addr_t get_content_cluster(const ci_t ci, unsigned int index, fat_data_t* fi) {
+    if (ci > CONTENT_TABLE_SIZE || ci < 0) return FAT_CLUSTER_BAD;
+#ifndef NIFAT32_NO_EXTENTS
+    if (_walk_extents(ci, index, fi)) return _lookup_extent(&_content_table[ci].extents, index);
+#endif
+    cluster_addr_t ca = _content_table[ci].data_cluster;
+    while (index-- > 0 && !is_cluster_end(ca) && !is_cluster_bad(ca)) ca = read_fat(ca, fi);
+    return ca;
+}
+
+cluster_addr_t get_content_next_cluster(const ci_t ci, unsigned int index, cluster_addr_t ca, fat_data_t* fi) {
+    if (ci > CONTENT_TABLE_SIZE || ci < 0) return FAT_CLUSTER_BAD;
+#ifndef NIFAT32_NO_EXTENTS
+    if (_walk_extents(ci, index, fi)) return _lookup_extent(&_content_table[ci].extents, index);
+#endif
+    UNUSED(index);
+    return read_fat(ca, fi);
+}
+
+unsigned int get_content_run(const ci_t ci, unsigned int index, unsigned int max, fat_data_t* fi) {
+    if (ci > CONTENT_TABLE_SIZE || ci < 0 || !max) return 0;
+#ifndef NIFAT32_NO_EXTENTS
+    if (_walk_extents(ci, index + max - 1, fi)) {
+        extent_map_t* map = &_content_table[ci].extents;
+        if (index >= map->length) return 0;
+        unsigned int run = _find_extent(map, index);
+        unsigned int end = run + 1 < map->count ? map->runs[run + 1].index : map->length;
+        return end - index < max ? end - index : max;
+    }
+#endif
+    UNUSED(index, fi);
+    return 1;
+}
+
+unsigned int get_content_length(const ci_t ci, fat_data_t* fi) {
+    if (ci > CONTENT_TABLE_SIZE || ci < 0) return 0;
+#ifndef NIFAT32_NO_EXTENTS
+    if (_walk_extents(ci, ~0U, fi)) return _content_table[ci].extents.length;
+#endif
+    unsigned int length = 0;
+    cluster_addr_t ca = _content_table[ci].data_cluster;
+    while (!is_cluster_end(ca) && !is_cluster_bad(ca) && length < fi->total_clusters) {
+        ca = read_fat(ca, fi);
+        length++;
+    }
+
+    return length;
+}
+
+int content_extents_append(const ci_t ci, cluster_addr_t ca) {
+    if (ci > CONTENT_TABLE_SIZE || ci < 0) return 0;
+#ifndef NIFAT32_NO_EXTENTS
+    /* A partial map will find the cluster by the next walk. */
+    _drop_shared_extents(ci);
+    extent_map_t* map = &_content_table[ci].extents;
+    if (map->runs && map->complete && !_extend_extents(map, ca)) content_extents_drop(ci);
+#endif
+    UNUSED(ca);
+    return 1;
+}
+
+int content_extents_trim(const ci_t ci, unsigned int first, unsigned int count) {
+    if (ci > CONTENT_TABLE_SIZE || ci < 0) return 0;
+#ifndef NIFAT32_NO_EXTENTS
+    _drop_shared_extents(ci);
+    extent_map_t* map = &_content_table[ci].extents;
+    if (!map->runs) return 1;
+    if (first >= map->length) return content_extents_drop(ci);
+    if (count <= map->length - first) map->complete = 1;
+    else count = map->length - first;
+
+    /* Runs are clipped to [first, first + count) and moved to the start. */
+    unsigned int kept = 0;
+    for (unsigned int i = 0; i < map->count; i++) {
+        unsigned int start = map->runs[i].index;
+        unsigned int end   = i + 1 < map->count ? map->runs[i + 1].index : map->length;
+        if (end <= first || start >= first + count) continue;
+        if (start < first) start = first;
+        map->runs[kept].ca    = map->runs[i].ca + (start - map->runs[i].index);
+        map->runs[kept].index = start - first;
+        kept++;
+    }
+
+    map->count  = kept;
+    map->length = count;
+#endif
+    UNUSED(first, count);
+    return 1;
+}
+
+#ifndef NIFAT32_NO_READAHEAD
+/*
+Read the window of clusters from the chain index to the read-ahead buffer.
+Returns 1 if succeeds, otherwise will return 0.
+*/
+static int _fill_readahead(const ci_t ci, unsigned int index, fat_data_t* fi) {
+    readahead_t* ra = &_content_table[ci].readahead;
+    ra->count = 0;
+    if (ra->capacity < ra->window) {
+        if (ra->buffer) nft32_free_s(ra->buffer);
+        ra->buffer   = (buffer_t)nft32_malloc_s(ra->window * fi->cluster_size);
+        ra->capacity = ra->buffer ? ra->window : 0;
+        if (!ra->buffer) {
+            print_warn("Not enough memory for the read-ahead of ci=%i. Reading directly...", ci);
+            return 0;
+        }
+    }
+
+    cluster_batch_t batch;
+    cluster_batch_init(&batch);
+    unsigned int filled = 0;
+    cluster_addr_t ca = get_content_cluster(ci, index, fi);
+    while (filled < ra->window && !is_cluster_end(ca) && !is_cluster_bad(ca)) {
+        unsigned int run = get_content_run(ci, index + filled, ra->window - filled, fi);
+        if (!run) break;
+        if (!cluster_batch_read(&batch, ca, run, 0, ra->buffer + filled * fi->cluster_size, run * fi->cluster_size, fi)) break;
+        filled += run;
+        ca = get_content_next_cluster(ci, index + filled, ca + run - 1, fi);
+    }
+
+    if (!cluster_batch_wait(&batch)) return 0;
+    ra->first = index;
+    ra->count = filled;
+    return 1;
+}
+
+/*
+Check if the clusters from the first to the last index are buffered.
+*/
+static int _readahead_covers(readahead_t* ra, unsigned int first, unsigned int last) {
+    return ra->count && first >= ra->first && last < ra->first + ra->count;
+}
+#endif
+
+int read_content_ahead(const ci_t ci, cluster_offset_t offset, buffer_t buffer, int size, fat_data_t* fi) {
+    if (ci > CONTENT_TABLE_SIZE || ci < 0 || size <= 0) return 0;
+#ifndef NIFAT32_NO_READAHEAD
+    readahead_t* ra = &_content_table[ci].readahead;
+    int sequential = offset == ra->next;
+    ra->next = offset + size;
+
+    unsigned int first = offset / fi->cluster_size;
+    unsigned int last  = (offset + size - 1) / fi->cluster_size;
+    if (!_readahead_covers(ra, first, last)) {
+        if (!sequential) {
+            ra->window = 0;
+            return 0;
+        }
+
+        ra->window = ra->window ? ra->window * 2 : 1;
+        if (ra->window > READ_AHEAD_MAX) ra->window = READ_AHEAD_MAX;
+
+        /* Reads of the window size and bigger are moved by runs directly to the caller buffer. */
+        if (last - first >= ra->window) return 0;
+        if (!_fill_readahead(ci, first, fi) || !_readahead_covers(ra, first, last)) return 0;
+    }
+
+    nft32_str_memcpy(buffer, ra->buffer + (offset - ra->first * fi->cluster_size), size);
+    return size;
+#endif
+    UNUSED(offset, buffer, fi);
+    return 0;
+}
+
+int content_readahead_drop(const ci_t ci) {
+    if (ci > CONTENT_TABLE_SIZE || ci < 0) return 0;
+#ifndef NIFAT32_NO_READAHEAD
+    for (ci_t i = 0; i < CONTENT_TABLE_SIZE; i++) {
+        if (i == ci || _content_table[i].data_cluster == _content_table[ci].data_cluster) {
+            _content_table[i].readahead.count = 0;
+        }
+    }
+#endif
+    return 1;
+}
+
 unsigned int get_content_size(const ci_t ci) {
     if (ci > CONTENT_TABLE_SIZE || ci < 0) return 0;
     return _content_table[ci].meta.file_size;
@@ -82,6 +394,24 @@ const char* get_content_name(const ci_t ci) {
     return (const char*)_content_table[ci].meta.file_name;
 }
 
+int get_content_hashed_name(const ci_t ci, hashed_name_t* hn) {
+    if (ci > CONTENT_TABLE_SIZE || ci < 0) return 0;
+    hn->name = (const char*)_content_table[ci].meta.file_name;
+    hn->hash = _content_table[ci].meta.name_hash;
+    return 1;
+}
+
+int update_content_meta(const ci_t ci, cluster_addr_t dca, unsigned int file_size, directory_entry_t* meta) {
+    if (ci > CONTENT_TABLE_SIZE || ci < 0) return 0;
+    content_t* content = &_content_table[ci];
+    content->data_cluster   = dca;
+    content->meta.dca       = dca;
+    content->meta.file_size = file_size;
+    content->meta.checksum  = entry_checksum_update(&content->meta_prefix, &content->meta);
+    if (meta) nft32_str_memcpy(meta, &content->meta, sizeof(directory_entry_t));
+    return 1;
+}
+
 cluster_addr_t get_content_root_ca(const ci_t ci) {
     if (ci > CONTENT_TABLE_SIZE || ci < 0) return FAT_CLUSTER_BAD;
     return _content_table[ci].parent_cluster;
@@ -134,6 +464,11 @@ int destroy_content(ci_t ci) {
     if (ci > CONTENT_TABLE_SIZE || ci < 0) return 0;
     if (_content_table[ci].content_type == CONTENT_TYPE_EMPTY) return 0;
     if (_content_table[ci].index.root) ecache_free(_content_table[ci].index.root);
+    content_extents_drop(ci);
+#ifndef NIFAT32_NO_READAHEAD
+    if (_content_table[ci].readahead.buffer) nft32_free_s(_content_table[ci].readahead.buffer);
+#endif
+    nft32_str_memset(&_content_table[ci].readahead, 0, sizeof(readahead_t));
     _content_table[ci].content_type = CONTENT_TYPE_EMPTY;
     _content_table[ci].index.root   = NO_ECACHE;
     return 1;
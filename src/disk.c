@@ -1,147 +1,725 @@
 #include <nft32/disk.h>
 
 static disk_io_t _disk_io = {
-    .read_sector  = NULL,
-    .write_sector = NULL,
-    .sector_size  = 512
+    .read_sector   = NULL,
+    .write_sector  = NULL,
+    .sector_size   = 512,
+    .read_sectors  = NULL,
+    .write_sectors = NULL,
+    .readv         = NULL,
+    .writev        = NULL,
+    .wait          = NULL,
+    .submit        = NULL,
+    .poll          = NULL
 };
 
-static io_thread_t _io_guard = { .lock = NULL_LOCK };
+static io_shard_t _io_shards[IO_LOCK_SHARDS];
 
-static int _lock_area(sector_addr_t sa, int size, int ro) {
-    if (!THR_require_write(&_io_guard.lock, get_thread_num())) return 0;
-    int found = -1, locked = 0;
-    for (int i = 0; i < IO_THREADS_MAX; i++) {
-        if (_io_guard.areas[i].count == -1) {
+static void _wait() {
+    if (_disk_io.wait) {
+        _disk_io.wait();
+        return;
+    }
+
+    sched_yield();
+}
+
+/*
+Take the lock, or wait for it. Waiters of the disk layer don't fail.
+*/
+static void _wait_lock(lock_t* lock) {
+    while (!THR_require_write(lock, get_thread_num())) _wait();
+}
+
+/*
+Count of shards of the range regions. A range of IO_LOCK_SHARDS regions covers every shard.
+*/
+static int _area_shards(sector_addr_t sa, int size, int* first) {
+    sector_addr_t region = sa / IO_LOCK_REGION_SECTORS;
+    sector_addr_t last   = (sa + (size > 0 ? size : 1) - 1) / IO_LOCK_REGION_SECTORS;
+    *first = region % IO_LOCK_SHARDS;
+    return last - region + 1 < IO_LOCK_SHARDS ? (int)(last - region + 1) : IO_LOCK_SHARDS;
+}
+
+/*
+Remove the range from the shard. Equal ranges are the same, thus any of them can be removed.
+*/
+static void _shard_remove(io_shard_t* shard, sector_addr_t sa, int size) {
+    _wait_lock(&shard->lock);
+    for (int i = 0; i < IO_SHARD_AREAS; i++) {
+        if (shard->areas[i].count != -1 && shard->areas[i].start == sa && shard->areas[i].count == size) {
+            shard->areas[i].count = -1;
+            break;
+        }
+    }
+
+    THR_release_write(&shard->lock, get_thread_num());
+}
+
+/*
+Place the range to the shard, if there is no overlapped range of a writer.
+Return 0 if the range overlaps, or if the shard is full.
+*/
+static int _shard_place(io_shard_t* shard, sector_addr_t sa, int size, int ro) {
+    _wait_lock(&shard->lock);
+    int found = -1;
+    for (int i = 0; i < IO_SHARD_AREAS; i++) {
+        io_area_t* area = &shard->areas[i];
+        if (area->count == -1) {
             if (found == -1) found = i;
             continue;
         }
 
-        sector_addr_t a_start = _io_guard.areas[i].start;
-        sector_addr_t a_end   = a_start + _io_guard.areas[i].count;
-        sector_addr_t b_start = sa;
-        sector_addr_t b_end   = sa + size;
-        if ((a_start < b_end) && (b_start < a_end)) {
-            if (!ro) {
-                locked = 1;
-                break;
-            } 
-            else {
-                if (!_io_guard.areas[i].ro) {
-                    locked = 1;
-                    break;
-                }
-            }
+        if (area->start < sa + size && sa < area->start + area->count && (!ro || !area->ro)) {
+            found = -1;
+            break;
         }
     }
 
-    if (!locked && found != -1) {
-        _io_guard.areas[found].start = sa;
-        _io_guard.areas[found].count = size;
-        _io_guard.areas[found].ro    = ro;
-        THR_release_write(&_io_guard.lock, get_thread_num());
-        return 1;
+    if (found != -1) {
+        shard->areas[found].start = sa;
+        shard->areas[found].count = size;
+        shard->areas[found].ro    = ro;
     }
 
-    THR_release_write(&_io_guard.lock, get_thread_num());
-    return 0;
+    THR_release_write(&shard->lock, get_thread_num());
+    return found != -1;
+}
+
+/*
+Try to lock the area once. Shards are locked one by one, and a conflict releases shards of
+the range, thus a thread never waits with a part of an area.
+*/
+static int _try_lock_area(sector_addr_t sa, int size, int ro) {
+    int first, shards = _area_shards(sa, size, &first);
+    for (int s = 0; s < shards; s++) {
+        if (_shard_place(&_io_shards[(first + s) % IO_LOCK_SHARDS], sa, size, ro)) continue;
+        while (s-- > 0) _shard_remove(&_io_shards[(first + s) % IO_LOCK_SHARDS], sa, size);
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+Lock the area. The caller waits until overlapped writers (or readers for a write) release it.
+*/
+static void _lock_area(sector_addr_t sa, int size, int ro) {
+    while (!_try_lock_area(sa, size, ro)) _wait();
+}
+
+static void _unlock_area(sector_addr_t sa, int size) {
+    int first, shards = _area_shards(sa, size, &first);
+    for (int s = 0; s < shards; s++) _shard_remove(&_io_shards[(first + s) % IO_LOCK_SHARDS], sa, size);
+}
+
+/*
+Read bytes from the byte offset of the sector. The range goes to the platform by one call,
+or by sectors if there is no `read_sectors`. The offset should be in the first sector.
+*/
+static int _io_read_range(sector_addr_t sa, sector_offset_t offset, unsigned char* buffer, int size) {
+    if (_disk_io.read_sectors) return _disk_io.read_sectors(sa, offset, buffer, size);
+
+    while (size > 0) {
+        int read_size = size > _disk_io.sector_size - offset ? _disk_io.sector_size - offset : size;
+        if (!_disk_io.read_sector(sa++, offset, buffer, read_size)) return 0;
+        buffer += read_size;
+        size -= read_size;
+        offset = 0;
+    }
+
+    return 1;
+}
+
+#ifndef NIFAT32_RO
+/*
+Write bytes from the byte offset of the sector. The range goes to the platform by one call,
+or by sectors if there is no `write_sectors`. The offset should be in the first sector.
+*/
+static int _io_write_range(sector_addr_t sa, sector_offset_t offset, const unsigned char* data, int size) {
+    if (_disk_io.write_sectors) return _disk_io.write_sectors(sa, offset, data, size);
+
+    while (size > 0) {
+        int write_size = size > _disk_io.sector_size - offset ? _disk_io.sector_size - offset : size;
+        if (!_disk_io.write_sector(sa++, offset, data, write_size)) return 0;
+        data += write_size;
+        size -= write_size;
+        offset = 0;
+    }
+
+    return 1;
+}
+#endif
+
+#ifndef NO_SECTOR_CACHE
+static sector_cache_t _cache = { .count = 0, .lock = NULL_LOCK };
+
+static unsigned char* _slot_data(int i) {
+    return _cache.data + (unsigned long)i * _disk_io.sector_size;
+}
+
+static int _cache_find(sector_addr_t sa) {
+    for (int i = _cache.buckets[sa & _cache.mask]; i != -1; i = _cache.slots[i].hnext) {
+        if (_cache.slots[i].sa == sa) return i;
+    }
+
+    return -1;
+}
+
+static void _cache_unlink(int i) {
+    sector_slot_t* slot = &_cache.slots[i];
+    if (slot->prev != -1) _cache.slots[slot->prev].next = slot->next;
+    else _cache.head = slot->next;
+    if (slot->next != -1) _cache.slots[slot->next].prev = slot->prev;
+    else _cache.tail = slot->prev;
+}
+
+/*
+Move the slot to the head of the LRU list.
+*/
+static void _cache_touch(int i) {
+    if (_cache.head == i) return;
+    _cache_unlink(i);
+    _cache.slots[i].prev = -1;
+    _cache.slots[i].next = _cache.head;
+    if (_cache.head != -1) _cache.slots[_cache.head].prev = i;
+    _cache.head = i;
+    if (_cache.tail == -1) _cache.tail = i;
+}
+
+static void _cache_unhash(int i) {
+    int* link = &_cache.buckets[_cache.slots[i].sa & _cache.mask];
+    while (*link != i) link = &_cache.slots[*link].hnext;
+    *link = _cache.slots[i].hnext;
+}
+
+#ifndef NIFAT32_RO
+static int _cache_writeback(int i) {
+    if (!_io_write_range(_cache.slots[i].sa, 0, _slot_data(i), _disk_io.sector_size)) {
+        print_error("Sector cache write-back error! sa=%u", _cache.slots[i].sa);
+        return 0;
+    }
+
+    _cache.slots[i].dirty = 0;
+    _cache.stat.dirty--;
+    _cache.stat.writebacks++;
+    return 1;
+}
+#endif
+
+/*
+Take the least recently used slot for the sector. A dirty sector of the slot is written first.
+The caller should touch sectors of the current run before, thus they aren't evicted.
+Return the slot index, or -1 if the dirty sector can't be written.
+*/
+static int _cache_take(sector_addr_t sa) {
+    int i = _cache.tail;
+    sector_slot_t* slot = &_cache.slots[i];
+    if (slot->valid) {
+#ifndef NIFAT32_RO
+        if (slot->dirty && !_cache_writeback(i)) return -1;
+#endif
+        _cache_unhash(i);
+        _cache.stat.evictions++;
+    }
+
+    slot->sa    = sa;
+    slot->valid = 1;
+    slot->dirty = 0;
+    slot->hnext = _cache.buckets[sa & _cache.mask];
+    _cache.buckets[sa & _cache.mask] = i;
+    _cache_touch(i);
+    return i;
 }
 
-static int _unlock_area(sector_addr_t sa, int size) {
-    if (THR_require_write(&_io_guard.lock, get_thread_num())) {
-        for (int i = 0; i < IO_THREADS_MAX; i++) {
-            if (_io_guard.areas[i].start == sa && _io_guard.areas[i].count == size) {
-                _io_guard.areas[i].count = -1;
-                _io_guard.areas[i].start = 0;
-                _io_guard.areas[i].ro    = 0;
-                break;
+/*
+Touch cached sectors of the run and count them.
+*/
+static int _cache_touch_run(sector_addr_t sa, int sc) {
+    int cached = 0;
+    for (int s = 0; s < sc; s++) {
+        int i = _cache_find(sa + s);
+        if (i == -1) continue;
+        _cache_touch(i);
+        cached++;
+    }
+
+    return cached;
+}
+
+/*
+Part of the sector `s` of the run, which is covered by the range.
+*/
+static void _run_part(int s, sector_offset_t offset, int size, int* from, int* part, int* pos) {
+    int ss = _disk_io.sector_size;
+    *from = s ? 0 : offset;
+    *pos  = s ? s * ss - offset : 0;
+    *part = ss - *from;
+    if (*part > size - *pos) *part = size - *pos;
+}
+
+/*
+Copy cached dirty sectors over the data of a run, which was read from the disk.
+*/
+static void _cache_overlay(sector_addr_t sa, sector_offset_t offset, unsigned char* buffer, int size, int sc) {
+    if (!_cache.stat.dirty) return;
+    for (int s = 0; s < sc; s++) {
+        int i = _cache_find(sa + s);
+        if (i == -1 || !_cache.slots[i].dirty) continue;
+        int from, part, pos;
+        _run_part(s, offset, size, &from, &part, &pos);
+        nft32_str_memcpy(buffer + pos, _slot_data(i) + from, part);
+    }
+}
+
+#ifndef NIFAT32_RO
+/*
+Copy the written data to cached sectors of the run. Dirty flags are kept.
+*/
+static void _cache_patch(sector_addr_t sa, sector_offset_t offset, const unsigned char* data, int size, int sc) {
+    for (int s = 0; s < sc; s++) {
+        int i = _cache_find(sa + s);
+        if (i == -1) continue;
+        int from, part, pos;
+        _run_part(s, offset, size, &from, &part, &pos);
+        nft32_str_memcpy(_slot_data(i) + from, data + pos, part);
+    }
+}
+#endif
+
+static int _cache_read(sector_addr_t sa, sector_offset_t offset, unsigned char* buffer, int size, int sc) {
+    if (sc > SECTOR_CACHE_RUN_MAX) {
+        if (!_io_read_range(sa, offset, buffer, size)) return 0;
+        _cache_overlay(sa, offset, buffer, size, sc);
+        return 1;
+    }
+
+    int ss = _disk_io.sector_size;
+    int cached = _cache_touch_run(sa, sc);
+    _cache.stat.hits   += cached;
+    _cache.stat.misses += sc - cached;
+    if (cached < sc && !_io_read_range(sa, 0, _cache.scratch, sc * ss)) return 0;
+
+    for (int s = 0; s < sc; s++) {
+        int from, part, pos;
+        _run_part(s, offset, size, &from, &part, &pos);
+        int i = _cache_find(sa + s);
+        if (i == -1) {
+            i = _cache_take(sa + s);
+            if (i == -1) {
+                nft32_str_memcpy(buffer + pos, _cache.scratch + s * ss + from, part);
+                continue;
             }
+
+            nft32_str_memcpy(_slot_data(i), _cache.scratch + s * ss, ss);
         }
 
-        THR_release_write(&_io_guard.lock, get_thread_num());
-        return 1;
+        nft32_str_memcpy(buffer + pos, _slot_data(i) + from, part);
     }
-    
-    return 0;
+
+    return 1;
 }
 
-int DSK_setup(
-    int (*read)(sector_addr_t, sector_offset_t, unsigned char*, int), 
-    int (*write)(sector_addr_t, sector_offset_t, const unsigned char*, int), 
-    int sector_size
-) {
-    print_debug("DSK_setup(read=%p, write=%p, sector_size=%i)", read, write, sector_size);
-    if (!read || !write || sector_size <= 0) return 0;
-    
-    _disk_io.read_sector  = read;
-    _disk_io.write_sector = write;
-    _disk_io.sector_size  = sector_size;
-    for (int i = 0; i < IO_THREADS_MAX; i++) {
-        _io_guard.areas[i].count = -1;
-        _io_guard.areas[i].start = 0;
-        _io_guard.areas[i].ro    = 0;
+#ifndef NIFAT32_RO
+static int _cache_write(sector_addr_t sa, sector_offset_t offset, const unsigned char* data, int size, int sc) {
+    int ss = _disk_io.sector_size;
+    if (sc > SECTOR_CACHE_RUN_MAX || _cache.mode == SECTOR_CACHE_WRITE_THROUGH) {
+        if (!_io_write_range(sa, offset, data, size)) return 0;
+        if (sc > SECTOR_CACHE_RUN_MAX) {
+            _cache_patch(sa, offset, data, size, sc);
+            return 1;
+        }
+    }
+
+    _cache.stat.hits += _cache_touch_run(sa, sc);
+    for (int s = 0; s < sc; s++) {
+        int from, part, pos;
+        _run_part(s, offset, size, &from, &part, &pos);
+        int i = _cache_find(sa + s);
+        if (i == -1) {
+            /* A partial sector is cached only by the write-back, which reads it first. */
+            if (part < ss && _cache.mode == SECTOR_CACHE_WRITE_THROUGH) continue;
+            i = _cache_take(sa + s);
+            if (i == -1) {
+                if (!_io_write_range(sa + s, from, data + pos, part)) return 0;
+                continue;
+            }
+
+            if (part < ss) {
+                _cache.stat.misses++;
+                if (!_io_read_range(sa + s, 0, _slot_data(i), ss)) {
+                    _cache_unhash(i);
+                    _cache.slots[i].valid = 0;
+                    return 0;
+                }
+            }
+        }
+
+        nft32_str_memcpy(_slot_data(i) + from, data + pos, part);
+        if (_cache.mode == SECTOR_CACHE_WRITE_BACK && !_cache.slots[i].dirty) {
+            _cache.slots[i].dirty = 1;
+            _cache.stat.dirty++;
+        }
     }
 
     return 1;
 }
+#endif
+#endif
 
-int DSK_read_sector(sector_addr_t sa, unsigned char* buffer, int buff_size) {
-    print_debug("DSK_read_sector(sa=%u, size=%i)", sa, buff_size);
-    if (_lock_area(sa, 1, READ_LOCK)) {
-        int read_result = _disk_io.read_sector(sa, 0, buffer, buff_size);
-        _unlock_area(sa, 1);
+/*
+Read bytes from the byte offset of the sector through the sector cache. The caller should hold the area.
+*/
+static int _read_range(sector_addr_t sa, sector_offset_t offset, unsigned char* buffer, int size) {
+    sa += offset / _disk_io.sector_size;
+    offset %= _disk_io.sector_size;
+#ifndef NO_SECTOR_CACHE
+    if (_cache.count) {
+        _wait_lock(&_cache.lock);
+        int sc = (offset + size + _disk_io.sector_size - 1) / _disk_io.sector_size;
+        int read_result = _cache_read(sa, offset, buffer, size, sc);
+        THR_release_write(&_cache.lock, get_thread_num());
         return read_result;
     }
-    else {
-        print_error("Can't read-lock area sa=%u sc=1", sa);
+#endif
+    return _io_read_range(sa, offset, buffer, size);
+}
+
+#ifndef NIFAT32_RO
+/*
+Write bytes from the byte offset of the sector through the sector cache. The caller should hold the area.
+*/
+static int _write_range(sector_addr_t sa, sector_offset_t offset, const unsigned char* data, int size) {
+    sa += offset / _disk_io.sector_size;
+    offset %= _disk_io.sector_size;
+#ifndef NO_SECTOR_CACHE
+    if (_cache.count) {
+        _wait_lock(&_cache.lock);
+        int sc = (offset + size + _disk_io.sector_size - 1) / _disk_io.sector_size;
+        int write_result = _cache_write(sa, offset, data, size, sc);
+        THR_release_write(&_cache.lock, get_thread_num());
+        return write_result;
+    }
+#endif
+    return _io_write_range(sa, offset, data, size);
+}
+#endif
+
+/*
+Sectors under the range of the vector part.
+*/
+static int _iovec_sectors(const disk_iovec_t* iov, sector_addr_t* sa) {
+    *sa = iov->sa + iov->offset / _disk_io.sector_size;
+    return (iov->offset % _disk_io.sector_size + iov->size + _disk_io.sector_size - 1) / _disk_io.sector_size;
+}
+
+/*
+Try to lock areas of every vector part. If an area can't be locked, locked areas are released,
+and the caller goes by ranges, thus it doesn't wait with a part of areas.
+*/
+static int _lock_iovec(const disk_iovec_t* iov, int count, int ro) {
+    for (int i = 0; i < count; i++) {
+        sector_addr_t sa;
+        int sc = _iovec_sectors(&iov[i], &sa);
+        if (_try_lock_area(sa, sc, ro)) continue;
+        while (i-- > 0) {
+            sc = _iovec_sectors(&iov[i], &sa);
+            _unlock_area(sa, sc);
+        }
+
+        return 0;
+    }
+
+    return 1;
+}
+
+static void _unlock_iovec(const disk_iovec_t* iov, int count) {
+    for (int i = 0; i < count; i++) {
+        sector_addr_t sa;
+        int sc = _iovec_sectors(&iov[i], &sa);
+        _unlock_area(sa, sc);
     }
+}
 
+static int _cache_enabled() {
+#ifndef NO_SECTOR_CACHE
+    return _cache.count > 0;
+#endif
     return 0;
 }
 
-int DSK_readoff_sectors(sector_addr_t sa, sector_offset_t offset, unsigned char* buffer, int buff_size, int sc) {
-    print_debug("DSK_readoff_sectors(sa=%u, offset=%u, size=%i, sc=%i)", sa, offset, buff_size, sc);
-    if (_lock_area(sa, sc, READ_LOCK)) {
-        int total_readden = 0;
-        for (int i = 0; i < sc && buff_size > 0; i++) {
-            if (offset > _disk_io.sector_size) offset -= _disk_io.sector_size;
-            else {
-                int read_size = buff_size > _disk_io.sector_size - offset ? _disk_io.sector_size - offset : buff_size;
-                if (!_disk_io.read_sector(sa + i, offset, buffer + total_readden, read_size)) {
-                    print_error("Disk read IO error! addr=%u, off=%u, read_size=%i", sa + i, offset, read_size);
-                    _unlock_area(sa, sc);
-                    return 0;
-                }
+#ifndef NIFAT32_RO
+static int _cache_write_through() {
+#ifndef NO_SECTOR_CACHE
+    return !_cache.count || _cache.mode == SECTOR_CACHE_WRITE_THROUGH;
+#endif
+    return 1;
+}
 
-                total_readden += read_size;
-                buff_size -= read_size;
-                offset = 0;
-            }
+/*
+Copy ranges, which are written by the platform `writev`, to cached sectors.
+*/
+static void _cache_patch_iovec(const disk_iovec_t* iov, int count) {
+#ifndef NO_SECTOR_CACHE
+    if (!_cache.count) return;
+    _wait_lock(&_cache.lock);
+    for (int i = 0; i < count; i++) {
+        sector_addr_t sa;
+        int sc = _iovec_sectors(&iov[i], &sa);
+        _cache_patch(sa, iov[i].offset % _disk_io.sector_size, iov[i].buffer, iov[i].size, sc);
+    }
+
+    THR_release_write(&_cache.lock, get_thread_num());
+    return;
+#endif
+    UNUSED(iov, count);
+}
+#endif
+
+/*
+Try to lock ranges of every request. If a range can't be locked, locked ranges are released.
+Under NIFAT32_RO writes aren't queued.
+*/
+static int _lock_requests(disk_request_t* reqs, int count) {
+    for (int i = 0; i < count; i++) {
+        sector_addr_t sa;
+        int sc = _iovec_sectors(&reqs[i].iov, &sa);
+#ifdef NIFAT32_RO
+        int locked = !reqs[i].write && _try_lock_area(sa, sc, READ_LOCK);
+#else
+        int locked = _try_lock_area(sa, sc, reqs[i].write ? WRITE_LOCK : READ_LOCK);
+#endif
+        if (locked) continue;
+        while (i-- > 0) {
+            sc = _iovec_sectors(&reqs[i].iov, &sa);
+            _unlock_area(sa, sc);
         }
 
-        _unlock_area(sa, sc);
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+Invoke the completion callback, then publish the status. The waiter can reuse the request after it.
+*/
+static void _request_finish(disk_request_t* req, int result) {
+    if (req->done) req->done(req, result);
+    __sync_synchronize();
+    req->status = result ? 1 : 0;
+}
+
+/*
+Do the request by blocking run functions.
+*/
+static void _request_sync(disk_request_t* req) {
+    sector_addr_t sa;
+    int sc = _iovec_sectors(&req->iov, &sa) + sa - req->iov.sa;
+    int result = req->write ?
+        DSK_writeoff_run(req->iov.sa, req->iov.offset, req->iov.buffer, req->iov.size, sc) :
+        DSK_readoff_run(req->iov.sa, req->iov.offset, req->iov.buffer, req->iov.size, sc);
+    _request_finish(req, result);
+}
+
+/*
+Do a list of ranges by batches of requests.
+*/
+static int _iovec_batch(const disk_iovec_t* iov, int count, int write) {
+    int result = 1;
+    disk_request_t reqs[DISK_BATCH_MAX];
+    for (int first = 0; first < count; first += DISK_BATCH_MAX) {
+        int batch = count - first < DISK_BATCH_MAX ? count - first : DISK_BATCH_MAX;
+        for (int i = 0; i < batch; i++) {
+            reqs[i].iov   = iov[first + i];
+            reqs[i].write = write;
+            reqs[i].done  = NULL;
+            reqs[i].ctx   = NULL;
+        }
+
+        DSK_submit(reqs, batch);
+        result = DSK_wait(reqs, batch) && result;
+        if (!result && !write) return 0;
+    }
+
+    return result;
+}
+
+int DSK_setup(const disk_io_t* io) {
+    print_debug(
+        "DSK_setup(read=%p, write=%p, sector_size=%i, read_sectors=%p, write_sectors=%p, readv=%p, writev=%p, submit=%p, poll=%p)", 
+        io->read_sector, io->write_sector, io->sector_size, io->read_sectors, io->write_sectors, io->readv, io->writev, io->submit, io->poll
+    );
+
+    if (!io->read_sector || !io->write_sector || io->sector_size <= 0) return 0;
+    nft32_str_memcpy(&_disk_io, io, sizeof(disk_io_t));
+    for (int s = 0; s < IO_LOCK_SHARDS; s++) {
+        _io_shards[s].lock = NULL_LOCK;
+        for (int i = 0; i < IO_SHARD_AREAS; i++) {
+            _io_shards[s].areas[i].count = -1;
+            _io_shards[s].areas[i].start = 0;
+            _io_shards[s].areas[i].ro    = 0;
+        }
+    }
+
+    return 1;
+}
+
+int DSK_cache_init(unsigned int size, int mode) {
+#ifndef NO_SECTOR_CACHE
+    print_debug("DSK_cache_init(size=%u, mode=%i)", size, mode);
+    DSK_cache_unload();
+    int count = size / _disk_io.sector_size;
+    if (!size) return 1;
+    if (count < 2 * SECTOR_CACHE_RUN_MAX) {
+        print_warn("Sector cache budget %u is less than %i sectors! There is no sector cache.", size, 2 * SECTOR_CACHE_RUN_MAX);
         return 1;
     }
-    else {
-        print_error("Can't read-lock area sa=%u sc=%i", sa, sc);
+
+    int buckets = 1;
+    while (buckets < count) buckets <<= 1;
+    _cache.slots   = (sector_slot_t*)nft32_malloc_s(count * sizeof(sector_slot_t));
+    _cache.buckets = (int*)nft32_malloc_s(buckets * sizeof(int));
+    _cache.data    = (unsigned char*)nft32_malloc_s((unsigned long)count * _disk_io.sector_size);
+    _cache.scratch = (unsigned char*)nft32_malloc_s(SECTOR_CACHE_RUN_MAX * _disk_io.sector_size);
+    if (!_cache.slots || !_cache.buckets || !_cache.data || !_cache.scratch) {
+        print_error("nft32_malloc_s() error!");
+        DSK_cache_unload();
+        return 0;
+    }
+
+    for (int i = 0; i < buckets; i++) _cache.buckets[i] = -1;
+    for (int i = 0; i < count; i++) {
+        _cache.slots[i].sa    = 0;
+        _cache.slots[i].prev  = i - 1;
+        _cache.slots[i].next  = i + 1 < count ? i + 1 : -1;
+        _cache.slots[i].hnext = -1;
+        _cache.slots[i].valid = 0;
+        _cache.slots[i].dirty = 0;
     }
 
+    nft32_str_memset(&_cache.stat, 0, sizeof(sector_cache_stat_t));
+    _cache.stat.sectors = count;
+    _cache.mask  = buckets - 1;
+    _cache.head  = 0;
+    _cache.tail  = count - 1;
+    _cache.mode  = mode;
+    _cache.count = count;
+    return 1;
+#endif
+    UNUSED(size, mode);
+    print_warn("DSK_cache_init() is not implemented! Don't provide the 'NO_SECTOR_CACHE'!");
+    return 1;
+}
+
+int DSK_flush() {
+#if !defined(NO_SECTOR_CACHE) && !defined(NIFAT32_RO)
+    if (!_cache.count || !_cache.stat.dirty) return 1;
+    _wait_lock(&_cache.lock);
+    int result = 1;
+    for (int i = 0; i < _cache.count; i++) {
+        if (_cache.slots[i].valid && _cache.slots[i].dirty) result = _cache_writeback(i) && result;
+    }
+
+    THR_release_write(&_cache.lock, get_thread_num());
+    return result;
+#endif
+    return 1;
+}
+
+int DSK_cache_stat(sector_cache_stat_t* st) {
+#ifndef NO_SECTOR_CACHE
+    nft32_str_memcpy(st, &_cache.stat, sizeof(sector_cache_stat_t));
+    return _cache.count > 0;
+#endif
+    nft32_str_memset(st, 0, sizeof(sector_cache_stat_t));
     return 0;
 }
 
-int DSK_write_sector(sector_addr_t sa, const unsigned char* data, int data_size) {
-#ifndef NIFAT32_RO
-    print_debug("DSK_write_sector(sa=%u, size=%i)", sa, data_size);
-    if (_lock_area(sa, 1, WRITE_LOCK)) {
-        int write_result = _disk_io.write_sector(sa, 0, data, data_size);
-        _unlock_area(sa, 1);
-        return write_result;
+int DSK_cache_stat_reset() {
+#ifndef NO_SECTOR_CACHE
+    _cache.stat.hits       = 0;
+    _cache.stat.misses     = 0;
+    _cache.stat.evictions  = 0;
+    _cache.stat.writebacks = 0;
+#endif
+    return 1;
+}
+
+int DSK_cache_unload() {
+#ifndef NO_SECTOR_CACHE
+    int result = DSK_flush();
+    _cache.count = 0;
+    if (_cache.slots) nft32_free_s(_cache.slots);
+    if (_cache.buckets) nft32_free_s(_cache.buckets);
+    if (_cache.data) nft32_free_s(_cache.data);
+    if (_cache.scratch) nft32_free_s(_cache.scratch);
+    _cache.slots   = NULL;
+    _cache.buckets = NULL;
+    _cache.data    = NULL;
+    _cache.scratch = NULL;
+    return result;
+#endif
+    return 1;
+}
+
+int DSK_read_sector(sector_addr_t sa, unsigned char* buffer, int buff_size) {
+    print_debug("DSK_read_sector(sa=%u, size=%i)", sa, buff_size);
+    _lock_area(sa, 1, READ_LOCK);
+    int read_result = _read_range(sa, 0, buffer, buff_size);
+    _unlock_area(sa, 1);
+    return read_result;
+}
+
+int DSK_readoff_sectors(sector_addr_t sa, sector_offset_t offset, unsigned char* buffer, int buff_size, int sc) {
+    print_debug("DSK_readoff_sectors(sa=%u, offset=%u, size=%i, sc=%i)", sa, offset, buff_size, sc);
+    return DSK_readoff_run(sa, offset, buffer, buff_size, sc);
+}
+
+int DSK_readoff_run(sector_addr_t sa, sector_offset_t offset, unsigned char* buffer, int buff_size, int sc) {
+    print_debug("DSK_readoff_run(sa=%u, offset=%u, size=%i, sc=%i)", sa, offset, buff_size, sc);
+    int run_size = sc * _disk_io.sector_size - offset;
+    if (buff_size > run_size) buff_size = run_size;
+    if (buff_size <= 0) return 1;
+
+    _lock_area(sa, sc, READ_LOCK);
+    int read_result = _read_range(sa, offset, buffer, buff_size);
+    if (!read_result) print_error("Disk read IO error! addr=%u, off=%u, read_size=%i", sa, offset, buff_size);
+    _unlock_area(sa, sc);
+    return read_result;
+}
+
+int DSK_readv(const disk_iovec_t* iov, int count) {
+    print_debug("DSK_readv(count=%i)", count);
+    if (count <= 0) return 1;
+
+    /* If every area is locked, the list goes to the platform by one call. With the sector cache ranges go through it. */
+    if (_disk_io.readv && !_cache_enabled() && _lock_iovec(iov, count, READ_LOCK)) {
+        int read_result = _disk_io.readv(iov, count);
+        if (!read_result) print_error("Disk vectored read IO error! count=%i", count);
+        _unlock_iovec(iov, count);
+        return read_result;
     }
-    else {
-        print_error("Can't write-lock area sa=%u sc=1", sa);
+
+    /* Without the platform `readv` ranges go in flight by requests. */
+    if (_disk_io.submit) return _iovec_batch(iov, count, 0);
+
+    for (int i = 0; i < count; i++) {
+        sector_addr_t sa;
+        int sc = _iovec_sectors(&iov[i], &sa);
+        if (!DSK_readoff_run(iov[i].sa, iov[i].offset, iov[i].buffer, iov[i].size, sc + sa - iov[i].sa)) return 0;
     }
 
-    return 0;
+    return 1;
+}
+
+int DSK_write_sector(sector_addr_t sa, const unsigned char* data, int data_size) {
+#ifndef NIFAT32_RO
+    print_debug("DSK_write_sector(sa=%u, size=%i)", sa, data_size);
+    _lock_area(sa, 1, WRITE_LOCK);
+    int write_result = _write_range(sa, 0, data, data_size);
+    _unlock_area(sa, 1);
+    return write_result;
 #endif
     UNUSED(sa, data, data_size);
     return 1;
@@ -150,65 +728,132 @@ int DSK_write_sector(sector_addr_t sa, const unsigned char* data, int data_size)
 int DSK_writeoff_sectors(sector_addr_t sa, sector_offset_t offset, const unsigned char* data, int data_size, int sc) {
 #ifndef NIFAT32_RO
     print_debug("DSK_writeoff_sectors(sa=%u, offset=%u, size=%i, sc=%i)", sa, offset, data_size, sc);
-    if (_lock_area(sa, sc, WRITE_LOCK)) {
-        int total_written = 0;
-        for (int i = 0; i < sc && data_size > 0; i++) {
-            if (offset > _disk_io.sector_size) offset -= _disk_io.sector_size;
-            else {
-                int write_size = data_size > _disk_io.sector_size - offset ? _disk_io.sector_size - offset : data_size;
-                if (!_disk_io.write_sector(sa + i, offset, data + total_written, write_size)) {
-                    print_error("Disk write IO error! addr=%u, off=%u, write_size=%i", sa + i, offset, write_size);
-                    _unlock_area(sa, sc);
-                    return 0;
-                }
-                
-                total_written += write_size;
-                data_size -= write_size;
-                offset = 0;
-            }
-        }
+    return DSK_writeoff_run(sa, offset, data, data_size, sc);
+#endif
+    UNUSED(sa, offset, data, data_size, sc);
+    return 1;
+}
 
-        _unlock_area(sa, sc);
-        return 1;
-    }
-    else {
-        print_error("Can't write-lock area sa=%u sc=%i", sa, sc);
-    }
+int DSK_writeoff_run(sector_addr_t sa, sector_offset_t offset, const unsigned char* data, int data_size, int sc) {
+#ifndef NIFAT32_RO
+    print_debug("DSK_writeoff_run(sa=%u, offset=%u, size=%i, sc=%i)", sa, offset, data_size, sc);
+    int run_size = sc * _disk_io.sector_size - offset;
+    if (data_size > run_size) data_size = run_size;
+    if (data_size <= 0) return 1;
 
-    return 0;
+    _lock_area(sa, sc, WRITE_LOCK);
+    int write_result = _write_range(sa, offset, data, data_size);
+    if (!write_result) print_error("Disk write IO error! addr=%u, off=%u, write_size=%i", sa, offset, data_size);
+    _unlock_area(sa, sc);
+    return write_result;
 #endif
     UNUSED(sa, offset, data, data_size, sc);
     return 1;
 }
 
-int DSK_copy_sectors(sector_addr_t src, sector_addr_t dst, int sc, unsigned char* buffer, int buff_size) {
+int DSK_writev(const disk_iovec_t* iov, int count) {
 #ifndef NIFAT32_RO
-    if (_lock_area(dst, sc, WRITE_LOCK)) {
-        int copy_result = 0;
-        for (int i = 0; i < sc; i++) {
-            int readden = _disk_io.read_sector(src, i, buffer, buff_size);
-            if (!readden) {
-                print_error("Copy error! Can't read data! src=%u, dst=%u, sc=%i", src, dst, sc);
-                return 0;
-            }
-            
-            int written = _disk_io.write_sector(dst, i, buffer, buff_size);
-            if (!written) {
-                print_error("Copy error! Can't write a copied data! src=%u, dst=%u, sc=%i", src, dst, sc);
-                return 0;
-            }
+    print_debug("DSK_writev(count=%i)", count);
+    if (count <= 0) return 1;
+
+    /* 
+    If every area is locked, the list goes to the platform by one call. The write-through 
+    cache gets copies of written ranges, the write-back cache gets ranges one by one.
+    */
+    if (_disk_io.writev && _cache_write_through() && _lock_iovec(iov, count, WRITE_LOCK)) {
+        int write_result = _disk_io.writev(iov, count);
+        if (!write_result) print_error("Disk vectored write IO error! count=%i", count);
+        else _cache_patch_iovec(iov, count);
+        _unlock_iovec(iov, count);
+        return write_result;
+    }
+
+    if (_disk_io.submit) return _iovec_batch(iov, count, 1);
+
+    int result = 1;
+    for (int i = 0; i < count; i++) {
+        sector_addr_t sa;
+        int sc = _iovec_sectors(&iov[i], &sa);
+        result = DSK_writeoff_run(iov[i].sa, iov[i].offset, iov[i].buffer, iov[i].size, sc + sa - iov[i].sa) && result;
+    }
+
+    return result;
+#endif
+    UNUSED(iov, count);
+    return 1;
+}
+
+int DSK_submit(disk_request_t* reqs, int count) {
+    print_debug("DSK_submit(count=%i)", count);
+    for (int i = 0; i < count; i++) reqs[i].status = DISK_REQUEST_PENDING;
+
+    /* The sector cache isn't changed by the platform, thus its requests go through the cache. */
+    int queued = 0;
+    if (_disk_io.submit && !_cache_enabled() && _lock_requests(reqs, count)) {
+        queued = _disk_io.submit(reqs, count);
+        if (queued < 0) queued = 0;
+        for (int i = queued; i < count; i++) {
+            sector_addr_t sa;
+            int sc = _iovec_sectors(&reqs[i].iov, &sa);
+            _unlock_area(sa, sc);
+        }
+    }
 
-            copy_result += readden + written;
+    for (int i = queued; i < count; i++) _request_sync(&reqs[i]);
+    return 1;
+}
+
+int DSK_poll(int wait) {
+    if (!_disk_io.poll) return 0;
+    return _disk_io.poll(wait);
+}
+
+int DSK_wait(disk_request_t* reqs, int count) {
+    int result = 1;
+    for (int i = 0; i < count; i++) {
+        while (reqs[i].status == DISK_REQUEST_PENDING) {
+            if (DSK_poll(1) <= 0) _wait();
         }
 
-        _unlock_area(dst, sc);
-        return copy_result;
+        result = reqs[i].status == 1 && result;
     }
-    else {
-        print_error("Can't read-lock area sa=%u sc=1", dst);
+
+    return result;
+}
+
+void DSK_complete(disk_request_t* req, int result) {
+    if (!result) print_error("Disk async IO error! addr=%u, off=%u, size=%i", req->iov.sa, req->iov.offset, req->iov.size);
+    sector_addr_t sa;
+    int sc = _iovec_sectors(&req->iov, &sa);
+    _unlock_area(sa, sc);
+    _request_finish(req, result);
+}
+
+int DSK_copy_sectors(sector_addr_t src, sector_addr_t dst, int sc, unsigned char* buffer, int buff_size) {
+#ifndef NIFAT32_RO
+    if (buff_size > _disk_io.sector_size) buff_size = _disk_io.sector_size;
+    _lock_area(dst, sc, WRITE_LOCK);
+    int copy_result = 0;
+    for (int i = 0; i < sc; i++) {
+        int readden = _read_range(src + i, 0, buffer, buff_size);
+        if (!readden) {
+            print_error("Copy error! Can't read data! src=%u, dst=%u, sc=%i", src, dst, sc);
+            _unlock_area(dst, sc);
+            return 0;
+        }
+        
+        int written = _write_range(dst + i, 0, buffer, buff_size);
+        if (!written) {
+            print_error("Copy error! Can't write a copied data! src=%u, dst=%u, sc=%i", src, dst, sc);
+            _unlock_area(dst, sc);
+            return 0;
+        }
+
+        copy_result += readden + written;
     }
 
-    return 0;
+    _unlock_area(dst, sc);
+    return copy_result;
 #endif
     UNUSED(src, dst, sc, buffer, buff_size);
     return 1;
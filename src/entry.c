@@ -1,20 +1,60 @@
 #include <nft32/entry.h>
 
-static int _validate_entry(directory_entry_t* entry) {
+checksum_t entry_checksum(const directory_entry_t* entry) {
+    checksum_state_t prefix;
+    entry_checksum_prefix(entry, &prefix);
+    return entry_checksum_update(&prefix, entry);
+}
+
+int entry_checksum_prefix(const directory_entry_t* entry, checksum_state_t* prefix) {
+    nft32_checksum_init(prefix);
+    return nft32_checksum_update(prefix, (const_buffer_t)entry, ENTRY_CHECKSUM_PREFIX);
+}
+
+checksum_t entry_checksum_update(const checksum_state_t* prefix, const directory_entry_t* entry) {
+    checksum_state_t state;
+    nft32_str_memcpy(&state, prefix, sizeof(checksum_state_t));
+
+    const checksum_t zero = 0;
+    nft32_checksum_update(&state, (const_buffer_t)&entry->dca, sizeof(entry->dca) + sizeof(entry->file_size));
+    nft32_checksum_update(&state, (const_buffer_t)&zero, sizeof(zero));
+    return nft32_checksum_final(&state);
+}
+
+/*
+Fused decode and validation pass. Every entry is decoded and its checksum is checked
+right away, while the decoded entry is still hot in the cache. The result is saved to the
+validity bitmap, thus handlers don't need to hash entries again.
+Note: Decoding continues after the ENTRY_END slot (the whole cluster is written back later),
+      but these slots aren't validated.
+*/
+static void _unpack_validate_entries(
+    cluster_addr_t ca, const byte_t* __restrict enc, directory_entry_t* __restrict dec, unsigned int count, entry_bitmap_t* __restrict valid
+) {
+    int validate = 1;
+    int encoded_entry = nft32_ecc_encoded_size(sizeof(directory_entry_t));
+    for (unsigned int i = 0; i < count; i++, enc += encoded_entry, dec++) {
+        corrections_unpack(CORRECTIONS_DIRECTORY, 0, ca, enc, (byte_t*)dec, sizeof(directory_entry_t));
+        if (!(i % ENTRY_BITMAP_BITS)) valid[i / ENTRY_BITMAP_BITS] = 0;
+        if (!validate) continue;
+        if (dec->file_name[0] == ENTRY_END) {
+            validate = 0;
+            continue;
+        }
+
 #ifndef NO_ENTRY_VALIDATION
-    checksum_t entry_checksum = entry->checksum;
-    entry->checksum = 0;
-    if (nft32_murmur3_x86_32((buffer_t)entry, sizeof(directory_entry_t), 0) == entry_checksum) entry->checksum = entry_checksum;
-    else {
-        print_error("Entry validation error! Checksums aren't the same!");
-        return 0;
-    }
+        if (entry_checksum(dec) != dec->checksum) {
+            print_error("Entry validation error! Checksums aren't the same!");
+            continue;
+        }
 #endif
-    return 1;
+        ENTRY_BITMAP_SET(valid, i);
+    }
 }
 
 static int _read_encoded_cluster(
-    cluster_addr_t ca, buffer_t __restrict enc, int enc_size, buffer_t __restrict dec, int dec_size, fat_data_t* __restrict fi
+    cluster_addr_t ca, buffer_t __restrict enc, int enc_size, buffer_t __restrict dec, int dec_size, 
+    entry_bitmap_t* __restrict valid, fat_data_t* __restrict fi
 ) {
     print_debug("_read_encoded_cluster(ca=%u)", ca);
     if (!enc || !dec || is_cluster_bad(ca)) {
@@ -29,7 +69,7 @@ static int _read_encoded_cluster(
         return 0;
     }
 
-    nft32_unpack_memory((const encoded_t*)enc, dec, dec_size);
+    _unpack_validate_entries(ca, (const byte_t*)enc, (directory_entry_t*)dec, dec_size / sizeof(directory_entry_t), valid);
     return 1;
 }
 
@@ -37,28 +77,29 @@ int entry_iterate(
     cluster_addr_t ca, int (*handler)(entry_info_t*, directory_entry_t*, void*), void* ctx, fat_data_t* __restrict fi
 ) {
     print_debug("entry_iterate(cluster=%u)", ca);
-    int decoded_len = fi->cluster_size / sizeof(encoded_t);
-    if (decoded_len < 0) {
+    unsigned int entries_per_cluster = ENTRIES_PER_CLUSTER(fi);
+    int decoded_len = entries_per_cluster * sizeof(directory_entry_t);
+    if (decoded_len <= 0) {
         print_error("decoded_len (%i) is lower than 0!", decoded_len);
         return 0;
     }
 
     int exit = 0;
     stack_buffer_t cluster_data[fi->cluster_size], decoded_cluster[decoded_len];
-    unsigned int entries_per_cluster = (fi->cluster_size / sizeof(encoded_t)) / sizeof(directory_entry_t);
+    entry_bitmap_t valid[ENTRY_BITMAP_SIZE(entries_per_cluster)];
     do {
-        if (!_read_encoded_cluster(ca, (buffer_t)&cluster_data, fi->cluster_size, (buffer_t)&decoded_cluster, decoded_len, fi)) {
+        if (!_read_encoded_cluster(ca, (buffer_t)&cluster_data, fi->cluster_size, (buffer_t)&decoded_cluster, decoded_len, valid, fi)) {
             break;
         }
         
         directory_entry_t* entry = (directory_entry_t*)&decoded_cluster;
         for (unsigned int i = 0; i < entries_per_cluster && !exit; i++, entry++) {
             if (entry->file_name[0] == ENTRY_END) break;
-            entry_info_t info = { .ca = ca, .offset = i };
+            entry_info_t info = { .ca = ca, .offset = i, .valid = ENTRY_BITMAP_GET(valid, i) };
             exit = handler(&info, entry, ctx);
         }
 
-        nft32_pack_memory((buffer_t)&decoded_cluster, (encoded_t*)&cluster_data, decoded_len);
+        nft32_ecc_pack((const byte_t*)&decoded_cluster, (byte_t*)&cluster_data, decoded_len);
         if (!write_cluster(ca, (buffer_t)&cluster_data, fi->cluster_size, fi)) {
             print_error("Error correction of directory entry failed. Aborting...");
             errors_register_error(ERROR_CORRECTION_ERROR, fi);
@@ -68,14 +109,14 @@ int entry_iterate(
     return exit;
 }
 
-static int _index_handler(entry_info_t* info __attribute__((unused)), directory_entry_t* __restrict entry, void* __restrict ctx) {
+static int _index_handler(entry_info_t* info, directory_entry_t* __restrict entry, void* __restrict ctx) {
     ecache_t** context = (ecache_t**)ctx;
-    if (!_validate_entry(entry) || entry->file_name[0] == ENTRY_FREE) {
+    if (!info->valid || entry->file_name[0] == ENTRY_FREE) {
         return 0;
     }
 
-    checksum_t entry_hash = nft32_murmur3_x86_32((const_buffer_t)entry->file_name, sizeof(entry->file_name), 0);
-    *context = ecache_insert(*context, entry_hash, (entry->attributes & FILE_DIRECTORY) != FILE_DIRECTORY, entry->dca);
+    /* The entry is validated, thus the stored name hash is used without rehashing the name. */
+    *context = ecache_insert(*context, entry->name_hash, (entry->attributes & FILE_DIRECTORY) != FILE_DIRECTORY, entry->dca);
     return 0;
 }
 
@@ -85,8 +126,7 @@ int entry_index(cluster_addr_t ca, ecache_t** __restrict cache, fat_data_t* __re
 }
 
 typedef struct {
-    const char*        name;
-    checksum_t         name_hash;
+    const hashed_name_t* name;
     directory_entry_t* meta;
     ecache_t*          index;
     fat_data_t*        fi; // filesystem info
@@ -95,10 +135,10 @@ typedef struct {
 
 static int _search_handler(entry_info_t* info, directory_entry_t* entry, void* ctx) {
     entry_ctx_t* context = (entry_ctx_t*)ctx;
-    print_debug("ENTRY SEARCH: %.11s, ca=%u", context->name, info->ca);
-    if (!_validate_entry(entry) || entry->file_name[0] == ENTRY_FREE) return 0;
-    if (context->name_hash != entry->name_hash) return 0;
-    if (nft32_str_strncmp(context->name, (char*)entry->file_name, 11)) return 0;
+    print_debug("ENTRY SEARCH: %.11s, ca=%u", context->name->name, info->ca);
+    if (!info->valid || entry->file_name[0] == ENTRY_FREE) return 0;
+    if (context->name->hash != entry->name_hash) return 0;
+    if (nft32_str_strncmp(context->name->name, (char*)entry->file_name, FATNAME_SIZE)) return 0;
     if (context->meta) {
         nft32_str_memcpy(context->meta, entry, sizeof(directory_entry_t));
         context->meta->rca = info->ca;
@@ -108,19 +148,18 @@ static int _search_handler(entry_info_t* info, directory_entry_t* entry, void* c
 }
 
 int entry_search(
-    const char* name, cluster_addr_t ca, ecache_t* __restrict cache, directory_entry_t* meta, fat_data_t* __restrict fi
+    const hashed_name_t* name, cluster_addr_t ca, ecache_t* __restrict cache, directory_entry_t* meta, fat_data_t* __restrict fi
 ) {
-    print_debug("entry_search(name=%s, ca=%u, cache=%s)", name, ca, cache != NO_ECACHE ? "YES" : "NO");
+    print_debug("entry_search(name=%.11s, ca=%u, cache=%s)", name->name, ca, cache != NO_ECACHE ? "YES" : "NO");
     if (cache != NO_ECACHE) {
-        checksum_t entry_hash = nft32_murmur3_x86_32((const_buffer_t)name, 11, 0);
-        ecache_t* cached_entry = ecache_find(cache, entry_hash);
+        ecache_t* cached_entry = ecache_find(cache, name->hash);
         if (cached_entry) {
             if (meta) create_entry(name, IS_ECACHE_DIR(cached_entry), cached_entry->ca, 0, meta);
             return 1;
         }
     }
 
-    entry_ctx_t ctx = { .meta = meta, .name = name, .name_hash = nft32_murmur3_x86_32((const_buffer_t)name, 11, 0) };
+    entry_ctx_t ctx = { .meta = meta, .name = name };
     if (entry_iterate(ca, _search_handler, (void*)&ctx, fi)) {
         print_debug("Entry=%.11s found! dca=%u, rca=%u", meta->file_name, meta->dca, meta->rca);
         return 1;
@@ -132,17 +171,14 @@ int entry_search(
 #ifndef NIFAT32_RO
 static int _edit_handler(entry_info_t* info, directory_entry_t* entry, void* ctx) {
     entry_ctx_t* context = (entry_ctx_t*)ctx;
-    if (!_validate_entry(entry) || entry->file_name[0] == ENTRY_FREE) return 0;
-    if (context->name_hash != entry->name_hash) return 0;
-    if (nft32_str_strncmp((char*)entry->file_name, context->name, 11)) return 0;
+    if (!info->valid || entry->file_name[0] == ENTRY_FREE) return 0;
+    if (context->name->hash != entry->name_hash) return 0;
+    if (nft32_str_strncmp((char*)entry->file_name, context->name->name, FATNAME_SIZE)) return 0;
 
     context->ji = journal_add_operation(EDIT_OP, info->ca, info->offset, (unsqueezed_entry_t*)context->meta, context->fi);
     if (context->index != NO_ECACHE) {
-        checksum_t src, dst;
-        src = nft32_murmur3_x86_32((const_buffer_t)context->name, 11, 0);
-        ecache_delete(context->index, src);
-        dst = nft32_murmur3_x86_32((const_buffer_t)entry->file_name, sizeof(entry->file_name), 0);
-        ecache_insert(context->index, dst, (entry->attributes & FILE_DIRECTORY) != FILE_DIRECTORY, entry->dca);
+        ecache_delete(context->index, context->name->hash);
+        ecache_insert(context->index, context->name->hash, (entry->attributes & FILE_DIRECTORY) != FILE_DIRECTORY, entry->dca);
     }
 
     nft32_str_memcpy(entry, context->meta, sizeof(directory_entry_t));
@@ -151,17 +187,22 @@ static int _edit_handler(entry_info_t* info, directory_entry_t* entry, void* ctx
 #endif
 
 int entry_edit(
-    cluster_addr_t ca, ecache_t* __restrict cache, const char* name, const directory_entry_t* meta, fat_data_t* __restrict fi
+    cluster_addr_t ca, ecache_t* __restrict cache, const hashed_name_t* name, const directory_entry_t* meta, fat_data_t* __restrict fi
 ) {
 #ifndef NIFAT32_RO
-    print_debug("entry_edit(cluster=%u, name=%.11s, cache=%s)", ca, name, cache != NO_ECACHE ? "YES" : "NO");
+    print_debug("entry_edit(cluster=%u, name=%.11s, cache=%s)", ca, name->name, cache != NO_ECACHE ? "YES" : "NO");
     entry_ctx_t context = { 
-        .meta      = (directory_entry_t*)meta, 
-        .name      = name, 
-        .name_hash = nft32_murmur3_x86_32((const_buffer_t)name, 11, 0), 
-        .index     = cache, .fi = fi, .ji = -1
+        .meta  = (directory_entry_t*)meta, 
+        .name  = name, 
+        .index = cache, .fi = fi, .ji = -1
     };
 
+    if (!fat_cache_flush(fi)) {
+        print_error("FAT cache flush error! The entry isn't edited.");
+        errors_register_error(WRITE_FAT_ERROR, fi);
+        return 0;
+    }
+
     int result = entry_iterate(ca, _edit_handler, (void*)&context, fi);
     if (context.ji >= 0) journal_solve_operation(context.ji, fi);
     return result;
@@ -174,39 +215,48 @@ int entry_edit(
 int entry_add(cluster_addr_t ca, ecache_t* __restrict cache, directory_entry_t* __restrict meta, fat_data_t* __restrict fi) {
 #ifndef NIFAT32_RO
     print_debug("entry_add(ca=%u, name=%.11s, dca=%u, rca=%u, cache=%s)", ca, meta->file_name, meta->dca, meta->rca, cache != NO_ECACHE ? "YES" : "NO");
-    int decoded_len = fi->cluster_size / sizeof(encoded_t);
-    if (decoded_len < 0) {
+    unsigned int entries_per_cluster = ENTRIES_PER_CLUSTER(fi);
+    int decoded_len = entries_per_cluster * sizeof(directory_entry_t);
+    if (decoded_len <= 0) {
         print_error("decoded_len (%i) is lower than 0!", decoded_len);
         return 0;
     }
 
     stack_buffer_t cluster_data[fi->cluster_size], decoded_cluster[decoded_len];    
-    unsigned int entries_per_cluster = (fi->cluster_size / sizeof(encoded_t)) / sizeof(directory_entry_t);
+    entry_bitmap_t valid[ENTRY_BITMAP_SIZE(entries_per_cluster)];
     do {
-        if (!_read_encoded_cluster(ca, (buffer_t)&cluster_data, fi->cluster_size, (buffer_t)&decoded_cluster, decoded_len, fi)) {
+        if (!_read_encoded_cluster(ca, (buffer_t)&cluster_data, fi->cluster_size, (buffer_t)&decoded_cluster, decoded_len, valid, fi)) {
             break;
         }
     
         directory_entry_t* entry = (directory_entry_t*)&decoded_cluster;
         for (unsigned int i = 0; i < entries_per_cluster; i++, entry++) {
             if (
-                !_validate_entry(entry) || 
+                !ENTRY_BITMAP_GET(valid, i) || 
                 entry->file_name[0] == ENTRY_FREE || 
                 entry->file_name[0] == ENTRY_END
             ) {
+                /* The entry and the journal record must not reference FAT changes that are only in the cache. */
+                if (!fat_cache_flush(fi)) {
+                    print_error("FAT cache flush error! The entry isn't added.");
+                    errors_register_error(WRITE_FAT_ERROR, fi);
+                    return 0;
+                }
+
                 int ji = journal_add_operation(ADD_OP, ca, i, (unsqueezed_entry_t*)meta, fi);
 
                 meta->rca = ca;
-                meta->checksum = nft32_murmur3_x86_32((const_buffer_t)meta, sizeof(directory_entry_t), 0);
+                meta->checksum = entry_checksum(meta);
 
+                /* Only the last entry moves the directory end. A reused slot keeps entries after it. */
+                int last = entry->file_name[0] == ENTRY_END;
                 nft32_str_memcpy(entry, meta, sizeof(directory_entry_t));
-                if (i + 1 < entries_per_cluster) (entry + 1)->file_name[0] = ENTRY_END;
+                if (last && i + 1 < entries_per_cluster) (entry + 1)->file_name[0] = ENTRY_END;
                 if (cache != NO_ECACHE) {
-                    checksum_t entry_hash = nft32_murmur3_x86_32((const_buffer_t)meta->file_name, sizeof(meta->file_name), 0);
-                    ecache_insert(cache, entry_hash, (entry->attributes & FILE_DIRECTORY) != FILE_DIRECTORY, meta->dca);
+                    ecache_insert(cache, meta->name_hash, (entry->attributes & FILE_DIRECTORY) != FILE_DIRECTORY, meta->dca);
                 }
 
-                nft32_pack_memory((buffer_t)&decoded_cluster, (encoded_t*)&cluster_data, decoded_len);
+                nft32_ecc_pack((const byte_t*)&decoded_cluster, (byte_t*)&cluster_data, decoded_len);
                 if (!write_cluster(ca, (buffer_t)&cluster_data, fi->cluster_size, fi)) {
                     print_error("Writing new directory entry failed. Aborting...");
                     errors_register_error(ENTRY_ADD_ERROR, fi);
@@ -232,12 +282,6 @@ int entry_add(cluster_addr_t ca, ecache_t* __restrict cache, directory_entry_t*
                 break;
             }
 
-            if (!set_cluster_end(nca, fi)) {
-                print_error("Can't set new cluster as <END>. Aborting...");
-                errors_register_error(ALLOCATED_CLUSTER_BAD_ERROR, fi);
-                break;
-            }
-
             if (!write_fat(ca, nca, fi)) {
                 print_error("Extension of the cluster chain with new cluster failed. Aborting...");
                 errors_register_error(CLUSTER_CHAIN_APPEND_ERROR, fi);
@@ -259,17 +303,18 @@ static int _entry_erase_rec(cluster_addr_t ca, int file, fat_data_t* fi) {
     print_debug("_entry_erase_rec(cluster=%u, file=%i)", ca, file);
     if (file) return dealloc_chain(ca, fi);
     else {
-        int decoded_len = fi->cluster_size / sizeof(encoded_t);
-        if (fi->cluster_size || decoded_len < 0) {
+        unsigned int entries_per_cluster = ENTRIES_PER_CLUSTER(fi);
+        int decoded_len = entries_per_cluster * sizeof(directory_entry_t);
+        if (fi->cluster_size || decoded_len <= 0) {
             print_error("decoded_len (%i) is lower than 0!", decoded_len);
             return 0;
         }
 
         cluster_addr_t nca = ca;
         stack_buffer_t cluster_data[fi->cluster_size], decoded_cluster[decoded_len];   
-        unsigned int entries_per_cluster = (fi->cluster_size / sizeof(encoded_t)) / sizeof(directory_entry_t);
+        entry_bitmap_t valid[ENTRY_BITMAP_SIZE(entries_per_cluster)];
         do {
-            if (!_read_encoded_cluster(ca, (buffer_t)&cluster_data, fi->cluster_size, (buffer_t)&decoded_cluster, decoded_len, fi)) {
+            if (!_read_encoded_cluster(ca, (buffer_t)&cluster_data, fi->cluster_size, (buffer_t)&decoded_cluster, decoded_len, valid, fi)) {
                 break;
             }
             
@@ -277,7 +322,7 @@ static int _entry_erase_rec(cluster_addr_t ca, int file, fat_data_t* fi) {
             directory_entry_t* entry = (directory_entry_t*)&decoded_cluster;
             for (unsigned int i = 0; i < entries_per_cluster; i++, entry++) {
                 if (entry->file_name[0] == ENTRY_END) break;
-                if (_validate_entry(entry) && entry->file_name[0] != ENTRY_FREE) {
+                if (ENTRY_BITMAP_GET(valid, i) && entry->file_name[0] != ENTRY_FREE) {
                     if (_entry_erase_rec(entry->dca, (entry->attributes & FILE_DIRECTORY) != FILE_DIRECTORY, fi) < 0) {
                         print_warn("Recursive erase error!");
                         errors_register_error(RECURSIVE_ERASE_ERROR, fi);
@@ -300,13 +345,12 @@ static int _entry_erase_rec(cluster_addr_t ca, int file, fat_data_t* fi) {
 
 static int _remove_handler(entry_info_t* __restrict info, directory_entry_t* __restrict entry, void* __restrict ctx) {
     entry_ctx_t* context = (entry_ctx_t*)ctx;
-    if (!_validate_entry(entry) || entry->file_name[0] == ENTRY_FREE) return 0;
-    if (nft32_str_strncmp((char*)entry->file_name, context->name, 11)) return 0;
+    if (!info->valid || entry->file_name[0] == ENTRY_FREE) return 0;
+    if (context->name->hash != entry->name_hash) return 0;
+    if (nft32_str_strncmp((char*)entry->file_name, context->name->name, FATNAME_SIZE)) return 0;
 
     if (context->index != NO_ECACHE) {
-        checksum_t src;
-        src = nft32_murmur3_x86_32((const_buffer_t)context->name, 11, 0);
-        ecache_delete(context->index, src);
+        ecache_delete(context->index, context->name->hash);
     }
 
     context->ji = journal_add_operation(DEL_OP, info->ca, info->offset, (unsqueezed_entry_t*)entry, context->fi);
@@ -321,12 +365,22 @@ static int _remove_handler(entry_info_t* __restrict info, directory_entry_t* __r
 }
 #endif
 
-int entry_remove(cluster_addr_t ca, const char* name, ecache_t* __restrict cache, fat_data_t* __restrict fi) {
+int entry_remove(cluster_addr_t ca, const hashed_name_t* name, ecache_t* __restrict cache, fat_data_t* __restrict fi) {
 #ifndef NIFAT32_RO
-    print_debug("entry_remove(cluster=%u, name=%.11s, cache=%s)", ca, name, cache != NO_ECACHE ? "YES" : "NO");
+    print_debug("entry_remove(cluster=%u, name=%.11s, cache=%s)", ca, name->name, cache != NO_ECACHE ? "YES" : "NO");
     entry_ctx_t context = { .name = name, .fi = fi, .index = cache, .ji = -1 };
     int result = entry_iterate(ca, _remove_handler, (void*)&context, fi);
-    if (context.ji >= 0) journal_solve_operation(context.ji, fi);
+    if (context.ji >= 0) {
+        /* The released chain must reach the disk before the journal record is solved. */
+        if (!fat_cache_flush(fi)) {
+            print_error("FAT cache flush error! The journal record isn't solved.");
+            errors_register_error(WRITE_FAT_ERROR, fi);
+            return 0;
+        }
+
+        journal_solve_operation(context.ji, fi);
+    }
+
     return result;
 #endif
     UNUSED(ca, name, cache, fi);
@@ -335,7 +389,7 @@ int entry_remove(cluster_addr_t ca, const char* name, ecache_t* __restrict cache
 }
 
 int create_entry(
-    const char* fullname, char is_dir, cluster_addr_t first_cluster, unsigned int file_size, directory_entry_t* entry
+    const hashed_name_t* name, char is_dir, cluster_addr_t first_cluster, unsigned int file_size, directory_entry_t* entry
 ) {
     entry->checksum = 0;
     entry->rca = FAT_CLUSTER_BAD;
@@ -350,8 +404,8 @@ int create_entry(
         entry->attributes = FILE_ARCHIVE;
     }
 
-    nft32_str_memcpy(entry->file_name, fullname, 11);
-    entry->name_hash = nft32_murmur3_x86_32((const_buffer_t)entry->file_name, sizeof(entry->file_name), 0);
+    nft32_str_memcpy(entry->file_name, name->name, FATNAME_SIZE);
+    entry->name_hash = name->hash;
     print_debug("_create_entry=%.11s, is_dir=%i, fca=%u", entry->file_name, is_dir, first_cluster);
     return 1; 
 }
@@ -1,60 +1,151 @@
 #include <nft32/fat.h>
 
-static cluster_val_t* _fat = NULL;
-int fat_cache_init(fat_data_t* fi) {
+static cluster_val_t* _fat = NULL;        // whole table, NULL in the paged mode
+static unsigned char* _fat_loaded = NULL; // bit per FAT block
+static unsigned char* _fat_dirty  = NULL; // bit per FAT block, NULL if write-back is off
+static volatile unsigned int _dirty_blocks = 0;
+static lock_t _flush_lock = NULL_LOCK;
+static lock_t _page_lock  = NULL_LOCK;
+static lock_t _sum_lock   = NULL_LOCK;
+static int    _fat_paged  = 0;
+
+#define FAT_BLOCK_BIT(b)        ((unsigned char)(1 << ((b) % 8)))
+#define FAT_BLOCK_LOADED(b)     ((_fat_loaded[(b) / 8] >> ((b) % 8)) & 1)
+#define SET_FAT_BLOCK_LOADED(b) __sync_fetch_and_or(&_fat_loaded[(b) / 8], FAT_BLOCK_BIT(b))
+#define FAT_BLOCKS(fi)          (((fi)->total_clusters + FAT_BLOCK_ENTRIES(fi) - 1) / FAT_BLOCK_ENTRIES(fi))
+#define FAT_CACHED()            (_fat || _fat_paged)
+
+static int _load_fat_block(unsigned int block, cluster_val_t* values, fat_data_t* fi);
+
+int fat_cache_init(unsigned int budget, fat_data_t* fi) {
 #ifndef NO_FAT_CACHE
+    unsigned int blocks = FAT_BLOCKS(fi);
+    unsigned int table_size = fi->total_clusters * sizeof(cluster_val_t) + (blocks + 7) / 8;
+    if (budget && budget < table_size) {
+        unsigned int pages = budget / FATPAGE_COST(FAT_BLOCK_ENTRIES(fi));
+        if (!pages) pages = 1;
+        if (!fatpage_init(pages, FAT_BLOCK_ENTRIES(fi), fi)) return 0;
+        print_info("FAT cache is paged: %u of %u FAT blocks in RAM", pages, blocks);
+        _fat_paged = 1;
+        return 1;
+    }
+
     _fat = (cluster_val_t*)nft32_malloc_s(fi->total_clusters * sizeof(cluster_val_t));
-    if (!_fat) {
+    _fat_loaded = (unsigned char*)nft32_malloc_s((blocks + 7) / 8);
+    if (!_fat || !_fat_loaded) {
         print_error("nft32_malloc_s() error!");
         errors_register_error(MALLOC_ERROR, fi);
+        fat_cache_unload();
         return 0;
     }
 
-    for (cluster_addr_t ca = 0; ca < fi->total_clusters; ca++) _fat[ca] = FAT_CLUSTER_BAD;
+    nft32_str_memset(_fat_loaded, 0, (blocks + 7) / 8);
     return 1;
 #endif
-    UNUSED(fi);
+    UNUSED(budget, fi);
     print_warn("fat_cache_init() is not implemented! Don't provide the 'NO_FAT_CACHE'!");
     return 1;
 }
 
-int fat_cache_hload(fat_data_t* fi) {
-#ifndef NO_FAT_CACHE
-    if (!_fat) return 0;
-    for (cluster_addr_t ca = 0; ca < fi->total_clusters; ca++) {
-        cluster_val_t cls = read_fat(ca, fi);
-        if (cls == FAT_CLUSTER_FREE) fatmap_set(ca);
-        else fatmap_unset(ca);
-        _fat[ca] = cls;
+int fat_cache_writeback(fat_data_t* fi) {
+#if !defined(NO_FAT_CACHE) && !defined(NIFAT32_RO)
+    if (!FAT_CACHED()) return 0;
+    if (_fat_dirty) return 1;
+
+    unsigned int bitmap_size = (FAT_BLOCKS(fi) + 7) / 8;
+    _fat_dirty = (unsigned char*)nft32_malloc_s(bitmap_size);
+    if (!_fat_dirty) {
+        print_error("nft32_malloc_s() error!");
+        errors_register_error(MALLOC_ERROR, fi);
+        return 0;
     }
 
+    nft32_str_memset(_fat_dirty, 0, bitmap_size);
+    _dirty_blocks = 0;
     return 1;
 #endif
     UNUSED(fi);
-    print_warn("fat_cache_hload() is not implemented! Don't provide the 'NO_FAT_CACHE'!");
-    return 1;
+    print_warn("fat_cache_writeback() is not implemented! Don't provide the 'NO_FAT_CACHE' and the 'NIFAT32_RO'!");
+    return 0;
 }
 
 int fat_cache_unload() {
 #ifndef NO_FAT_CACHE
+    if (_fat_dirty) nft32_free_s(_fat_dirty);
+    _fat_dirty = NULL;
+    _dirty_blocks = 0;
+
+    if (_fat_paged) {
+        fatpage_unload();
+        _fat_paged = 0;
+        return 1;
+    }
+
+    if (_fat_loaded) nft32_free_s(_fat_loaded);
+    _fat_loaded = NULL;
+
     if (_fat) nft32_free_s(_fat);
     else return 0;
+    _fat = NULL;
     return 1;
 #endif
     print_warn("fat_cache_unload() is not implemented! Don't provide the 'NO_FAT_CACHE'!");
     return 1;
 }
 
+/*
+Lock pages of the paged cache. The whole table cache doesn't evict blocks and doesn't need the lock.
+*/
+static int _lock_pages() {
+    return !_fat_paged || THR_require_write(&_page_lock, get_thread_num());
+}
+
+static void _unlock_pages() {
+    if (_fat_paged) THR_release_write(&_page_lock, get_thread_num());
+}
+
+/*
+Get the location of the encoded FAT entry.
+Note: With the SECDED codec an entry can cross the sector border, so sc can be 2.
+*/
+static sector_addr_t _fat_entry_location(cluster_addr_t ca, fat_data_t* fi, int fat, int size, sector_offset_t* offset, int* sc) {
+    cluster_offset_t fat_offset = ca * size;
+    *offset = fat_offset % fi->bytes_per_sector;
+    *sc = (*offset + size + fi->bytes_per_sector - 1) / fi->bytes_per_sector;
+    return fi->sectors_padd + GET_FATSECTOR(fat, fi->total_sectors) + (fat_offset / fi->bytes_per_sector);
+}
+
+/*
+Checksum of FAT block entries. Stored to the FAT_SUM_SLOT of the block.
+*/
+static checksum_t _fat_block_sum(const cluster_val_t* values, int count) {
+    return nft32_checksum((const unsigned char*)values, count * sizeof(cluster_val_t));
+}
+
 #ifndef NIFAT32_RO
-static int __write_fat__(cluster_addr_t ca, cluster_status_t value, fat_data_t* fi, int fat) {
-    cluster_offset_t fat_offset = ca * sizeof(cluster_val_t) * sizeof(encoded_t);
-    sector_addr_t fat_sector = fi->sectors_padd + GET_FATSECTOR(fat, fi->total_sectors) + (fat_offset / fi->bytes_per_sector);
-    
-    decoded_t table_buffer[sizeof(cluster_val_t)] = { 0 };
-    nft32_pack_memory((const byte_t*)&value, table_buffer, sizeof(cluster_val_t));
-    if (
-        !DSK_writeoff_sectors(fat_sector, fat_offset % fi->bytes_per_sector, (const unsigned char*)table_buffer, sizeof(table_buffer), 1)
-    ) {
+/*
+Fill vector parts for the encoded entries from the cluster in every FAT copy.
+*/
+static void _fat_copies_iovec(cluster_addr_t ca, const byte_t* encoded, int size, disk_iovec_t* iov, fat_data_t* fi) {
+    int sc = 1;
+    int encoded_size = nft32_ecc_encoded_size(sizeof(cluster_val_t));
+    for (int i = 0; i < fi->fat_count; i++) {
+        iov[i].sa     = _fat_entry_location(ca, fi, i, encoded_size, &iov[i].offset, &sc);
+        iov[i].buffer = (unsigned char*)encoded;
+        iov[i].size   = size;
+    }
+}
+
+/*
+Write the entry to every FAT copy by one vectored disk call.
+*/
+static int __write_fat__(cluster_addr_t ca, cluster_status_t value, fat_data_t* fi) {
+    byte_t table_buffer[ECC_MAX_ENCODED_SIZE(sizeof(cluster_val_t))] = { 0 };
+    nft32_ecc_pack((const byte_t*)&value, table_buffer, sizeof(cluster_val_t));
+
+    disk_iovec_t iov[fi->fat_count];
+    _fat_copies_iovec(ca, table_buffer, nft32_ecc_encoded_size(sizeof(cluster_val_t)), iov, fi);
+    if (!DSK_writev(iov, fi->fat_count)) {
         print_error("Could not write new FAT32 cluster number to sector.");
         errors_register_error(WRITE_FAT_ERROR, fi);
         return 0;
@@ -62,6 +153,267 @@ static int __write_fat__(cluster_addr_t ca, cluster_status_t value, fat_data_t*
 
     return 1;    
 } 
+
+/*
+Write entries of one FAT block to every FAT copy. The block is encoded with one codec call
+and written to every copy with one vectored disk call. With fat_checksums the block checksum
+is written in the same call.
+*/
+static int _flush_fat_block(unsigned int block, const cluster_val_t* values, fat_data_t* fi) {
+    cluster_addr_t first_ca = block * FAT_BLOCK_ENTRIES(fi);
+    int count = FAT_BLOCK_ENTRIES(fi);
+    if (first_ca + count > fi->total_clusters) count = fi->total_clusters - first_ca;
+
+    int encoded_size = nft32_ecc_encoded_size(sizeof(cluster_val_t));
+    byte_t encoded_block[FAT_BLOCK_ENTRIES(fi) * ECC_MAX_ENCODED_SIZE(sizeof(cluster_val_t))];
+    nft32_ecc_pack((const byte_t*)values, encoded_block, count * sizeof(cluster_val_t));
+    checksum_t sum = fi->fat_checksums ? _fat_block_sum(values, count) : 0;
+
+    byte_t encoded_sum[ECC_MAX_ENCODED_SIZE(sizeof(cluster_val_t))] = { 0 };
+    nft32_ecc_pack((const byte_t*)&sum, encoded_sum, sizeof(cluster_val_t));
+
+    disk_iovec_t iov[2 * fi->fat_count];
+    _fat_copies_iovec(first_ca, encoded_block, count * encoded_size, iov, fi);
+    if (fi->fat_checksums) _fat_copies_iovec(FAT_SUM_SLOT(block, fi), encoded_sum, encoded_size, iov + fi->fat_count, fi);
+    if (!DSK_writev(iov, fi->fat_checksums ? 2 * fi->fat_count : fi->fat_count)) {
+        print_error("Could not write FAT block=%u.", block);
+        errors_register_error(WRITE_FAT_ERROR, fi);
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+Mark a cached FAT block as dirty. The block will be written on the next flush.
+*/
+static void _mark_fat_block_dirty(unsigned int block) {
+    unsigned char prev = __sync_fetch_and_or(&_fat_dirty[block / 8], FAT_BLOCK_BIT(block));
+    if (!(prev & FAT_BLOCK_BIT(block))) __sync_fetch_and_add(&_dirty_blocks, 1);
+}
+
+/*
+Clear the dirty bit of a FAT block.
+Return 1 if the block was dirty.
+*/
+static int _clear_fat_block_dirty(unsigned int block) {
+    unsigned char prev = __sync_fetch_and_and(&_fat_dirty[block / 8], (unsigned char)~FAT_BLOCK_BIT(block));
+    if (!(prev & FAT_BLOCK_BIT(block))) return 0;
+    __sync_fetch_and_sub(&_dirty_blocks, 1);
+    return 1;
+}
+#endif
+
+/*
+Get cached entries of the FAT block. A miss loads the block. In the paged mode the caller
+should hold the page lock. The victim page is written to the disk before the eviction if
+it is dirty.
+Return NULL if the block can't be cached.
+*/
+static cluster_val_t* _get_fat_page(unsigned int block, fat_data_t* fi) {
+    if (!_fat_paged) {
+        cluster_val_t* values = &_fat[block * FAT_BLOCK_ENTRIES(fi)];
+        if (FAT_BLOCK_LOADED(block) || _load_fat_block(block, values, fi)) return values;
+        return NULL;
+    }
+
+    cluster_val_t* page = fatpage_get(block);
+    if (page) return page;
+
+    unsigned int victim = FATPAGE_EMPTY;
+    if (!(page = fatpage_victim(&victim))) return NULL;
+    if (victim != FATPAGE_EMPTY) {
+#ifndef NIFAT32_RO
+        if (_fat_dirty && _clear_fat_block_dirty(victim) && !_flush_fat_block(victim, page, fi)) {
+            _mark_fat_block_dirty(victim);
+            return NULL;
+        }
+#endif
+        fatpage_bind(page, FATPAGE_EMPTY);
+    }
+
+    if (!_load_fat_block(block, page, fi)) return NULL;
+    fatpage_bind(page, block);
+    return page;
+}
+
+int fat_cache_flush(fat_data_t* fi) {
+#if !defined(NO_FAT_CACHE) && !defined(NIFAT32_RO)
+    if (!_fat_dirty || !_dirty_blocks) return 1;
+    if (!THR_require_write(&_flush_lock, get_thread_num())) {
+        print_error("Can't lock FAT flush!");
+        return 0;
+    }
+
+    int result = 1;
+    unsigned int blocks = FAT_BLOCKS(fi);
+    cluster_val_t page_copy[FAT_BLOCK_ENTRIES(fi)];
+    for (unsigned int byte = 0; byte < (blocks + 7) / 8 && _dirty_blocks; byte++) {
+        if (!_fat_dirty[byte]) continue;
+        for (unsigned int block = byte * 8; block < byte * 8 + 8 && block < blocks; block++) {
+            /* The bit is cleared before the encoding. A write_fat during the flush marks the block again. */
+            const cluster_val_t* values = NULL;
+            if (!_fat_paged) {
+                if (!_clear_fat_block_dirty(block)) continue;
+                values = &_fat[block * FAT_BLOCK_ENTRIES(fi)];
+            }
+            else {
+                /* A page is copied under the lock, thus it can be evicted during the write. */
+                if (!_lock_pages()) {
+                    result = 0;
+                    continue;
+                }
+
+                cluster_val_t* page = fatpage_get(block);
+                if (page && _clear_fat_block_dirty(block)) {
+                    nft32_str_memcpy(page_copy, page, sizeof(page_copy));
+                    values = page_copy;
+                }
+
+                _unlock_pages();
+                if (!values) continue;
+            }
+
+            if (!_flush_fat_block(block, values, fi)) {
+                _mark_fat_block_dirty(block);
+                result = 0;
+            }
+        }
+    }
+
+    THR_release_write(&_flush_lock, get_thread_num());
+    return result;
+#endif
+    UNUSED(fi);
+    return 1;
+}
+
+#ifndef NIFAT32_RO
+/*
+Mark the stored free map area dirty before the FAT is written.
+Returns 1 if succeeds, otherwise will return 0, and the FAT shouldn't be written.
+*/
+static int _prepare_fatmap(fat_data_t* fi) {
+    if (fatmap_prepare()) return 1;
+    print_error("Free map can't be marked dirty. The FAT isn't written.");
+    errors_register_error(WRITE_FAT_ERROR, fi);
+    return 0;
+}
+
+/*
+Update free map bits of FAT entries.
+Returns 1 if succeeds, otherwise will return 0.
+*/
+static int _update_fatmap(cluster_addr_t ca, const cluster_val_t* entries, int entries_count, fat_data_t* fi) {
+    for (int i = 0; i < entries_count; i++) {
+        if (!(entries[i] == FAT_CLUSTER_FREE ? fatmap_set(ca + i) : fatmap_unset(ca + i))) {
+            print_error("Free map can't be changed for ca=%u.", ca + i);
+            errors_register_error(WRITE_FAT_ERROR, fi);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+Apply written FAT entries to the cache page (if the block is cached) and to the free map.
+Called only after the FAT write succeeds, thus a failed write doesn't leave changes in RAM.
+*/
+static int _apply_fat_entries(cluster_addr_t ca, const cluster_val_t* entries, int entries_count, fat_data_t* fi) {
+    unsigned int block = ca / FAT_BLOCK_ENTRIES(fi);
+    if (FAT_CACHED() && _lock_pages()) {
+        cluster_val_t* page = _fat_paged ? fatpage_get(block) : &_fat[block * FAT_BLOCK_ENTRIES(fi)];
+        if (page) nft32_str_memcpy(page + ca % FAT_BLOCK_ENTRIES(fi), entries, entries_count * sizeof(cluster_val_t));
+        _unlock_pages();
+    }
+
+    return _update_fatmap(ca, entries, entries_count, fi);
+}
+
+/*
+Put entries of one block into the write-back cache. The map is changed with the page, the disk
+is written by the flush. If too many blocks are dirty, they are flushed first, thus a failed
+flush doesn't leave the new entries in RAM.
+Returns 1 if the entries are cached, 0 if the block can't be cached, and -1 on error.
+*/
+static int _cache_fat_entries(cluster_addr_t ca, const cluster_val_t* entries, int entries_count, fat_data_t* fi) {
+    if (_dirty_blocks >= FAT_DIRTY_LIMIT && !fat_cache_flush(fi)) return -1;
+    if (!_lock_pages()) return 0;
+
+    int result = 0;
+    unsigned int block = ca / FAT_BLOCK_ENTRIES(fi);
+    cluster_val_t* page = _get_fat_page(block, fi);
+    if (page) {
+        result = -1;
+        if (_prepare_fatmap(fi)) {
+            nft32_str_memcpy(page + ca % FAT_BLOCK_ENTRIES(fi), entries, entries_count * sizeof(cluster_val_t));
+            _mark_fat_block_dirty(block);
+            result = _update_fatmap(ca, entries, entries_count, fi) ? 1 : -1;
+        }
+    }
+
+    _unlock_pages();
+    return result;
+}
+
+/*
+Write entries of one block with the checksum of the block. The block is taken from the cache or loaded,
+updated, and written to every FAT copy. Writers are serialized, thus FAT copies get blocks
+in the same order as the cache.
+*/
+static int _write_fat_block_entries(cluster_addr_t ca, const cluster_val_t* entries, int entries_count, fat_data_t* fi) {
+    if (!THR_require_write(&_sum_lock, get_thread_num())) {
+        print_error("Can't lock FAT block write!");
+        errors_register_error(WRITE_FAT_ERROR, fi);
+        return 0;
+    }
+
+    unsigned int block = ca / FAT_BLOCK_ENTRIES(fi);
+    unsigned int first = ca % FAT_BLOCK_ENTRIES(fi);
+    int count = FAT_BLOCK_ENTRIES(fi);
+    if (block * FAT_BLOCK_ENTRIES(fi) + count > fi->total_clusters) count = fi->total_clusters - block * FAT_BLOCK_ENTRIES(fi);
+
+    int loaded = 0;
+    cluster_val_t values[FAT_BLOCK_ENTRIES(fi)];
+    if (FAT_CACHED() && _lock_pages()) {
+        cluster_val_t* page = _get_fat_page(block, fi);
+        if (page) {
+            nft32_str_memcpy(values, page, count * sizeof(cluster_val_t));
+            loaded = 1;
+        }
+
+        _unlock_pages();
+    }
+
+    if (!loaded) loaded = _load_fat_block(block, values, fi);
+    nft32_str_memcpy(values + first, entries, entries_count * sizeof(cluster_val_t));
+    int result = loaded && _prepare_fatmap(fi) && _flush_fat_block(block, values, fi);
+    if (result) result = _apply_fat_entries(ca, entries, entries_count, fi);
+    THR_release_write(&_sum_lock, get_thread_num());
+    return result;
+}
+
+/*
+Write entries of one block to every FAT copy. The entries are encoded with one codec call
+and written to every copy with one vectored disk call.
+*/
+static int _write_fat_entries(cluster_addr_t ca, const cluster_val_t* entries, int entries_count, fat_data_t* fi) {
+    if (!_prepare_fatmap(fi)) return 0;
+    int encoded_size = nft32_ecc_encoded_size(sizeof(cluster_val_t));
+    byte_t encoded[FAT_BLOCK_ENTRIES(fi) * ECC_MAX_ENCODED_SIZE(sizeof(cluster_val_t))];
+    nft32_ecc_pack((const byte_t*)entries, encoded, entries_count * sizeof(cluster_val_t));
+
+    disk_iovec_t iov[fi->fat_count];
+    _fat_copies_iovec(ca, encoded, entries_count * encoded_size, iov, fi);
+    if (!DSK_writev(iov, fi->fat_count)) {
+        print_error("Could not write FAT entries ca=%u count=%i.", ca, entries_count);
+        errors_register_error(WRITE_FAT_ERROR, fi);
+        return 0;
+    }
+
+    return _apply_fat_entries(ca, entries, entries_count, fi);
+}
 #endif
 
 int write_fat(cluster_addr_t ca, cluster_status_t value, fat_data_t* fi) {
@@ -73,36 +425,342 @@ int write_fat(cluster_addr_t ca, cluster_status_t value, fat_data_t* fi) {
         return 0;
     }
     
-    if (_fat) _fat[ca] = value;
-    if (value == FAT_CLUSTER_FREE) fatmap_set(ca);
-    else fatmap_unset(ca);
+    cluster_val_t entry = value;
+    if (_fat_dirty && ca < fi->total_clusters) {
+        int cached = _cache_fat_entries(ca, &entry, 1, fi);
+        if (cached) return cached > 0;
+    }
+
+    if (fi->fat_checksums && ca < fi->total_clusters) return _write_fat_block_entries(ca, &entry, 1, fi);
+    if (!_prepare_fatmap(fi) || !__write_fat__(ca, value, fi)) return 0;
+    if (ca >= fi->total_clusters) return 1;
+    return _apply_fat_entries(ca, &entry, 1, fi);
+#endif
+    UNUSED(ca, value, fi);
+    return 1;
+}
 
+int write_fat_chain(cluster_addr_t ca, unsigned int count, cluster_status_t last, fat_data_t* fi) {
+#ifndef NIFAT32_RO
+    print_debug("write_fat_chain(ca=%u, count=%u, last=%u)", ca, count, last);
+    if (!count || ca < fi->ext_root_cluster || ca + count > fi->total_clusters) {
+        print_error("Can't write chain! Wrong cluster range! %u+%u", ca, count);
+        errors_register_error(WRITE_FAT_ERROR, fi);
+        return 0;
+    }
+
+    /* The run is split by FAT blocks. Every block is written once. */
     int result = 1;
-    for (int i = 0; i < fi->fat_count; i++) result = __write_fat__(ca, value, fi, i) && result;
+    cluster_val_t entries[FAT_BLOCK_ENTRIES(fi)];
+    while (count > 0 && result) {
+        int entries_count = FAT_BLOCK_ENTRIES(fi) - ca % FAT_BLOCK_ENTRIES(fi);
+        if ((unsigned int)entries_count > count) entries_count = count;
+        for (int i = 0; i < entries_count; i++) entries[i] = ca + i + 1;
+        if ((unsigned int)entries_count == count) entries[entries_count - 1] = last;
+
+        int cached = _fat_dirty ? _cache_fat_entries(ca, entries, entries_count, fi) : 0;
+        if (cached) result = cached > 0;
+        else if (fi->fat_checksums) result = _write_fat_block_entries(ca, entries, entries_count, fi);
+        else result = _write_fat_entries(ca, entries, entries_count, fi);
+
+        ca += entries_count;
+        count -= entries_count;
+    }
+
     return result;
 #endif
-    UNUSED(ca, value, fi);
+    UNUSED(ca, count, last, fi);
     return 1;
 }
 
 static cluster_val_t __read_fat__(cluster_addr_t ca, fat_data_t* fi, int fat) {
-    cluster_offset_t fat_offset = ca * sizeof(cluster_val_t) * sizeof(encoded_t);
-    sector_addr_t fat_sector = fi->sectors_padd + GET_FATSECTOR(fat, fi->total_sectors) + (fat_offset / fi->bytes_per_sector);
+    int sc = 1;
+    sector_offset_t offset = 0;
+    int encoded_size = nft32_ecc_encoded_size(sizeof(cluster_val_t));
+    sector_addr_t fat_sector = _fat_entry_location(ca, fi, fat, encoded_size, &offset, &sc);
     
-    encoded_t table_buffer[sizeof(cluster_val_t)] = { 0 };
-    if (
-        !DSK_readoff_sectors(fat_sector, fat_offset % fi->bytes_per_sector, (unsigned char*)table_buffer, sizeof(table_buffer), 1
-    )) {
+    byte_t table_buffer[ECC_MAX_ENCODED_SIZE(sizeof(cluster_val_t))] = { 0 };
+    if (!DSK_readoff_sectors(fat_sector, offset, (unsigned char*)table_buffer, encoded_size, sc)) {
         print_error("Could not read sector that contains FAT32 table entry needed.");
         errors_register_error(READ_FAT_ERROR, fi);
         return FAT_CLUSTER_BAD;
     }
 
     cluster_val_t table_value = 0;
-    nft32_unpack_memory(table_buffer, (byte_t*)&table_value, sizeof(cluster_val_t));
+    corrections_unpack(CORRECTIONS_FAT, fat, ca, table_buffer, (byte_t*)&table_value, sizeof(cluster_val_t));
     return table_value & 0x0FFFFFFF;
 }
 
+/*
+Read the entry from every FAT copy by one vectored disk call. If the call fails, copies
+are read one by one, thus an unreadable copy doesn't hide other copies.
+*/
+static void _read_fat_copies(cluster_addr_t ca, cluster_val_t* values, fat_data_t* fi) {
+    int sc = 1;
+    int encoded_size = nft32_ecc_encoded_size(sizeof(cluster_val_t));
+    byte_t table_buffers[fi->fat_count][ECC_MAX_ENCODED_SIZE(sizeof(cluster_val_t))];
+    disk_iovec_t iov[fi->fat_count];
+    for (int i = 0; i < fi->fat_count; i++) {
+        iov[i].sa     = _fat_entry_location(ca, fi, i, encoded_size, &iov[i].offset, &sc);
+        iov[i].buffer = (unsigned char*)table_buffers[i];
+        iov[i].size   = encoded_size;
+    }
+
+    if (!DSK_readv(iov, fi->fat_count)) {
+        for (int i = 0; i < fi->fat_count; i++) values[i] = __read_fat__(ca, fi, i);
+        return;
+    }
+
+    for (int i = 0; i < fi->fat_count; i++) {
+        values[i] = 0;
+        corrections_unpack(CORRECTIONS_FAT, i, ca, table_buffers[i], (byte_t*)&values[i], sizeof(cluster_val_t));
+        values[i] &= 0x0FFFFFFF;
+    }
+}
+
+/* Decoding buffers of the FAT loader. */
+typedef struct {
+    byte_t*        encoded;
+    cluster_val_t* decoded;
+    int*           freq;
+    int*           wrong;
+    checksum_t*    sums;
+} fat_load_ws_t;
+
+/*
+Rewrite a FAT block with wrong copies. In the write-back mode the block is written on the next flush.
+*/
+static void _repair_fat_block(unsigned int block, const cluster_val_t* values, fat_data_t* fi) {
+#ifndef NIFAT32_RO
+    print_warn("FAT wrong values in block=%u. Fixing...", block);
+    if (_fat_dirty) _mark_fat_block_dirty(block);
+    else _flush_fat_block(block, values, fi);
+#endif
+    UNUSED(block, values, fi);
+}
+
+/*
+Read checksums of consecutive FAT blocks from the FAT copy with one disk call.
+*/
+static int _read_fat_sums(unsigned int block, unsigned int blocks, int fat, fat_load_ws_t* ws, fat_data_t* fi) {
+    int sc = 1;
+    sector_offset_t offset = 0;
+    int encoded_size = nft32_ecc_encoded_size(sizeof(checksum_t));
+    sector_addr_t fat_sector = _fat_entry_location(FAT_SUM_SLOT(block, fi), fi, fat, encoded_size, &offset, &sc);
+    sc = (offset + blocks * encoded_size + fi->bytes_per_sector - 1) / fi->bytes_per_sector;
+    if (!DSK_readoff_sectors(fat_sector, offset, (unsigned char*)ws->encoded, blocks * encoded_size, sc)) {
+        print_error("Could not read FAT checksums of blocks=%u..%u from FAT=%i.", block, block + blocks - 1, fat);
+        errors_register_error(READ_FAT_ERROR, fi);
+        return 0;
+    }
+
+    corrections_unpack_entries(
+        CORRECTIONS_FAT, fat, FAT_SUM_SLOT(block, fi), (const byte_t*)ws->encoded, (byte_t*)ws->sums, blocks, sizeof(checksum_t)
+    );
+
+    return 1;
+}
+
+/*
+Check if the block of the loaded range matches the checksum from ws->sums.
+*/
+static int _fat_block_sum_ok(unsigned int b, const cluster_val_t* values, int count, fat_load_ws_t* ws, fat_data_t* fi) {
+    int first = b * FAT_BLOCK_ENTRIES(fi);
+    int entries = count - first < (int)FAT_BLOCK_ENTRIES(fi) ? count - first : (int)FAT_BLOCK_ENTRIES(fi);
+    return _fat_block_sum(values + first, entries) == ws->sums[b];
+}
+
+/*
+Load consecutive FAT blocks to the cache. Every FAT copy is read with one disk call and
+decoded with one codec call. The first copy is decoded right into the cache. With fat_checksums
+the first copy is used as is, if every block matches its checksum. While other copies are
+equal to the first one, there is nothing to vote. After the first difference entries are 
+voted the same way as in read_fat. Blocks with wrong copies or checksums are rewritten.
+*/
+static int _load_fat_range(unsigned int block, unsigned int blocks, cluster_val_t* values, fat_load_ws_t* ws, fat_data_t* fi) {
+    cluster_addr_t first_ca = block * FAT_BLOCK_ENTRIES(fi);
+    int count = blocks * FAT_BLOCK_ENTRIES(fi);
+    if (first_ca + count > fi->total_clusters) count = fi->total_clusters - first_ca;
+
+    int voting = 0;
+    int sums_read = 0, sums_failed = 0;
+    int encoded_size = nft32_ecc_encoded_size(sizeof(cluster_val_t));
+    for (int i = 0; i < fi->fat_count; i++) {
+        cluster_val_t* decoded = i ? ws->decoded : values;
+        int sc = 1;
+        sector_offset_t offset = 0;
+        sector_addr_t fat_sector = _fat_entry_location(first_ca, fi, i, encoded_size, &offset, &sc);
+        sc = (offset + count * encoded_size + fi->bytes_per_sector - 1) / fi->bytes_per_sector;
+        if (DSK_readoff_sectors(fat_sector, offset, (unsigned char*)ws->encoded, count * encoded_size, sc)) {
+            corrections_unpack_entries(CORRECTIONS_FAT, i, first_ca, (const byte_t*)ws->encoded, (byte_t*)decoded, count, sizeof(cluster_val_t));
+            for (int e = 0; e < count; e++) decoded[e] &= 0x0FFFFFFF;
+        }
+        else {
+            print_error("Could not read FAT blocks=%u..%u from FAT=%i.", block, block + blocks - 1, i);
+            errors_register_error(READ_FAT_ERROR, fi);
+            for (int e = 0; e < count; e++) decoded[e] = FAT_CLUSTER_BAD;
+        }
+
+        if (!i) {
+            if (!fi->fat_checksums) continue;
+            sums_read = _read_fat_sums(block, blocks, 0, ws, fi);
+            for (unsigned int b = 0; sums_read && !sums_failed && b < blocks; b++) sums_failed = !_fat_block_sum_ok(b, values, count, ws, fi);
+            if (sums_read && !sums_failed) break;
+
+            print_warn("FAT checksum mismatch in blocks=%u..%u. Voting...", block, block + blocks - 1);
+            sums_failed = 1;
+            continue;
+        }
+
+        if (!voting) {
+            cluster_val_t diff = 0;
+            for (int e = 0; e < count; e++) diff |= decoded[e] ^ values[e];
+            if (!diff) continue;
+
+            voting = 1;
+            for (int e = 0; e < count; e++) {
+                ws->freq[e]  = i - 1;
+                ws->wrong[e] = 0;
+            }
+        }
+
+        for (int e = 0; e < count; e++) {
+            int same = decoded[e] == values[e];
+            ws->freq[e]  += same ? 1 : -1;
+            ws->wrong[e] += !same;
+            if (ws->freq[e] < 0) {
+                values[e] = decoded[e];
+                ws->freq[e] = 0;
+            }
+        }
+    }
+
+    for (int e = 0; e < count; e++) {
+        if (values[e] == FAT_CLUSTER_FREE) fatmap_set(first_ca + e);
+        else fatmap_unset(first_ca + e);
+    }
+
+    if (_fat_loaded) {
+        for (unsigned int b = 0; b < blocks; b++) SET_FAT_BLOCK_LOADED(block + b);
+    }
+
+    if (!voting && !sums_failed) return 1;
+
+    for (unsigned int b = 0; b < blocks; b++) {
+        int first = b * FAT_BLOCK_ENTRIES(fi);
+        int wrong = sums_failed && (!sums_read || !_fat_block_sum_ok(b, values, count, ws, fi));
+        for (int e = first; voting && !wrong && e < count && e < first + (int)FAT_BLOCK_ENTRIES(fi); e++) {
+            wrong = ws->wrong[e] > 0 && first_ca + e >= fi->ext_root_cluster;
+        }
+
+        if (wrong) _repair_fat_block(block + b, values + first, fi);
+    }
+
+    return 1;
+}
+
+/*
+Load one FAT block (entries of one decoded FAT sector) to the provided cache entries.
+*/
+static int _load_fat_block(unsigned int block, cluster_val_t* values, fat_data_t* fi) {
+    byte_t encoded[FAT_BLOCK_ENTRIES(fi) * ECC_MAX_ENCODED_SIZE(sizeof(cluster_val_t))];
+    cluster_val_t decoded[FAT_BLOCK_ENTRIES(fi)];
+    int freq[FAT_BLOCK_ENTRIES(fi)], wrong[FAT_BLOCK_ENTRIES(fi)];
+    checksum_t sum = 0;
+    fat_load_ws_t ws = { .encoded = encoded, .decoded = decoded, .freq = freq, .wrong = wrong, .sums = &sum };
+    return _load_fat_range(block, 1, values, &ws, fi);
+}
+
+#if !defined(NO_FAT_CACHE) || !defined(NO_FAT_MAP)
+/*
+Load FAT blocks first..last by FAT_HLOAD_CHUNK blocks per read. Blocks go to the whole table
+cache, or to the scratch buffer of FAT_HLOAD_CHUNK blocks, if it is provided. In both cases
+the free cluster map is filled.
+*/
+static int _load_fat_blocks(unsigned int first, unsigned int last, cluster_val_t* scratch, fat_data_t* fi) {
+    unsigned int entries = FAT_HLOAD_CHUNK * FAT_BLOCK_ENTRIES(fi);
+    fat_load_ws_t ws = {
+        .encoded = (byte_t*)nft32_malloc_s(entries * ECC_MAX_ENCODED_SIZE(sizeof(cluster_val_t))),
+        .decoded = (cluster_val_t*)nft32_malloc_s(entries * sizeof(cluster_val_t)),
+        .freq    = (int*)nft32_malloc_s(entries * sizeof(int)),
+        .wrong   = (int*)nft32_malloc_s(entries * sizeof(int)),
+        .sums    = (checksum_t*)nft32_malloc_s(FAT_HLOAD_CHUNK * sizeof(checksum_t))
+    };
+
+    int result = 1;
+    int bulk = ws.encoded && ws.decoded && ws.freq && ws.wrong && ws.sums;
+    if (!bulk) print_warn("Not enough memory for the bulk FAT load. Loading by blocks...");
+
+    unsigned int block = first;
+    while (block < last) {
+        if (!scratch && FAT_BLOCK_LOADED(block)) {
+            block++;
+            continue;
+        }
+
+        unsigned int count = 1;
+        cluster_val_t* values = scratch ? scratch : &_fat[block * FAT_BLOCK_ENTRIES(fi)];
+        if (bulk) {
+            while (count < FAT_HLOAD_CHUNK && block + count < last && (scratch || !FAT_BLOCK_LOADED(block + count))) count++;
+            result = _load_fat_range(block, count, values, &ws, fi) && result;
+        }
+        else {
+            result = _load_fat_block(block, values, fi) && result;
+        }
+
+        block += count;
+    }
+
+    if (ws.encoded) nft32_free_s(ws.encoded);
+    if (ws.decoded) nft32_free_s(ws.decoded);
+    if (ws.freq)    nft32_free_s(ws.freq);
+    if (ws.wrong)   nft32_free_s(ws.wrong);
+    if (ws.sums)    nft32_free_s(ws.sums);
+    return result;
+}
+#endif
+
+int fat_cache_hload_part(int part, int parts, fat_data_t* fi) {
+#ifndef NO_FAT_CACHE
+    if (_fat_paged) {
+        print_warn("FAT cache is paged. Blocks will be loaded on demand.");
+        return 1;
+    }
+
+    if (!_fat || parts <= 0 || part < 0 || part >= parts) return 0;
+    unsigned int blocks = FAT_BLOCKS(fi);
+    unsigned int first = (unsigned int)(((unsigned long long)blocks * part) / parts);
+    unsigned int last  = (unsigned int)(((unsigned long long)blocks * (part + 1)) / parts);
+    return _load_fat_blocks(first, last, NULL, fi);
+#endif
+    UNUSED(part, parts, fi);
+    print_warn("fat_cache_hload_part() is not implemented! Don't provide the 'NO_FAT_CACHE'!");
+    return 1;
+}
+
+int fat_cache_hload(fat_data_t* fi) {
+    return fat_cache_hload_part(0, 1, fi);
+}
+
+int fat_scan(fat_data_t* fi) {
+#ifndef NO_FAT_MAP
+    if (_fat) return fat_cache_hload(fi);
+    cluster_val_t* scratch = (cluster_val_t*)nft32_malloc_s(FAT_HLOAD_CHUNK * FAT_BLOCK_ENTRIES(fi) * sizeof(cluster_val_t));
+    if (!scratch) {
+        print_error("nft32_malloc_s() error!");
+        errors_register_error(MALLOC_ERROR, fi);
+        return 0;
+    }
+
+    int result = _load_fat_blocks(0, FAT_BLOCKS(fi), scratch, fi);
+    nft32_free_s(scratch);
+    return result;
+#endif
+    UNUSED(fi);
+    print_warn("fat_scan() is not implemented! Don't provide the 'NO_FAT_MAP'!");
+    return 1;
+}
+
 cluster_val_t read_fat(cluster_addr_t ca, fat_data_t* fi) {
     print_debug("read_fat(ca=%u)", ca);
     if (ca < fi->ext_root_cluster || ca > fi->total_clusters) {
@@ -111,16 +769,30 @@ cluster_val_t read_fat(cluster_addr_t ca, fat_data_t* fi) {
         return FAT_CLUSTER_BAD;
     }
 
-    if (_fat && _fat[ca] != FAT_CLUSTER_BAD) {
-        print_debug("cached read_fat(ca=%u) -> %u", ca, _fat[ca]);
-        return _fat[ca];
+    if (FAT_CACHED() && ca < fi->total_clusters && _lock_pages()) {
+        cluster_val_t* page = _get_fat_page(ca / FAT_BLOCK_ENTRIES(fi), fi);
+        cluster_val_t value = page ? page[ca % FAT_BLOCK_ENTRIES(fi)] : FAT_CLUSTER_BAD;
+        _unlock_pages();
+        if (page) {
+            print_debug("cached read_fat(ca=%u) -> %u", ca, value);
+            return value;
+        }
+    }
+
+    if (fi->fat_checksums && ca < fi->total_clusters) {
+        cluster_val_t values[FAT_BLOCK_ENTRIES(fi)];
+        _load_fat_block(ca / FAT_BLOCK_ENTRIES(fi), values, fi);
+        print_debug("read_fat(ca=%u) -> %u", ca, values[ca % FAT_BLOCK_ENTRIES(fi)]);
+        return values[ca % FAT_BLOCK_ENTRIES(fi)];
     }
 
     int wrong = -1;
     int val_freq = 0;
     cluster_val_t table_value = FAT_CLUSTER_BAD;
+    cluster_val_t fat_values[fi->fat_count];
+    _read_fat_copies(ca, fat_values, fi);
     for (int i = 0; i < fi->fat_count; i++) {
-        cluster_val_t fat_val = __read_fat__(ca, fi, i);
+        cluster_val_t fat_val = fat_values[i];
         if (fat_val == table_value) val_freq++;
         else {
             val_freq--;
@@ -133,7 +805,6 @@ cluster_val_t read_fat(cluster_addr_t ca, fat_data_t* fi) {
         }
     }
 
-    if (_fat) _fat[ca] = table_value;
     if (table_value == FAT_CLUSTER_FREE) fatmap_set(ca);
     else fatmap_unset(ca);
 
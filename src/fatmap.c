@@ -1,70 +1,552 @@
 #include <nft32/fatmap.h>
 
-static bitmap_val_t* _bitmap = NULL;
+#ifndef NO_FAT_MAP
+static bitmap_val_t* _levels[FATMAP_LEVELS] = { NULL };
+static unsigned int  _words[FATMAP_LEVELS]  = { 0 };
+static unsigned int  _depth    = 0;
+static unsigned int  _clusters = 0;
+
+/* Free clusters in the map. It is changed with every bit, thus it equals the count of set bits. */
+static volatile unsigned int _free     = 0;
+static volatile int          _complete = 0;
+
+#define FATMAP_NONE 0xFFFFFFFFU
+
+/* State of the free map area. The map is bound to the area only if it is complete. */
+#define FATMAP_AREA_NONE    0
+#define FATMAP_AREA_DIRTY   1
+#define FATMAP_AREA_CLEAN   2
+#define FATMAP_AREA_STORING 3
+
+static lock_t        _area_lock  = NULL_LOCK;
+static volatile int  _area_state = FATMAP_AREA_NONE;
+static sector_addr_t _area_sa    = 0;
+
+static int _mark_dirty();
+static int _prepare_change();
+
+/*
+Count set bits of the word. __builtin_popcount can be a libgcc call, which isn't linked with -nostdlib.
+*/
+static inline unsigned int _bit_count(bitmap_val_t word) {
+    unsigned int count = 0;
+    for (; word; count++) word &= word - 1;
+    return count;
+}
+#endif
+
 int fatmap_init(fat_data_t* fi) {
 #ifndef NO_FAT_MAP
-    _bitmap = (bitmap_val_t*)nft32_malloc_s((fi->total_clusters / BITS_PER_WORD) * sizeof(bitmap_val_t));
-    if (!_bitmap) {
+    unsigned int total = 0, bits = fi->total_clusters;
+    _depth = 0;
+    do {
+        _words[_depth] = (bits + BITS_PER_WORD - 1) / BITS_PER_WORD;
+        total += _words[_depth];
+        bits = _words[_depth++];
+    } while (bits > 1 && _depth < FATMAP_LEVELS);
+
+    bitmap_val_t* bitmap = (bitmap_val_t*)nft32_malloc_s(total * sizeof(bitmap_val_t));
+    if (!bitmap) {
         print_error("nft32_malloc_s() error!");
         errors_register_error(MALLOC_ERROR, fi);
+        _depth = 0;
         return 0;
     }
 
-    nft32_str_memset(_bitmap, 0x00, (fi->total_clusters / BITS_PER_WORD) * sizeof(bitmap_val_t));
+    nft32_str_memset(bitmap, 0x00, total * sizeof(bitmap_val_t));
+    for (unsigned int l = 0; l < _depth; l++) {
+        _levels[l] = bitmap;
+        bitmap += _words[l];
+    }
+
+    _clusters = fi->total_clusters;
+    _free     = 0;
+    _complete = 0;
     return 1;
 #endif
+    UNUSED(fi);
     print_warn("fatmap_init() is not implemented! Don't provide the 'NO_FAT_MAP'!");
     return 1;
 }
 
+#ifndef NO_FAT_MAP
+#define FATMAP_WORD(l, w) (*(volatile bitmap_val_t*)&_levels[l][w])
+
+/*
+Set the bit of the word on the summary levels from the level. A word became non-empty, 
+thus its bit is set on the next level, while the next word was empty.
+*/
+static void _set_summary(unsigned int word, unsigned int l) {
+    for (; l < _depth; l++) {
+        bitmap_val_t bit = 1U << (word % BITS_PER_WORD);
+        if (__sync_fetch_and_or(&_levels[l][word / BITS_PER_WORD], bit) != BITMAP_NFREE) break;
+        word /= BITS_PER_WORD;
+    }
+}
+
+/*
+Clear the bit of the empty word on the summary levels from the level. If a cluster was
+set in the word meanwhile, the bit is set back. Otherwise a set, which saw the summary bit
+before the clear, would be lost.
+*/
+static void _clear_summary(unsigned int word, unsigned int l) {
+    for (; l < _depth; l++) {
+        bitmap_val_t bit = 1U << (word % BITS_PER_WORD);
+        bitmap_val_t old = __sync_fetch_and_and(&_levels[l][word / BITS_PER_WORD], ~bit);
+        if (FATMAP_WORD(l - 1, word) != BITMAP_NFREE) {
+            _set_summary(word, l);
+            return;
+        }
+
+        if (old != bit) return;
+        word /= BITS_PER_WORD;
+    }
+}
+
+/*
+Clear the cluster bit. Returns 1 if the bit was set.
+*/
+static int _clear_bit(unsigned int ca) {
+    bitmap_val_t bit = 1U << (ca % BITS_PER_WORD);
+    bitmap_val_t old = __sync_fetch_and_and(&_levels[0][ca / BITS_PER_WORD], ~bit);
+    if (!(old & bit)) return 0;
+    __sync_fetch_and_sub(&_free, 1);
+    if (old == bit) _clear_summary(ca / BITS_PER_WORD, 1);
+    return 1;
+}
+#endif
+
 int fatmap_set(unsigned int ca) {
 #ifndef NO_FAT_MAP
-    if (!_bitmap) return 0;
-    _bitmap[ca / BITS_PER_WORD] |= (1U << (ca % BITS_PER_WORD));
+    if (!_depth || ca >= _clusters) return 1;
+    bitmap_val_t bit = 1U << (ca % BITS_PER_WORD);
+    if (FATMAP_WORD(0, ca / BITS_PER_WORD) & bit) return 1;
+    if (!_prepare_change()) return 0;
+    bitmap_val_t old = __sync_fetch_and_or(&_levels[0][ca / BITS_PER_WORD], bit);
+    if (old & bit) return 1;
+    __sync_fetch_and_add(&_free, 1);
+    if (old == BITMAP_NFREE) _set_summary(ca / BITS_PER_WORD, 1);
     return 1;
 #endif
+    UNUSED(ca);
     print_warn("fatmap_set() is not implemented! Don't provide the 'NO_FAT_MAP'!");
     return 1;
 }
 
 int fatmap_unset(unsigned int ca) {
 #ifndef NO_FAT_MAP
-    if (!_bitmap) return 0;
-    _bitmap[ca / BITS_PER_WORD] &= ~(1U << (ca % BITS_PER_WORD));
+    if (!_depth || ca >= _clusters) return 1;
+    if (!BITMAP_IS_FREE(FATMAP_WORD(0, ca / BITS_PER_WORD), ca % BITS_PER_WORD)) return 1;
+    if (!_prepare_change()) return 0;
+    _clear_bit(ca);
     return 1;
 #endif
+    UNUSED(ca);
     print_warn("fatmap_unset() is not implemented! Don't provide the 'NO_FAT_MAP'!");
     return 1;
 }
 
-unsigned int fatmap_find_free(unsigned int offset, int size, fat_data_t* fi) {
+int fatmap_prepare() {
 #ifndef NO_FAT_MAP
-    if (!_bitmap) return 0;
-    if (size <= 0 || offset >= fi->total_clusters) return 0;
-    unsigned int limit = fi->total_clusters - offset - size;
-    for (unsigned int i = offset; i <= limit; ++i) {
+    if (!_depth) return 1;
+    return _prepare_change();
+#endif
+    return 1;
+}
+
+#ifndef NO_FAT_MAP
+/*
+Find the first free cluster from the position. The search goes up by levels until
+a word with a set bit is found, then goes down by the lowest set bits. If the way down
+meets an empty word, its summary bit is cleared and the search starts again.
+Returns the cluster or FATMAP_NONE.
+*/
+static unsigned int _find_free_from(unsigned int offset) {
+    while (1) {
+        unsigned int l = 0, pos = offset;
+        while (1) {
+            unsigned int word = pos / BITS_PER_WORD;
+            if (word >= _words[l]) return FATMAP_NONE;
+            bitmap_val_t masked = FATMAP_WORD(l, word) & (~0U << (pos % BITS_PER_WORD));
+            if (masked != BITMAP_NFREE) {
+                pos = word * BITS_PER_WORD + __builtin_ctz(masked);
+                break;
+            }
+
+            if (++l >= _depth) return FATMAP_NONE;
+            pos = word + 1;
+        }
+
         int found = 1;
-        for (int j = 0; j < size; ++j) {
-            unsigned int bit_index = i + j;
-            if ((_bitmap[bit_index / BITS_PER_WORD] >> (bit_index % BITS_PER_WORD)) & 1U) {
+        while (l-- > 0) {
+            bitmap_val_t word = FATMAP_WORD(l, pos);
+            if (word == BITMAP_NFREE) {
+                _clear_summary(pos, l + 1);
                 found = 0;
-                i = bit_index;
                 break;
             }
+
+            pos = pos * BITS_PER_WORD + __builtin_ctz(word);
+        }
+
+        if (found) return pos;
+    }
+}
+
+/*
+Count free clusters from the free cluster, up to the limit. Checks a word at a time.
+*/
+static unsigned int _free_run(unsigned int ca, unsigned int limit) {
+    unsigned int length = 0;
+    while (length < limit) {
+        bitmap_val_t used = ~FATMAP_WORD(0, ca / BITS_PER_WORD) >> (ca % BITS_PER_WORD);
+        if (used) return length + __builtin_ctz(used);
+        length += BITS_PER_WORD - ca % BITS_PER_WORD;
+        ca += BITS_PER_WORD - ca % BITS_PER_WORD;
+    }
+
+    return length;
+}
+#endif
+
+unsigned int fatmap_find_free(unsigned int offset, int size, fat_data_t* fi) {
+    return fatmap_find_free_range(offset, fi->total_clusters, size, fi);
+}
+
+unsigned int fatmap_find_free_range(unsigned int offset, unsigned int end, int size, fat_data_t* fi) {
+#ifndef NO_FAT_MAP
+    if (!_depth) return 0;
+    if (end > fi->total_clusters) end = fi->total_clusters;
+    if (size <= 0 || offset >= end) return 0;
+    while (1) {
+        unsigned int ca = _find_free_from(offset);
+        if (ca == FATMAP_NONE || ca + size > end) return 0;
+        unsigned int run = _free_run(ca, size);
+        if (run >= (unsigned int)size) return ca;
+        offset = ca + run + 1;
+    }
+#endif
+    UNUSED(offset, end, size, fi);
+    print_warn("fatmap_find_free_range() is not implemented! Don't provide the 'NO_FAT_MAP'!");
+    return 0;
+}
+
+unsigned int fatmap_claim_free(unsigned int offset, unsigned int end, fat_data_t* fi) {
+#ifndef NO_FAT_MAP
+    if (!_depth || !_prepare_change()) return 0;
+    if (end > fi->total_clusters) end = fi->total_clusters;
+    while (offset < end) {
+        unsigned int ca = _find_free_from(offset);
+        if (ca == FATMAP_NONE || ca >= end) return 0;
+        if (_clear_bit(ca)) return ca;
+
+        /* Another thread has claimed the cluster first. */
+        offset = ca + 1;
+    }
+
+    return 0;
+#endif
+    UNUSED(offset, end, fi);
+    print_warn("fatmap_claim_free() is not implemented! Don't provide the 'NO_FAT_MAP'!");
+    return 0;
+}
+
+int fatmap_claim(unsigned int ca, unsigned int count) {
+#ifndef NO_FAT_MAP
+    if (!_depth || !count || ca + count > _clusters || !_prepare_change()) return 0;
+
+    /* The run is claimed by words. If a word has a used cluster, claimed words are set back. */
+    unsigned int claimed = 0;
+    while (claimed < count) {
+        unsigned int pos = ca + claimed, bits = BITS_PER_WORD - pos % BITS_PER_WORD;
+        if (bits > count - claimed) bits = count - claimed;
+        bitmap_val_t mask = (bits == BITS_PER_WORD ? ~0U : (1U << bits) - 1) << (pos % BITS_PER_WORD);
+
+        bitmap_val_t old;
+        bitmap_val_t* word = &_levels[0][pos / BITS_PER_WORD];
+        do {
+            old = FATMAP_WORD(0, pos / BITS_PER_WORD);
+        } while ((old & mask) == mask && !__sync_bool_compare_and_swap(word, old, old & ~mask));
+
+        if ((old & mask) != mask) {
+            for (unsigned int c = 0; c < claimed; c++) fatmap_set(ca + c);
+            return 0;
+        }
+
+        __sync_fetch_and_sub(&_free, bits);
+        if (old == mask) _clear_summary(pos / BITS_PER_WORD, 1);
+        claimed += bits;
+    }
+
+    return 1;
+#endif
+    UNUSED(ca, count);
+    print_warn("fatmap_claim() is not implemented! Don't provide the 'NO_FAT_MAP'!");
+    return 0;
+}
+
+#ifndef NIFAT32_RO
+/*
+Write the header to the first sector of the free map area. The header checksum is set here.
+*/
+static int _write_area_header(sector_addr_t sa, fatmap_header_t* header) {
+    header->checksum = 0;
+    header->checksum = nft32_checksum((const unsigned char*)header, sizeof(fatmap_header_t));
+
+    int encoded_size = nft32_ecc_encoded_size(sizeof(fatmap_header_t));
+    byte_t encoded[ECC_MAX_ENCODED_SIZE(sizeof(fatmap_header_t))];
+    nft32_ecc_pack((const byte_t*)header, encoded, sizeof(fatmap_header_t));
+    if (!DSK_writeoff_sectors(sa, 0, (const unsigned char*)encoded, encoded_size, 1)) {
+        print_error("Could not write the free map header at sa=%u.", sa);
+        return 0;
+    }
+
+    return 1;
+}
+#endif
+
+#ifndef NO_FAT_MAP
+/*
+Write the header of the free map area with the state. The clean header holds the checksum
+and the free clusters count of the first level.
+*/
+static int _write_header(unsigned char state) {
+#ifndef NIFAT32_RO
+    fatmap_header_t header = { .magic = FREEMAP_MAGIC, .state = state, .clusters = _clusters };
+    if (state == FREEMAP_CLEAN) {
+        for (unsigned int w = 0; w < _words[0]; w++) header.free += _bit_count(_levels[0][w]);
+        header.bitmap_checksum = nft32_checksum((const unsigned char*)_levels[0], _words[0] * sizeof(bitmap_val_t));
+    }
+
+    return _write_area_header(_area_sa, &header);
+#endif
+    UNUSED(state);
+    return 0;
+}
+
+/*
+Mark the area dirty before the first change of the loaded or stored map is used.
+A change in the middle of fatmap_store waits for the store, then marks the stored area.
+*/
+static int _mark_dirty() {
+    if (!THR_require_write(&_area_lock, get_thread_num())) return 0;
+    int result = 1;
+    if (_area_state == FATMAP_AREA_CLEAN) {
+        /* The dirty mark should reach the disk before any FAT change. If it doesn't,
+           the area stays clean, and the change is refused. */
+        result = _write_header(FREEMAP_DIRTY) && DSK_flush();
+        if (result) _area_state = FATMAP_AREA_DIRTY;
+        else print_error("Could not mark the free map area dirty!");
+    }
+
+    THR_release_write(&_area_lock, get_thread_num());
+    return result;
+}
+
+/*
+Mark the bound area dirty before a change of the map.
+Returns 1 if the area is dirty or the map isn't bound to an area, otherwise will return 0.
+*/
+static int _prepare_change() {
+    if (_area_state == FATMAP_AREA_NONE || _area_state == FATMAP_AREA_DIRTY) return 1;
+    return _mark_dirty();
+}
+
+/*
+Set summary levels from the first level.
+*/
+static void _build_levels() {
+    for (unsigned int l = 1; l < _depth; l++) {
+        nft32_str_memset(_levels[l], 0x00, _words[l] * sizeof(bitmap_val_t));
+        for (unsigned int w = 0; w < _words[l - 1]; w++) {
+            if (_levels[l - 1][w] != BITMAP_NFREE) _levels[l][w / BITS_PER_WORD] |= 1U << (w % BITS_PER_WORD);
         }
+    }
+}
+#endif
 
-        if (found) return i;
+int fatmap_load(fat_data_t* fi) {
+#ifndef NO_FAT_MAP
+    if (!_depth || !fi->free_map) return 0;
+    _area_sa = GET_FREEMAPSECTOR(fi->total_sectors, FREEMAP_SECTORS(fi));
+    _area_state = FATMAP_AREA_DIRTY;
+
+    int header_size = nft32_ecc_encoded_size(sizeof(fatmap_header_t));
+    byte_t encoded_header[ECC_MAX_ENCODED_SIZE(sizeof(fatmap_header_t))];
+    if (!DSK_readoff_sectors(_area_sa, 0, (unsigned char*)encoded_header, header_size, 1)) {
+        print_error("Could not read the free map header at sa=%u.", _area_sa);
+        errors_register_error(SECTOR_READ_ERROR, fi);
+        return 0;
+    }
+
+    fatmap_header_t header;
+    corrections_unpack(CORRECTIONS_FREEMAP, 0, 0, encoded_header, (byte_t*)&header, sizeof(fatmap_header_t));
+    checksum_t hcheck = header.checksum;
+    header.checksum = 0;
+    if (header.magic != FREEMAP_MAGIC || nft32_checksum((const unsigned char*)&header, sizeof(fatmap_header_t)) != hcheck) {
+        print_warn("Free map header is damaged or not written yet.");
+        return 0;
     }
 
+    if (header.state != FREEMAP_CLEAN || header.clusters != _clusters) {
+        print_warn("Free map is dirty (state=%i, clusters=%u).", header.state, header.clusters);
+        return 0;
+    }
+
+    int bytes = _words[0] * sizeof(bitmap_val_t);
+    int encoded_size = nft32_ecc_encoded_size(bytes);
+    byte_t* encoded = (byte_t*)nft32_malloc_s(encoded_size);
+    if (!encoded) {
+        print_error("nft32_malloc_s() error!");
+        errors_register_error(MALLOC_ERROR, fi);
+        _write_header(FREEMAP_DIRTY);
+        return 0;
+    }
+
+    int result = DSK_readoff_sectors(_area_sa + 1, 0, (unsigned char*)encoded, encoded_size, FREEMAP_SECTORS(fi) - 1);
+    if (result) {
+        corrections_unpack(CORRECTIONS_FREEMAP, 0, 0, encoded, (byte_t*)_levels[0], bytes);
+        result = nft32_checksum((const unsigned char*)_levels[0], bytes) == header.bitmap_checksum;
+        if (!result) print_warn("Free map checksum mismatch.");
+    }
+    else {
+        print_error("Could not read the free map at sa=%u.", _area_sa + 1);
+        errors_register_error(SECTOR_READ_ERROR, fi);
+    }
+
+    nft32_free_s(encoded);
+    if (!result) {
+        /* The clean area can't be used, thus it is marked dirty until the next store. */
+        nft32_str_memset(_levels[0], 0x00, bytes);
+        _write_header(FREEMAP_DIRTY);
+        return 0;
+    }
+
+    if (_clusters % BITS_PER_WORD) _levels[0][_words[0] - 1] &= (1U << (_clusters % BITS_PER_WORD)) - 1;
+    _free = 0;
+    for (unsigned int w = 0; w < _words[0]; w++) _free += _bit_count(_levels[0][w]);
+    _build_levels();
+    _area_state = FATMAP_AREA_CLEAN;
+    print_info("Free map is loaded: %u free clusters", header.free);
+    return 1;
+#endif
+    UNUSED(fi);
+    print_warn("fatmap_load() is not implemented! Don't provide the 'NO_FAT_MAP'!");
     return 0;
+}
+
+int fatmap_store(fat_data_t* fi) {
+#if !defined(NO_FAT_MAP) && !defined(NIFAT32_RO)
+    if (!_depth || _area_state == FATMAP_AREA_NONE || _area_state == FATMAP_AREA_CLEAN) return 1;
+    if (!THR_require_write(&_area_lock, get_thread_num())) return 0;
+    if (_area_state != FATMAP_AREA_DIRTY) {
+        THR_release_write(&_area_lock, get_thread_num());
+        return 1;
+    }
+
+    /* Changes from now on are marked after the store. */
+    _area_state = FATMAP_AREA_STORING;
+    __sync_synchronize();
+
+    int bytes = _words[0] * sizeof(bitmap_val_t);
+    int encoded_size = nft32_ecc_encoded_size(bytes);
+    byte_t* encoded = (byte_t*)nft32_malloc_s(encoded_size);
+    int result = encoded != NULL;
+    if (!result) {
+        print_error("nft32_malloc_s() error!");
+        errors_register_error(MALLOC_ERROR, fi);
+    }
+    else {
+        nft32_ecc_pack((const byte_t*)_levels[0], encoded, bytes);
+        result = DSK_writeoff_sectors(_area_sa + 1, 0, (const unsigned char*)encoded, encoded_size, FREEMAP_SECTORS(fi) - 1);
+        if (!result) {
+            print_error("Could not write the free map at sa=%u.", _area_sa + 1);
+            errors_register_error(SECTOR_WRITE_ERROR, fi);
+        }
+
+        nft32_free_s(encoded);
+    }
+
+    /* The FAT and the map reach the disk before the clean mark. */
+    result = result && DSK_flush() && _write_header(FREEMAP_CLEAN);
+    _area_state = result ? FATMAP_AREA_CLEAN : FATMAP_AREA_DIRTY;
+    THR_release_write(&_area_lock, get_thread_num());
+    return result;
+#endif
+    UNUSED(fi);
+    return 1;
+}
+
+int fatmap_invalidate(fat_data_t* fi) {
+#ifndef NIFAT32_RO
+    if (!fi->free_map) return 1;
+#ifndef NO_FAT_MAP
+    /* The loaded map marks its area by the first change. */
+    if (_area_state == FATMAP_AREA_CLEAN) return 1;
+#endif
+    fatmap_header_t header = { .magic = FREEMAP_MAGIC, .state = FREEMAP_DIRTY, .clusters = fi->total_clusters };
+    if (!_write_area_header(GET_FREEMAPSECTOR(fi->total_sectors, FREEMAP_SECTORS(fi)), &header) || !DSK_flush()) {
+        errors_register_error(SECTOR_WRITE_ERROR, fi);
+        return 0;
+    }
+
+    return 1;
+#endif
+    UNUSED(fi);
+    return 1;
+}
+
+int fatmap_complete() {
+#ifndef NO_FAT_MAP
+    if (!_depth) return 0;
+    _complete = 1;
+    return 1;
 #endif
-    print_warn("fatmap_find_free() is not implemented! Don't provide the 'NO_FAT_MAP'!");
     return 0;
 }
 
+void fatmap_stat_add_run(fatmap_stat_t* st, unsigned int length) {
+    if (!length) return;
+    int bucket = 31 - __builtin_clz(length);
+    st->histogram[bucket < FATMAP_HISTOGRAM ? bucket : FATMAP_HISTOGRAM - 1]++;
+    if (length > st->largest) st->largest = length;
+    st->extents++;
+}
+
+int fatmap_stat(fatmap_stat_t* st) {
+    nft32_str_memset(st, 0x00, sizeof(fatmap_stat_t));
+#ifndef NO_FAT_MAP
+    if (!_depth) return -1;
+    if (!_complete) return 0;
+
+    /* Runs are counted by the map at the moment of the walk, thus they may differ from the counter a bit. */
+    st->free = _free;
+    unsigned int ca = 0;
+    while ((ca = _find_free_from(ca)) != FATMAP_NONE) {
+        unsigned int run = _free_run(ca, _clusters - ca);
+        fatmap_stat_add_run(st, run);
+        ca += run + 1;
+        if (ca >= _clusters) break;
+    }
+
+    return 1;
+#endif
+    return -1;
+}
+
 int fatmap_unload() {
 #ifndef NO_FAT_MAP
-    if (_bitmap) nft32_free_s(_bitmap);
+    if (_depth) nft32_free_s(_levels[0]);
+    for (unsigned int l = 0; l < FATMAP_LEVELS; l++) {
+        _levels[l] = NULL;
+        _words[l]  = 0;
+    }
+
+    _depth      = 0;
+    _clusters   = 0;
+    _free       = 0;
+    _complete   = 0;
+    _area_state = FATMAP_AREA_NONE;
     return 1;
 #endif
     print_warn("fatmap_unload() is not implemented! Don't provide the 'NO_FAT_MAP'!");
@@ -0,0 +1,128 @@
+#include <nft32/fatpage.h>
+
+#ifndef NO_FAT_CACHE
+static unsigned int* _entries = NULL;
+static fat_page_t*   _pages   = NULL;
+static int*          _buckets = NULL;
+static unsigned int  _pages_count   = 0;
+static unsigned int  _page_entries  = 0;
+static unsigned int  _buckets_count = 0; // power of two
+static unsigned int  _clock_hand    = 0;
+
+#define FATPAGE_BUCKET(block) (((block) * 2654435761U) & (_buckets_count - 1))
+#endif
+
+int fatpage_init(unsigned int pages, unsigned int entries, fat_data_t* fi) {
+#ifndef NO_FAT_CACHE
+    if (!pages || !entries) return 0;
+    _buckets_count = 1;
+    while (_buckets_count < pages) _buckets_count <<= 1;
+
+    _entries = (unsigned int*)nft32_malloc_s(pages * entries * sizeof(unsigned int));
+    _pages   = (fat_page_t*)nft32_malloc_s(pages * sizeof(fat_page_t));
+    _buckets = (int*)nft32_malloc_s(_buckets_count * sizeof(int));
+    if (!_entries || !_pages || !_buckets) {
+        print_error("nft32_malloc_s() error!");
+        errors_register_error(MALLOC_ERROR, fi);
+        fatpage_unload();
+        return 0;
+    }
+
+    for (unsigned int i = 0; i < pages; i++) {
+        _pages[i].block = FATPAGE_EMPTY;
+        _pages[i].next  = -1;
+        _pages[i].ref   = 0;
+    }
+
+    for (unsigned int i = 0; i < _buckets_count; i++) _buckets[i] = -1;
+    _pages_count  = pages;
+    _page_entries = entries;
+    _clock_hand   = 0;
+    return 1;
+#endif
+    UNUSED(pages, entries, fi);
+    print_warn("fatpage_init() is not implemented! Don't provide the 'NO_FAT_CACHE'!");
+    return 0;
+}
+
+unsigned int* fatpage_get(unsigned int block) {
+#ifndef NO_FAT_CACHE
+    if (!_pages) return NULL;
+    for (int i = _buckets[FATPAGE_BUCKET(block)]; i >= 0; i = _pages[i].next) {
+        if (_pages[i].block != block) continue;
+        _pages[i].ref = 1;
+        return _entries + i * _page_entries;
+    }
+
+    return NULL;
+#endif
+    UNUSED(block);
+    print_warn("fatpage_get() is not implemented! Don't provide the 'NO_FAT_CACHE'!");
+    return NULL;
+}
+
+unsigned int* fatpage_victim(unsigned int* block) {
+#ifndef NO_FAT_CACHE
+    if (!_pages) return NULL;
+    while (1) {
+        unsigned int i = _clock_hand;
+        _clock_hand = (_clock_hand + 1) % _pages_count;
+        if (_pages[i].block != FATPAGE_EMPTY && _pages[i].ref) {
+            _pages[i].ref = 0;
+            continue;
+        }
+
+        *block = _pages[i].block;
+        return _entries + i * _page_entries;
+    }
+#endif
+    UNUSED(block);
+    print_warn("fatpage_victim() is not implemented! Don't provide the 'NO_FAT_CACHE'!");
+    return NULL;
+}
+
+#ifndef NO_FAT_CACHE
+static void _unlink_page(int index) {
+    int* link = &_buckets[FATPAGE_BUCKET(_pages[index].block)];
+    while (*link >= 0 && *link != index) link = &_pages[*link].next;
+    if (*link == index) *link = _pages[index].next;
+    _pages[index].next = -1;
+}
+#endif
+
+int fatpage_bind(unsigned int* page, unsigned int block) {
+#ifndef NO_FAT_CACHE
+    if (!_pages || page < _entries) return 0;
+    unsigned int index = (unsigned int)(page - _entries) / _page_entries;
+    if (index >= _pages_count) return 0;
+
+    if (_pages[index].block != FATPAGE_EMPTY) _unlink_page(index);
+    _pages[index].block = block;
+    _pages[index].ref   = 1;
+    if (block != FATPAGE_EMPTY) {
+        unsigned int bucket = FATPAGE_BUCKET(block);
+        _pages[index].next = _buckets[bucket];
+        _buckets[bucket] = index;
+    }
+
+    return 1;
+#endif
+    UNUSED(page, block);
+    print_warn("fatpage_bind() is not implemented! Don't provide the 'NO_FAT_CACHE'!");
+    return 0;
+}
+
+int fatpage_unload() {
+#ifndef NO_FAT_CACHE
+    if (_entries) nft32_free_s(_entries);
+    if (_pages)   nft32_free_s(_pages);
+    if (_buckets) nft32_free_s(_buckets);
+    _entries = NULL;
+    _pages   = NULL;
+    _buckets = NULL;
+    _pages_count = 0;
+    return 1;
+#endif
+    print_warn("fatpage_unload() is not implemented! Don't provide the 'NO_FAT_CACHE'!");
+    return 1;
+}
@@ -2,12 +2,13 @@
 
 #ifndef NIFAT32_RO
 static int __write_journal__(int index, journal_entry_t* entry, fat_data_t* fi, int journal) {
-    decoded_t entry_buffer[sizeof(journal_entry_t)] = { 0 };
-    cluster_offset_t entry_offset = index * sizeof(entry_buffer);
-    nft32_pack_memory((const byte_t*)entry, entry_buffer, sizeof(journal_entry_t));
+    byte_t entry_buffer[ECC_MAX_ENCODED_SIZE(sizeof(journal_entry_t))] = { 0 };
+    int encoded_size = nft32_ecc_encoded_size(sizeof(journal_entry_t));
+    cluster_offset_t entry_offset = index * encoded_size;
+    nft32_ecc_pack((const byte_t*)entry, entry_buffer, sizeof(journal_entry_t));
     if (
         !DSK_writeoff_sectors(
-            GET_JOURNALSECTOR(journal, fi->total_sectors), entry_offset, (const_buffer_t)entry_buffer, sizeof(entry_buffer), 1
+            GET_JOURNALSECTOR(journal, fi->total_sectors), entry_offset, (const_buffer_t)entry_buffer, encoded_size, 1
         )
     ) {
         print_error("Could not write journal to journal sector!");
@@ -25,11 +26,12 @@ static int _write_journal(int index, journal_entry_t* entry, fat_data_t* fi) {
 }
 
 static int __read_journal__(int index, journal_entry_t* entry, fat_data_t* fi, int journal) {
-    decoded_t entry_buffer[sizeof(journal_entry_t)] = { 0 };
-    cluster_offset_t entry_offset = index * sizeof(entry_buffer);
+    byte_t entry_buffer[ECC_MAX_ENCODED_SIZE(sizeof(journal_entry_t))] = { 0 };
+    int encoded_size = nft32_ecc_encoded_size(sizeof(journal_entry_t));
+    cluster_offset_t entry_offset = index * encoded_size;
     if (
         !DSK_readoff_sectors(
-            GET_JOURNALSECTOR(journal, fi->total_sectors), entry_offset, (buffer_t)entry_buffer, sizeof(entry_buffer), 1
+            GET_JOURNALSECTOR(journal, fi->total_sectors), entry_offset, (buffer_t)entry_buffer, encoded_size, 1
         )
     ) {
         print_error("Could not read journal from journal sector!");
@@ -37,7 +39,7 @@ static int __read_journal__(int index, journal_entry_t* entry, fat_data_t* fi, i
         return 0;
     }
 
-    nft32_unpack_memory((const decoded_t*)entry_buffer, (byte_t*)entry, sizeof(journal_entry_t));
+    corrections_unpack(CORRECTIONS_JOURNAL, journal, 0, (const byte_t*)entry_buffer, (byte_t*)entry, sizeof(journal_entry_t));
     return 1;    
 } 
 
@@ -89,7 +91,8 @@ static int _unsqueeze_entry(squeezed_entry_t* src, unsqueezed_entry_t* dst) {
     dst->file_size  = src->file_size;
     nft32_str_memcpy(dst->file_name, src->file_name, sizeof(src->file_name));
     dst->name_hash = nft32_murmur3_x86_32((const_buffer_t)dst->file_name, sizeof(dst->file_name), 0);
-    dst->checksum  = nft32_murmur3_x86_32((const_buffer_t)dst, sizeof(unsqueezed_entry_t), 0);
+    dst->checksum  = 0;
+    dst->checksum  = nft32_checksum((const_buffer_t)dst, sizeof(unsqueezed_entry_t));
     return 1;
 }
 #endif
@@ -101,7 +104,7 @@ int restore_from_journal(fat_data_t* fi) {
     if (!fi->journals_count) return 0;
     for (
         _journal_index = 0; 
-        _journal_index < (fi->cluster_size / (sizeof(journal_entry_t) * sizeof(encoded_t))); 
+        _journal_index < JOURNAL_ENTRIES(fi); 
         _journal_index++
     ) {
         journal_entry_t entry;
@@ -114,15 +117,17 @@ int restore_from_journal(fat_data_t* fi) {
         
         switch (entry.op) {
             case DEL_OP: {
-                decoded_t entry_buffer[sizeof(unsqueezed_entry_t)] = { 0 };
-                writeoff_cluster(entry.ca, entry.offset * sizeof(entry_buffer), (const_buffer_t)entry_buffer, sizeof(entry_buffer), fi);
+                byte_t entry_buffer[ECC_MAX_ENCODED_SIZE(sizeof(unsqueezed_entry_t))] = { 0 };
+                int encoded_size = nft32_ecc_encoded_size(sizeof(unsqueezed_entry_t));
+                writeoff_cluster(entry.ca, entry.offset * encoded_size, (const_buffer_t)entry_buffer, encoded_size, fi);
                 break;
             }
             case ADD_OP:
             case EDIT_OP: {
-                decoded_t entry_buffer[sizeof(unsqueezed_entry_t)] = { 0 };
-                nft32_pack_memory((const byte_t*)&restored, entry_buffer, sizeof(unsqueezed_entry_t));
-                writeoff_cluster(entry.ca, entry.offset * sizeof(entry_buffer), (const_buffer_t)entry_buffer, sizeof(entry_buffer), fi);
+                byte_t entry_buffer[ECC_MAX_ENCODED_SIZE(sizeof(unsqueezed_entry_t))] = { 0 };
+                int encoded_size = nft32_ecc_encoded_size(sizeof(unsqueezed_entry_t));
+                nft32_ecc_pack((const byte_t*)&restored, entry_buffer, sizeof(unsqueezed_entry_t));
+                writeoff_cluster(entry.ca, entry.offset * encoded_size, (const_buffer_t)entry_buffer, encoded_size, fi);
                 break;
             }
             default: break;
@@ -150,7 +155,7 @@ int journal_add_operation(unsigned char op, cluster_addr_t ca, int offset, unsqu
     int entry_index = 0;
     while (delay-- > 0) {
         if (THR_require_write(&_journal_lock, get_thread_num())) {
-            entry_index = _journal_index++ % (fi->cluster_size / (sizeof(journal_entry_t) * sizeof(encoded_t)));
+            entry_index = _journal_index++ % JOURNAL_ENTRIES(fi);
             journal_entry_t curr;
             _read_journal(entry_index, &curr, fi);
             THR_release_write(&_journal_lock, get_thread_num());
@@ -13,6 +13,19 @@ static inline unsigned int _fmix32(unsigned int h) {
     return h;
 }
 
+static inline unsigned int _mix_k1(unsigned int k1) {
+    k1 *= 0xcc9e2d51;
+    k1 = _rotl32(k1, 15);
+    k1 *= 0x1b873593;
+    return k1;
+}
+
+static inline unsigned int _mix_h1(unsigned int h1, unsigned int k1) {
+    h1 ^= _mix_k1(k1);
+    h1 = _rotl32(h1, 13);
+    return h1 * 5 + 0xe6546b64;
+}
+
 checksum_t nft32_murmur3_x86_32(const unsigned char* key, unsigned int len, unsigned int seed) {
     const unsigned int c1 = 0xcc9e2d51;
     const unsigned int c2 = 0x1b873593;
@@ -48,4 +61,76 @@ checksum_t nft32_murmur3_x86_32(const unsigned char* key, unsigned int len, unsi
     h1 ^= len;
     h1 = _fmix32(h1);
     return h1;
-}
\ No newline at end of file
+}
+int nft32_murmur3_init(murmur3_state_t* state, unsigned int seed) {
+    state->h1       = seed;
+    state->len      = 0;
+    state->tail     = 0;
+    state->tail_len = 0;
+    return 1;
+}
+
+int nft32_murmur3_update(murmur3_state_t* state, const unsigned char* key, unsigned int len) {
+    state->len += len;
+    while (state->tail_len && len) {
+        state->tail |= (unsigned int)(*key++) << (state->tail_len * 8);
+        len--;
+        if (++state->tail_len == 4) {
+            state->h1 = _mix_h1(state->h1, state->tail);
+            state->tail = 0;
+            state->tail_len = 0;
+        }
+    }
+
+    unsigned int h1 = state->h1;
+    for (; len >= 4; len -= 4, key += 4) {
+        h1 = _mix_h1(h1, (unsigned int)key[0] | ((unsigned int)key[1] << 8) | ((unsigned int)key[2] << 16) | ((unsigned int)key[3] << 24));
+    }
+
+    state->h1 = h1;
+    for (; len; len--) state->tail |= (unsigned int)(*key++) << (state->tail_len++ * 8);
+    return 1;
+}
+
+checksum_t nft32_murmur3_final(const murmur3_state_t* state) {
+    unsigned int h1 = state->h1;
+    if (state->tail_len) h1 ^= _mix_k1(state->tail);
+    h1 ^= state->len;
+    return _fmix32(h1);
+}
+
+static int _algorithm = CHECKSUM_MURMUR3;
+
+int nft32_checksum_setup(int algorithm) {
+    if (algorithm != CHECKSUM_MURMUR3 && algorithm != CHECKSUM_CRC32C) return 0;
+    _algorithm = algorithm;
+    return 1;
+}
+
+int nft32_checksum_algorithm() {
+    return _algorithm;
+}
+
+checksum_t nft32_checksum(const unsigned char* key, unsigned int len) {
+    if (_algorithm == CHECKSUM_CRC32C) return ~nft32_crc32c_update(CRC32C_INIT, key, len);
+    return nft32_murmur3_x86_32(key, len, 0);
+}
+
+int nft32_checksum_init(checksum_state_t* state) {
+    state->crc = CRC32C_INIT;
+    return nft32_murmur3_init(&state->murmur3, 0);
+}
+
+int nft32_checksum_update(checksum_state_t* state, const unsigned char* key, unsigned int len) {
+    if (_algorithm == CHECKSUM_CRC32C) {
+        state->crc = nft32_crc32c_update(state->crc, key, len);
+        return 1;
+    }
+
+    return nft32_murmur3_update(&state->murmur3, key, len);
+}
+
+checksum_t nft32_checksum_final(const checksum_state_t* state) {
+    if (_algorithm == CHECKSUM_CRC32C) return ~state->crc;
+    return nft32_murmur3_final(&state->murmur3);
+}
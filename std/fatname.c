@@ -104,3 +104,9 @@ int unpack_83_name(const char* name83, char* name, char* ext) {
     ext[3]  = 0;
     return 1;
 }
+
+int nft32_hash_fatname(const char* name83, hashed_name_t* hn) {
+    hn->name = name83;
+    hn->hash = nft32_murmur3_x86_32((const unsigned char*)name83, FATNAME_SIZE, 0);
+    return 1;
+}
@@ -1,69 +1,248 @@
 #include <std/hamming.h>
+#include <std/hamming_simd.h>
+#include <std/secded.h>
 
-static encoded_t _encode_hamming_15_11(decoded_t data) {
-    encoded_t encoded = 0;
-    encoded = SET_BIT(encoded, 2, GET_BIT(data, 0));
-    encoded = SET_BIT(encoded, 4, GET_BIT(data, 1));
-    encoded = SET_BIT(encoded, 5, GET_BIT(data, 2));
-    encoded = SET_BIT(encoded, 6, GET_BIT(data, 3));
-    encoded = SET_BIT(encoded, 8, GET_BIT(data, 4));
-    encoded = SET_BIT(encoded, 9, GET_BIT(data, 5));
-    encoded = SET_BIT(encoded, 10, GET_BIT(data, 6));
-    encoded = SET_BIT(encoded, 11, GET_BIT(data, 7));
-    encoded = SET_BIT(encoded, 12, GET_BIT(data, 8));
-    encoded = SET_BIT(encoded, 13, GET_BIT(data, 9));
-    encoded = SET_BIT(encoded, 14, GET_BIT(data, 10));
-
-    byte_t p1 = GET_BIT(encoded, 2) ^ GET_BIT(encoded, 4) ^ GET_BIT(encoded, 6) ^ GET_BIT(encoded, 8) ^ GET_BIT(encoded, 10) ^ GET_BIT(encoded, 12) ^ GET_BIT(encoded, 14);
-    byte_t p2 = GET_BIT(encoded, 2) ^ GET_BIT(encoded, 5) ^ GET_BIT(encoded, 6) ^ GET_BIT(encoded, 9) ^ GET_BIT(encoded, 10) ^ GET_BIT(encoded, 13) ^ GET_BIT(encoded, 14);
-    byte_t p4 = GET_BIT(encoded, 4) ^ GET_BIT(encoded, 5) ^ GET_BIT(encoded, 6) ^ GET_BIT(encoded, 11) ^ GET_BIT(encoded, 12) ^ GET_BIT(encoded, 13) ^ GET_BIT(encoded, 14);
-    byte_t p8 = GET_BIT(encoded, 8) ^ GET_BIT(encoded, 9) ^ GET_BIT(encoded, 10) ^ GET_BIT(encoded, 11) ^ GET_BIT(encoded, 12) ^ GET_BIT(encoded, 13) ^ GET_BIT(encoded, 14);
-
-    encoded = SET_BIT(encoded, 0, p1);
-    encoded = SET_BIT(encoded, 1, p2);
-    encoded = SET_BIT(encoded, 3, p4);
-    encoded = SET_BIT(encoded, 7, p8);
-    return encoded;
-}
-
-static decoded_t _decode_hamming_15_11(encoded_t encoded) {
-    byte_t s1 = GET_BIT(encoded, 0) ^ GET_BIT(encoded, 2) ^ GET_BIT(encoded, 4) ^ GET_BIT(encoded, 6) ^ GET_BIT(encoded, 8) ^ GET_BIT(encoded, 10) ^ GET_BIT(encoded, 12) ^ GET_BIT(encoded, 14);
-    byte_t s2 = GET_BIT(encoded, 1) ^ GET_BIT(encoded, 2) ^ GET_BIT(encoded, 5) ^ GET_BIT(encoded, 6) ^ GET_BIT(encoded, 9) ^ GET_BIT(encoded, 10) ^ GET_BIT(encoded, 13) ^ GET_BIT(encoded, 14);
-    byte_t s4 = GET_BIT(encoded, 3) ^ GET_BIT(encoded, 4) ^ GET_BIT(encoded, 5) ^ GET_BIT(encoded, 6) ^ GET_BIT(encoded, 11) ^ GET_BIT(encoded, 12) ^ GET_BIT(encoded, 13) ^ GET_BIT(encoded, 14);
-    byte_t s8 = GET_BIT(encoded, 7) ^ GET_BIT(encoded, 8) ^ GET_BIT(encoded, 9) ^ GET_BIT(encoded, 10) ^ GET_BIT(encoded, 11) ^ GET_BIT(encoded, 12) ^ GET_BIT(encoded, 13) ^ GET_BIT(encoded, 14);
-    byte_t error_pos = s1 + (s2 << 1) + (s4 << 2) + (s8 << 3);
-    if (error_pos) encoded = TOGGLE_BIT(encoded, (error_pos - 1));
-    
-    decoded_t data = 0;
-    data = SET_BIT(data, 0, GET_BIT(encoded, 2));
-    data = SET_BIT(data, 1, GET_BIT(encoded, 4));
-    data = SET_BIT(data, 2, GET_BIT(encoded, 5));
-    data = SET_BIT(data, 3, GET_BIT(encoded, 6));
-    data = SET_BIT(data, 4, GET_BIT(encoded, 8));
-    data = SET_BIT(data, 5, GET_BIT(encoded, 9));
-    data = SET_BIT(data, 6, GET_BIT(encoded, 10));
-    data = SET_BIT(data, 7, GET_BIT(encoded, 11));
-    data = SET_BIT(data, 8, GET_BIT(encoded, 12));
-    data = SET_BIT(data, 9, GET_BIT(encoded, 13));
-    data = SET_BIT(data, 10, GET_BIT(encoded, 14));
-    return data;
-}
-
-static inline byte_t _get_byte(const decoded_t* ptr, int offset) {
-    return (byte_t)_decode_hamming_15_11(ptr[offset]);
-}
-
-static inline int _set_byte(encoded_t* ptr, int offset, byte_t byte) {
-    ptr[offset] = _encode_hamming_15_11((encoded_t)byte);
-    return 1;
+#ifndef NIFAT32_HAMMING_NIBBLE
+/* Hamming 15,11 codeword for every possible byte. */
+static const encoded_t _encode_table[256] = {
+    0x0000, 0x0007, 0x0019, 0x001E, 0x002A, 0x002D, 0x0033, 0x0034,
+    0x004B, 0x004C, 0x0052, 0x0055, 0x0061, 0x0066, 0x0078, 0x007F,
+    0x0181, 0x0186, 0x0198, 0x019F, 0x01AB, 0x01AC, 0x01B2, 0x01B5,
+    0x01CA, 0x01CD, 0x01D3, 0x01D4, 0x01E0, 0x01E7, 0x01F9, 0x01FE,
+    0x0282, 0x0285, 0x029B, 0x029C, 0x02A8, 0x02AF, 0x02B1, 0x02B6,
+    0x02C9, 0x02CE, 0x02D0, 0x02D7, 0x02E3, 0x02E4, 0x02FA, 0x02FD,
+    0x0303, 0x0304, 0x031A, 0x031D, 0x0329, 0x032E, 0x0330, 0x0337,
+    0x0348, 0x034F, 0x0351, 0x0356, 0x0362, 0x0365, 0x037B, 0x037C,
+    0x0483, 0x0484, 0x049A, 0x049D, 0x04A9, 0x04AE, 0x04B0, 0x04B7,
+    0x04C8, 0x04CF, 0x04D1, 0x04D6, 0x04E2, 0x04E5, 0x04FB, 0x04FC,
+    0x0502, 0x0505, 0x051B, 0x051C, 0x0528, 0x052F, 0x0531, 0x0536,
+    0x0549, 0x054E, 0x0550, 0x0557, 0x0563, 0x0564, 0x057A, 0x057D,
+    0x0601, 0x0606, 0x0618, 0x061F, 0x062B, 0x062C, 0x0632, 0x0635,
+    0x064A, 0x064D, 0x0653, 0x0654, 0x0660, 0x0667, 0x0679, 0x067E,
+    0x0780, 0x0787, 0x0799, 0x079E, 0x07AA, 0x07AD, 0x07B3, 0x07B4,
+    0x07CB, 0x07CC, 0x07D2, 0x07D5, 0x07E1, 0x07E6, 0x07F8, 0x07FF,
+    0x0888, 0x088F, 0x0891, 0x0896, 0x08A2, 0x08A5, 0x08BB, 0x08BC,
+    0x08C3, 0x08C4, 0x08DA, 0x08DD, 0x08E9, 0x08EE, 0x08F0, 0x08F7,
+    0x0909, 0x090E, 0x0910, 0x0917, 0x0923, 0x0924, 0x093A, 0x093D,
+    0x0942, 0x0945, 0x095B, 0x095C, 0x0968, 0x096F, 0x0971, 0x0976,
+    0x0A0A, 0x0A0D, 0x0A13, 0x0A14, 0x0A20, 0x0A27, 0x0A39, 0x0A3E,
+    0x0A41, 0x0A46, 0x0A58, 0x0A5F, 0x0A6B, 0x0A6C, 0x0A72, 0x0A75,
+    0x0B8B, 0x0B8C, 0x0B92, 0x0B95, 0x0BA1, 0x0BA6, 0x0BB8, 0x0BBF,
+    0x0BC0, 0x0BC7, 0x0BD9, 0x0BDE, 0x0BEA, 0x0BED, 0x0BF3, 0x0BF4,
+    0x0C0B, 0x0C0C, 0x0C12, 0x0C15, 0x0C21, 0x0C26, 0x0C38, 0x0C3F,
+    0x0C40, 0x0C47, 0x0C59, 0x0C5E, 0x0C6A, 0x0C6D, 0x0C73, 0x0C74,
+    0x0D8A, 0x0D8D, 0x0D93, 0x0D94, 0x0DA0, 0x0DA7, 0x0DB9, 0x0DBE,
+    0x0DC1, 0x0DC6, 0x0DD8, 0x0DDF, 0x0DEB, 0x0DEC, 0x0DF2, 0x0DF5,
+    0x0E89, 0x0E8E, 0x0E90, 0x0E97, 0x0EA3, 0x0EA4, 0x0EBA, 0x0EBD,
+    0x0EC2, 0x0EC5, 0x0EDB, 0x0EDC, 0x0EE8, 0x0EEF, 0x0EF1, 0x0EF6,
+    0x0F08, 0x0F0F, 0x0F11, 0x0F16, 0x0F22, 0x0F25, 0x0F3B, 0x0F3C,
+    0x0F43, 0x0F44, 0x0F5A, 0x0F5D, 0x0F69, 0x0F6E, 0x0F70, 0x0F77
+};
+
+/* Syndrome part of the low (bits 0..7) and high (bits 8..15) codeword bytes.
+   Bit 15 isn't covered by the code, that's why it doesn't change a syndrome. */
+static const byte_t _syndrome_lo[256] = {
+    0x00, 0x01, 0x02, 0x03, 0x03, 0x02, 0x01, 0x00, 0x04, 0x05, 0x06, 0x07, 0x07, 0x06, 0x05, 0x04,
+    0x05, 0x04, 0x07, 0x06, 0x06, 0x07, 0x04, 0x05, 0x01, 0x00, 0x03, 0x02, 0x02, 0x03, 0x00, 0x01,
+    0x06, 0x07, 0x04, 0x05, 0x05, 0x04, 0x07, 0x06, 0x02, 0x03, 0x00, 0x01, 0x01, 0x00, 0x03, 0x02,
+    0x03, 0x02, 0x01, 0x00, 0x00, 0x01, 0x02, 0x03, 0x07, 0x06, 0x05, 0x04, 0x04, 0x05, 0x06, 0x07,
+    0x07, 0x06, 0x05, 0x04, 0x04, 0x05, 0x06, 0x07, 0x03, 0x02, 0x01, 0x00, 0x00, 0x01, 0x02, 0x03,
+    0x02, 0x03, 0x00, 0x01, 0x01, 0x00, 0x03, 0x02, 0x06, 0x07, 0x04, 0x05, 0x05, 0x04, 0x07, 0x06,
+    0x01, 0x00, 0x03, 0x02, 0x02, 0x03, 0x00, 0x01, 0x05, 0x04, 0x07, 0x06, 0x06, 0x07, 0x04, 0x05,
+    0x04, 0x05, 0x06, 0x07, 0x07, 0x06, 0x05, 0x04, 0x00, 0x01, 0x02, 0x03, 0x03, 0x02, 0x01, 0x00,
+    0x08, 0x09, 0x0A, 0x0B, 0x0B, 0x0A, 0x09, 0x08, 0x0C, 0x0D, 0x0E, 0x0F, 0x0F, 0x0E, 0x0D, 0x0C,
+    0x0D, 0x0C, 0x0F, 0x0E, 0x0E, 0x0F, 0x0C, 0x0D, 0x09, 0x08, 0x0B, 0x0A, 0x0A, 0x0B, 0x08, 0x09,
+    0x0E, 0x0F, 0x0C, 0x0D, 0x0D, 0x0C, 0x0F, 0x0E, 0x0A, 0x0B, 0x08, 0x09, 0x09, 0x08, 0x0B, 0x0A,
+    0x0B, 0x0A, 0x09, 0x08, 0x08, 0x09, 0x0A, 0x0B, 0x0F, 0x0E, 0x0D, 0x0C, 0x0C, 0x0D, 0x0E, 0x0F,
+    0x0F, 0x0E, 0x0D, 0x0C, 0x0C, 0x0D, 0x0E, 0x0F, 0x0B, 0x0A, 0x09, 0x08, 0x08, 0x09, 0x0A, 0x0B,
+    0x0A, 0x0B, 0x08, 0x09, 0x09, 0x08, 0x0B, 0x0A, 0x0E, 0x0F, 0x0C, 0x0D, 0x0D, 0x0C, 0x0F, 0x0E,
+    0x09, 0x08, 0x0B, 0x0A, 0x0A, 0x0B, 0x08, 0x09, 0x0D, 0x0C, 0x0F, 0x0E, 0x0E, 0x0F, 0x0C, 0x0D,
+    0x0C, 0x0D, 0x0E, 0x0F, 0x0F, 0x0E, 0x0D, 0x0C, 0x08, 0x09, 0x0A, 0x0B, 0x0B, 0x0A, 0x09, 0x08
+};
+
+static const byte_t _syndrome_hi[256] = {
+    0x00, 0x09, 0x0A, 0x03, 0x0B, 0x02, 0x01, 0x08, 0x0C, 0x05, 0x06, 0x0F, 0x07, 0x0E, 0x0D, 0x04,
+    0x0D, 0x04, 0x07, 0x0E, 0x06, 0x0F, 0x0C, 0x05, 0x01, 0x08, 0x0B, 0x02, 0x0A, 0x03, 0x00, 0x09,
+    0x0E, 0x07, 0x04, 0x0D, 0x05, 0x0C, 0x0F, 0x06, 0x02, 0x0B, 0x08, 0x01, 0x09, 0x00, 0x03, 0x0A,
+    0x03, 0x0A, 0x09, 0x00, 0x08, 0x01, 0x02, 0x0B, 0x0F, 0x06, 0x05, 0x0C, 0x04, 0x0D, 0x0E, 0x07,
+    0x0F, 0x06, 0x05, 0x0C, 0x04, 0x0D, 0x0E, 0x07, 0x03, 0x0A, 0x09, 0x00, 0x08, 0x01, 0x02, 0x0B,
+    0x02, 0x0B, 0x08, 0x01, 0x09, 0x00, 0x03, 0x0A, 0x0E, 0x07, 0x04, 0x0D, 0x05, 0x0C, 0x0F, 0x06,
+    0x01, 0x08, 0x0B, 0x02, 0x0A, 0x03, 0x00, 0x09, 0x0D, 0x04, 0x07, 0x0E, 0x06, 0x0F, 0x0C, 0x05,
+    0x0C, 0x05, 0x06, 0x0F, 0x07, 0x0E, 0x0D, 0x04, 0x00, 0x09, 0x0A, 0x03, 0x0B, 0x02, 0x01, 0x08,
+    0x00, 0x09, 0x0A, 0x03, 0x0B, 0x02, 0x01, 0x08, 0x0C, 0x05, 0x06, 0x0F, 0x07, 0x0E, 0x0D, 0x04,
+    0x0D, 0x04, 0x07, 0x0E, 0x06, 0x0F, 0x0C, 0x05, 0x01, 0x08, 0x0B, 0x02, 0x0A, 0x03, 0x00, 0x09,
+    0x0E, 0x07, 0x04, 0x0D, 0x05, 0x0C, 0x0F, 0x06, 0x02, 0x0B, 0x08, 0x01, 0x09, 0x00, 0x03, 0x0A,
+    0x03, 0x0A, 0x09, 0x00, 0x08, 0x01, 0x02, 0x0B, 0x0F, 0x06, 0x05, 0x0C, 0x04, 0x0D, 0x0E, 0x07,
+    0x0F, 0x06, 0x05, 0x0C, 0x04, 0x0D, 0x0E, 0x07, 0x03, 0x0A, 0x09, 0x00, 0x08, 0x01, 0x02, 0x0B,
+    0x02, 0x0B, 0x08, 0x01, 0x09, 0x00, 0x03, 0x0A, 0x0E, 0x07, 0x04, 0x0D, 0x05, 0x0C, 0x0F, 0x06,
+    0x01, 0x08, 0x0B, 0x02, 0x0A, 0x03, 0x00, 0x09, 0x0D, 0x04, 0x07, 0x0E, 0x06, 0x0F, 0x0C, 0x05,
+    0x0C, 0x05, 0x06, 0x0F, 0x07, 0x0E, 0x0D, 0x04, 0x00, 0x09, 0x0A, 0x03, 0x0B, 0x02, 0x01, 0x08
+};
+
+static inline encoded_t _encode_hamming_15_11(byte_t data) {
+    return _encode_table[data];
+}
+
+static inline byte_t _syndrome_hamming_15_11(encoded_t encoded) {
+    return _syndrome_lo[encoded & 0xFF] ^ _syndrome_hi[(encoded >> 8) & 0xFF];
+}
+#else
+/* The code is linear, so a byte codeword is a XOR of the codewords of its nibbles. */
+static const encoded_t _encode_lo[16] = {
+    0x0000, 0x0007, 0x0019, 0x001E, 0x002A, 0x002D, 0x0033, 0x0034,
+    0x004B, 0x004C, 0x0052, 0x0055, 0x0061, 0x0066, 0x0078, 0x007F
+};
+
+static const encoded_t _encode_hi[16] = {
+    0x0000, 0x0181, 0x0282, 0x0303, 0x0483, 0x0502, 0x0601, 0x0780,
+    0x0888, 0x0909, 0x0A0A, 0x0B8B, 0x0C0B, 0x0D8A, 0x0E89, 0x0F08
+};
+
+/* Syndrome part of every codeword nibble (bits 0..3, 4..7, 8..11, 12..15). */
+static const byte_t _syndrome_nibble[4][16] = {
+    { 0x00, 0x01, 0x02, 0x03, 0x03, 0x02, 0x01, 0x00, 0x04, 0x05, 0x06, 0x07, 0x07, 0x06, 0x05, 0x04 },
+    { 0x00, 0x05, 0x06, 0x03, 0x07, 0x02, 0x01, 0x04, 0x08, 0x0D, 0x0E, 0x0B, 0x0F, 0x0A, 0x09, 0x0C },
+    { 0x00, 0x09, 0x0A, 0x03, 0x0B, 0x02, 0x01, 0x08, 0x0C, 0x05, 0x06, 0x0F, 0x07, 0x0E, 0x0D, 0x04 },
+    { 0x00, 0x0D, 0x0E, 0x03, 0x0F, 0x02, 0x01, 0x0C, 0x00, 0x0D, 0x0E, 0x03, 0x0F, 0x02, 0x01, 0x0C }
+};
+
+static inline encoded_t _encode_hamming_15_11(byte_t data) {
+    return _encode_lo[data & 0x0F] ^ _encode_hi[(data >> 4) & 0x0F];
+}
+
+static inline byte_t _syndrome_hamming_15_11(encoded_t encoded) {
+    return _syndrome_nibble[0][encoded & 0x0F] ^ _syndrome_nibble[1][(encoded >> 4) & 0x0F] ^
+           _syndrome_nibble[2][(encoded >> 8) & 0x0F] ^ _syndrome_nibble[3][(encoded >> 12) & 0x0F];
+}
+#endif
+
+/* Error mask for every syndrome value. The syndrome is a 1-based position of the flipped bit. */
+static const encoded_t _correction_table[16] = {
+    0x0000, 0x0001, 0x0002, 0x0004, 0x0008, 0x0010, 0x0020, 0x0040,
+    0x0080, 0x0100, 0x0200, 0x0400, 0x0800, 0x1000, 0x2000, 0x4000
+};
+
+static inline byte_t _extract_hamming_15_11(encoded_t encoded) {
+    return (byte_t)(((encoded >> 2) & 0x01) | ((encoded >> 3) & 0x0E) | ((encoded >> 4) & 0xF0));
+}
+
+int nft32_unpack_memory_scalar(const encoded_t* src, byte_t* dst, int l, int* first) {
+    int corrected = 0;
+    for (int i = 0; i < l; i++) {
+        byte_t syndrome = _syndrome_hamming_15_11(src[i]);
+        if (syndrome && !corrected++) *first = i;
+        dst[i] = _extract_hamming_15_11(src[i] ^ _correction_table[syndrome]);
+    }
+
+    return corrected;
+}
+
+void* nft32_pack_memory_scalar(const byte_t* src, encoded_t* dst, int l) {
+    for (int i = 0; i < l; i++) dst[i] = _encode_hamming_15_11(src[i]);
+    return (void*)dst;
+}
+
+static hamming_kernel_t _kernel = {
+    .kernel = HAMMING_KERNEL_SCALAR,
+    .unpack = nft32_unpack_memory_scalar,
+    .pack   = nft32_pack_memory_scalar
+};
+
+static const hamming_kernel_t _kernels[] = {
+#ifdef NIFAT32_HAMMING_SIMD
+    /* Ordered from the fastest to the slowest. */
+    { .kernel = HAMMING_KERNEL_AVX2, .unpack = nft32_unpack_memory_avx2, .pack = nft32_pack_memory_avx2 },
+    { .kernel = HAMMING_KERNEL_BMI2, .unpack = nft32_unpack_memory_bmi2, .pack = nft32_pack_memory_bmi2 },
+    { .kernel = HAMMING_KERNEL_SSE2, .unpack = nft32_unpack_memory_sse2, .pack = nft32_pack_memory_sse2 },
+#endif
+    { .kernel = HAMMING_KERNEL_SCALAR, .unpack = nft32_unpack_memory_scalar, .pack = nft32_pack_memory_scalar }
+};
+
+static int _kernel_supported(int kernel) {
+    if (kernel == HAMMING_KERNEL_SCALAR) return 1;
+#ifdef NIFAT32_HAMMING_SIMD
+    return nft32_hamming_simd_supported(kernel);
+#else
+    return 0;
+#endif
+}
+
+int nft32_hamming_setup(int kernel) {
+    for (unsigned int i = 0; i < sizeof(_kernels) / sizeof(_kernels[0]); i++) {
+        if (kernel != HAMMING_KERNEL_AUTO && _kernels[i].kernel != kernel) continue;
+        if (!_kernel_supported(_kernels[i].kernel)) continue;
+        _kernel = _kernels[i];
+        return 1;
+    }
+
+    return 0;
+}
+
+int nft32_hamming_kernel() {
+    return _kernel.kernel;
 }
 
 void* nft32_unpack_memory(const encoded_t* src, byte_t* dst, int l) {
-    for (int i = 0; i < l; i++) dst[i] = _get_byte(src, i);
+    int first = -1;
+    _kernel.unpack(src, dst, l, &first);
     return (void*)dst;
 }
 
+int nft32_unpack_memory_count(const encoded_t* src, byte_t* dst, int l, int* first) {
+    int position = -1;
+    int corrected = _kernel.unpack(src, dst, l, &position);
+    if (first) *first = position;
+    return corrected;
+}
+
 void* nft32_pack_memory(const byte_t* src, encoded_t* dst, int l) {
-    for (int i = 0; i < l; i++) _set_byte(dst, i, src[i]);
-    return (void*)dst;
+    return _kernel.pack(src, dst, l);
+}
+
+static int _hamming_unpack(const byte_t* src, byte_t* dst, int l, int* first) {
+    return _kernel.unpack((const encoded_t*)src, dst, l, first);
+}
+
+static void* _hamming_pack(const byte_t* src, byte_t* dst, int l) {
+    return _kernel.pack(src, (encoded_t*)dst, l);
+}
+
+static const ecc_codec_t _codecs[] = {
+    { .codec = ECC_HAMMING_15_11, .data_block = 1, .encoded_block = sizeof(encoded_t), .unpack = _hamming_unpack, .pack = _hamming_pack },
+    { .codec = ECC_SECDED_39_32, .data_block = SECDED_DATA_BLOCK, .encoded_block = SECDED_ENCODED_BLOCK, .unpack = nft32_secded_unpack, .pack = nft32_secded_pack }
+};
+
+static const ecc_codec_t* _codec = &_codecs[ECC_HAMMING_15_11];
+
+int nft32_ecc_setup(int codec) {
+    for (unsigned int i = 0; i < sizeof(_codecs) / sizeof(_codecs[0]); i++) {
+        if (_codecs[i].codec != codec) continue;
+        _codec = &_codecs[i];
+        return 1;
+    }
+
+    return 0;
+}
+
+int nft32_ecc_codec() {
+    return _codec->codec;
+}
+
+int nft32_ecc_data_block() {
+    return _codec->data_block;
+}
+
+int nft32_ecc_encoded_size(int l) {
+    return ((l + _codec->data_block - 1) / _codec->data_block) * _codec->encoded_block;
+}
+
+int nft32_ecc_unpack(const byte_t* src, byte_t* dst, int l, int* first) {
+    int position = -1;
+    int errors = _codec->unpack(src, dst, l, &position);
+    if (first) *first = position;
+    return errors;
+}
+
+void* nft32_ecc_pack(const byte_t* src, byte_t* dst, int l) {
+    return _codec->pack(src, dst, l);
 }
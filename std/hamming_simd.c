@@ -0,0 +1,269 @@
+#include <std/hamming_simd.h>
+
+#ifdef NIFAT32_HAMMING_SIMD
+#include <cpuid.h>
+#include <immintrin.h>
+
+#define SSE2_TARGET __attribute__((target("sse2")))
+#define AVX2_TARGET __attribute__((target("avx2")))
+#define BMI2_TARGET __attribute__((target("bmi2")))
+#define AVX2_POPCNT_TARGET __attribute__((target("avx2,popcnt")))
+
+/* Parity masks for the s1, s2, s4 and s8 syndrome bits. */
+#define HAMMING_S1_MASK 0x5555
+#define HAMMING_S2_MASK 0x6666
+#define HAMMING_S4_MASK 0x7878
+#define HAMMING_S8_MASK 0x7F80
+
+/* Data bits positions in a codeword (2, 4, 5, 6, 8, 9, 10, 11). */
+#define HAMMING_DATA_MASK 0x0F74
+
+/* Scalar decode of the src[o..o + l) block. first is relative to the whole buffer. */
+static inline int _unpack_block(const encoded_t* src, byte_t* dst, int o, int l, int* first) {
+    int block_first = -1;
+    int corrected = nft32_unpack_memory_scalar(src + o, dst + o, l, &block_first);
+    if (corrected && *first < 0) *first = o + block_first;
+    return corrected;
+}
+
+static unsigned long long _read_xcr(unsigned int index) {
+    unsigned int eax, edx;
+    __asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
+    return ((unsigned long long)edx << 32) | eax;
+}
+
+int nft32_hamming_simd_supported(int kernel) {
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return 0;
+
+    int sse2 = (edx & bit_SSE2) != 0;
+    int avx  = (ecx & bit_OSXSAVE) && (ecx & bit_AVX) && ((_read_xcr(0) & 0x6) == 0x6);
+
+    unsigned int ext_ebx = 0;
+    if (__get_cpuid_max(0, NULL) >= 7) {
+        __cpuid_count(7, 0, eax, ext_ebx, ecx, edx);
+    }
+
+    switch (kernel) {
+        case HAMMING_KERNEL_SSE2: return sse2;
+        case HAMMING_KERNEL_AVX2: return avx && (ext_ebx & bit_AVX2);
+        case HAMMING_KERNEL_BMI2: return (ext_ebx & bit_BMI2) != 0;
+        default: return 0;
+    }
+}
+
+/* SSE2 */
+
+/* Parity of every 16-bit lane in the lowest bit of the lane. */
+static inline SSE2_TARGET __m128i _parity16_sse2(__m128i x) {
+    x = _mm_xor_si128(x, _mm_srli_epi16(x, 8));
+    x = _mm_xor_si128(x, _mm_srli_epi16(x, 4));
+    x = _mm_xor_si128(x, _mm_srli_epi16(x, 2));
+    x = _mm_xor_si128(x, _mm_srli_epi16(x, 1));
+    return _mm_and_si128(x, _mm_set1_epi16(1));
+}
+
+/* Non-zero lane means a non-zero syndrome of the codeword. */
+static inline SSE2_TARGET __m128i _syndrome_any_sse2(__m128i c) {
+    __m128i s = _parity16_sse2(_mm_and_si128(c, _mm_set1_epi16(HAMMING_S1_MASK)));
+    s = _mm_or_si128(s, _parity16_sse2(_mm_and_si128(c, _mm_set1_epi16(HAMMING_S2_MASK))));
+    s = _mm_or_si128(s, _parity16_sse2(_mm_and_si128(c, _mm_set1_epi16(HAMMING_S4_MASK))));
+    s = _mm_or_si128(s, _parity16_sse2(_mm_and_si128(c, _mm_set1_epi16((short)HAMMING_S8_MASK))));
+    return s;
+}
+
+static inline SSE2_TARGET __m128i _extract_sse2(__m128i c) {
+    __m128i d = _mm_and_si128(_mm_srli_epi16(c, 2), _mm_set1_epi16(0x01));
+    d = _mm_or_si128(d, _mm_and_si128(_mm_srli_epi16(c, 3), _mm_set1_epi16(0x0E)));
+    d = _mm_or_si128(d, _mm_and_si128(_mm_srli_epi16(c, 4), _mm_set1_epi16(0xF0)));
+    return d;
+}
+
+SSE2_TARGET int nft32_unpack_memory_sse2(const encoded_t* src, byte_t* dst, int l, int* first) {
+    int i = 0, corrected = 0;
+    for (; i + 16 <= l; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + i + 8));
+        __m128i s = _mm_or_si128(_syndrome_any_sse2(a), _syndrome_any_sse2(b));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(s, _mm_setzero_si128())) != 0xFFFF) {
+            corrected += _unpack_block(src, dst, i, 16, first);
+            continue;
+        }
+
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(_extract_sse2(a), _extract_sse2(b)));
+    }
+
+    corrected += _unpack_block(src, dst, i, l - i, first);
+    return corrected;
+}
+
+static inline SSE2_TARGET __m128i _encode_sse2(__m128i d) {
+    __m128i c = _mm_slli_epi16(_mm_and_si128(d, _mm_set1_epi16(0x01)), 2);
+    c = _mm_or_si128(c, _mm_slli_epi16(_mm_and_si128(d, _mm_set1_epi16(0x0E)), 3));
+    c = _mm_or_si128(c, _mm_slli_epi16(_mm_and_si128(d, _mm_set1_epi16(0xF0)), 4));
+
+    __m128i p = _parity16_sse2(_mm_and_si128(c, _mm_set1_epi16(HAMMING_S1_MASK)));
+    p = _mm_or_si128(p, _mm_slli_epi16(_parity16_sse2(_mm_and_si128(c, _mm_set1_epi16(HAMMING_S2_MASK))), 1));
+    p = _mm_or_si128(p, _mm_slli_epi16(_parity16_sse2(_mm_and_si128(c, _mm_set1_epi16(HAMMING_S4_MASK))), 3));
+    p = _mm_or_si128(p, _mm_slli_epi16(_parity16_sse2(_mm_and_si128(c, _mm_set1_epi16((short)HAMMING_S8_MASK))), 7));
+    return _mm_or_si128(c, p);
+}
+
+SSE2_TARGET void* nft32_pack_memory_sse2(const byte_t* src, encoded_t* dst, int l) {
+    int i = 0;
+    for (; i + 16 <= l; i += 16) {
+        __m128i d = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _encode_sse2(_mm_unpacklo_epi8(d, _mm_setzero_si128())));
+        _mm_storeu_si128((__m128i*)(dst + i + 8), _encode_sse2(_mm_unpackhi_epi8(d, _mm_setzero_si128())));
+    }
+
+    nft32_pack_memory_scalar(src + i, dst + i, l - i);
+    return (void*)dst;
+}
+
+
+/* AVX2 */
+
+#define BROADCAST_TABLE(...) _mm256_broadcastsi128_si256(_mm_setr_epi8(__VA_ARGS__))
+
+/*
+Decode 16 codewords. The syndrome is a XOR of nibble lookups (pshufb), and the correction
+mask is a lookup by the syndrome, so there are no branches even for blocks with errors.
+*/
+static inline AVX2_TARGET __m256i _decode_avx2(__m256i c, __m256i* syndrome_out) {
+    const __m256i s0 = BROADCAST_TABLE(0x00, 0x01, 0x02, 0x03, 0x03, 0x02, 0x01, 0x00, 0x04, 0x05, 0x06, 0x07, 0x07, 0x06, 0x05, 0x04);
+    const __m256i s1 = BROADCAST_TABLE(0x00, 0x05, 0x06, 0x03, 0x07, 0x02, 0x01, 0x04, 0x08, 0x0D, 0x0E, 0x0B, 0x0F, 0x0A, 0x09, 0x0C);
+    const __m256i s2 = BROADCAST_TABLE(0x00, 0x09, 0x0A, 0x03, 0x0B, 0x02, 0x01, 0x08, 0x0C, 0x05, 0x06, 0x0F, 0x07, 0x0E, 0x0D, 0x04);
+    const __m256i s3 = BROADCAST_TABLE(0x00, 0x0D, 0x0E, 0x03, 0x0F, 0x02, 0x01, 0x0C, 0x00, 0x0D, 0x0E, 0x03, 0x0F, 0x02, 0x01, 0x0C);
+    const __m256i c0 = BROADCAST_TABLE(0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
+    const __m256i c1 = BROADCAST_TABLE(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i low_byte = _mm256_set1_epi16(0x00FF);
+
+    __m256i lo = _mm256_and_si256(c, nibble);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(c, 4), nibble);
+
+    /* Even bytes are codeword bits 0..7, odd bytes are bits 8..15. */
+    __m256i even = _mm256_xor_si256(_mm256_shuffle_epi8(s0, lo), _mm256_shuffle_epi8(s1, hi));
+    __m256i odd  = _mm256_xor_si256(_mm256_shuffle_epi8(s2, lo), _mm256_shuffle_epi8(s3, hi));
+    __m256i syndrome = _mm256_and_si256(_mm256_xor_si256(even, _mm256_srli_epi16(odd, 8)), low_byte);
+
+    __m256i correction = _mm256_or_si256(
+        _mm256_shuffle_epi8(c0, syndrome), _mm256_slli_epi16(_mm256_shuffle_epi8(c1, syndrome), 8)
+    );
+
+    *syndrome_out = syndrome;
+    c = _mm256_xor_si256(c, correction);
+    __m256i d = _mm256_and_si256(_mm256_srli_epi16(c, 2), _mm256_set1_epi16(0x01));
+    d = _mm256_or_si256(d, _mm256_and_si256(_mm256_srli_epi16(c, 3), _mm256_set1_epi16(0x0E)));
+    d = _mm256_or_si256(d, _mm256_and_si256(_mm256_srli_epi16(c, 4), _mm256_set1_epi16(0xF0)));
+    return d;
+}
+
+AVX2_POPCNT_TARGET int nft32_unpack_memory_avx2(const encoded_t* src, byte_t* dst, int l, int* first) {
+    int i = 0, corrected = 0;
+    for (; i + 32 <= l; i += 32) {
+        __m256i sa, sb;
+        __m256i a = _decode_avx2(_mm256_loadu_si256((const __m256i*)(src + i)), &sa);
+        __m256i b = _decode_avx2(_mm256_loadu_si256((const __m256i*)(src + i + 16)), &sb);
+        __m256i d = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+        _mm256_storeu_si256((__m256i*)(dst + i), d);
+
+        /* Two mask bits per codeword with a non-zero syndrome. */
+        unsigned long long corrections = 
+            (unsigned int)~_mm256_movemask_epi8(_mm256_cmpeq_epi16(sa, _mm256_setzero_si256())) |
+            ((unsigned long long)(unsigned int)~_mm256_movemask_epi8(_mm256_cmpeq_epi16(sb, _mm256_setzero_si256())) << 32);
+        if (corrections) {
+            if (*first < 0) *first = i + __builtin_ctzll(corrections) / 2;
+            corrected += __builtin_popcountll(corrections) / 2;
+        }
+    }
+
+    corrected += _unpack_block(src, dst, i, l - i, first);
+    return corrected;
+}
+
+AVX2_TARGET void* nft32_pack_memory_avx2(const byte_t* src, encoded_t* dst, int l) {
+    /* Codeword of the low nibble has an empty high byte, and the high byte of the
+       high nibble codeword is the nibble itself. */
+    const __m256i el = BROADCAST_TABLE(0x00, 0x07, 0x19, 0x1E, 0x2A, 0x2D, 0x33, 0x34, 0x4B, 0x4C, 0x52, 0x55, 0x61, 0x66, 0x78, 0x7F);
+    const __m256i eh = BROADCAST_TABLE(0x00, 0x81, 0x82, 0x03, 0x83, 0x02, 0x01, 0x80, 0x88, 0x09, 0x0A, 0x8B, 0x0B, 0x8A, 0x89, 0x08);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+    int i = 0;
+    for (; i + 32 <= l; i += 32) {
+        __m256i d  = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i lo = _mm256_and_si256(d, nibble);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(d, 4), nibble);
+        __m256i low_bytes = _mm256_xor_si256(_mm256_shuffle_epi8(el, lo), _mm256_shuffle_epi8(eh, hi));
+
+        __m256i first  = _mm256_unpacklo_epi8(low_bytes, hi);
+        __m256i second = _mm256_unpackhi_epi8(low_bytes, hi);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256((__m256i*)(dst + i + 16), _mm256_permute2x128_si256(first, second, 0x31));
+    }
+
+    nft32_pack_memory_scalar(src + i, dst + i, l - i);
+    return (void*)dst;
+}
+
+#undef BROADCAST_TABLE
+
+
+/* BMI2 */
+
+#define LANES4(v) ((unsigned long long)(v) * 0x0001000100010001ULL)
+
+/* Parity of every 16-bit lane of x in the lowest bit of the lane (SWAR). */
+static inline unsigned long long _parity16x4(unsigned long long x) {
+    x ^= x >> 8;
+    x ^= x >> 4;
+    x ^= x >> 2;
+    x ^= x >> 1;
+    return x & LANES4(1);
+}
+
+static inline unsigned long long _syndrome_any_x4(unsigned long long c) {
+    return _parity16x4(c & LANES4(HAMMING_S1_MASK)) | _parity16x4(c & LANES4(HAMMING_S2_MASK)) |
+           _parity16x4(c & LANES4(HAMMING_S4_MASK)) | _parity16x4(c & LANES4(HAMMING_S8_MASK));
+}
+
+BMI2_TARGET int nft32_unpack_memory_bmi2(const encoded_t* src, byte_t* dst, int l, int* first) {
+    int i = 0, corrected = 0;
+    for (; i + 4 <= l; i += 4) {
+        unsigned long long c;
+        __builtin_memcpy(&c, src + i, sizeof(c));
+        if (_syndrome_any_x4(c)) {
+            corrected += _unpack_block(src, dst, i, 4, first);
+            continue;
+        }
+
+        unsigned int d = (unsigned int)_pext_u64(c, LANES4(HAMMING_DATA_MASK));
+        __builtin_memcpy(dst + i, &d, sizeof(d));
+    }
+
+    corrected += _unpack_block(src, dst, i, l - i, first);
+    return corrected;
+}
+
+BMI2_TARGET void* nft32_pack_memory_bmi2(const byte_t* src, encoded_t* dst, int l) {
+    int i = 0;
+    for (; i + 4 <= l; i += 4) {
+        unsigned int d;
+        __builtin_memcpy(&d, src + i, sizeof(d));
+        unsigned long long c = _pdep_u64(d, LANES4(HAMMING_DATA_MASK));
+        c |= _parity16x4(c & LANES4(HAMMING_S1_MASK));
+        c |= _parity16x4(c & LANES4(HAMMING_S2_MASK)) << 1;
+        c |= _parity16x4(c & LANES4(HAMMING_S4_MASK)) << 3;
+        c |= _parity16x4(c & LANES4(HAMMING_S8_MASK)) << 7;
+        __builtin_memcpy(dst + i, &c, sizeof(c));
+    }
+
+    nft32_pack_memory_scalar(src + i, dst + i, l - i);
+    return (void*)dst;
+}
+
+#undef LANES4
+
+
+#endif
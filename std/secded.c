@@ -0,0 +1,79 @@
+#include <std/secded.h>
+
+/*
+Code bit i (1..38) is the Hamming position i, bit 0 is the overall parity.
+Parity bits are at the power-of-two positions, data bits fill the rest.
+*/
+static const unsigned long long _parity_masks[6] = {
+    0x2AAAAAAAAAULL, 0x4CCCCCCCCCULL, 0x70F0F0F0F0ULL, 0x00FF00FF00ULL, 0x00FFFF0000ULL, 0x7F00000000ULL
+};
+
+#define SECDED_CODE_MASK 0x7FFFFFFFFFULL
+#define SECDED_MAX_POS   38
+
+static inline unsigned int _parity64(unsigned long long x) {
+    x ^= x >> 32;
+    x ^= x >> 16;
+    x ^= x >> 8;
+    x ^= x >> 4;
+    return (0x6996 >> (x & 0x0F)) & 1;
+}
+
+static inline unsigned long long _spread_data(unsigned int d) {
+    return ((unsigned long long)(d & 0x00000001) << 3) | ((unsigned long long)(d & 0x0000000E) << 4) |
+           ((unsigned long long)(d & 0x000007F0) << 5) | ((unsigned long long)(d & 0x03FFF800) << 6) |
+           ((unsigned long long)(d & 0xFC000000) << 7);
+}
+
+static inline unsigned int _gather_data(unsigned long long c) {
+    return (unsigned int)(
+        ((c >> 3) & 0x00000001) | ((c >> 4) & 0x0000000E) | ((c >> 5) & 0x000007F0) |
+        ((c >> 6) & 0x03FFF800) | ((c >> 7) & 0xFC000000)
+    );
+}
+
+static inline unsigned long long _encode_secded_39_32(unsigned int d) {
+    unsigned long long c = _spread_data(d);
+    for (int j = 0; j < 6; j++) c |= (unsigned long long)_parity64(c & _parity_masks[j]) << (1 << j);
+    return c | _parity64(c);
+}
+
+/* Return 0 for a clean block, 1 for a block with an error. */
+static inline int _decode_secded_39_32(unsigned long long c, unsigned int* d) {
+    unsigned int syndrome = 0;
+    for (int j = 0; j < 6; j++) syndrome |= _parity64(c & _parity_masks[j]) << j;
+    unsigned int overall = _parity64(c & SECDED_CODE_MASK);
+
+    /* Odd count of flipped bits with a valid position is a single error.
+       Other cases are double errors. These are only detected, the data is left as is. */
+    if (overall && syndrome <= SECDED_MAX_POS) c ^= 1ULL << syndrome;
+    *d = _gather_data(c);
+    return syndrome || overall;
+}
+
+int nft32_secded_unpack(const byte_t* src, byte_t* dst, int l, int* first) {
+    int errors = 0;
+    for (int i = 0, block = 0; i < l; i += SECDED_DATA_BLOCK, src += SECDED_ENCODED_BLOCK, block++) {
+        unsigned long long c = 0;
+        for (int b = 0; b < SECDED_ENCODED_BLOCK; b++) c |= (unsigned long long)src[b] << (b * 8);
+
+        unsigned int d = 0;
+        if (_decode_secded_39_32(c, &d) && !errors++) *first = block;
+        for (int b = 0; b < SECDED_DATA_BLOCK && i + b < l; b++) dst[i + b] = (byte_t)(d >> (b * 8));
+    }
+
+    return errors;
+}
+
+void* nft32_secded_pack(const byte_t* src, byte_t* dst, int l) {
+    byte_t* block = dst;
+    for (int i = 0; i < l; i += SECDED_DATA_BLOCK, block += SECDED_ENCODED_BLOCK) {
+        unsigned int d = 0;
+        for (int b = 0; b < SECDED_DATA_BLOCK && i + b < l; b++) d |= (unsigned int)src[i + b] << (b * 8);
+
+        unsigned long long c = _encode_secded_39_32(d);
+        for (int b = 0; b < SECDED_ENCODED_BLOCK; b++) block[b] = (byte_t)(c >> (b * 8));
+    }
+
+    return (void*)dst;
+}
@@ -84,6 +84,20 @@ static inline int _mock_sector_write_(sector_addr_t sa, sector_offset_t offset,
     return pwrite(disk_fd, data, data_size, sa * sector_size + offset) > 0;
 }
 
+static inline int _mock_readv_(const disk_iovec_t* iov, int count) {
+    for (int i = 0; i < count; i++) {
+        if (!_mock_sector_read_(iov[i].sa, iov[i].offset, iov[i].buffer, iov[i].size)) return 0;
+    }
+
+    return 1;
+}
+
+static inline int _mock_writev_(const disk_iovec_t* iov, int count) {
+    int result = 1;
+    for (int i = 0; i < count; i++) result = _mock_sector_write_(iov[i].sa, iov[i].offset, iov[i].buffer, iov[i].size) && result;
+    return result;
+}
+
 static int _mock_fprintf_(const char* fmt, ...) {
     va_list args;
     va_start(args, fmt);
@@ -116,9 +130,13 @@ static int setup_nifat32(nifat32_params_t* out) {
 #endif
         .fat_cache = CACHE, 
         .disk_io   = {
-            .read_sector  = _mock_sector_read_,
-            .write_sector = _mock_sector_write_,
-            .sector_size  = sector_size
+            .read_sector   = _mock_sector_read_,
+            .write_sector  = _mock_sector_write_,
+            .sector_size   = sector_size,
+            .read_sectors  = _mock_sector_read_,
+            .write_sectors = _mock_sector_write_,
+            .readv         = _mock_readv_,
+            .writev        = _mock_writev_
         },
         .logg_io   = {
             .fd_fprintf  = _mock_fprintf_,
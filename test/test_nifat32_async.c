@@ -0,0 +1,134 @@
+/*
+Asynchronous IO test. Mount with the io_uring backend and with the thread pool backend, write
+a file by parts, copy it, and read both files. Data should be the same, the platform should get
+batches of requests (FAT copies and copied clusters), and a mount without the backend should
+read the same data.
+*/
+/* unix_async.h goes first: pthread.h should be included before the sched_yield() macro of threading.h. */
+#include "../unix_async.h"
+#include "nifat32_test.h"
+
+#define TEST_CLUSTERS 40
+#define TEST_PARTS    5
+
+static int submits = 0;
+static int requests = 0;
+static int largest_batch = 0;
+
+static int _counting_submit(disk_request_t* reqs, int count) {
+    int queued = unix_async_submit(reqs, count);
+    submits++;
+    requests += queued;
+    if (queued > largest_batch) largest_batch = queued;
+    return queued;
+}
+
+static unsigned char _pattern(int round, int position) {
+    return (unsigned char)(position * 11 + round * 57 + (position >> 10));
+}
+
+static int _mount(nifat32_params_t* params, int async) {
+    NIFAT32_unload();
+    params->disk_io.readv  = async ? NULL : _mock_readv_;
+    params->disk_io.writev = async ? NULL : _mock_writev_;
+    params->disk_io.submit = async ? _counting_submit : NULL;
+    params->disk_io.poll   = async ? unix_async_poll : NULL;
+    if (!NIFAT32_init(params)) {
+        fprintf(stderr, "NIFAT32_init() error!\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+static int _check(char* path, int round, unsigned char* data, int size) {
+    for (int i = 0; i < size; i++) data[i] = _pattern(round, i);
+    ci_t ci = nifat32_open_test(NO_RCI, path, DF_MODE, SUCCESS);
+    if (ci < 0 || !nifate32_read_and_compare_alloc(ci, 0, (const_buffer_t)data, size, SUCCESS)) return 0;
+    NIFAT32_close_content(ci);
+    return 1;
+}
+
+static int _round(nifat32_params_t* params, int round, int mode, unsigned char* data, int size) {
+    int used = unix_async_init(disk_fd, sector_size, mode);
+    if (used == UNIX_ASYNC_NONE || !_mount(params, 1)) {
+        fprintf(stderr, "ERROR! Async backend setup error!\n");
+        return 0;
+    }
+
+    submits = requests = largest_batch = 0;
+    char src[32], dst[32], path[48];
+    snprintf(src, sizeof(src), "asrc%i", round);
+    snprintf(dst, sizeof(dst), "adst%i", round);
+    snprintf(path, sizeof(path), "%s/data.bin", src);
+
+    /* The file is written by parts, thus the chain grows between writes. */
+    ci_t ci = nifat32_open_test(NO_RCI, path, MODE(CR_MODE | W_MODE | R_MODE, FILE_TARGET), SUCCESS);
+    if (ci < 0) return 0;
+    for (int i = 0; i < size; i++) data[i] = _pattern(round, i);
+    for (int p = 0; p < TEST_PARTS; p++) {
+        int part = size / TEST_PARTS;
+        if (NIFAT32_write_buffer2content(ci, p * part, (const_buffer_t)data + p * part, part) != part) {
+            fprintf(stderr, "ERROR! NIFAT32_write_buffer2content wrote less data!\n");
+            return 0;
+        }
+    }
+
+    NIFAT32_close_content(ci);
+    ci_t src_ci = nifat32_open_test(NO_RCI, src, DF_MODE, SUCCESS);
+    ci_t dst_ci = nifat32_open_test(NO_RCI, dst, MODE(CR_MODE | W_MODE | R_MODE, DIR_TARGET), SUCCESS);
+    if (src_ci < 0 || dst_ci < 0 || !NIFAT32_copy_content(src_ci, dst_ci, DEEP_COPY)) {
+        fprintf(stderr, "ERROR! NIFAT32_copy_content error!\n");
+        return 0;
+    }
+
+    NIFAT32_close_content(src_ci);
+    NIFAT32_close_content(dst_ci);
+
+    snprintf(path, sizeof(path), "%s/data.bin", dst);
+    if (!_check(path, round, data, size)) return 0;
+    snprintf(path, sizeof(path), "%s/data.bin", src);
+    if (!_check(path, round, data, size)) return 0;
+
+    fprintf(
+        stdout, "%-8s %i requests by %i submits, largest batch %i\n",
+        used == UNIX_ASYNC_URING ? "io_uring" : "pool", requests, submits, largest_batch
+    );
+
+    NIFAT32_unload();
+    unix_async_destroy();
+    if (!requests || largest_batch < 2) {
+        fprintf(stderr, "ERROR! Requests didn't go in flight by batches!\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+int main() {
+#ifndef NO_CREATION
+    nifat32_params_t params;
+    if (!setup_nifat32(&params)) return EXIT_FAILURE;
+
+    fat_data_t fs;
+    NIFAT32_get_fs_data(&fs);
+    int size = fs.cluster_size * TEST_CLUSTERS;
+    unsigned char* data = (unsigned char*)malloc(size);
+
+    fprintf(stdout, "\n==== Async IO Summary (%i clusters, %i FATs) ====\n", TEST_CLUSTERS, fs.fat_count);
+    if (!_round(&params, 0, UNIX_ASYNC_URING, data, size)) return EXIT_FAILURE;
+    if (!_round(&params, 1, UNIX_ASYNC_POOL, data, size)) return EXIT_FAILURE;
+
+    if (!_mount(&params, 0)) return EXIT_FAILURE;
+    for (int r = 0; r < 2; r++) {
+        char path[32];
+        snprintf(path, sizeof(path), "adst%i/data.bin", r);
+        if (!_check(path, r, data, size)) return EXIT_FAILURE;
+    }
+
+    NIFAT32_unload();
+    free(data);
+#endif
+
+    return EXIT_SUCCESS;
+}
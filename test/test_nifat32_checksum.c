@@ -0,0 +1,98 @@
+/*
+Checksum test. The streaming murmur3 hasher should give the same hash as the one-shot
+function for every split of the data. The entry checksum finished from a saved prefix
+should match the full entry checksum. CRC32C kernels should match the reference value
+and each other.
+*/
+#include "nifat32_test.h"
+
+static int _check_crc32c(const unsigned char* data, unsigned int size) {
+    int kernels[] = { CRC32C_KERNEL_SW, CRC32C_KERNEL_SSE42, CRC32C_KERNEL_ARMV8 };
+    for (int k = 0; k < (int)(sizeof(kernels) / sizeof(kernels[0])); k++) {
+        if (!nft32_crc32c_setup(kernels[k])) {
+            fprintf(stdout, "CRC32C kernel %i isn't supported, skip\n", kernels[k]);
+            continue;
+        }
+
+        if (~nft32_crc32c_update(CRC32C_INIT, (const unsigned char*)"123456789", 9) != 0xE3069283) {
+            fprintf(stderr, "ERROR! [kernel=%i] CRC32C check value mismatch\n", kernels[k]);
+            return 0;
+        }
+
+        nft32_checksum_setup(CHECKSUM_CRC32C);
+        for (unsigned int len = 0; len <= size; len++) {
+            nft32_crc32c_setup(CRC32C_KERNEL_SW);
+            checksum_t expected = nft32_checksum(data, len);
+            nft32_crc32c_setup(kernels[k]);
+            for (unsigned int a = 0; a <= len; a++) {
+                checksum_state_t state;
+                nft32_checksum_init(&state);
+                nft32_checksum_update(&state, data, a);
+                nft32_checksum_update(&state, data + a, len - a);
+                if (nft32_checksum_final(&state) != expected || nft32_checksum(data, len) != expected) {
+                    fprintf(stderr, "ERROR! [kernel=%i] CRC32C mismatch: len=%u, split=%u\n", kernels[k], len, a);
+                    return 0;
+                }
+            }
+        }
+
+        nft32_checksum_setup(CHECKSUM_MURMUR3);
+    }
+
+    return nft32_crc32c_setup(CRC32C_KERNEL_AUTO);
+}
+
+int main() {
+    unsigned char data[64];
+    for (int i = 0; i < (int)sizeof(data); i++) data[i] = (unsigned char)(i * 37 + 11);
+
+    for (unsigned int len = 0; len <= sizeof(data); len++) {
+        checksum_t expected = nft32_murmur3_x86_32(data, len, 0x1234);
+        for (unsigned int a = 0; a <= len; a++) {
+            for (unsigned int b = a; b <= len; b++) {
+                murmur3_state_t state;
+                nft32_murmur3_init(&state, 0x1234);
+                nft32_murmur3_update(&state, data, a);
+                nft32_murmur3_update(&state, data + a, b - a);
+                nft32_murmur3_update(&state, data + b, len - b);
+                if (nft32_murmur3_final(&state) != expected) {
+                    fprintf(stderr, "ERROR! Streaming hash mismatch: len=%u, split=%u/%u\n", len, a, b);
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+    }
+
+    if (!_check_crc32c(data, sizeof(data))) return EXIT_FAILURE;
+
+    hashed_name_t name;
+    nft32_hash_fatname("TEST    TXT", &name);
+    if (name.hash != nft32_murmur3_x86_32((const unsigned char*)"TEST    TXT", 11, 0)) {
+        fprintf(stderr, "ERROR! Hashed name mismatch\n");
+        return EXIT_FAILURE;
+    }
+
+    directory_entry_t entry;
+    create_entry(&name, 0, 100, 4096, &entry);
+    entry.rca = 5;
+
+    int algorithms[] = { CHECKSUM_MURMUR3, CHECKSUM_CRC32C };
+    for (int a = 0; a < (int)(sizeof(algorithms) / sizeof(algorithms[0])); a++) {
+        nft32_checksum_setup(algorithms[a]);
+
+        checksum_state_t prefix;
+        entry_checksum_prefix(&entry, &prefix);
+        for (int i = 0; i < 100; i++) {
+            entry.dca = 100 + i * 3;
+            entry.file_size = 4096 + i * 511;
+            entry.checksum = 0;
+            checksum_t expected = nft32_checksum((const unsigned char*)&entry, sizeof(directory_entry_t));
+            if (entry_checksum(&entry) != expected || entry_checksum_update(&prefix, &entry) != expected) {
+                fprintf(stderr, "ERROR! [algorithm=%i] Entry checksum mismatch at i=%i\n", algorithms[a], i);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,126 @@
+/*
+Concurrent allocation test. Most of the volume is allocated first. Then threads allocate
+clusters and runs from the rest, and free a part of them, at the same time. Every allocated cluster is owned by one thread until it is freed, thus
+a cluster, which is allocated twice, is found by the owner table. At the end the map
+should match the FAT.
+*/
+#include <pthread.h>
+#include "nifat32_test.h"
+
+#define TEST_THREADS 4
+#define TEST_ROUNDS  4000
+#define TEST_KEEP    48
+#define TEST_RUN_MAX 8
+#define TEST_FREE    1024
+
+static fat_data_t fs;
+static volatile int* owners = NULL;
+static volatile int doubles = 0;
+static volatile int failures = 0;
+
+typedef struct {
+    cluster_addr_t ca;
+    unsigned int   count;
+} held_t;
+
+static int _own(cluster_addr_t ca, unsigned int count, int thread) {
+    for (unsigned int c = 0; c < count; c++) {
+        int owner = __sync_val_compare_and_swap(&owners[ca + c], 0, thread + 1);
+        if (owner) {
+            fprintf(stderr, "ERROR! Cluster %u of thread %i is allocated by thread %i!\n", ca + c, owner - 1, thread);
+            __sync_fetch_and_add(&doubles, 1);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void _release(held_t* held) {
+    for (unsigned int c = 0; c < held->count; c++) owners[held->ca + c] = 0;
+    if (!dealloc_chain(held->ca, &fs)) __sync_fetch_and_add(&failures, 1);
+}
+
+static void* _worker(void* arg) {
+    int thread = (int)(long)arg;
+    unsigned int seed = 17 + thread;
+    held_t held[TEST_KEEP] = { 0 };
+    for (int r = 0; r < TEST_ROUNDS; r++) {
+        held_t* slot = &held[rand_r(&seed) % TEST_KEEP];
+        if (slot->count) {
+            _release(slot);
+            slot->count = 0;
+        }
+
+        if (rand_r(&seed) % 2) {
+            slot->ca = alloc_cluster(&fs);
+            slot->count = is_cluster_bad(slot->ca) ? 0 : 1;
+        }
+        else {
+            slot->ca = alloc_extent(1 + rand_r(&seed) % TEST_RUN_MAX, FAT_CLUSTER_BAD, &slot->count, &fs);
+            if (is_cluster_bad(slot->ca)) slot->count = 0;
+        }
+
+        if (!slot->count) __sync_fetch_and_add(&failures, 1);
+        else if (!_own(slot->ca, slot->count, thread)) slot->count = 0;
+    }
+
+    for (int h = 0; h < TEST_KEEP; h++) {
+        if (held[h].count) _release(&held[h]);
+    }
+
+    return NULL;
+}
+
+int main() {
+#ifndef NO_CREATION
+    nifat32_params_t params;
+    if (!setup_nifat32(&params)) return EXIT_FAILURE;
+    NIFAT32_unload();
+    params.fat_cache = CACHE | HARD_CACHE | MAP_CACHE;
+    if (!NIFAT32_init(&params)) {
+        fprintf(stderr, "NIFAT32_init() error!\n");
+        return EXIT_FAILURE;
+    }
+
+    NIFAT32_get_fs_data(&fs);
+    owners = (volatile int*)calloc(fs.total_clusters, sizeof(int));
+
+    /* Clusters are allocated without data, thus hashed metadata in the data area is safe. */
+    unsigned int allocated = 0, total = 0;
+    while (total + TEST_FREE < fs.total_clusters) {
+        cluster_addr_t ca = alloc_extent(fs.total_clusters - TEST_FREE - total, FAT_CLUSTER_BAD, &allocated, &fs);
+        if (is_cluster_bad(ca)) break;
+        total += allocated;
+    }
+
+    fprintf(stdout, "Allocated %u clusters before the test\n", total);
+
+    pthread_t workers[TEST_THREADS];
+    for (long t = 0; t < TEST_THREADS; t++) pthread_create(&workers[t], NULL, _worker, (void*)t);
+    for (int t = 0; t < TEST_THREADS; t++) pthread_join(workers[t], NULL);
+
+    /* The map is walked first, because FAT reads fill the map. */
+    int mismatches = 0;
+    unsigned char* map_free = (unsigned char*)calloc(fs.total_clusters, 1);
+    for (unsigned int ca = fatmap_find_free(0, 1, &fs); ca; ca = fatmap_find_free(ca + 1, 1, &fs)) map_free[ca] = 1;
+    for (unsigned int ca = fs.ext_root_cluster; ca < fs.total_clusters; ca++) {
+        if (map_free[ca] && !is_cluster_free(read_fat(ca, &fs))) mismatches++;
+    }
+
+    free(map_free);
+    fprintf(stdout, "\n==== Claim Summary (%i threads, %i rounds) ====\n", TEST_THREADS, TEST_ROUNDS);
+    fprintf(stdout, "Double allocations: %i\n", doubles);
+    fprintf(stdout, "Failed operations:  %i\n", failures);
+    fprintf(stdout, "Map mismatches:     %i\n", mismatches);
+    if (doubles || mismatches) {
+        fprintf(stderr, "ERROR! Clusters were allocated twice or lost by the map!\n");
+        return EXIT_FAILURE;
+    }
+
+    NIFAT32_unload();
+    free((void*)owners);
+#endif
+
+    return EXIT_SUCCESS;
+}
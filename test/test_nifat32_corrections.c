@@ -0,0 +1,66 @@
+/*
+Corrections test. Flip one bit in the boot sector and one bit in the second FAT copy,
+then check that the decoder reports the corrected bits in the right regions.
+With FAT checksums only the first FAT copy is read, thus the bit is flipped there.
+*/
+#include "nifat32_test.h"
+
+static int _flip_bit(off_t addr, int bit) {
+    int fd = open(disk_path, O_RDWR);
+    if (fd < 0) return 0;
+
+    unsigned char byte = 0;
+    int res = pread(fd, &byte, 1, addr) == 1;
+    byte ^= (1 << bit);
+    res = res && pwrite(fd, &byte, 1, addr) == 1;
+    close(fd);
+    return res;
+}
+
+int main() {
+#ifdef V_SIZE
+    unsigned int ts = (V_SIZE * 1024 * 1024) / sector_size;
+#else
+    unsigned int ts = (64 * 1024 * 1024) / sector_size;
+#endif
+
+    off_t boot_addr = (off_t)GET_BOOTSECTOR(0, ts) * sector_size + 10;
+    if (!_flip_bit(boot_addr, 1)) return EXIT_FAILURE;
+    if (!setup_nifat32(NULL)) return EXIT_FAILURE;
+
+    corrections_t corrections;
+    NIFAT32_get_corrections(&corrections, 1);
+    if (corrections.boot != 1) {
+        fprintf(stderr, "ERROR! Boot corrections=%u, expected 1\n", corrections.boot);
+        return EXIT_FAILURE;
+    }
+
+    fat_data_t fs;
+    NIFAT32_get_fs_data(&fs);
+    if (fs.fat_count < 2) {
+        fprintf(stdout, "Single FAT copy, skip the FAT check\n");
+        _flip_bit(boot_addr, 1);
+        return EXIT_SUCCESS;
+    }
+
+    int copy = fs.fat_checksums ? 0 : 1;
+    cluster_addr_t ca = fs.ext_root_cluster + 100;
+    cluster_offset_t fat_offset = ca * nft32_ecc_encoded_size(sizeof(cluster_val_t));
+    off_t fat_addr = ((off_t)fs.sectors_padd + GET_FATSECTOR(copy, fs.total_sectors)) * fs.bytes_per_sector + fat_offset;
+    if (!_flip_bit(fat_addr, 2)) return EXIT_FAILURE;
+
+    cluster_val_t value = read_fat(ca, &fs);
+    NIFAT32_get_corrections(&corrections, 0);
+    if (corrections.fat[copy] != 1 || corrections.fat[!copy] || corrections.last_fat_ca != ca) {
+        fprintf(
+            stderr, "ERROR! FAT corrections: fat[0]=%u, fat[1]=%u, last_ca=%u (value=%u)\n",
+            corrections.fat[0], corrections.fat[1], corrections.last_fat_ca, value
+        );
+        return EXIT_FAILURE;
+    }
+
+    _flip_bit(boot_addr, 1);
+    _flip_bit(fat_addr, 2);
+    destroy_nifat32();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,116 @@
+/*
+Entry validation test. Write files into one directory cluster and damage the checksum of
+one entry. The damaged entry should be skipped by the search and the index, and entries
+before and after it in the same cluster should still be found.
+*/
+#include "nifat32_test.h"
+
+#define TEST_FILES   5
+#define TEST_DAMAGED 2
+
+static void _file_name(int file, char* name, hashed_name_t* hn) {
+    char path[32];
+    snprintf(path, sizeof(path), "val%i.txt", file);
+    nft32_name_to_fatname(path, name);
+    nft32_hash_fatname(name, hn);
+}
+
+/*
+Flip the checksum of the entry. entry_iterate writes the cluster back, thus the damaged
+entry reaches the disk with valid ECC.
+*/
+static int _damage_handler(entry_info_t* info, directory_entry_t* entry, void* ctx) {
+    hashed_name_t* name = (hashed_name_t*)ctx;
+    if (!info->valid || strncmp((char*)entry->file_name, name->name, FATNAME_SIZE)) return 0;
+    entry->checksum ^= 0x5A5A;
+    return 1;
+}
+
+static int _check_entries(const char* stage, cluster_addr_t dca, fat_data_t* fs) {
+    ecache_t* index = NULL;
+    entry_index(dca, &index, fs);
+
+    int errors = 0;
+    for (int f = 0; f < TEST_FILES; f++) {
+        char name[FATNAME_SIZE + 1] = { 0 };
+        hashed_name_t hn;
+        _file_name(f, name, &hn);
+
+        directory_entry_t meta;
+        int found   = entry_search(&hn, dca, NO_ECACHE, &meta, fs) == 1;
+        int indexed = ecache_find(index, hn.hash) != NULL;
+        int expected = f != TEST_DAMAGED;
+        if (found != expected || indexed != expected) {
+            fprintf(
+                stderr, "ERROR! %s: entry %i (found=%i, indexed=%i), expected %i\n", stage, f, found, indexed, expected
+            );
+            errors++;
+        }
+    }
+
+    if (index) ecache_free(index);
+    return !errors;
+}
+
+int main() {
+#ifdef NO_ENTRY_VALIDATION
+    fprintf(stdout, "Entries aren't validated, skip\n");
+    return EXIT_SUCCESS;
+#endif
+#ifndef NO_CREATION
+    nifat32_params_t params;
+    if (!setup_nifat32(&params)) return EXIT_FAILURE;
+
+    for (int f = 0; f < TEST_FILES; f++) {
+        char path[32];
+        snprintf(path, sizeof(path), "vdir/val%i.txt", f);
+        ci_t ci = nifat32_open_test(NO_RCI, path, MODE(CR_MODE | W_MODE | R_MODE, FILE_TARGET), SUCCESS);
+        if (ci < 0) return EXIT_FAILURE;
+        NIFAT32_close_content(ci);
+    }
+
+    ci_t dir = nifat32_open_test(NO_RCI, "vdir", DF_MODE, SUCCESS);
+    if (dir < 0) return EXIT_FAILURE;
+    cluster_addr_t dca = get_content_data_ca(dir);
+    NIFAT32_close_content(dir);
+
+    fat_data_t fs;
+    NIFAT32_get_fs_data(&fs);
+    if ((unsigned int)TEST_FILES > ENTRIES_PER_CLUSTER(&fs)) {
+        fprintf(stdout, "Entries don't fit one cluster, skip\n");
+        NIFAT32_unload();
+        return EXIT_SUCCESS;
+    }
+
+    char damaged[FATNAME_SIZE + 1] = { 0 };
+    hashed_name_t damaged_hn;
+    _file_name(TEST_DAMAGED, damaged, &damaged_hn);
+    if (entry_iterate(dca, _damage_handler, (void*)&damaged_hn, &fs) != 1) {
+        fprintf(stderr, "ERROR! The entry for the damage wasn't found!\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!_check_entries("Damaged entry", dca, &fs)) return EXIT_FAILURE;
+
+    /* A new mount has no cached entries. */
+    NIFAT32_unload();
+    if (!NIFAT32_init(&params)) {
+        fprintf(stderr, "NIFAT32_init() error!\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!_check_entries("Mount after the damage", dca, &fs)) return EXIT_FAILURE;
+    for (int f = 0; f < TEST_FILES; f++) {
+        char path[32];
+        snprintf(path, sizeof(path), "vdir/val%i.txt", f);
+        if (NIFAT32_content_exists(path) != (f != TEST_DAMAGED)) {
+            fprintf(stderr, "ERROR! NIFAT32_content_exists(%s) is wrong!\n", path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    NIFAT32_unload();
+#endif
+
+    return EXIT_SUCCESS;
+}
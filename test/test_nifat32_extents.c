@@ -0,0 +1,136 @@
+/*
+Extent allocation test. Make small holes in the cluster space, then write a large file,
+reserve a chain with NIFAT32_put_content and deep copy the file. With the FAT map every
+chain should take a few contiguous runs instead of filling the holes cluster by cluster.
+*/
+#include "nifat32_test.h"
+
+#define TEST_HOLES    24
+#define TEST_CLUSTERS 64
+#define TEST_RESERVE  48
+#define TEST_RUNS_MAX 4
+
+static unsigned char _pattern(int position) {
+    return (unsigned char)(position * 17 + (position >> 11));
+}
+
+/*
+Count the chain length and runs of clusters that follow each other on disk.
+*/
+static int _chain_runs(char* path, int* length, fat_data_t* fs) {
+    ci_t ci = nifat32_open_test(NO_RCI, path, DF_MODE, SUCCESS);
+    if (ci < 0) return -1;
+
+    int runs = 0;
+    *length = 0;
+    cluster_addr_t prev = FAT_CLUSTER_BAD;
+    for (cluster_addr_t ca = get_content_data_ca(ci); !is_cluster_end(ca) && !is_cluster_bad(ca); ca = read_fat(ca, fs)) {
+        if (ca != prev + 1) runs++;
+        prev = ca;
+        (*length)++;
+    }
+
+    NIFAT32_close_content(ci);
+    return runs;
+}
+
+static int _check_chain(char* path, int expected_length, fat_data_t* fs) {
+    int length = 0;
+    int runs = _chain_runs(path, &length, fs);
+    fprintf(stdout, "%s: %i clusters in %i runs\n", path, length, runs);
+    if (runs < 0 || length != expected_length) {
+        fprintf(stderr, "ERROR! Chain of %s has %i clusters, expected %i!\n", path, length, expected_length);
+        return 0;
+    }
+
+#ifndef NO_FAT_MAP
+    if (runs > TEST_RUNS_MAX) {
+        fprintf(stderr, "ERROR! Chain of %s is fragmented!\n", path);
+        return 0;
+    }
+#endif
+    return 1;
+}
+
+int main() {
+#ifndef NO_CREATION
+    nifat32_params_t params;
+    if (!setup_nifat32(&params)) return EXIT_FAILURE;
+    NIFAT32_unload();
+    params.fat_cache = CACHE | HARD_CACHE | MAP_CACHE;
+    if (!NIFAT32_init(&params)) {
+        fprintf(stderr, "NIFAT32_init() error!\n");
+        return EXIT_FAILURE;
+    }
+
+    fat_data_t fs;
+    NIFAT32_get_fs_data(&fs);
+    int data_size = fs.cluster_size * TEST_CLUSTERS;
+    unsigned char* data = (unsigned char*)malloc(data_size);
+    for (int i = 0; i < data_size; i++) data[i] = _pattern(i);
+
+    for (int f = 0; f < TEST_HOLES; f++) {
+        char path[32];
+        snprintf(path, sizeof(path), "ext/h%i.bin", f);
+        ci_t ci = nifat32_open_test(NO_RCI, path, MODE(CR_MODE | W_MODE | R_MODE, FILE_TARGET), SUCCESS);
+        if (ci < 0) return EXIT_FAILURE;
+        NIFAT32_write_buffer2content(ci, 0, (const_buffer_t)data, 2 * fs.cluster_size);
+        NIFAT32_close_content(ci);
+    }
+
+    for (int f = 0; f < TEST_HOLES; f += 2) {
+        char path[32];
+        snprintf(path, sizeof(path), "ext/h%i.bin", f);
+        ci_t ci = nifat32_open_test(NO_RCI, path, DF_MODE, SUCCESS);
+        if (ci < 0 || !NIFAT32_delete_content(ci)) return EXIT_FAILURE;
+    }
+
+    ci_t ci = nifat32_open_test(NO_RCI, "ext/big.bin", MODE(CR_MODE | W_MODE | R_MODE, FILE_TARGET), SUCCESS);
+    if (ci < 0) return EXIT_FAILURE;
+    if (NIFAT32_write_buffer2content(ci, 0, (const_buffer_t)data, data_size) != data_size) {
+        fprintf(stderr, "ERROR! NIFAT32_write_buffer2content wrote less data!\n");
+        return EXIT_FAILURE;
+    }
+
+    NIFAT32_close_content(ci);
+    if (!_check_chain("ext/big.bin", TEST_CLUSTERS, &fs)) return EXIT_FAILURE;
+
+    ci_t rci = nifat32_open_test(NO_RCI, "ext", DF_MODE, SUCCESS);
+    if (rci < 0) return EXIT_FAILURE;
+    cinfo_t info = { .type = STAT_FILE, .full_name = "RESERVE BIN" };
+    if (!NIFAT32_put_content(rci, &info, TEST_RESERVE)) {
+        fprintf(stderr, "ERROR! NIFAT32_put_content error!\n");
+        return EXIT_FAILURE;
+    }
+
+    NIFAT32_close_content(rci);
+    if (!_check_chain("ext/reserve.bin", TEST_RESERVE, &fs)) return EXIT_FAILURE;
+
+    ci_t src = nifat32_open_test(NO_RCI, "ext/big.bin", DF_MODE, SUCCESS);
+    ci_t dst = nifat32_open_test(NO_RCI, "ext/copy.bin", MODE(CR_MODE | W_MODE | R_MODE, FILE_TARGET), SUCCESS);
+    if (src < 0 || dst < 0 || !NIFAT32_copy_content(src, dst, DEEP_COPY)) return EXIT_FAILURE;
+    NIFAT32_close_content(src);
+    NIFAT32_close_content(dst);
+    if (!_check_chain("ext/copy.bin", TEST_CLUSTERS, &fs)) return EXIT_FAILURE;
+
+    static char* paths[] = { "ext/big.bin", "ext/copy.bin" };
+    for (int p = 0; p < 2; p++) {
+        ci = nifat32_open_test(NO_RCI, paths[p], DF_MODE, SUCCESS);
+        if (ci < 0 || !nifate32_read_and_compare_alloc(ci, 0, (const_buffer_t)data, data_size, SUCCESS)) return EXIT_FAILURE;
+        NIFAT32_close_content(ci);
+    }
+
+    for (int f = 1; f < TEST_HOLES; f += 2) {
+        char path[32];
+        snprintf(path, sizeof(path), "ext/h%i.bin", f);
+        ci = nifat32_open_test(NO_RCI, path, DF_MODE, SUCCESS);
+        if (ci < 0 || !nifate32_read_and_compare_alloc(ci, 0, (const_buffer_t)data, 2 * fs.cluster_size, SUCCESS)) return EXIT_FAILURE;
+        NIFAT32_close_content(ci);
+    }
+
+    NIFAT32_unload();
+    free(data);
+#endif
+
+    return EXIT_SUCCESS;
+}
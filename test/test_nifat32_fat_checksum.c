@@ -0,0 +1,105 @@
+/*
+FAT checksum test. Walk a chain without the FAT cache and count disk reads, then damage
+the first FAT copy and check that the chain is still read right and the copy is repaired.
+On an image formatted with --fat-checksum a lookup should read only the first FAT copy.
+*/
+#include "nifat32_test.h"
+
+#define TEST_CLUSTERS 64
+
+static int read_calls = 0;
+
+static int _counting_sector_read(sector_addr_t sa, sector_offset_t offset, buffer_t buffer, int buff_size) {
+    read_calls++;
+    return _mock_sector_read_(sa, offset, buffer, buff_size);
+}
+
+static int _damage_fat_entry(fat_data_t* fs, int fat, cluster_addr_t ca, unsigned char noise) {
+    int encoded_size = nft32_ecc_encoded_size(sizeof(cluster_val_t));
+    off_t position = (off_t)(fs->sectors_padd + GET_FATSECTOR(fat, fs->total_sectors)) * sector_size + (off_t)ca * encoded_size;
+    unsigned char garbage[ECC_MAX_ENCODED_SIZE(sizeof(cluster_val_t))];
+    memset(garbage, noise, sizeof(garbage));
+    return pwrite(disk_fd, garbage, encoded_size, position) == encoded_size;
+}
+
+/*
+Read the chain and return the count of disk reads. -1 if the chain differs from the expected one.
+*/
+static int _walk_chain(cluster_addr_t* chain, fat_data_t* fs) {
+    read_calls = 0;
+    for (int i = 0; i < TEST_CLUSTERS; i++) {
+        cluster_val_t next = read_fat(chain[i], fs);
+        cluster_val_t expected = i + 1 < TEST_CLUSTERS ? chain[i + 1] : FAT_CLUSTER_END;
+        if (next != expected) {
+            fprintf(stderr, "ERROR! read_fat(%u) -> %u, expected %u!\n", chain[i], next, expected);
+            return -1;
+        }
+    }
+
+    return read_calls;
+}
+
+int main() {
+#ifndef NO_CREATION
+    nifat32_params_t params;
+    if (!setup_nifat32(&params)) return EXIT_FAILURE;
+
+    fat_data_t fs;
+    NIFAT32_get_fs_data(&fs);
+    int data_size = fs.cluster_size * TEST_CLUSTERS;
+    unsigned char* data = (unsigned char*)calloc(1, data_size);
+    ci_t ci = nifat32_open_test(NO_RCI, "fsum/chain.bin", (CR_MODE | W_MODE | R_MODE | FILE_TARGET), SUCCESS);
+    if (ci < 0) return EXIT_FAILURE;
+    NIFAT32_write_buffer2content(ci, 0, (const_buffer_t)data, data_size);
+
+    cluster_addr_t chain[TEST_CLUSTERS];
+    chain[0] = get_content_data_ca(ci);
+    for (int i = 1; i < TEST_CLUSTERS; i++) chain[i] = read_fat(chain[i - 1], &fs);
+    NIFAT32_close_content(ci);
+    free(data);
+
+    NIFAT32_unload();
+    params.fat_cache = NO_CACHE;
+    params.disk_io.read_sector  = _counting_sector_read;
+    params.disk_io.read_sectors = _counting_sector_read;
+    params.disk_io.readv        = NULL;
+    if (!NIFAT32_init(&params)) {
+        fprintf(stderr, "NIFAT32_init() error!\n");
+        return EXIT_FAILURE;
+    }
+
+    int clean_reads = _walk_chain(chain, &fs);
+    if (clean_reads < 0) return EXIT_FAILURE;
+
+    cluster_addr_t damaged = chain[TEST_CLUSTERS / 2];
+    if (!_damage_fat_entry(&fs, 0, damaged, 0x5A)) {
+        fprintf(stderr, "Can't damage FAT entry!\n");
+        return EXIT_FAILURE;
+    }
+
+    int damaged_reads  = _walk_chain(chain, &fs);
+    int repaired_reads = _walk_chain(chain, &fs);
+    if (damaged_reads < 0 || repaired_reads < 0) return EXIT_FAILURE;
+
+    fprintf(stdout, "\n==== FAT Checksum Summary (%i lookups, %i FATs, checksums=%i) ====\n", TEST_CLUSTERS, fs.fat_count, fs.fat_checksums);
+    fprintf(stdout, "Clean chain reads:    %i\n", clean_reads);
+    fprintf(stdout, "Damaged chain reads:  %i\n", damaged_reads);
+    fprintf(stdout, "Repaired chain reads: %i\n", repaired_reads);
+
+    if (fs.fat_checksums) {
+        if (clean_reads >= TEST_CLUSTERS * fs.fat_count) {
+            fprintf(stderr, "ERROR! Checksummed lookups read every FAT copy!\n");
+            return EXIT_FAILURE;
+        }
+
+        if (repaired_reads != clean_reads) {
+            fprintf(stderr, "ERROR! The first FAT copy wasn't repaired!\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    NIFAT32_unload();
+#endif
+
+    return EXIT_SUCCESS;
+}
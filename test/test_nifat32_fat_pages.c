@@ -0,0 +1,73 @@
+/*
+Paged FAT cache test. Mount with a FAT cache budget of a few FAT sectors, write a file
+whose chain crosses more FAT sectors than fit to the cache, then compare data and the
+chain after a remount with the whole table cache. Done with and without write-back.
+*/
+#include "nifat32_test.h"
+
+#define TEST_CLUSTERS 700
+#define TEST_PAGES    4
+
+static int _remount(nifat32_params_t* params, unsigned char fat_cache, unsigned int budget) {
+    NIFAT32_unload();
+    params->fat_cache      = fat_cache;
+    params->fat_cache_size = budget;
+    if (!NIFAT32_init(params)) {
+        fprintf(stderr, "NIFAT32_init() error!\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+static int _check_file(char* path, const unsigned char* data, int data_size, fat_data_t* fs) {
+    ci_t ci = nifat32_open_test(NO_RCI, path, DF_MODE, SUCCESS);
+    if (ci < 0) return 0;
+
+    int chain = 0;
+    for (cluster_addr_t ca = get_content_data_ca(ci); !is_cluster_end(ca) && !is_cluster_bad(ca); ca = read_fat(ca, fs)) chain++;
+    if (chain != TEST_CLUSTERS) {
+        fprintf(stderr, "ERROR! Chain length of %s is %i, expected %i!\n", path, chain, TEST_CLUSTERS);
+        return 0;
+    }
+
+    int result = nifate32_read_and_compare_alloc(ci, 0, (const_buffer_t)data, data_size, SUCCESS);
+    NIFAT32_close_content(ci);
+    return result;
+}
+
+int main() {
+#ifndef NO_CREATION
+    nifat32_params_t params;
+    if (!setup_nifat32(&params)) return EXIT_FAILURE;
+
+    fat_data_t fs;
+    NIFAT32_get_fs_data(&fs);
+    unsigned int budget = TEST_PAGES * FATPAGE_COST(fs.bytes_per_sector / sizeof(cluster_val_t));
+    int data_size = fs.cluster_size * TEST_CLUSTERS;
+    unsigned char* data = (unsigned char*)malloc(data_size);
+    for (int i = 0; i < data_size; i++) data[i] = (unsigned char)(i * 13 + (i >> 12));
+
+    static const unsigned char modes[] = { CACHE, CACHE | WRITE_BACK_CACHE };
+    static char* paths[] = { "pages/sync.bin", "pages/wback.bin" };
+    for (int m = 0; m < 2; m++) {
+        if (!_remount(&params, modes[m], budget)) return EXIT_FAILURE;
+        ci_t ci = nifat32_open_test(NO_RCI, paths[m], (CR_MODE | W_MODE | R_MODE | FILE_TARGET), SUCCESS);
+        if (ci < 0) return EXIT_FAILURE;
+        if (NIFAT32_write_buffer2content(ci, 0, (const_buffer_t)data, data_size) != data_size) {
+            fprintf(stderr, "ERROR! NIFAT32_write_buffer2content wrote less data!\n");
+            return EXIT_FAILURE;
+        }
+
+        NIFAT32_close_content(ci);
+        if (!_check_file(paths[m], data, data_size, &fs)) return EXIT_FAILURE;
+        if (!_remount(&params, CACHE, 0)) return EXIT_FAILURE;
+        if (!_check_file(paths[m], data, data_size, &fs)) return EXIT_FAILURE;
+    }
+
+    NIFAT32_unload();
+    free(data);
+#endif
+
+    return EXIT_SUCCESS;
+}
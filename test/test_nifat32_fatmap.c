@@ -0,0 +1,123 @@
+/*
+FAT map test. Mount with the map, make holes in the cluster space by deleting files,
+then compare free run searches in the map with a search over the FAT. Files written
+to the holes should keep their data after a remount.
+*/
+#include "nifat32_test.h"
+
+#define TEST_FILES   24
+#define TEST_QUERIES 300
+#define TEST_RUN_MAX 40
+
+static int _file_clusters(int file) {
+    return 1 + (file * 7) % 9;
+}
+
+static unsigned char _pattern(int file, int position) {
+    return (unsigned char)(position * 11 + file * 37);
+}
+
+static int _remount(nifat32_params_t* params, unsigned char fat_cache) {
+    NIFAT32_unload();
+    params->fat_cache = fat_cache;
+    if (!NIFAT32_init(params)) {
+        fprintf(stderr, "NIFAT32_init() error!\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+static int _write_file(int file, fat_data_t* fs) {
+    char path[32];
+    snprintf(path, sizeof(path), "fmap/f%i.bin", file);
+    ci_t ci = nifat32_open_test(NO_RCI, path, (CR_MODE | W_MODE | R_MODE | FILE_TARGET), SUCCESS);
+    if (ci < 0) return 0;
+
+    int size = _file_clusters(file) * fs->cluster_size;
+    unsigned char* data = (unsigned char*)malloc(size);
+    for (int i = 0; i < size; i++) data[i] = _pattern(file, i);
+    int written = NIFAT32_write_buffer2content(ci, 0, (const_buffer_t)data, size);
+    NIFAT32_close_content(ci);
+    free(data);
+    return written == size;
+}
+
+static int _check_file(int file, fat_data_t* fs) {
+    char path[32];
+    snprintf(path, sizeof(path), "fmap/f%i.bin", file);
+    ci_t ci = nifat32_open_test(NO_RCI, path, R_MODE | FILE_TARGET, SUCCESS);
+    if (ci < 0) return 0;
+
+    int size = _file_clusters(file) * fs->cluster_size;
+    unsigned char* data = (unsigned char*)malloc(size);
+    for (int i = 0; i < size; i++) data[i] = _pattern(file, i);
+    int result = nifate32_read_and_compare_alloc(ci, 0, (const_buffer_t)data, size, SUCCESS);
+    NIFAT32_close_content(ci);
+    free(data);
+    return result;
+}
+
+/*
+Find the first run of free clusters by FAT reads.
+*/
+static unsigned int _scan_free(unsigned int offset, int size, fat_data_t* fs) {
+    int run = 0;
+    for (unsigned int ca = offset; ca < fs->total_clusters; ca++) {
+        if (read_fat(ca, fs) != FAT_CLUSTER_FREE) run = 0;
+        else if (++run == size) return ca - size + 1;
+    }
+
+    return 0;
+}
+
+int main() {
+#ifndef NO_CREATION
+    nifat32_params_t params;
+    if (!setup_nifat32(&params)) return EXIT_FAILURE;
+    if (!_remount(&params, CACHE | HARD_CACHE | MAP_CACHE)) return EXIT_FAILURE;
+
+    fat_data_t fs;
+    NIFAT32_get_fs_data(&fs);
+    for (int f = 0; f < TEST_FILES; f++) {
+        if (!_write_file(f, &fs)) return EXIT_FAILURE;
+    }
+
+    for (int f = 0; f < TEST_FILES; f += 2) {
+        char path[32];
+        snprintf(path, sizeof(path), "fmap/f%i.bin", f);
+        ci_t ci = nifat32_open_test(NO_RCI, path, DF_MODE, SUCCESS);
+        if (ci < 0 || !NIFAT32_delete_content(ci)) return EXIT_FAILURE;
+    }
+
+#ifndef NO_FAT_MAP
+    srand(15);
+    for (int i = 0; i < TEST_QUERIES; i++) {
+        unsigned int offset = fs.ext_root_cluster + rand() % 512;
+        int size = 1 + rand() % TEST_RUN_MAX;
+        unsigned int found = fatmap_find_free(offset, size, &fs);
+        unsigned int expected = _scan_free(offset, size, &fs);
+        if (found != expected) {
+            fprintf(stderr, "ERROR! fatmap_find_free(%u, %i) -> %u, expected %u!\n", offset, size, found, expected);
+            return EXIT_FAILURE;
+        }
+    }
+#endif
+
+    for (int f = 0; f < TEST_FILES; f += 2) {
+        if (!_write_file(f, &fs)) return EXIT_FAILURE;
+    }
+
+    if (!_remount(&params, CACHE)) return EXIT_FAILURE;
+    for (int f = 0; f < TEST_FILES; f++) {
+        if (!_check_file(f, &fs)) {
+            fprintf(stderr, "ERROR! File %i differs!\n", f);
+            return EXIT_FAILURE;
+        }
+    }
+
+    NIFAT32_unload();
+#endif
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,254 @@
+/*
+Free map test. Make holes in the cluster space, unmount and mount with CACHE | MAP_CACHE.
+A clean mount should load the map from the free map area with a few reads, an unclean
+mount or a damaged area should rebuild the map from the FAT. In every case the map should
+match the FAT. A mount without MAP_CACHE changes the FAT without the map, thus the next
+MAP_CACHE mount should rebuild the map, and new files shouldn't take clusters of its files.
+If the dirty mark can't be written, the FAT shouldn't be changed. If the FAT can't be written,
+the map and the cache shouldn't be changed.
+The image should be formatted with --free-map.
+*/
+#include "nifat32_test.h"
+
+#define TEST_FILES 24
+#define TEST_MIXED_CLUSTERS 40
+
+static int read_calls = 0;
+
+static int _counting_sector_read(sector_addr_t sa, sector_offset_t offset, buffer_t buffer, int buff_size) {
+    read_calls++;
+    return _mock_sector_read_(sa, offset, buffer, buff_size);
+}
+
+static sector_addr_t failing_sector = 0;
+static fat_data_t* failing_fat = NULL;
+
+/*
+Check if the sector is in one of FAT copies.
+*/
+static int _fat_sector(sector_addr_t sa, fat_data_t* fs) {
+    for (int fat = 0; fat < fs->fat_count; fat++) {
+        sector_addr_t first = fs->sectors_padd + GET_FATSECTOR(fat, fs->total_sectors);
+        if (sa >= first && sa < first + fs->fat_size) return 1;
+    }
+
+    return 0;
+}
+
+static int _failing_sector_write(sector_addr_t sa, sector_offset_t offset, const_buffer_t data, int data_size) {
+    sector_addr_t target = sa + offset / sector_size;
+    if (failing_sector && target == failing_sector) return 0;
+    if (failing_fat && _fat_sector(target, failing_fat)) return 0;
+    return _mock_sector_write_(sa, offset, data, data_size);
+}
+
+static int _file_clusters(int file) {
+    return 1 + (file * 5) % 7;
+}
+
+static unsigned char _pattern(int file, int position) {
+    return (unsigned char)(position * 13 + file * 41);
+}
+
+/*
+Mount and return the count of disk reads of the mount, or -1.
+*/
+static int _mount(nifat32_params_t* params, unsigned char fat_cache) {
+    read_calls = 0;
+    params->fat_cache = fat_cache;
+    params->disk_io.read_sector   = _counting_sector_read;
+    params->disk_io.read_sectors  = _counting_sector_read;
+    params->disk_io.write_sector  = _failing_sector_write;
+    params->disk_io.write_sectors = _failing_sector_write;
+    params->disk_io.readv         = NULL;
+    params->disk_io.writev        = NULL;
+    if (!NIFAT32_init(params)) {
+        fprintf(stderr, "NIFAT32_init() error!\n");
+        return -1;
+    }
+
+    return read_calls;
+}
+
+/*
+Drop the mount without the FAT flush and the free map store, as a power loss does.
+*/
+static void _crash() {
+    fat_cache_unload();
+    fatmap_unload();
+    ctable_destroy();
+}
+
+static int _write_file_sized(int file, int clusters, fat_data_t* fs) {
+    char path[32];
+    snprintf(path, sizeof(path), "fmap/f%i.bin", file);
+    ci_t ci = nifat32_open_test(NO_RCI, path, MODE(CR_MODE | W_MODE | R_MODE, FILE_TARGET), SUCCESS);
+    if (ci < 0) return 0;
+
+    int size = clusters * fs->cluster_size;
+    unsigned char* data = (unsigned char*)malloc(size);
+    for (int i = 0; i < size; i++) data[i] = _pattern(file, i);
+    int written = NIFAT32_write_buffer2content(ci, 0, (const_buffer_t)data, size);
+    NIFAT32_close_content(ci);
+    free(data);
+    return written == size;
+}
+
+static int _write_file(int file, fat_data_t* fs) {
+    return _write_file_sized(file, _file_clusters(file), fs);
+}
+
+static int _check_file_sized(int file, int clusters, fat_data_t* fs) {
+    char path[32];
+    snprintf(path, sizeof(path), "fmap/f%i.bin", file);
+    ci_t ci = nifat32_open_test(NO_RCI, path, DF_MODE, SUCCESS);
+    if (ci < 0) return 0;
+
+    int size = clusters * fs->cluster_size;
+    unsigned char* data = (unsigned char*)malloc(size);
+    for (int i = 0; i < size; i++) data[i] = _pattern(file, i);
+    int result = nifate32_read_and_compare_alloc(ci, 0, (const_buffer_t)data, size, SUCCESS);
+    NIFAT32_close_content(ci);
+    free(data);
+    return result;
+}
+
+static int _check_file(int file, fat_data_t* fs) {
+    return _check_file_sized(file, _file_clusters(file), fs);
+}
+
+/*
+Compare free clusters of the map with the FAT. The map is walked first, because FAT reads
+fill the map.
+*/
+static int _check_map(const char* stage, fat_data_t* fs) {
+    unsigned char* map_free = (unsigned char*)calloc(fs->total_clusters, 1);
+    for (unsigned int ca = fatmap_find_free(0, 1, fs); ca; ca = fatmap_find_free(ca + 1, 1, fs)) map_free[ca] = 1;
+
+    int mismatches = 0, free_clusters = 0;
+    for (unsigned int ca = fs->ext_root_cluster; ca < fs->total_clusters; ca++) {
+        int fat_free = read_fat(ca, fs) == FAT_CLUSTER_FREE;
+        free_clusters += fat_free;
+        if (fat_free != map_free[ca] && mismatches++ < 5) {
+            fprintf(stderr, "ERROR! %s: cluster %u is %s in the FAT, but not in the map!\n", stage, ca, fat_free ? "free" : "used");
+        }
+    }
+
+    free(map_free);
+    fprintf(stdout, "%s: %i free clusters, %i mismatches\n", stage, free_clusters, mismatches);
+    return !mismatches;
+}
+
+static int _damage_free_map(fat_data_t* fs) {
+    unsigned char garbage[64];
+    memset(garbage, 0x5A, sizeof(garbage));
+    off_t position = (off_t)(GET_FREEMAPSECTOR(fs->total_sectors, FREEMAP_SECTORS(fs)) + 1) * sector_size;
+    return pwrite(disk_fd, garbage, sizeof(garbage), position) == sizeof(garbage);
+}
+
+int main() {
+#ifndef NO_CREATION
+    nifat32_params_t params;
+    if (!setup_nifat32(&params)) return EXIT_FAILURE;
+
+    fat_data_t fs;
+    NIFAT32_get_fs_data(&fs);
+    if (!fs.free_map) {
+        fprintf(stdout, "The volume has no free map area. Format it with --free-map.\n");
+        NIFAT32_unload();
+        return EXIT_SUCCESS;
+    }
+
+    NIFAT32_unload();
+    if (_mount(&params, CACHE | MAP_CACHE) < 0) return EXIT_FAILURE;
+    for (int f = 0; f < TEST_FILES; f++) {
+        if (!_write_file(f, &fs)) return EXIT_FAILURE;
+    }
+
+    for (int f = 0; f < TEST_FILES; f += 2) {
+        char path[32];
+        snprintf(path, sizeof(path), "fmap/f%i.bin", f);
+        ci_t ci = nifat32_open_test(NO_RCI, path, DF_MODE, SUCCESS);
+        if (ci < 0 || !NIFAT32_delete_content(ci)) return EXIT_FAILURE;
+    }
+
+    NIFAT32_unload();
+    int clean_reads = _mount(&params, CACHE | MAP_CACHE);
+    if (clean_reads < 0 || !_check_map("Clean mount", &fs)) return EXIT_FAILURE;
+
+    for (int f = 0; f < TEST_FILES; f += 2) {
+        if (!_write_file(f, &fs)) return EXIT_FAILURE;
+    }
+
+    _crash();
+    int dirty_reads = _mount(&params, CACHE | MAP_CACHE);
+    if (dirty_reads < 0 || !_check_map("Unclean mount", &fs)) return EXIT_FAILURE;
+
+    NIFAT32_unload();
+    if (!_damage_free_map(&fs)) {
+        fprintf(stderr, "Can't damage the free map!\n");
+        return EXIT_FAILURE;
+    }
+
+    int damaged_reads = _mount(&params, CACHE | MAP_CACHE);
+    if (damaged_reads < 0 || !_check_map("Damaged map mount", &fs)) return EXIT_FAILURE;
+    for (int f = 0; f < TEST_FILES; f++) {
+        if (!_check_file(f, &fs)) return EXIT_FAILURE;
+    }
+
+    /* The stored map is clean, then a mount without the map writes a file. */
+    NIFAT32_unload();
+    if (_mount(&params, CACHE) < 0 || !_write_file_sized(TEST_FILES, TEST_MIXED_CLUSTERS, &fs)) return EXIT_FAILURE;
+    NIFAT32_unload();
+    if (_mount(&params, CACHE | MAP_CACHE) < 0 || !_check_map("Mount after a mount without the map", &fs)) return EXIT_FAILURE;
+    for (int f = TEST_FILES + 1; f < TEST_FILES + 5; f++) {
+        if (!_write_file(f, &fs)) return EXIT_FAILURE;
+    }
+
+    if (!_check_file_sized(TEST_FILES, TEST_MIXED_CLUSTERS, &fs)) {
+        fprintf(stderr, "ERROR! New files took clusters of the file, written without the map!\n");
+        return EXIT_FAILURE;
+    }
+
+    /* The clean area can't be marked dirty, thus a new file can't take clusters. */
+    NIFAT32_unload();
+    if (_mount(&params, CACHE | MAP_CACHE) < 0) return EXIT_FAILURE;
+    failing_sector = GET_FREEMAPSECTOR(fs.total_sectors, FREEMAP_SECTORS(&fs));
+    ci_t refused = NIFAT32_open_content(NO_RCI, "fmap/refused.bin", MODE(CR_MODE | W_MODE | R_MODE, FILE_TARGET));
+    if (refused >= 0) {
+        unsigned char block[512] = { 0 };
+        NIFAT32_write_buffer2content(refused, 0, (const_buffer_t)block, sizeof(block));
+        NIFAT32_close_content(refused);
+    }
+
+    failing_sector = 0;
+    _crash();
+    if (_mount(&params, CACHE | MAP_CACHE) < 0 || !_check_map("Mount after a failed dirty mark", &fs)) return EXIT_FAILURE;
+
+    /* FAT writes fail, thus the cache and the map should keep clusters of the deleted file. */
+    NIFAT32_unload();
+    if (_mount(&params, CACHE | MAP_CACHE) < 0) return EXIT_FAILURE;
+    failing_fat = &fs;
+    ci_t victim = NIFAT32_open_content(NO_RCI, "fmap/f1.bin", DF_MODE);
+    if (victim >= 0) NIFAT32_delete_content(victim);
+    failing_fat = NULL;
+    if (!_check_map("After a failed FAT write", &fs)) return EXIT_FAILURE;
+    NIFAT32_unload();
+    if (_mount(&params, CACHE | MAP_CACHE) < 0 || !_check_map("Mount after a failed FAT write", &fs)) return EXIT_FAILURE;
+
+    fprintf(stdout, "\n==== Free Map Summary (%u clusters) ====\n", fs.total_clusters);
+    fprintf(stdout, "Clean mount reads:   %i\n", clean_reads);
+    fprintf(stdout, "Unclean mount reads: %i\n", dirty_reads);
+    fprintf(stdout, "Damaged mount reads: %i\n", damaged_reads);
+#ifndef NO_FAT_MAP
+    if (clean_reads >= dirty_reads || clean_reads >= damaged_reads) {
+        fprintf(stderr, "ERROR! The clean mount scanned the FAT!\n");
+        return EXIT_FAILURE;
+    }
+#endif
+
+    NIFAT32_unload();
+#endif
+
+    return EXIT_SUCCESS;
+}
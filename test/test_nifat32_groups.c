@@ -0,0 +1,129 @@
+/*
+Allocation groups test. Write several files by clusters in turn. Every new file takes its
+own allocation group, thus chains shouldn't mix, and every file should take a few runs.
+A reserved chain bigger than a group should spill to other groups.
+*/
+#include "nifat32_test.h"
+
+#define TEST_FILES    4
+#define TEST_CLUSTERS 96
+#define TEST_RUNS_MAX 2
+
+static unsigned char _pattern(int file, int position) {
+    return (unsigned char)(position * 3 + file * 101 + (position >> 12));
+}
+
+static int _chain_runs(ci_t ci, int* length, fat_data_t* fs) {
+    int runs = 0;
+    *length = 0;
+    cluster_addr_t prev = FAT_CLUSTER_BAD;
+    for (cluster_addr_t ca = get_content_data_ca(ci); !is_cluster_end(ca) && !is_cluster_bad(ca); ca = read_fat(ca, fs)) {
+        if (ca != prev + 1) runs++;
+        prev = ca;
+        (*length)++;
+    }
+
+    return runs;
+}
+
+int main() {
+#ifndef NO_CREATION
+    nifat32_params_t params;
+    if (!setup_nifat32(&params)) return EXIT_FAILURE;
+    NIFAT32_unload();
+    params.fat_cache = CACHE | HARD_CACHE | MAP_CACHE;
+    if (!NIFAT32_init(&params)) {
+        fprintf(stderr, "NIFAT32_init() error!\n");
+        return EXIT_FAILURE;
+    }
+
+    fat_data_t fs;
+    NIFAT32_get_fs_data(&fs);
+    int cs = fs.cluster_size;
+    unsigned char* cluster = (unsigned char*)malloc(cs);
+
+    ci_t files[TEST_FILES];
+    for (int f = 0; f < TEST_FILES; f++) {
+        char path[32];
+        snprintf(path, sizeof(path), "groups/f%i.bin", f);
+        files[f] = nifat32_open_test(NO_RCI, path, MODE(CR_MODE | W_MODE | R_MODE, FILE_TARGET), SUCCESS);
+        if (files[f] < 0) return EXIT_FAILURE;
+    }
+
+    for (int c = 0; c < TEST_CLUSTERS; c++) {
+        for (int f = 0; f < TEST_FILES; f++) {
+            for (int i = 0; i < cs; i++) cluster[i] = _pattern(f, c * cs + i);
+            if (NIFAT32_write_buffer2content(files[f], c * cs, (const_buffer_t)cluster, cs) != cs) {
+                fprintf(stderr, "ERROR! Write of cluster %i to file %i failed!\n", c, f);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    for (int f = 0; f < TEST_FILES; f++) {
+        int length = 0;
+        int runs = _chain_runs(files[f], &length, &fs);
+        fprintf(stdout, "File %i: %i clusters in %i runs from ca=%u\n", f, length, runs, get_content_data_ca(files[f]));
+        if (length != TEST_CLUSTERS) {
+            fprintf(stderr, "ERROR! File %i has %i clusters!\n", f, length);
+            return EXIT_FAILURE;
+        }
+
+#ifndef NO_FAT_MAP
+        if (runs > TEST_RUNS_MAX) {
+            fprintf(stderr, "ERROR! Chains of interleaved writers are mixed!\n");
+            return EXIT_FAILURE;
+        }
+#endif
+
+        NIFAT32_close_content(files[f]);
+    }
+
+    /*
+    The reserved chain is bigger than a group, thus it spills to other groups. The chain
+    isn't written, because data over the whole volume would hit hashed metadata.
+    */
+    int spill = fs.total_clusters / 2;
+    ci_t rci = nifat32_open_test(NO_RCI, "groups", DF_MODE, SUCCESS);
+    if (rci < 0) return EXIT_FAILURE;
+    cinfo_t info = { .type = STAT_FILE, .full_name = "SPILL   BIN" };
+    if (!NIFAT32_put_content(rci, &info, spill)) {
+        fprintf(stderr, "ERROR! NIFAT32_put_content error!\n");
+        return EXIT_FAILURE;
+    }
+
+    NIFAT32_close_content(rci);
+    ci_t sci = nifat32_open_test(NO_RCI, "groups/spill.bin", DF_MODE, SUCCESS);
+    if (sci < 0) return EXIT_FAILURE;
+    int spill_length = 0;
+    int spill_runs = _chain_runs(sci, &spill_length, &fs);
+    fprintf(stdout, "Spill file: %i clusters in %i runs\n", spill_length, spill_runs);
+    if (spill_length != spill || !NIFAT32_delete_content(sci)) {
+        fprintf(stderr, "ERROR! Spill file has %i clusters, expected %i!\n", spill_length, spill);
+        return EXIT_FAILURE;
+    }
+
+    NIFAT32_unload();
+    if (!NIFAT32_init(&params)) {
+        fprintf(stderr, "NIFAT32_init() error!\n");
+        return EXIT_FAILURE;
+    }
+
+    int size = TEST_CLUSTERS * cs;
+    unsigned char* data = (unsigned char*)malloc(size);
+    for (int f = 0; f < TEST_FILES; f++) {
+        char path[32];
+        snprintf(path, sizeof(path), "groups/f%i.bin", f);
+        for (int i = 0; i < size; i++) data[i] = _pattern(f, i);
+        ci_t ci = nifat32_open_test(NO_RCI, path, DF_MODE, SUCCESS);
+        if (ci < 0 || !nifate32_read_and_compare_alloc(ci, 0, (const_buffer_t)data, size, SUCCESS)) return EXIT_FAILURE;
+        NIFAT32_close_content(ci);
+    }
+
+    free(data);
+    NIFAT32_unload();
+    free(cluster);
+#endif
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,199 @@
+/*
+Hamming test. Will compare the table-driven codec with the bit-by-bit reference codec
+for every byte and for every codeword with zero or one flipped bit. Every Hamming
+kernel supported by the CPU (scalar, SSE2, AVX2, BMI2) is checked, including the count
+of corrected codewords. The SECDED 39,32 codec is checked for single bit correction
+and double bit detection.
+*/
+#include "nifat32_test.h"
+#include <std/secded.h>
+
+static encoded_t _reference_encode(decoded_t data) {
+    encoded_t encoded = 0;
+    encoded = SET_BIT(encoded, 2, GET_BIT(data, 0));
+    encoded = SET_BIT(encoded, 4, GET_BIT(data, 1));
+    encoded = SET_BIT(encoded, 5, GET_BIT(data, 2));
+    encoded = SET_BIT(encoded, 6, GET_BIT(data, 3));
+    encoded = SET_BIT(encoded, 8, GET_BIT(data, 4));
+    encoded = SET_BIT(encoded, 9, GET_BIT(data, 5));
+    encoded = SET_BIT(encoded, 10, GET_BIT(data, 6));
+    encoded = SET_BIT(encoded, 11, GET_BIT(data, 7));
+
+    byte_t p1 = GET_BIT(encoded, 2) ^ GET_BIT(encoded, 4) ^ GET_BIT(encoded, 6) ^ GET_BIT(encoded, 8) ^ GET_BIT(encoded, 10) ^ GET_BIT(encoded, 12) ^ GET_BIT(encoded, 14);
+    byte_t p2 = GET_BIT(encoded, 2) ^ GET_BIT(encoded, 5) ^ GET_BIT(encoded, 6) ^ GET_BIT(encoded, 9) ^ GET_BIT(encoded, 10) ^ GET_BIT(encoded, 13) ^ GET_BIT(encoded, 14);
+    byte_t p4 = GET_BIT(encoded, 4) ^ GET_BIT(encoded, 5) ^ GET_BIT(encoded, 6) ^ GET_BIT(encoded, 11) ^ GET_BIT(encoded, 12) ^ GET_BIT(encoded, 13) ^ GET_BIT(encoded, 14);
+    byte_t p8 = GET_BIT(encoded, 8) ^ GET_BIT(encoded, 9) ^ GET_BIT(encoded, 10) ^ GET_BIT(encoded, 11) ^ GET_BIT(encoded, 12) ^ GET_BIT(encoded, 13) ^ GET_BIT(encoded, 14);
+
+    encoded = SET_BIT(encoded, 0, p1);
+    encoded = SET_BIT(encoded, 1, p2);
+    encoded = SET_BIT(encoded, 3, p4);
+    encoded = SET_BIT(encoded, 7, p8);
+    return encoded;
+}
+
+static byte_t _reference_decode(encoded_t encoded) {
+    byte_t s1 = GET_BIT(encoded, 0) ^ GET_BIT(encoded, 2) ^ GET_BIT(encoded, 4) ^ GET_BIT(encoded, 6) ^ GET_BIT(encoded, 8) ^ GET_BIT(encoded, 10) ^ GET_BIT(encoded, 12) ^ GET_BIT(encoded, 14);
+    byte_t s2 = GET_BIT(encoded, 1) ^ GET_BIT(encoded, 2) ^ GET_BIT(encoded, 5) ^ GET_BIT(encoded, 6) ^ GET_BIT(encoded, 9) ^ GET_BIT(encoded, 10) ^ GET_BIT(encoded, 13) ^ GET_BIT(encoded, 14);
+    byte_t s4 = GET_BIT(encoded, 3) ^ GET_BIT(encoded, 4) ^ GET_BIT(encoded, 5) ^ GET_BIT(encoded, 6) ^ GET_BIT(encoded, 11) ^ GET_BIT(encoded, 12) ^ GET_BIT(encoded, 13) ^ GET_BIT(encoded, 14);
+    byte_t s8 = GET_BIT(encoded, 7) ^ GET_BIT(encoded, 8) ^ GET_BIT(encoded, 9) ^ GET_BIT(encoded, 10) ^ GET_BIT(encoded, 11) ^ GET_BIT(encoded, 12) ^ GET_BIT(encoded, 13) ^ GET_BIT(encoded, 14);
+    byte_t error_pos = s1 + (s2 << 1) + (s4 << 2) + (s8 << 3);
+    if (error_pos) encoded = TOGGLE_BIT(encoded, (error_pos - 1));
+
+    byte_t data = 0;
+    data = SET_BIT(data, 0, GET_BIT(encoded, 2));
+    data = SET_BIT(data, 1, GET_BIT(encoded, 4));
+    data = SET_BIT(data, 2, GET_BIT(encoded, 5));
+    data = SET_BIT(data, 3, GET_BIT(encoded, 6));
+    data = SET_BIT(data, 4, GET_BIT(encoded, 8));
+    data = SET_BIT(data, 5, GET_BIT(encoded, 9));
+    data = SET_BIT(data, 6, GET_BIT(encoded, 10));
+    data = SET_BIT(data, 7, GET_BIT(encoded, 11));
+    return data;
+}
+
+static int _check_kernel(int kernel) {
+    byte_t bytes[256];
+    encoded_t codewords[256];
+    for (int i = 0; i < 256; i++) bytes[i] = (byte_t)i;
+    nft32_pack_memory(bytes, codewords, 256);
+    for (int i = 0; i < 256; i++) {
+        if (codewords[i] != _reference_encode(i)) {
+            fprintf(stderr, "ERROR! [kernel=%i] Encode mismatch for byte=0x%x: 0x%x != 0x%x\n", kernel, i, codewords[i], _reference_encode(i));
+            return 0;
+        }
+    }
+
+    static encoded_t all_codewords[1 << 16];
+    static byte_t decoded[1 << 16];
+    for (int i = 0; i < (1 << 16); i++) all_codewords[i] = (encoded_t)i;
+    nft32_unpack_memory(all_codewords, decoded, 1 << 16);
+    for (int i = 0; i < (1 << 16); i++) {
+        if (decoded[i] != _reference_decode((encoded_t)i)) {
+            fprintf(stderr, "ERROR! [kernel=%i] Decode mismatch for codeword=0x%x: 0x%x != 0x%x\n", kernel, i, decoded[i], _reference_decode(i));
+            return 0;
+        }
+    }
+
+    for (int i = 0; i < 256; i++) {
+        for (int bit = 0; bit < 15; bit++) {
+            encoded_t flipped = TOGGLE_BIT(codewords[i], bit);
+            byte_t restored = 0;
+            nft32_unpack_memory(&flipped, &restored, 1);
+            if (restored != i) {
+                fprintf(stderr, "ERROR! [kernel=%i] Single bit error wasn't corrected! byte=0x%x, bit=%i\n", kernel, i, bit);
+                return 0;
+            }
+        }
+    }
+
+    /* Unaligned lengths and offsets for the kernel tails. */
+    for (int l = 1; l < 80; l++) {
+        byte_t restored[80] = { 0 };
+        nft32_pack_memory(bytes + 3, codewords + 1, l);
+        for (int i = 0; i < l; i++) codewords[1 + i] = TOGGLE_BIT(codewords[1 + i], (i + l) % 15);
+        nft32_unpack_memory(codewords + 1, restored + 1, l);
+        if (restored[0] || memcmp(restored + 1, bytes + 3, l)) {
+            fprintf(stderr, "ERROR! [kernel=%i] Tail mismatch for length=%i\n", kernel, l);
+            return 0;
+        }
+    }
+
+    /* Corrected codewords telemetry. One flipped bit at the position p and at the last codeword. */
+    for (int p = 0; p < 79; p++) {
+        int first = 0;
+        byte_t restored[80] = { 0 };
+        nft32_pack_memory(bytes, codewords, 80);
+        if (nft32_unpack_memory_count(codewords, restored, 80, &first) != 0 || first != -1) {
+            fprintf(stderr, "ERROR! [kernel=%i] Corrections in the clean data!\n", kernel);
+            return 0;
+        }
+
+        codewords[p] = TOGGLE_BIT(codewords[p], p % 15);
+        codewords[79] = TOGGLE_BIT(codewords[79], 3);
+        int corrected = nft32_unpack_memory_count(codewords, restored, 80, &first);
+        if (corrected != 2 || first != p || memcmp(restored, bytes, 80)) {
+            fprintf(stderr, "ERROR! [kernel=%i] Wrong corrections count=%i, first=%i, p=%i\n", kernel, corrected, first, p);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int _check_secded() {
+    if (!nft32_ecc_setup(ECC_SECDED_39_32)) return 0;
+    if (nft32_ecc_encoded_size(sizeof(cluster_val_t)) != SECDED_ENCODED_BLOCK) {
+        fprintf(stderr, "ERROR! [secded] Wrong encoded size=%i\n", nft32_ecc_encoded_size(sizeof(cluster_val_t)));
+        return 0;
+    }
+
+    srand(0x5EC);
+    for (int w = 0; w < 1000; w++) {
+        unsigned int word = ((unsigned int)rand() << 16) ^ (unsigned int)rand();
+        byte_t encoded[SECDED_ENCODED_BLOCK] = { 0 };
+        unsigned int restored = 0;
+        nft32_ecc_pack((const byte_t*)&word, encoded, sizeof(word));
+        if (nft32_ecc_unpack(encoded, (byte_t*)&restored, sizeof(word), NULL) || restored != word) {
+            fprintf(stderr, "ERROR! [secded] Clean decode mismatch for word=0x%x\n", word);
+            return 0;
+        }
+
+        for (int a = 0; a < 39; a++) {
+            byte_t flipped[SECDED_ENCODED_BLOCK];
+            memcpy(flipped, encoded, sizeof(flipped));
+            flipped[a / 8] ^= 1 << (a % 8);
+            if (nft32_ecc_unpack(flipped, (byte_t*)&restored, sizeof(word), NULL) != 1 || restored != word) {
+                fprintf(stderr, "ERROR! [secded] Single bit error wasn't corrected! word=0x%x, bit=%i\n", word, a);
+                return 0;
+            }
+
+            for (int b = a + 1; b < 39; b++) {
+                flipped[b / 8] ^= 1 << (b % 8);
+                if (nft32_ecc_unpack(flipped, (byte_t*)&restored, sizeof(word), NULL) != 1) {
+                    fprintf(stderr, "ERROR! [secded] Double bit error wasn't detected! word=0x%x, bits=%i,%i\n", word, a, b);
+                    return 0;
+                }
+
+                flipped[b / 8] ^= 1 << (b % 8);
+            }
+        }
+    }
+
+    /* Lengths that aren't multiple of the data block. Tail is padded with zeros. */
+    byte_t bytes[80];
+    for (int i = 0; i < 80; i++) bytes[i] = (byte_t)(i * 7 + 1);
+    for (int l = 1; l < 80; l++) {
+        byte_t encoded[ECC_MAX_ENCODED_SIZE(80)] = { 0 };
+        byte_t restored[81] = { 0 };
+        nft32_ecc_pack(bytes, encoded, l);
+        encoded[nft32_ecc_encoded_size(l) - 1] ^= 0x10;
+
+        int first = 0;
+        if (nft32_ecc_unpack(encoded, restored, l, &first) != 1 || restored[l] || memcmp(restored, bytes, l)) {
+            fprintf(stderr, "ERROR! [secded] Tail mismatch for length=%i\n", l);
+            return 0;
+        }
+
+        if (first != (l - 1) / SECDED_DATA_BLOCK) {
+            fprintf(stderr, "ERROR! [secded] Wrong first block=%i for length=%i\n", first, l);
+            return 0;
+        }
+    }
+
+    return nft32_ecc_setup(ECC_HAMMING_15_11);
+}
+
+int main() {
+    int kernels[] = { HAMMING_KERNEL_SCALAR, HAMMING_KERNEL_SSE2, HAMMING_KERNEL_AVX2, HAMMING_KERNEL_BMI2 };
+    for (int i = 0; i < (int)(sizeof(kernels) / sizeof(kernels[0])); i++) {
+        if (!nft32_hamming_setup(kernels[i])) {
+            fprintf(stdout, "Kernel %i isn't supported, skip\n", kernels[i]);
+            continue;
+        }
+
+        if (!_check_kernel(kernels[i])) return EXIT_FAILURE;
+    }
+
+    if (!_check_secded()) return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
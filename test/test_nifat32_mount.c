@@ -0,0 +1,111 @@
+/*
+Mount benchmark. Measure the HARD_CACHE mount, the hard load split between threads,
+and the per-entry load that was used by the hard load before. Check that every load
+gives the same table, even when two FAT copies are damaged.
+*/
+#include <pthread.h>
+#include "nifat32_test.h"
+
+#define LOAD_THREADS 4
+
+nifat32_timer_t hard_mount_timer;
+nifat32_timer_t thread_load_timer;
+nifat32_timer_t entry_load_timer;
+
+static int _damage_fat_entry(fat_data_t* fs, int fat, cluster_addr_t ca, unsigned char noise) {
+    int encoded_size = nft32_ecc_encoded_size(sizeof(cluster_val_t));
+    off_t position = (off_t)(fs->sectors_padd + GET_FATSECTOR(fat, fs->total_sectors)) * sector_size + (off_t)ca * encoded_size;
+    unsigned char garbage[ECC_MAX_ENCODED_SIZE(sizeof(cluster_val_t))];
+    memset(garbage, noise, sizeof(garbage));
+    return pwrite(disk_fd, garbage, encoded_size, position) == encoded_size;
+}
+
+/*
+Remount with the provided cache mode. Two FAT copies of one entry are damaged before the mount.
+*/
+static int _remount(nifat32_params_t* params, unsigned char fat_cache, fat_data_t* fs) {
+    NIFAT32_unload();
+    cluster_addr_t damaged = fs->ext_root_cluster + 1;
+    if (!_damage_fat_entry(fs, 1, damaged, 0x5A) || !_damage_fat_entry(fs, 2, damaged, 0xA5)) {
+        fprintf(stderr, "Can't damage FAT entry!\n");
+        return 0;
+    }
+
+    params->fat_cache = fat_cache;
+    return NIFAT32_init(params);
+}
+
+static void* _load_part(void* arg) {
+    NIFAT32_hload_fat((int)(long)arg, LOAD_THREADS);
+    return NULL;
+}
+
+int main(int argc, char* argv[]) {
+#ifndef NO_CREATION
+    if (argc < 2) {
+        fprintf(stderr, "Test count requiered!\nUsage:%s <count>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    nifat32_params_t params;
+    if (!setup_nifat32(&params)) return EXIT_FAILURE;
+
+    fat_data_t fs;
+    NIFAT32_get_fs_data(&fs);
+    for (int i = 0; i < 8; i++) {
+        char path[32];
+        snprintf(path, sizeof(path), "mnt/file%i.bin", i);
+        ci_t ci = nifat32_open_test(NO_RCI, path, (CR_MODE | W_MODE | R_MODE | FILE_TARGET), SUCCESS);
+        if (ci < 0) return EXIT_FAILURE;
+        unsigned char* data = (unsigned char*)calloc(fs.cluster_size, i + 1);
+        NIFAT32_write_buffer2content(ci, 0, (const_buffer_t)data, fs.cluster_size * (i + 1));
+        NIFAT32_close_content(ci);
+        free(data);
+    }
+
+    if (!_remount(&params, NO_CACHE, &fs)) return EXIT_FAILURE;
+    cluster_val_t* expected = (cluster_val_t*)malloc(fs.total_clusters * sizeof(cluster_val_t));
+    add_time2timer(MEASURE_TIME_US({
+        for (cluster_addr_t ca = fs.ext_root_cluster; ca < fs.total_clusters; ca++) expected[ca] = read_fat(ca, &fs);
+    }), &entry_load_timer);
+
+    int count = atoi(argv[1]);
+    if (count > 20) count = 20;
+    for (int i = 0; i < count; i++) {
+        add_time2timer(MEASURE_TIME_US({
+            if (!_remount(&params, CACHE | HARD_CACHE, &fs)) return EXIT_FAILURE;
+        }), &hard_mount_timer);
+
+        for (cluster_addr_t ca = fs.ext_root_cluster; ca < fs.total_clusters; ca++) {
+            if (read_fat(ca, &fs) != expected[ca]) {
+                fprintf(stderr, "ERROR! Hard load value mismatch at ca=%u!\n", ca);
+                return EXIT_FAILURE;
+            }
+        }
+
+        if (!_remount(&params, CACHE, &fs)) return EXIT_FAILURE;
+        add_time2timer(MEASURE_TIME_US({
+            pthread_t workers[LOAD_THREADS];
+            for (long t = 0; t < LOAD_THREADS; t++) pthread_create(&workers[t], NULL, _load_part, (void*)t);
+            for (int t = 0; t < LOAD_THREADS; t++) pthread_join(workers[t], NULL);
+        }), &thread_load_timer);
+
+        for (cluster_addr_t ca = fs.ext_root_cluster; ca < fs.total_clusters; ca++) {
+            if (read_fat(ca, &fs) != expected[ca]) {
+                fprintf(stderr, "ERROR! Threaded load value mismatch at ca=%u!\n", ca);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    NIFAT32_unload();
+    free(expected);
+
+    fprintf(stdout, "\n==== Mount Summary (%u clusters, %i FATs) ====\n", fs.total_clusters, fs.fat_count);
+    fprintf(stdout, "Per-entry FAT load:        %.2f µs\n", get_avg_timer(&entry_load_timer));
+    fprintf(stdout, "HARD_CACHE mount:          %.2f µs\n", get_avg_timer(&hard_mount_timer));
+    fprintf(stdout, "Hard load by %i threads:    %.2f µs\n", LOAD_THREADS, get_avg_timer(&thread_load_timer));
+#endif
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,162 @@
+/*
+Range lock test. Threads read and write ranges of a RAM disk through the disk layer. The platform
+callbacks sleep, thus many ranges are in flight at once. Every callback checks, that no writer
+overlaps its range (and no reader overlaps a write). There should be no failed operation:
+waiters wait instead of failing. The hot phase puts every thread to a few sectors.
+*/
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include "nifat32_test.h"
+
+#define TEST_SECTORS     4096
+#define TEST_SECTOR_SIZE 512
+#define TEST_THREADS     128
+#define TEST_ROUNDS      40
+#define TEST_RANGE_MAX   16
+#define TEST_HOT_SECTORS 24
+#define TEST_DELAY_US    200
+
+static unsigned char* disk = NULL;
+static volatile int readers[TEST_SECTORS];
+static volatile int writers[TEST_SECTORS];
+static volatile int in_flight = 0;
+static volatile int peak_in_flight = 0;
+static volatile int peak_readers = 0;
+static volatile int violations = 0;
+static volatile int failures = 0;
+
+static void _enter(sector_addr_t sa, int sc, int write) {
+    int now = __sync_add_and_fetch(&in_flight, 1);
+    for (int peak = peak_in_flight; now > peak; peak = peak_in_flight) __sync_bool_compare_and_swap(&peak_in_flight, peak, now);
+    for (int s = 0; s < sc; s++) {
+        if (write) {
+            if (__sync_add_and_fetch(&writers[sa + s], 1) != 1 || readers[sa + s]) __sync_fetch_and_add(&violations, 1);
+        }
+        else {
+            int r = __sync_add_and_fetch(&readers[sa + s], 1);
+            for (int peak = peak_readers; r > peak; peak = peak_readers) __sync_bool_compare_and_swap(&peak_readers, peak, r);
+            if (writers[sa + s]) __sync_fetch_and_add(&violations, 1);
+        }
+    }
+}
+
+static void _leave(sector_addr_t sa, int sc, int write) {
+    for (int s = 0; s < sc; s++) __sync_fetch_and_sub(write ? &writers[sa + s] : &readers[sa + s], 1);
+    __sync_fetch_and_sub(&in_flight, 1);
+}
+
+static int _range_sectors(sector_offset_t offset, int size) {
+    return (offset % TEST_SECTOR_SIZE + size + TEST_SECTOR_SIZE - 1) / TEST_SECTOR_SIZE;
+}
+
+static int _ram_read(sector_addr_t sa, sector_offset_t offset, unsigned char* buffer, int size) {
+    int sc = _range_sectors(offset, size);
+    sa += offset / TEST_SECTOR_SIZE;
+    _enter(sa, sc, 0);
+    usleep(TEST_DELAY_US);
+    memcpy(buffer, disk + sa * TEST_SECTOR_SIZE + offset % TEST_SECTOR_SIZE, size);
+    _leave(sa, sc, 0);
+    return 1;
+}
+
+static int _ram_write(sector_addr_t sa, sector_offset_t offset, const unsigned char* data, int size) {
+    int sc = _range_sectors(offset, size);
+    sa += offset / TEST_SECTOR_SIZE;
+    _enter(sa, sc, 1);
+    usleep(TEST_DELAY_US);
+    memcpy(disk + sa * TEST_SECTOR_SIZE + offset % TEST_SECTOR_SIZE, data, size);
+    _leave(sa, sc, 1);
+    return 1;
+}
+
+/* threading.h defines an empty sched_yield() macro, thus the libc function is called by the name. */
+static void _yield() {
+    (sched_yield)();
+}
+
+typedef struct {
+    int          thread;
+    unsigned int span;
+} worker_t;
+
+static void* _worker(void* arg) {
+    worker_t* w = (worker_t*)arg;
+    unsigned int seed = 31 + w->thread;
+    unsigned char buffer[TEST_RANGE_MAX * TEST_SECTOR_SIZE];
+    for (int r = 0; r < TEST_ROUNDS; r++) {
+        int sc = 1 + rand_r(&seed) % (w->span < TEST_RANGE_MAX ? w->span / 4 : TEST_RANGE_MAX);
+        sector_addr_t sa = rand_r(&seed) % (w->span - sc + 1);
+        int result;
+        if (rand_r(&seed) % 4) result = DSK_readoff_run(sa, 0, buffer, sc * TEST_SECTOR_SIZE, sc);
+        else {
+            memset(buffer, w->thread, sc * TEST_SECTOR_SIZE);
+            result = DSK_writeoff_run(sa, 0, buffer, sc * TEST_SECTOR_SIZE, sc);
+        }
+
+        if (!result) __sync_fetch_and_add(&failures, 1);
+    }
+
+    return NULL;
+}
+
+static void _phase(const char* name, unsigned int span) {
+    in_flight = peak_in_flight = peak_readers = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pthread_t threads[TEST_THREADS];
+    worker_t workers[TEST_THREADS];
+    for (int t = 0; t < TEST_THREADS; t++) {
+        workers[t].thread = t;
+        workers[t].span   = span;
+        pthread_create(&threads[t], NULL, _worker, &workers[t]);
+    }
+
+    for (int t = 0; t < TEST_THREADS; t++) pthread_join(threads[t], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(
+        stdout, "%-6s %4u sectors: %8.0f ops/s, peak %i ranges in flight, peak %i readers of a sector\n",
+        name, span, TEST_THREADS * TEST_ROUNDS / seconds, peak_in_flight, peak_readers
+    );
+}
+
+int main() {
+    disk = (unsigned char*)calloc(TEST_SECTORS, TEST_SECTOR_SIZE);
+    disk_io_t io = {
+        .read_sector   = _ram_read,
+        .write_sector  = _ram_write,
+        .sector_size   = TEST_SECTOR_SIZE,
+        .read_sectors  = _ram_read,
+        .write_sectors = _ram_write,
+        .readv         = NULL,
+        .writev        = NULL,
+        .wait          = _yield
+    };
+
+    if (!DSK_setup(&io)) {
+        fprintf(stderr, "DSK_setup() error!\n");
+        return EXIT_FAILURE;
+    }
+
+    fprintf(stdout, "\n==== Range Lock Summary (%i threads, %i rounds, %i us per io) ====\n", TEST_THREADS, TEST_ROUNDS, TEST_DELAY_US);
+    _phase("Spread", TEST_SECTORS);
+    int spread_peak = peak_in_flight;
+    _phase("Hot", TEST_HOT_SECTORS);
+    fprintf(stdout, "Failed operations: %i\n", failures);
+    fprintf(stdout, "Overlap violations: %i\n", violations);
+    if (failures || violations) {
+        fprintf(stderr, "ERROR! Ranges were failed or overlapped!\n");
+        return EXIT_FAILURE;
+    }
+
+    if (spread_peak <= TEST_THREADS / 4) {
+        fprintf(stderr, "ERROR! Only %i ranges were in flight!\n", spread_peak);
+        return EXIT_FAILURE;
+    }
+
+    free(disk);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,137 @@
+/*
+Read-ahead test. Read a file by small chunks forward (sequential) and backward (random for the
+read-ahead). Data should be the same, and the forward read should make fewer platform calls.
+Chunks that cross cluster borders should be read right, and a write by another content should
+drop the buffered window.
+*/
+#include "nifat32_test.h"
+
+#define TEST_CLUSTERS 24
+#define TEST_CHUNK    512
+#define TEST_ODD      1000
+
+static int io_calls = 0;
+
+static int _counting_sector_read(sector_addr_t sa, sector_offset_t offset, buffer_t buffer, int buff_size) {
+    io_calls++;
+    return _mock_sector_read_(sa, offset, buffer, buff_size);
+}
+
+static int _counting_readv(const disk_iovec_t* iov, int count) {
+    io_calls++;
+    return _mock_readv_(iov, count);
+}
+
+static unsigned char _pattern(int round, int position) {
+    return (unsigned char)(position * 13 + round * 71 + (position >> 9));
+}
+
+/*
+Read the file by chunks in the provided direction and compare with the pattern.
+Returns count of platform calls, or -1 on a data error.
+*/
+static int _read_chunks(char* path, int round, int size, int chunk, int forward) {
+    ci_t ci = nifat32_open_test(NO_RCI, path, DF_MODE, SUCCESS);
+    if (ci < 0) return -1;
+
+    io_calls = 0;
+    int chunks = (size + chunk - 1) / chunk;
+    unsigned char buffer[TEST_ODD];
+    for (int c = 0; c < chunks; c++) {
+        int offset = (forward ? c : chunks - 1 - c) * chunk;
+        int part = size - offset < chunk ? size - offset : chunk;
+        if (NIFAT32_read_content2buffer(ci, offset, (buffer_t)buffer, part) != part) {
+            fprintf(stderr, "ERROR! NIFAT32_read_content2buffer read less data at %i!\n", offset);
+            return -1;
+        }
+
+        for (int i = 0; i < part; i++) {
+            if (buffer[i] != _pattern(round, offset + i)) {
+                fprintf(stderr, "ERROR! Data mismatch at %i!\n", offset + i);
+                return -1;
+            }
+        }
+    }
+
+    NIFAT32_close_content(ci);
+    return io_calls;
+}
+
+int main() {
+#ifndef NO_CREATION
+    nifat32_params_t params;
+    if (!setup_nifat32(&params)) return EXIT_FAILURE;
+
+    NIFAT32_unload();
+    params.disk_io.read_sector  = _counting_sector_read;
+    params.disk_io.read_sectors = _counting_sector_read;
+    params.disk_io.readv        = _counting_readv;
+    if (!NIFAT32_init(&params)) {
+        fprintf(stderr, "NIFAT32_init() error!\n");
+        return EXIT_FAILURE;
+    }
+
+    fat_data_t fs;
+    NIFAT32_get_fs_data(&fs);
+    int size = fs.cluster_size * TEST_CLUSTERS;
+    unsigned char* data = (unsigned char*)malloc(size);
+    for (int i = 0; i < size; i++) data[i] = _pattern(0, i);
+
+    char path[] = "ra/data.bin";
+    ci_t ci = nifat32_open_test(NO_RCI, path, MODE(CR_MODE | W_MODE | R_MODE, FILE_TARGET), SUCCESS);
+    if (ci < 0) return EXIT_FAILURE;
+    if (NIFAT32_write_buffer2content(ci, 0, (const_buffer_t)data, size) != size) {
+        fprintf(stderr, "ERROR! NIFAT32_write_buffer2content wrote less data!\n");
+        return EXIT_FAILURE;
+    }
+
+    NIFAT32_close_content(ci);
+
+    int forward  = _read_chunks(path, 0, size, TEST_CHUNK, 1);
+    int backward = _read_chunks(path, 0, size, TEST_CHUNK, 0);
+    int odd      = _read_chunks(path, 0, size, TEST_ODD, 1);
+    if (forward < 0 || backward < 0 || odd < 0) return EXIT_FAILURE;
+
+    /* The reader buffers a window, then the file is changed by another content. */
+    ci_t reader = nifat32_open_test(NO_RCI, path, DF_MODE, SUCCESS);
+    ci_t writer = nifat32_open_test(NO_RCI, path, MODE(W_MODE | R_MODE, FILE_TARGET), SUCCESS);
+    if (reader < 0 || writer < 0) return EXIT_FAILURE;
+
+    unsigned char buffer[TEST_CHUNK];
+    NIFAT32_read_content2buffer(reader, 0, (buffer_t)buffer, TEST_CHUNK);
+    NIFAT32_read_content2buffer(reader, TEST_CHUNK, (buffer_t)buffer, TEST_CHUNK);
+    for (int i = 0; i < size; i++) data[i] = _pattern(1, i);
+    if (NIFAT32_write_buffer2content(writer, 0, (const_buffer_t)data, size) != size) {
+        fprintf(stderr, "ERROR! NIFAT32_write_buffer2content wrote less data!\n");
+        return EXIT_FAILURE;
+    }
+
+    if (
+        NIFAT32_read_content2buffer(reader, 2 * TEST_CHUNK, (buffer_t)buffer, TEST_CHUNK) != TEST_CHUNK ||
+        memcmp(buffer, data + 2 * TEST_CHUNK, TEST_CHUNK)
+    ) {
+        fprintf(stderr, "ERROR! The read-ahead window wasn't dropped after the write!\n");
+        return EXIT_FAILURE;
+    }
+
+    NIFAT32_close_content(reader);
+    NIFAT32_close_content(writer);
+    if (_read_chunks(path, 1, size, TEST_CHUNK, 1) < 0) return EXIT_FAILURE;
+
+    fprintf(stdout, "\n==== Read-ahead Summary (%i clusters, %i bytes chunks, max window %i) ====\n", TEST_CLUSTERS, TEST_CHUNK, READ_AHEAD_MAX);
+    fprintf(stdout, "Forward:  %i calls\n", forward);
+    fprintf(stdout, "Backward: %i calls\n", backward);
+    fprintf(stdout, "Forward by %i bytes: %i calls\n", TEST_ODD, odd);
+#ifndef NIFAT32_NO_READAHEAD
+    if (forward * 4 >= backward) {
+        fprintf(stderr, "ERROR! Sequential reads weren't read ahead!\n");
+        return EXIT_FAILURE;
+    }
+#endif
+
+    NIFAT32_unload();
+    free(data);
+#endif
+
+    return EXIT_SUCCESS;
+}
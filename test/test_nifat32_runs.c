@@ -0,0 +1,116 @@
+/*
+Runs test. Write and read a file by one call and count disk transfers to the file clusters.
+Clusters of a fresh file follow each other on disk, thus the data should move by a few
+large transfers instead of one transfer per sector. Unaligned reads should stay correct.
+*/
+#include "nifat32_test.h"
+
+#define TEST_CLUSTERS 64
+#define TEST_READS    100
+#define TEST_LOG_SIZE 8192
+
+static fat_data_t fs;
+static sector_addr_t io_log[TEST_LOG_SIZE];
+static int io_count = 0;
+
+static int _logging_sector_read(sector_addr_t sa, sector_offset_t offset, buffer_t buffer, int buff_size) {
+    if (io_count < TEST_LOG_SIZE) io_log[io_count++] = sa + offset / sector_size;
+    return _mock_sector_read_(sa, offset, buffer, buff_size);
+}
+
+static int _logging_sector_write(sector_addr_t sa, sector_offset_t offset, const_buffer_t data, int data_size) {
+    if (io_count < TEST_LOG_SIZE) io_log[io_count++] = sa + offset / sector_size;
+    return _mock_sector_write_(sa, offset, data, data_size);
+}
+
+/*
+Count logged transfers to the file clusters. FAT copies are placed in the data area too,
+thus the transfers are matched with the chain.
+*/
+static int _file_transfers(ci_t ci) {
+    int transfers = 0;
+    for (int i = 0; i < io_count; i++) {
+        if (io_log[i] < fs.first_data_sector) continue;
+        cluster_addr_t target = (io_log[i] - fs.first_data_sector) / fs.sectors_per_cluster + fs.ext_root_cluster;
+        for (cluster_addr_t ca = get_content_data_ca(ci); !is_cluster_end(ca) && !is_cluster_bad(ca); ca = read_fat(ca, &fs)) {
+            if (ca != target) continue;
+            transfers++;
+            break;
+        }
+    }
+
+    io_count = 0;
+    return transfers;
+}
+
+int main() {
+#ifndef NO_CREATION
+    nifat32_params_t params;
+    if (!setup_nifat32(&params)) return EXIT_FAILURE;
+
+    NIFAT32_get_fs_data(&fs);
+    NIFAT32_unload();
+    params.disk_io.read_sector   = _logging_sector_read;
+    params.disk_io.write_sector  = _logging_sector_write;
+    params.disk_io.read_sectors  = _logging_sector_read;
+    params.disk_io.write_sectors = _logging_sector_write;
+    params.disk_io.readv         = NULL;
+    params.disk_io.writev        = NULL;
+    if (!NIFAT32_init(&params)) {
+        fprintf(stderr, "NIFAT32_init() error!\n");
+        return EXIT_FAILURE;
+    }
+
+    int data_size = fs.cluster_size * TEST_CLUSTERS;
+    unsigned char* data = (unsigned char*)malloc(data_size);
+    for (int i = 0; i < data_size; i++) data[i] = (unsigned char)(i * 29 + (i >> 10));
+
+    ci_t ci = nifat32_open_test(NO_RCI, "runs/file.bin", (CR_MODE | W_MODE | R_MODE | FILE_TARGET), SUCCESS);
+    if (ci < 0) return EXIT_FAILURE;
+
+    io_count = 0;
+    if (NIFAT32_write_buffer2content(ci, 0, (const_buffer_t)data, data_size) != data_size) {
+        fprintf(stderr, "ERROR! NIFAT32_write_buffer2content wrote less data!\n");
+        return EXIT_FAILURE;
+    }
+
+    int writes = _file_transfers(ci);
+    NIFAT32_close_content(ci);
+
+    ci = nifat32_open_test(NO_RCI, "runs/file.bin", R_MODE | FILE_TARGET, SUCCESS);
+    if (ci < 0) return EXIT_FAILURE;
+
+    io_count = 0;
+    if (!nifate32_read_and_compare_alloc(ci, 0, (const_buffer_t)data, data_size, SUCCESS)) return EXIT_FAILURE;
+    int reads = _file_transfers(ci);
+
+    srand(14);
+    unsigned char* buffer = (unsigned char*)malloc(data_size);
+    for (int i = 0; i < TEST_READS; i++) {
+        int offset = rand() % data_size;
+        int length = 1 + rand() % (4 * fs.cluster_size);
+        int expected = offset + length > data_size ? data_size - offset : length;
+        if (NIFAT32_read_content2buffer(ci, offset, (buffer_t)buffer, length) != expected || memcmp(buffer, data + offset, expected)) {
+            fprintf(stderr, "ERROR! Read at offset=%i size=%i differs!\n", offset, length);
+            return EXIT_FAILURE;
+        }
+    }
+
+    fprintf(stdout, "\n==== Runs Summary (%i clusters, %i sectors) ====\n", TEST_CLUSTERS, TEST_CLUSTERS * fs.sectors_per_cluster);
+    fprintf(stdout, "File writes: %i\n", writes);
+    fprintf(stdout, "File reads:  %i\n", reads);
+#ifndef NIFAT32_NO_EXTENTS
+    if (writes >= TEST_CLUSTERS || reads >= TEST_CLUSTERS) {
+        fprintf(stderr, "ERROR! The file wasn't transferred by runs!\n");
+        return EXIT_FAILURE;
+    }
+#endif
+
+    NIFAT32_close_content(ci);
+    NIFAT32_unload();
+    free(buffer);
+    free(data);
+#endif
+
+    return EXIT_SUCCESS;
+}
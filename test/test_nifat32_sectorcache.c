@@ -0,0 +1,156 @@
+/*
+Sector cache test. Create files, then open and read them several times without the sector cache, with
+the write-through cache and with the write-back cache. Data should be the same, and the platform should
+get fewer reads with the cache. Write-back changes should reach the image on NIFAT32_sync, thus
+a mount without the cache reads them.
+*/
+#include "nifat32_test.h"
+
+#define TEST_FILES  8
+#define TEST_PASSES 4
+#define TEST_CACHE  (256 * 1024)
+
+static int read_calls = 0;
+static int write_calls = 0;
+
+static int _counting_sector_read(sector_addr_t sa, sector_offset_t offset, buffer_t buffer, int buff_size) {
+    read_calls++;
+    return _mock_sector_read_(sa, offset, buffer, buff_size);
+}
+
+static int _counting_sector_write(sector_addr_t sa, sector_offset_t offset, const_buffer_t data, int data_size) {
+    write_calls++;
+    return _mock_sector_write_(sa, offset, data, data_size);
+}
+
+static int _mount(nifat32_params_t* params, unsigned int size, unsigned char mode) {
+    NIFAT32_unload();
+    params->fat_cache              = NO_CACHE;
+    params->sector_cache_size      = size;
+    params->sector_cache_mode      = mode;
+    params->disk_io.read_sector    = _counting_sector_read;
+    params->disk_io.write_sector   = _counting_sector_write;
+    params->disk_io.read_sectors   = _counting_sector_read;
+    params->disk_io.write_sectors  = _counting_sector_write;
+    params->disk_io.readv          = NULL;
+    params->disk_io.writev         = NULL;
+    if (!NIFAT32_init(params)) {
+        fprintf(stderr, "NIFAT32_init() error!\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+static unsigned char _pattern(int round, int file, int position) {
+    return (unsigned char)(position * 5 + file * 31 + round * 97);
+}
+
+/*
+Write files of the round, then read them several times. Return -1 on a data error.
+*/
+static int _round(int round, int size, unsigned char* data) {
+    read_calls = write_calls = 0;
+    for (int f = 0; f < TEST_FILES; f++) {
+        char path[32];
+        snprintf(path, sizeof(path), "sc%i/f%i.bin", round, f);
+        ci_t ci = nifat32_open_test(NO_RCI, path, MODE(CR_MODE | W_MODE | R_MODE, FILE_TARGET), SUCCESS);
+        if (ci < 0) return -1;
+        for (int i = 0; i < size; i++) data[i] = _pattern(round, f, i);
+        if (NIFAT32_write_buffer2content(ci, 0, (const_buffer_t)data, size) != size) {
+            fprintf(stderr, "ERROR! NIFAT32_write_buffer2content wrote less data!\n");
+            return -1;
+        }
+
+        NIFAT32_close_content(ci);
+    }
+
+    for (int p = 0; p < TEST_PASSES; p++) {
+        for (int f = 0; f < TEST_FILES; f++) {
+            char path[32];
+            snprintf(path, sizeof(path), "sc%i/f%i.bin", round, f);
+            for (int i = 0; i < size; i++) data[i] = _pattern(round, f, i);
+            ci_t ci = nifat32_open_test(NO_RCI, path, DF_MODE, SUCCESS);
+            if (ci < 0 || !nifate32_read_and_compare_alloc(ci, 0, (const_buffer_t)data, size, SUCCESS)) return -1;
+            NIFAT32_close_content(ci);
+        }
+    }
+
+    return read_calls;
+}
+
+static int _verify(int round, int size, unsigned char* data) {
+    for (int f = 0; f < TEST_FILES; f++) {
+        char path[32];
+        snprintf(path, sizeof(path), "sc%i/f%i.bin", round, f);
+        for (int i = 0; i < size; i++) data[i] = _pattern(round, f, i);
+        ci_t ci = nifat32_open_test(NO_RCI, path, DF_MODE, SUCCESS);
+        if (ci < 0 || !nifate32_read_and_compare_alloc(ci, 0, (const_buffer_t)data, size, SUCCESS)) return 0;
+        NIFAT32_close_content(ci);
+    }
+
+    return 1;
+}
+
+int main() {
+#ifndef NO_CREATION
+    nifat32_params_t params;
+    if (!setup_nifat32(&params)) return EXIT_FAILURE;
+
+    fat_data_t fs;
+    NIFAT32_get_fs_data(&fs);
+    int size = fs.cluster_size * 2 + 100;
+    unsigned char* data = (unsigned char*)malloc(size);
+
+    if (!_mount(&params, 0, SECTOR_CACHE_WRITE_THROUGH)) return EXIT_FAILURE;
+    int raw_reads = _round(0, size, data);
+    int raw_writes = write_calls;
+
+    if (!_mount(&params, TEST_CACHE, SECTOR_CACHE_WRITE_THROUGH)) return EXIT_FAILURE;
+    int wt_reads = _round(1, size, data);
+    sector_cache_stat_t wt;
+    int cached = NIFAT32_get_sector_cache_stat(&wt, 1);
+
+    if (!_mount(&params, TEST_CACHE, SECTOR_CACHE_WRITE_BACK)) return EXIT_FAILURE;
+    int wb_reads = _round(2, size, data);
+    int wb_writes = write_calls;
+    sector_cache_stat_t wb;
+    NIFAT32_get_sector_cache_stat(&wb, 0);
+    if (raw_reads < 0 || wt_reads < 0 || wb_reads < 0) return EXIT_FAILURE;
+    if (!NIFAT32_sync()) {
+        fprintf(stderr, "ERROR! NIFAT32_sync error!\n");
+        return EXIT_FAILURE;
+    }
+
+    sector_cache_stat_t synced;
+    NIFAT32_get_sector_cache_stat(&synced, 0);
+
+    /* The image without the cache should have every change. */
+    if (!_mount(&params, 0, SECTOR_CACHE_WRITE_THROUGH)) return EXIT_FAILURE;
+    for (int r = 0; r < 3; r++) {
+        if (!_verify(r, size, data)) return EXIT_FAILURE;
+    }
+
+    fprintf(stdout, "\n==== Sector Cache Summary (%i files, %i passes, %i KB) ====\n", TEST_FILES, TEST_PASSES, TEST_CACHE / 1024);
+    fprintf(stdout, "No cache:      %i reads, %i writes\n", raw_reads, raw_writes);
+    fprintf(stdout, "Write-through: %i reads, %u hits, %u misses, %u evictions\n", wt_reads, wt.hits, wt.misses, wt.evictions);
+    fprintf(stdout, "Write-back:    %i reads, %i writes, %u hits, %u misses, %u dirty before sync, %u after\n", wb_reads, wb_writes, wb.hits, wb.misses, wb.dirty, synced.dirty);
+#ifndef NO_SECTOR_CACHE
+    if (!cached || !wt.hits || wt_reads >= raw_reads || wb_reads >= raw_reads) {
+        fprintf(stderr, "ERROR! The sector cache didn't reduce platform reads!\n");
+        return EXIT_FAILURE;
+    }
+
+    if (wb_writes >= raw_writes || synced.dirty) {
+        fprintf(stderr, "ERROR! The write-back cache didn't defer writes until the sync!\n");
+        return EXIT_FAILURE;
+    }
+#endif
+
+    UNUSED(cached);
+    NIFAT32_unload();
+    free(data);
+#endif
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+/*
+Seek test. Write two files by clusters in turn, so their chains are fragmented, then read
+them at random offsets without the FAT cache. A read of the last cluster should not walk
+the chain. Truncate a file and check that the chain map follows the chain.
+*/
+#include "nifat32_test.h"
+
+#define TEST_CLUSTERS 150
+#define TEST_KEEP     40
+#define TEST_READS    200
+
+static int read_calls = 0;
+
+static int _counting_sector_read(sector_addr_t sa, sector_offset_t offset, buffer_t buffer, int buff_size) {
+    read_calls++;
+    return _mock_sector_read_(sa, offset, buffer, buff_size);
+}
+
+static unsigned char _pattern(int file, int position) {
+    return (unsigned char)(position * 7 + file * 131 + (position >> 9));
+}
+
+static int _check_read(ci_t ci, int file, int offset, int size, int expected) {
+    unsigned char* buffer = (unsigned char*)malloc(size);
+    int readden = NIFAT32_read_content2buffer(ci, offset, (buffer_t)buffer, size);
+    int result = readden == expected;
+    for (int i = 0; result && i < readden; i++) result = buffer[i] == _pattern(file, offset + i);
+    if (!result) fprintf(stderr, "ERROR! Read of file=%i at offset=%i size=%i: %i bytes, expected %i!\n", file, offset, size, readden, expected);
+    free(buffer);
+    return result;
+}
+
+int main() {
+#ifndef NO_CREATION
+    nifat32_params_t params;
+    if (!setup_nifat32(&params)) return EXIT_FAILURE;
+
+    fat_data_t fs;
+    NIFAT32_get_fs_data(&fs);
+    int cs = fs.cluster_size;
+    static char* paths[] = { "seek/a.bin", "seek/b.bin" };
+    ci_t files[2];
+    for (int f = 0; f < 2; f++) {
+        files[f] = nifat32_open_test(NO_RCI, paths[f], (CR_MODE | W_MODE | R_MODE | FILE_TARGET), SUCCESS);
+        if (files[f] < 0) return EXIT_FAILURE;
+    }
+
+    unsigned char* cluster = (unsigned char*)malloc(cs);
+    for (int c = 0; c < TEST_CLUSTERS; c++) {
+        for (int f = 0; f < 2; f++) {
+            for (int i = 0; i < cs; i++) cluster[i] = _pattern(f, c * cs + i);
+            if (NIFAT32_write_buffer2content(files[f], c * cs, (const_buffer_t)cluster, cs) != cs) {
+                fprintf(stderr, "ERROR! Write of cluster %i to %s failed!\n", c, paths[f]);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    for (int f = 0; f < 2; f++) NIFAT32_close_content(files[f]);
+
+    NIFAT32_unload();
+    params.fat_cache = NO_CACHE;
+    params.disk_io.read_sector  = _counting_sector_read;
+    params.disk_io.read_sectors = _counting_sector_read;
+    params.disk_io.readv        = NULL;
+    if (!NIFAT32_init(&params)) {
+        fprintf(stderr, "NIFAT32_init() error!\n");
+        return EXIT_FAILURE;
+    }
+
+    for (int f = 0; f < 2; f++) {
+        files[f] = nifat32_open_test(NO_RCI, paths[f], (W_MODE | R_MODE | FILE_TARGET), SUCCESS);
+        if (files[f] < 0) return EXIT_FAILURE;
+    }
+
+    srand(13);
+    int size = TEST_CLUSTERS * cs;
+    for (int i = 0; i < TEST_READS; i++) {
+        int f = rand() % 2;
+        int offset = rand() % size;
+        int length = 1 + rand() % (3 * cs);
+        int expected = offset + length > size ? size - offset : length;
+        if (!_check_read(files[f], f, offset, length, expected)) return EXIT_FAILURE;
+    }
+
+    read_calls = 0;
+    if (!_check_read(files[0], 0, size - cs, cs, cs)) return EXIT_FAILURE;
+    fprintf(stdout, "Disk reads for the last cluster of %i: %i\n", TEST_CLUSTERS, read_calls);
+#ifndef NIFAT32_NO_EXTENTS
+    if (read_calls >= TEST_CLUSTERS) {
+        fprintf(stderr, "ERROR! The read walked the chain!\n");
+        return EXIT_FAILURE;
+    }
+#endif
+
+    /* The second content of the same file should see the truncated chain. */
+    ci_t reader = nifat32_open_test(NO_RCI, paths[0], R_MODE | FILE_TARGET, SUCCESS);
+    if (reader < 0 || !_check_read(reader, 0, size - cs, cs, cs)) return EXIT_FAILURE;
+
+    NIFAT32_truncate_content(files[0], 0, TEST_KEEP * cs - 1);
+    if (!_check_read(files[0], 0, (TEST_KEEP - 1) * cs, 2 * cs, cs)) return EXIT_FAILURE;
+    if (!_check_read(reader, 0, TEST_KEEP * cs, cs, 0)) return EXIT_FAILURE;
+
+    for (int i = 0; i < cs; i++) cluster[i] = _pattern(0, TEST_KEEP * cs + i);
+    if (NIFAT32_write_buffer2content(files[0], TEST_KEEP * cs, (const_buffer_t)cluster, cs) != cs) {
+        fprintf(stderr, "ERROR! Write after the truncation failed!\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!_check_read(files[0], 0, 0, (TEST_KEEP + 2) * cs, (TEST_KEEP + 1) * cs)) return EXIT_FAILURE;
+    if (!_check_read(files[1], 1, 0, size, size)) return EXIT_FAILURE;
+
+    NIFAT32_close_content(reader);
+    for (int f = 0; f < 2; f++) NIFAT32_close_content(files[f]);
+    NIFAT32_unload();
+    free(cluster);
+#endif
+
+    return EXIT_SUCCESS;
+}
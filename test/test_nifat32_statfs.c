@@ -0,0 +1,139 @@
+/*
+Free space test. Make holes in the cluster space and compare NIFAT32_statfs with a FAT walk.
+With MAP_CACHE only the first call may read the disk, next calls should take counters
+from the map. Without the map the result should be the same.
+*/
+#include "nifat32_test.h"
+
+#define TEST_FILES 32
+#define TEST_POLLS 100
+
+static int read_calls = 0;
+
+static int _counting_sector_read(sector_addr_t sa, sector_offset_t offset, buffer_t buffer, int buff_size) {
+    read_calls++;
+    return _mock_sector_read_(sa, offset, buffer, buff_size);
+}
+
+static int _mount(nifat32_params_t* params, unsigned char fat_cache) {
+    NIFAT32_unload();
+    params->fat_cache = fat_cache;
+    params->disk_io.read_sector  = _counting_sector_read;
+    params->disk_io.read_sectors = _counting_sector_read;
+    params->disk_io.readv        = NULL;
+    if (!NIFAT32_init(params)) {
+        fprintf(stderr, "NIFAT32_init() error!\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+static int _check(const char* stage, fat_data_t* fs) {
+    nifat32_statfs_t st;
+    if (!NIFAT32_statfs(&st)) {
+        fprintf(stderr, "ERROR! %s: NIFAT32_statfs error!\n", stage);
+        return 0;
+    }
+
+    unsigned int free_clusters = 0, extents = 0, largest = 0, run = 0;
+    for (cluster_addr_t ca = fs->ext_root_cluster; ca <= fs->total_clusters; ca++) {
+        if (ca < fs->total_clusters && is_cluster_free(read_fat(ca, fs))) {
+            free_clusters++;
+            run++;
+            continue;
+        }
+
+        if (run) extents++;
+        if (run > largest) largest = run;
+        run = 0;
+    }
+
+    unsigned int histogram = 0;
+    for (int b = 0; b < FATMAP_HISTOGRAM; b++) histogram += st.extents_histogram[b];
+    fprintf(
+        stdout, "%s: %u free of %u, %u extents, largest %u, fragmentation %u%%\n",
+        stage, st.free_clusters, st.total_clusters, st.free_extents, st.largest_free_extent, st.fragmentation
+    );
+
+    if (
+        st.free_clusters != free_clusters || st.free_extents != extents || st.largest_free_extent != largest ||
+        histogram != extents || st.free_clusters + st.used_clusters != st.total_clusters
+    ) {
+        fprintf(stderr, "ERROR! %s: expected %u free clusters in %u extents, largest %u!\n", stage, free_clusters, extents, largest);
+        return 0;
+    }
+
+    return 1;
+}
+
+static int _write_file(int file, fat_data_t* fs) {
+    char path[32];
+    snprintf(path, sizeof(path), "stfs/f%i.bin", file);
+    ci_t ci = nifat32_open_test(NO_RCI, path, MODE(CR_MODE | W_MODE | R_MODE, FILE_TARGET), SUCCESS);
+    if (ci < 0) return 0;
+
+    int size = (1 + file % 5) * fs->cluster_size;
+    unsigned char* data = (unsigned char*)calloc(size, 1);
+    int written = NIFAT32_write_buffer2content(ci, 0, (const_buffer_t)data, size);
+    NIFAT32_close_content(ci);
+    free(data);
+    return written == size;
+}
+
+static int _delete_file(int file) {
+    char path[32];
+    snprintf(path, sizeof(path), "stfs/f%i.bin", file);
+    ci_t ci = nifat32_open_test(NO_RCI, path, DF_MODE, SUCCESS);
+    return ci >= 0 && NIFAT32_delete_content(ci);
+}
+
+int main() {
+#ifndef NO_CREATION
+    nifat32_params_t params;
+    if (!setup_nifat32(&params)) return EXIT_FAILURE;
+
+    fat_data_t fs;
+    NIFAT32_get_fs_data(&fs);
+    if (!_mount(&params, CACHE | MAP_CACHE)) return EXIT_FAILURE;
+    for (int f = 0; f < TEST_FILES; f++) {
+        if (!_write_file(f, &fs)) return EXIT_FAILURE;
+    }
+
+    for (int f = 0; f < TEST_FILES; f += 3) {
+        if (!_delete_file(f)) return EXIT_FAILURE;
+    }
+
+    nifat32_statfs_t st;
+    read_calls = 0;
+    if (!NIFAT32_statfs(&st)) return EXIT_FAILURE;
+    int first_reads = read_calls;
+
+    read_calls = 0;
+    for (int i = 0; i < TEST_POLLS; i++) NIFAT32_statfs(&st);
+    int poll_reads = read_calls;
+    if (!_check("Map", &fs)) return EXIT_FAILURE;
+
+    for (int f = 1; f < TEST_FILES; f += 3) {
+        if (!_delete_file(f)) return EXIT_FAILURE;
+    }
+
+    if (!_check("Map after deletes", &fs)) return EXIT_FAILURE;
+    if (!_mount(&params, CACHE)) return EXIT_FAILURE;
+    if (!_check("FAT walk", &fs)) return EXIT_FAILURE;
+
+    fprintf(stdout, "\n==== Statfs Summary (%u clusters) ====\n", fs.total_clusters);
+    fprintf(stdout, "First call reads:        %i\n", first_reads);
+    fprintf(stdout, "Reads of %i next calls: %i\n", TEST_POLLS, poll_reads);
+#ifndef NO_FAT_MAP
+    if (poll_reads) {
+        fprintf(stderr, "ERROR! NIFAT32_statfs read the disk with the complete map!\n");
+        return EXIT_FAILURE;
+    }
+#endif
+
+    NIFAT32_unload();
+#endif
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,92 @@
+/*
+Vectored IO test. Write and read a file with sector callbacks only, then with range and
+vector callbacks. Data should be the same, and the platform should get fewer calls with
+range and vector callbacks.
+*/
+#include "nifat32_test.h"
+
+#define TEST_CLUSTERS 16
+
+static int io_calls = 0;
+
+static int _counting_sector_read(sector_addr_t sa, sector_offset_t offset, buffer_t buffer, int buff_size) {
+    io_calls++;
+    return _mock_sector_read_(sa, offset, buffer, buff_size);
+}
+
+static int _counting_sector_write(sector_addr_t sa, sector_offset_t offset, const_buffer_t data, int data_size) {
+    io_calls++;
+    return _mock_sector_write_(sa, offset, data, data_size);
+}
+
+static int _counting_readv(const disk_iovec_t* iov, int count) {
+    io_calls++;
+    return _mock_readv_(iov, count);
+}
+
+static int _counting_writev(const disk_iovec_t* iov, int count) {
+    io_calls++;
+    return _mock_writev_(iov, count);
+}
+
+/*
+Mount with the provided callbacks, write and read the file, and return the count of calls.
+*/
+static int _round(nifat32_params_t* params, int vectored, char* path, unsigned char* data, int data_size) {
+    NIFAT32_unload();
+    params->fat_cache              = NO_CACHE;
+    params->disk_io.read_sector    = _counting_sector_read;
+    params->disk_io.write_sector   = _counting_sector_write;
+    params->disk_io.read_sectors   = vectored ? _counting_sector_read : NULL;
+    params->disk_io.write_sectors  = vectored ? _counting_sector_write : NULL;
+    params->disk_io.readv          = vectored ? _counting_readv : NULL;
+    params->disk_io.writev         = vectored ? _counting_writev : NULL;
+    if (!NIFAT32_init(params)) {
+        fprintf(stderr, "NIFAT32_init() error!\n");
+        return -1;
+    }
+
+    io_calls = 0;
+    ci_t ci = nifat32_open_test(NO_RCI, path, MODE(CR_MODE | W_MODE | R_MODE, FILE_TARGET), SUCCESS);
+    if (ci < 0) return -1;
+    if (NIFAT32_write_buffer2content(ci, 0, (const_buffer_t)data, data_size) != data_size) {
+        fprintf(stderr, "ERROR! NIFAT32_write_buffer2content wrote less data!\n");
+        return -1;
+    }
+
+    NIFAT32_close_content(ci);
+    ci = nifat32_open_test(NO_RCI, path, DF_MODE, SUCCESS);
+    if (ci < 0 || !nifate32_read_and_compare_alloc(ci, 0, (const_buffer_t)data, data_size, SUCCESS)) return -1;
+    NIFAT32_close_content(ci);
+    return io_calls;
+}
+
+int main() {
+#ifndef NO_CREATION
+    nifat32_params_t params;
+    if (!setup_nifat32(&params)) return EXIT_FAILURE;
+
+    fat_data_t fs;
+    NIFAT32_get_fs_data(&fs);
+    int data_size = fs.cluster_size * TEST_CLUSTERS;
+    unsigned char* data = (unsigned char*)malloc(data_size);
+    for (int i = 0; i < data_size; i++) data[i] = (unsigned char)(i * 7 + (i >> 9));
+
+    int sector_calls = _round(&params, 0, "vec/sector.bin", data, data_size);
+    int vector_calls = _round(&params, 1, "vec/vector.bin", data, data_size);
+    if (sector_calls < 0 || vector_calls < 0) return EXIT_FAILURE;
+
+    fprintf(stdout, "\n==== Vectored IO Summary (%i clusters, %i FATs) ====\n", TEST_CLUSTERS, fs.fat_count);
+    fprintf(stdout, "Sector callbacks only: %i calls\n", sector_calls);
+    fprintf(stdout, "Range and vector:      %i calls\n", vector_calls);
+    if (vector_calls >= sector_calls) {
+        fprintf(stderr, "ERROR! Vectored callbacks didn't reduce platform calls!\n");
+        return EXIT_FAILURE;
+    }
+
+    NIFAT32_unload();
+    free(data);
+#endif
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,65 @@
+/*
+Write-back FAT cache test. Write a file with the WRITE_BACK_CACHE mode, sync and
+remount with the classic cache, then compare data and the cluster chain.
+*/
+#include "nifat32_test.h"
+
+#define TEST_CLUSTERS 96
+
+static int _remount(nifat32_params_t* params, unsigned char fat_cache) {
+    NIFAT32_unload();
+    params->fat_cache = fat_cache;
+    if (!NIFAT32_init(params)) {
+        fprintf(stderr, "NIFAT32_init() error!\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+int main() {
+#ifndef NO_CREATION
+    nifat32_params_t params;
+    if (!setup_nifat32(&params)) return EXIT_FAILURE;
+    if (!_remount(&params, CACHE | WRITE_BACK_CACHE)) return EXIT_FAILURE;
+
+    fat_data_t fs;
+    NIFAT32_get_fs_data(&fs);
+    int data_size = fs.cluster_size * TEST_CLUSTERS;
+    unsigned char* data = (unsigned char*)malloc(data_size);
+    for (int i = 0; i < data_size; i++) data[i] = (unsigned char)(i * 31 + (i >> 8));
+
+    ci_t ci = nifat32_open_test(NO_RCI, "wback/test.bin", (CR_MODE | W_MODE | R_MODE | FILE_TARGET), SUCCESS);
+    if (ci < 0) return EXIT_FAILURE;
+    if (NIFAT32_write_buffer2content(ci, 0, (const_buffer_t)data, data_size) != data_size) {
+        fprintf(stderr, "ERROR! NIFAT32_write_buffer2content wrote less data!\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!nifate32_read_and_compare_alloc(ci, 0, (const_buffer_t)data, data_size, SUCCESS)) return EXIT_FAILURE;
+    NIFAT32_close_content(ci);
+
+    if (!NIFAT32_sync()) {
+        fprintf(stderr, "ERROR! NIFAT32_sync failed!\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!_remount(&params, CACHE)) return EXIT_FAILURE;
+    ci = nifat32_open_test(NO_RCI, "wback/test.bin", DF_MODE, SUCCESS);
+    if (ci < 0) return EXIT_FAILURE;
+
+    int chain = 0;
+    for (cluster_addr_t ca = get_content_data_ca(ci); !is_cluster_end(ca) && !is_cluster_bad(ca); ca = read_fat(ca, &fs)) chain++;
+    if (chain != TEST_CLUSTERS) {
+        fprintf(stderr, "ERROR! Chain length after sync is %i, expected %i!\n", chain, TEST_CLUSTERS);
+        return EXIT_FAILURE;
+    }
+
+    if (!nifate32_read_and_compare_alloc(ci, 0, (const_buffer_t)data, data_size, SUCCESS)) return EXIT_FAILURE;
+    NIFAT32_close_content(ci);
+    NIFAT32_unload();
+    free(data);
+#endif
+
+    return EXIT_SUCCESS;
+}
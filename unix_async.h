@@ -0,0 +1,332 @@
+/*
+unix_async.h
+Linux reference backend for the asynchronous disk interface (`submit` / `poll` of disk_io_t).
+Requests go to io_uring by raw syscalls. If io_uring isn't available (old kernel, seccomp),
+requests go to a pthread pool with pread / pwrite.
+
+Usage:
+    unix_async_init(image_fd, sector_size, UNIX_ASYNC_URING);
+    params.disk_io.submit = unix_async_submit;
+    params.disk_io.poll   = unix_async_poll;
+    ...
+    NIFAT32_unload();
+    unix_async_destroy();
+
+Include it before other nifat32 headers: threading.h defines a sched_yield() macro, that
+breaks pthread.h.
+*/
+
+#ifndef UNIX_ASYNC_H_
+#define UNIX_ASYNC_H_
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "nifat32.h"
+
+#ifndef UNIX_ASYNC_DEPTH
+    #define UNIX_ASYNC_DEPTH 64
+#endif
+
+#ifndef UNIX_ASYNC_THREADS
+    #define UNIX_ASYNC_THREADS 8
+#endif
+
+/* Tries of io_uring_enter for queued requests, if the kernel is interrupted or busy. */
+#ifndef UNIX_ASYNC_RETRIES
+    #define UNIX_ASYNC_RETRIES 16
+#endif
+
+#define UNIX_ASYNC_NONE  0
+#define UNIX_ASYNC_URING 1
+#define UNIX_ASYNC_POOL  2
+
+static int _async_mode = UNIX_ASYNC_NONE;
+static int _async_fd = -1;
+static int _async_sector_size = 512;
+static volatile int _async_in_flight = 0;
+
+static int _async_io(disk_request_t* req) {
+    off_t off = (off_t)req->iov.sa * _async_sector_size + req->iov.offset;
+    ssize_t done = req->write ? pwrite(_async_fd, req->iov.buffer, req->iov.size, off) : pread(_async_fd, req->iov.buffer, req->iov.size, off);
+    return done == req->iov.size;
+}
+
+/*
+io_uring rings. The submission ring is guarded by `sq_lock`, the completion ring by `cq_lock`,
+thus submits don't wait for a polling thread.
+*/
+static struct {
+    int                  fd;
+    unsigned             entries;
+    unsigned*            sq_head;
+    unsigned*            sq_tail;
+    unsigned*            sq_mask;
+    unsigned*            sq_array;
+    unsigned*            cq_head;
+    unsigned*            cq_tail;
+    unsigned*            cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void*                sq_ptr;
+    void*                cq_ptr;
+    size_t               sq_size;
+    size_t               cq_size;
+    pthread_mutex_t      sq_lock;
+    pthread_mutex_t      cq_lock;
+} _uring = { .fd = -1, .sq_lock = PTHREAD_MUTEX_INITIALIZER, .cq_lock = PTHREAD_MUTEX_INITIALIZER };
+
+static int _uring_enter(unsigned submit, unsigned wait, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, _uring.fd, submit, wait, flags, NULL, 0);
+}
+
+static int _uring_setup() {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    _uring.fd = (int)syscall(__NR_io_uring_setup, UNIX_ASYNC_DEPTH, &p);
+    if (_uring.fd < 0) return 0;
+
+    _uring.entries = p.sq_entries;
+    _uring.sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    _uring.cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (_uring.cq_size > _uring.sq_size) _uring.sq_size = _uring.cq_size;
+        _uring.cq_size = _uring.sq_size;
+    }
+
+    _uring.sq_ptr = mmap(NULL, _uring.sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _uring.fd, IORING_OFF_SQ_RING);
+    if (_uring.sq_ptr == MAP_FAILED) goto error;
+    _uring.cq_ptr = _uring.sq_ptr;
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        _uring.cq_ptr = mmap(NULL, _uring.cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _uring.fd, IORING_OFF_CQ_RING);
+        if (_uring.cq_ptr == MAP_FAILED) goto error;
+    }
+
+    _uring.sqes = (struct io_uring_sqe*)mmap(
+        NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _uring.fd, IORING_OFF_SQES
+    );
+    if (_uring.sqes == MAP_FAILED) goto error;
+
+    _uring.sq_head  = (unsigned*)((char*)_uring.sq_ptr + p.sq_off.head);
+    _uring.sq_tail  = (unsigned*)((char*)_uring.sq_ptr + p.sq_off.tail);
+    _uring.sq_mask  = (unsigned*)((char*)_uring.sq_ptr + p.sq_off.ring_mask);
+    _uring.sq_array = (unsigned*)((char*)_uring.sq_ptr + p.sq_off.array);
+    _uring.cq_head  = (unsigned*)((char*)_uring.cq_ptr + p.cq_off.head);
+    _uring.cq_tail  = (unsigned*)((char*)_uring.cq_ptr + p.cq_off.tail);
+    _uring.cq_mask  = (unsigned*)((char*)_uring.cq_ptr + p.cq_off.ring_mask);
+    _uring.cqes     = (struct io_uring_cqe*)((char*)_uring.cq_ptr + p.cq_off.cqes);
+    return 1;
+
+error:
+    close(_uring.fd);
+    _uring.fd = -1;
+    return 0;
+}
+
+static int _uring_submit(disk_request_t* reqs, int count) {
+    pthread_mutex_lock(&_uring.sq_lock);
+    int queued = 0;
+    unsigned tail = *_uring.sq_tail;
+    for (; queued < count; queued++) {
+        /* In-flight requests are bounded by the ring size, thus the completion ring never overflows. */
+        unsigned head = __atomic_load_n(_uring.sq_head, __ATOMIC_ACQUIRE);
+        if (tail - head >= _uring.entries || _async_in_flight + queued >= (int)_uring.entries) break;
+
+        disk_request_t* req = &reqs[queued];
+        unsigned index = tail & *_uring.sq_mask;
+        struct io_uring_sqe* sqe = &_uring.sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode    = req->write ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe->fd        = _async_fd;
+        sqe->addr      = (uint64_t)(uintptr_t)req->iov.buffer;
+        sqe->len       = req->iov.size;
+        sqe->off       = (uint64_t)req->iov.sa * _async_sector_size + req->iov.offset;
+        sqe->user_data = (uint64_t)(uintptr_t)req;
+        _uring.sq_array[index] = index;
+        tail++;
+    }
+
+    __atomic_store_n(_uring.sq_tail, tail, __ATOMIC_RELEASE);
+    if (queued) {
+        __sync_fetch_and_add(&_async_in_flight, queued);
+
+        /* The kernel may take a part of entries, or none of them on EINTR / EAGAIN / EBUSY. */
+        unsigned pending = queued;
+        for (int tries = 0; pending && tries < UNIX_ASYNC_RETRIES; tries++) {
+            int taken = _uring_enter(pending, 0, 0);
+            if (taken > 0) pending -= taken;
+            else if (taken < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) break;
+        }
+
+        /* Entries the kernel didn't take are removed from the ring and go back to the caller. */
+        if (pending) {
+            __atomic_store_n(_uring.sq_tail, tail - pending, __ATOMIC_RELEASE);
+            __sync_fetch_and_sub(&_async_in_flight, pending);
+            queued -= pending;
+        }
+    }
+
+    pthread_mutex_unlock(&_uring.sq_lock);
+    return queued;
+}
+
+static int _uring_poll(int wait) {
+    disk_request_t* reqs[UNIX_ASYNC_DEPTH];
+    int results[UNIX_ASYNC_DEPTH];
+    int count = 0;
+
+    pthread_mutex_lock(&_uring.cq_lock);
+    unsigned head = *_uring.cq_head;
+    if (wait && _async_in_flight > 0 && head == __atomic_load_n(_uring.cq_tail, __ATOMIC_ACQUIRE)) {
+        _uring_enter(0, 1, IORING_ENTER_GETEVENTS);
+    }
+
+    unsigned tail = __atomic_load_n(_uring.cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail && count < UNIX_ASYNC_DEPTH; head++, count++) {
+        struct io_uring_cqe* cqe = &_uring.cqes[head & *_uring.cq_mask];
+        reqs[count] = (disk_request_t*)(uintptr_t)cqe->user_data;
+        results[count] = cqe->res == reqs[count]->iov.size;
+    }
+
+    __atomic_store_n(_uring.cq_head, head, __ATOMIC_RELEASE);
+    __sync_fetch_and_sub(&_async_in_flight, count);
+    pthread_mutex_unlock(&_uring.cq_lock);
+
+    /* A completion can submit new requests, thus it goes without the ring lock. */
+    for (int i = 0; i < count; i++) DSK_complete(reqs[i], results[i]);
+    return count;
+}
+
+static void _uring_destroy() {
+    if (_uring.fd < 0) return;
+    munmap(_uring.sqes, _uring.entries * sizeof(struct io_uring_sqe));
+    if (_uring.cq_ptr != _uring.sq_ptr) munmap(_uring.cq_ptr, _uring.cq_size);
+    munmap(_uring.sq_ptr, _uring.sq_size);
+    close(_uring.fd);
+    _uring.fd = -1;
+}
+
+/*
+Thread pool. Workers complete requests by themselves, `poll` only waits for them.
+*/
+static struct {
+    pthread_t       threads[UNIX_ASYNC_THREADS];
+    disk_request_t* queue[UNIX_ASYNC_DEPTH];
+    int             head;
+    int             length;
+    int             completed; // since the last poll
+    int             stop;
+    pthread_mutex_t lock;
+    pthread_cond_t  work;
+    pthread_cond_t  done;
+} _pool = { .lock = PTHREAD_MUTEX_INITIALIZER, .work = PTHREAD_COND_INITIALIZER, .done = PTHREAD_COND_INITIALIZER };
+
+static void* _pool_worker(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&_pool.lock);
+    while (1) {
+        while (!_pool.length && !_pool.stop) pthread_cond_wait(&_pool.work, &_pool.lock);
+        if (!_pool.length) break;
+
+        disk_request_t* req = _pool.queue[_pool.head];
+        _pool.head = (_pool.head + 1) % UNIX_ASYNC_DEPTH;
+        _pool.length--;
+        pthread_mutex_unlock(&_pool.lock);
+
+        DSK_complete(req, _async_io(req));
+
+        pthread_mutex_lock(&_pool.lock);
+        __sync_fetch_and_sub(&_async_in_flight, 1);
+        _pool.completed++;
+        pthread_cond_broadcast(&_pool.done);
+    }
+
+    pthread_mutex_unlock(&_pool.lock);
+    return NULL;
+}
+
+static int _pool_setup() {
+    _pool.head = _pool.length = _pool.completed = _pool.stop = 0;
+    for (int t = 0; t < UNIX_ASYNC_THREADS; t++) {
+        if (pthread_create(&_pool.threads[t], NULL, _pool_worker, NULL)) return 0;
+    }
+
+    return 1;
+}
+
+static int _pool_submit(disk_request_t* reqs, int count) {
+    pthread_mutex_lock(&_pool.lock);
+    int queued = 0;
+    for (; queued < count && _pool.length < UNIX_ASYNC_DEPTH; queued++) {
+        _pool.queue[(_pool.head + _pool.length++) % UNIX_ASYNC_DEPTH] = &reqs[queued];
+    }
+
+    __sync_fetch_and_add(&_async_in_flight, queued);
+    pthread_cond_broadcast(&_pool.work);
+    pthread_mutex_unlock(&_pool.lock);
+    return queued;
+}
+
+static int _pool_poll(int wait) {
+    pthread_mutex_lock(&_pool.lock);
+    if (wait && !_pool.completed && _async_in_flight > 0) pthread_cond_wait(&_pool.done, &_pool.lock);
+    int count = _pool.completed;
+    _pool.completed = 0;
+    pthread_mutex_unlock(&_pool.lock);
+    return count;
+}
+
+static void _pool_destroy() {
+    pthread_mutex_lock(&_pool.lock);
+    _pool.stop = 1;
+    pthread_cond_broadcast(&_pool.work);
+    pthread_mutex_unlock(&_pool.lock);
+    for (int t = 0; t < UNIX_ASYNC_THREADS; t++) pthread_join(_pool.threads[t], NULL);
+}
+
+/*
+Setup the backend for the image.
+Params:
+- `fd` - Image file descriptor.
+- `sector_size` - Sector size.
+- `mode` - UNIX_ASYNC_URING (with the pool fallback) or UNIX_ASYNC_POOL.
+
+Return the used mode, or UNIX_ASYNC_NONE if something goes wrong.
+*/
+static int unix_async_init(int fd, int sector_size, int mode) {
+    _async_fd = fd;
+    _async_sector_size = sector_size;
+    _async_in_flight = 0;
+    if (mode == UNIX_ASYNC_URING && _uring_setup()) _async_mode = UNIX_ASYNC_URING;
+    else if (_pool_setup()) _async_mode = UNIX_ASYNC_POOL;
+    else _async_mode = UNIX_ASYNC_NONE;
+    return _async_mode;
+}
+
+static int unix_async_submit(disk_request_t* reqs, int count) {
+    if (_async_mode == UNIX_ASYNC_URING) return _uring_submit(reqs, count);
+    if (_async_mode == UNIX_ASYNC_POOL) return _pool_submit(reqs, count);
+    return 0;
+}
+
+static int unix_async_poll(int wait) {
+    if (_async_mode == UNIX_ASYNC_URING) return _uring_poll(wait);
+    if (_async_mode == UNIX_ASYNC_POOL) return _pool_poll(wait);
+    return 0;
+}
+
+/*
+Stop the backend. Requests should be completed before the call.
+*/
+static void unix_async_destroy() {
+    if (_async_mode == UNIX_ASYNC_URING) _uring_destroy();
+    if (_async_mode == UNIX_ASYNC_POOL) _pool_destroy();
+    _async_mode = UNIX_ASYNC_NONE;
+}
+
+#endif
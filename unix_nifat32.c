@@ -3,6 +3,7 @@ unix_nifat32.c
 This is a template file with simple implementation of file manage on nifat32.
 */
 
+#include "unix_async.h"
 #include <stdio.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -48,6 +49,20 @@ static int _mock_sector_write_(sector_addr_t sa, sector_offset_t offset, const_b
     return pwrite(disk_fd, data, data_size, sa * sector_size + offset) > 0;
 }
 
+static int _mock_readv_(const disk_iovec_t* iov, int count) {
+    for (int i = 0; i < count; i++) {
+        if (!_mock_sector_read_(iov[i].sa, iov[i].offset, iov[i].buffer, iov[i].size)) return 0;
+    }
+
+    return 1;
+}
+
+static int _mock_writev_(const disk_iovec_t* iov, int count) {
+    int result = 1;
+    for (int i = 0; i < count; i++) result = _mock_sector_write_(iov[i].sa, iov[i].offset, iov[i].buffer, iov[i].size) && result;
+    return result;
+}
+
 static int _mock_fprintf_(const char* fmt, ...) {
     va_list args;
     va_start(args, fmt);
@@ -89,9 +104,16 @@ int main(int argc, char* argv[]) {
         .ec        = 0,
         .bs_count  = bs,
         .disk_io   = {
-            .read_sector  = _mock_sector_read_,
-            .write_sector = _mock_sector_write_,
-            .sector_size  = sector_size
+            .read_sector   = _mock_sector_read_,
+            .write_sector  = _mock_sector_write_,
+            .sector_size   = sector_size,
+            .read_sectors  = _mock_sector_read_,
+            .write_sectors = _mock_sector_write_,
+            .readv         = _mock_readv_,
+            .writev        = _mock_writev_,
+            .wait          = NULL,
+            .submit        = NULL,
+            .poll          = NULL
         },
         .logg_io   = {
             .fd_fprintf  = _mock_fprintf_,
@@ -104,6 +126,11 @@ int main(int argc, char* argv[]) {
         }
     };
 
+    if (unix_async_init(disk_fd, sector_size, UNIX_ASYNC_URING) != UNIX_ASYNC_NONE) {
+        params.disk_io.submit = unix_async_submit;
+        params.disk_io.poll   = unix_async_poll;
+    }
+
     if (!NIFAT32_init(&params)) {
         fprintf(stderr, "NIFAT32_init() error!\n");
         close(disk_fd);
@@ -390,10 +417,10 @@ upper: {}
                     unsigned char cluster_data[8192] = { 0 };
                     NIFAT32_read_content2buffer(ci, 0, (buffer_t)cluster_data, 8192);
 
-                    unsigned char decoded[4096] = { 0 };
-                    nft32_unpack_memory((encoded_t*)cluster_data, decoded, sizeof(decoded));
+                    unsigned int entries = sizeof(cluster_data) / nft32_ecc_encoded_size(sizeof(directory_entry_t));
+                    unsigned char decoded[8192] = { 0 };
+                    nft32_ecc_unpack(cluster_data, decoded, entries * sizeof(directory_entry_t), NULL);
 
-                    unsigned int entries = (sizeof(cluster_data) / sizeof(short)) / sizeof(directory_entry_t);
                     directory_entry_t* entry = (directory_entry_t*)decoded;
                     for (unsigned int i = 0; i < entries; i++, entry++) {
                         if (entry->file_name[0] == ENTRY_END) break;
@@ -439,5 +466,6 @@ upper: {}
     }
 
     NIFAT32_unload();
+    unix_async_destroy();
     return EXIT_SUCCESS;
 }
@@ -2,7 +2,7 @@ gcc unix_nifat32.c nifat32.c                                \
     -Iinclude src/* std/*                                   \
     -DERROR_LOGS -DLOGGING_LOGS -DWARNING_LOGS -DDEBUG_LOGS \
     -DNON_DEFAULT_MM_MANAGER -DNO_HEAP                      \
-    -o builds/nifat32_unix
+    -o builds/nifat32_unix -lpthread
 
 cd formatter && make && ./formatter --jc 2 -o nifat32.img -s nifat32
 rm formatter